@@ -7,12 +7,16 @@
 #include <esp_system.h>
 #include <esp_wifi.h>
 
+#include "command_table.h"
 #include "configuration.h"
+#include "uart_link.h"
 
 #define DIRECT_MSG_FINAL_RESPONSE_OK "009,OK,"
 #define DIRECT_MSG_FINAL_RESPONSE_NOK "009,NOK,"
 #define DIRECT_MSG_MULTI_RESPONSE_OK "007,OK,"
 #define END_OF_MESSAGE_IDENTIFIER ";"
+#define WS_EVENT_MESH_STATUS "evt,mesh,"
+#define WS_EVENT_REPORT "evt,report,"
 
 namespace Wetzel {
 
@@ -21,29 +25,142 @@ enum Wifi_Status : uint8_t {
     WIFI_CONNECTED,
 };
 
+/**
+ * @brief Estatisticas da fila de comandos aguardando um coletor livre.
+ * 
+ */
+typedef struct {
+    uint32_t jobs;
+    uint32_t rejected;
+    uint64_t total_wait_us;
+    uint32_t max_wait_us;
+    uint32_t last_wait_us;
+} collector_stats_t;
+
+/**
+ * @brief Sombra local do status do mesh informado pelo sensor.
+ * 
+ */
+typedef struct {
+    Wifi_Status status;
+    char ssid[33];
+    uint32_t password_hash;  // FNV-1a, a senha nao fica em memoria
+} mesh_status_t;
+
+/**
+ * @brief Buffers de trabalho de uma requisicao, um por sessao HTTP, para
+ * manter a stack do httpd pequena.
+ * 
+ */
+typedef struct {
+    char query[ASYNC_SRV_QUERY_BUFFER_SIZE];
+    char param[ASYNC_SRV_PARAM_BUFFER_SIZE];
+    char response[ASYNC_SRV_RESPONSE_BUFFER_SIZE];
+    uart_frame_t frame;
+} request_arena_t;
+
+/**
+ * @brief Buffers de trabalho de um request worker.
+ * 
+ */
+typedef struct {
+    char param[ASYNC_SRV_PARAM_BUFFER_SIZE];
+    char response[ASYNC_SRV_RESPONSE_BUFFER_SIZE];
+    uart_frame_t frame;
+} request_scratch_t;
+
+/**
+ * @brief Mensagem enviada a um cliente WebSocket pela task do httpd.
+ * fd < 0 envia para todos os clientes conectados.
+ * 
+ */
+typedef struct {
+    int fd;
+    size_t len;
+    char data[ASYNC_SRV_WS_MSG_SIZE];
+} ws_async_msg_t;
+
+struct request_job_t;
+typedef esp_err_t (*request_handler_t)(request_job_t* job);
+
+/**
+ * @brief Requisicao que depende do sensor, atendida por um request worker.
+ * A task do httpd copia o que o handler usa (query e Range) e volta a atender
+ * os sockets; o worker escreve a resposta HTTP direto no socket. Comandos do
+ * WebSocket vao com o texto no lugar da query.
+ * 
+ */
+typedef struct request_job_t {
+    request_handler_t handler;
+    // -1 com o job livre
+    int fd;
+    // o httpd fechou a sessao: o fd so e fechado quando o worker terminar
+    volatile bool closed;
+    // falha no envio: o worker pede ao httpd para fechar a sessao
+    bool failed;
+    char query[ASYNC_SRV_QUERY_BUFFER_SIZE];
+    char range[ASYNC_SRV_RANGE_HEADER_SIZE];
+    request_scratch_t* scratch;
+} request_job_t;
+
 class AsyncServer {
    public:
     AsyncServer() {}
     ~AsyncServer() {}
     static void begin();
     static void begin_task();
-    static bool _att_wifi_ssid(bool send_data);
+    static bool _att_wifi_ssid();
     static SemaphoreHandle_t _uart_mutex;
     static void check_mesh_connection_task(void* arg);
-    static void read_report_in_serial_task(void* arg);
+    static void mesh_status_task(void* arg);
+    static bool meshStatus(mesh_status_t* status);
+    static void uart_rx_task(void* arg);
     static char http_packet_buffer[ASYNC_HTTP_PACKET_BUFFER_SIZE];
+    // segundo buffer do download de relatorio (leitura do SD em paralelo ao envio)
+    static char report_packet_buffer[ASYNC_HTTP_PACKET_BUFFER_SIZE];
     static uint32_t http_requests_received;
+    static collector_stats_t collectorStats();
 
    private:
     static void _send_ans_to_app(void* param);
-    static void _send_data_to_sensor(const char* msg);
-    static void _update_ssid(char* msg);
-    static uint16_t _wait_for_ok(char* response = NULL);
+    static void _send_data_to_sensor(const char* msg, uint8_t id = COMMAND_ID_NONE);
+    static uint16_t _send_command(command_slot_t* slot, const char* msg, char* response = NULL);
+    static void _update_ssid(const mesh_status_t& fresh);
+    static esp_err_t _parse_mesh_status(char* msg, mesh_status_t* status);
+    static bool _negotiate_mesh_status_push();
+    static uint16_t _wait_for_ok(command_slot_t* slot, char* response = NULL);
+    static void _route_uart_frame(uart_frame_t& frame);
+    static void _extract_command_id(uart_frame_t& frame, uint8_t seq);
+    static bool _is_mesh_status_frame(const uart_frame_t& frame);
+    static bool _negotiate_link_mode();
+    static bool _negotiate_correlation();
+    static bool _negotiate_flow_control();
+    static uint32_t _query_timeout_ms(const char* query);
     static esp_err_t echo_post_handler(httpd_req_t* req);
     static esp_err_t out_get_handler(httpd_req_t* req);
     static esp_err_t ans_get_handler(httpd_req_t* req);
+    static esp_err_t cmd_get_handler(httpd_req_t* req);
+    static esp_err_t _out_worker(request_job_t* job);
+    static esp_err_t _ans_worker(request_job_t* job);
+    static esp_err_t _cmd_worker(request_job_t* job);
+    static esp_err_t ws_handler(httpd_req_t* req);
+    static esp_err_t _ws_command_worker(request_job_t* job);
+    static void _ws_handle_command(int fd, const char* command);
+    static void _ws_send_async(int fd, const char* msg, size_t len);
+    static void _ws_broadcast(const char* msg, size_t len);
+    static void _ws_send_work(void* arg);
+    static bool _ws_has_clients();
+    static void _on_socket_close(httpd_handle_t hd, int sockfd);
     static esp_err_t upgrade_post_handler(httpd_req_t* req);
     static esp_err_t direct_msg_handler(httpd_req_t* req);
+    static esp_err_t report_get_handler(httpd_req_t* req);
+    static esp_err_t _report_worker(request_job_t* job);
+    static bool _parse_report_day(const char* text, int32_t* unix_day);
+    static bool _report_days_from_query(const char* query, int32_t* first_day, int32_t* last_day);
+    static bool _parse_range(const char* header, uint32_t total, uint32_t* start, uint32_t* end);
+    static request_arena_t* _get_arena(httpd_req_t* req);
+    static void _release_arena(void* ctx);
+    static void _log_stack_usage(const char* uri);
     static httpd_handle_t start_webserver(void);
     static void stop_webserver(httpd_handle_t server);
     static void disconnect_handler(void* arg, esp_event_base_t event_base,
@@ -54,29 +171,71 @@ class AsyncServer {
                                  int32_t event_id, void* event_data);
     static void ip_any_handler(void* arg, esp_event_base_t event_base,
                                int32_t event_id, void* event_data);
-    static void _device_response_string(char* response);
-    static void _device_response_from_uart_task(httpd_req_t* req = nullptr);
-    static void _uart_receive_response_task(void* arg);
+    static void _device_response_from_uart_task(request_job_t* job, command_slot_t* slot,
+                                                char* buffer, size_t buffer_size);
+    static void _start_collectors();
+    static void _start_request_workers();
+    static void _start_ws_msg_pool();
+    static esp_err_t _submit_to_worker(httpd_req_t* req, request_handler_t handler);
+    static esp_err_t _submit_ws_command(int fd, const char* command);
+    static request_job_t* _take_job(int fd, request_handler_t handler);
+    static void _request_worker_task(void* arg);
+    static bool _job_send(request_job_t* job, const char* data, size_t len);
+    static bool _job_resp_start(request_job_t* job, const char* status, const char* type,
+                                const char* headers);
+    static bool _job_resp_chunk(request_job_t* job, const char* data, size_t len);
+    static bool _job_resp_send(request_job_t* job, const char* status, const char* type,
+                               const char* headers, const char* body);
+    static bool _dispatch_to_collector(command_slot_t* slot);
+    static void _collector_worker_task(void* arg);
+    static void _collect_command_responses(command_slot_t* slot);
+    static bool _is_final_response_frame(const char* msg);
+    static bool _is_response_frame(const char* msg);
 
-    static QueueHandle_t _queue_uart_msg;
+    static UartLink* _uart_link;
+    static CommandTable _commands;
+    static bool _correlation_enabled;
+    // comando que pediu a troca de modo do enlace (so o "ok," dele a aplica)
+    static volatile uint8_t _mode_request_id;
+    static QueueHandle_t _queue_status_frames;
+    static QueueHandle_t _collector_queue;
+    static StaticTask_t _collector_tcbs[ASYNC_SRV_COLLECTOR_WORKERS];
+    static StackType_t _collector_stacks[ASYNC_SRV_COLLECTOR_WORKERS]
+                                        [ASYNC_SRV_COLLECTOR_TASK_STACK_SIZE];
+    static QueueHandle_t _request_queue;
+    static QueueHandle_t _free_jobs;
+    static request_job_t _jobs[ASYNC_SRV_REQUEST_QUEUE_LENGTH];
+    static portMUX_TYPE _jobs_mux;
+    static request_scratch_t _request_scratch[ASYNC_SRV_REQUEST_WORKERS];
+    static QueueHandle_t _free_ws_msgs;
+    static ws_async_msg_t _ws_msgs[ASYNC_SRV_WS_MSG_POOL_LENGTH];
+    static StaticTask_t _request_tcbs[ASYNC_SRV_REQUEST_WORKERS];
+    static StackType_t _request_stacks[ASYNC_SRV_REQUEST_WORKERS]
+                                      [ASYNC_SRV_REQUEST_TASK_STACK_SIZE];
+    static collector_stats_t _collector_stats;
+    static portMUX_TYPE _collector_stats_mux;
     static bool _msg_received;
     static bool _client_is_connected;
-    static char _msg[ASYNC_SRV_MSG_LENGTH];
     static bool _http_request;
     static bool _server2_begin;
     static bool _read_report_task_block;
     static uint8_t _reset_counter;
-    static char _last_ssid[33];
-    static Wifi_Status _last_status;
-    static char _last_password[65];
-    static bool _waiting_for_ans;
-    static bool _uart_response_is_complete;
-    static bool _uart_response_is_timeout;
+    static mesh_status_t _mesh_shadow;
+    static bool _mesh_shadow_valid;
+    static uint32_t _mesh_shadow_updated_ms;
+    static bool _mesh_status_push;
     static const httpd_uri_t echo;
     static const httpd_uri_t out;
     static const httpd_uri_t ans;
+    static const httpd_uri_t cmd;
+    static const httpd_uri_t ws;
+    static httpd_handle_t _server;
+    static int _ws_fds[ASYNC_SRV_MAX_OPEN_SOCKETS];
+    static request_arena_t _arenas[ASYNC_SRV_MAX_OPEN_SOCKETS];
+    static bool _arena_in_use[ASYNC_SRV_MAX_OPEN_SOCKETS];
     static const httpd_uri_t upgrade;
     static const httpd_uri_t direct;
+    static const httpd_uri_t report;
     // static WiFiServer* server2;
 };
 }  // namespace Wetzel
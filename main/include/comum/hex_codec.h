@@ -0,0 +1,33 @@
+#ifndef HEX_CODEC_H_
+#define HEX_CODEC_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace Wetzel {
+
+#define HEX_INVALID 0xFF
+
+/**
+ * @brief Valor de cada caractere ASCII como digito hexadecimal, HEX_INVALID
+ * se nao for um.
+ *
+ */
+extern const uint8_t HEX_NIBBLE_TABLE[256];
+
+static inline uint8_t hex_nibble(char c) {
+    return HEX_NIBBLE_TABLE[(uint8_t)c];
+}
+
+/**
+ * @brief Converte 2 * count digitos hexadecimais em count bytes, sem sscanf.
+ *
+ * @param text
+ * @param out
+ * @param count
+ * @return false se algum caractere nao for hexadecimal (out fica indefinido)
+ */
+bool hex_decode(const char* text, uint8_t* out, size_t count);
+
+}  // namespace Wetzel
+#endif
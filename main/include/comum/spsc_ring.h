@@ -0,0 +1,109 @@
+#ifndef SPSC_RING_H_
+#define SPSC_RING_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+
+namespace Wetzel {
+
+/**
+ * @brief Estatisticas de uma fila, para dimensionamento em campo.
+ *
+ */
+typedef struct {
+    uint32_t size;
+    uint32_t capacity;
+    uint32_t high_water_mark;
+    uint32_t overflows;
+} ring_stats_t;
+
+/**
+ * @brief Fila circular de capacidade fixa, sem alocacao e sem mutex, para um
+ * unico produtor e um unico consumidor (uma task de cada lado).
+ *
+ * @note push() so pode ser chamado pelo produtor e pop() so pelo consumidor.
+ *
+ * @tparam T Tipo copiavel
+ * @tparam N Capacidade, potencia de 2
+ */
+template <typename T, uint32_t N>
+class SpscRing {
+    static_assert(N >= 2 && (N & (N - 1)) == 0, "SpscRing: N deve ser potencia de 2");
+
+   private:
+    T _items[N];
+    // indices livres (so crescem); a posicao e indice & (N - 1)
+    std::atomic<uint32_t> _head{0};  // escrito pelo consumidor
+    std::atomic<uint32_t> _tail{0};  // escrito pelo produtor
+    std::atomic<uint32_t> _high_water_mark{0};
+    std::atomic<uint32_t> _overflows{0};
+
+   public:
+    SpscRing() {}
+
+    /**
+     * @brief Insere no fim da fila.
+     *
+     * @param item
+     * @return false se a fila estiver cheia (conta um overflow)
+     */
+    bool push(const T& item) {
+        uint32_t tail = _tail.load(std::memory_order_relaxed);
+        uint32_t used = tail - _head.load(std::memory_order_acquire);
+        if (used >= N) {
+            _overflows.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        _items[tail & (N - 1)] = item;
+        _tail.store(tail + 1, std::memory_order_release);
+        if (used + 1 > _high_water_mark.load(std::memory_order_relaxed)) {
+            _high_water_mark.store(used + 1, std::memory_order_relaxed);
+        }
+        return true;
+    }
+
+    /**
+     * @brief Retira o item mais antigo.
+     *
+     * @param item
+     * @return false se a fila estiver vazia
+     */
+    bool pop(T& item) {
+        uint32_t head = _head.load(std::memory_order_relaxed);
+        if (head == _tail.load(std::memory_order_acquire)) {
+            return false;
+        }
+        item = _items[head & (N - 1)];
+        _head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    uint32_t size() const {
+        // head antes de tail: head <= tail mesmo com o consumidor avancando
+        uint32_t head = _head.load(std::memory_order_acquire);
+        return _tail.load(std::memory_order_acquire) - head;
+    }
+
+    bool empty() const {
+        return size() == 0;
+    }
+
+    static constexpr uint32_t capacity() {
+        return N;
+    }
+
+    ring_stats_t stats() const {
+        ring_stats_t stats = {
+            .size = size(),
+            .capacity = N,
+            .high_water_mark = _high_water_mark.load(std::memory_order_relaxed),
+            .overflows = _overflows.load(std::memory_order_relaxed),
+        };
+        return stats;
+    }
+};
+
+}  // namespace Wetzel
+#endif
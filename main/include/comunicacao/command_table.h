@@ -0,0 +1,200 @@
+#ifndef COMMAND_TABLE_H_
+#define COMMAND_TABLE_H_
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/semphr.h>
+#include <freertos/stream_buffer.h>
+#include <freertos/task.h>
+
+#include "configuration.h"
+
+namespace Wetzel {
+
+// Prefixo do id de correlacao nas mensagens ASCII: "@<id>,<mensagem>"
+#define COMMAND_ID_PREFIX           '@'
+#define COMMAND_ID_NONE             0
+
+/**
+ * @brief Frame recebido pela UART2, ja sem o terminador ';' e sem o prefixo
+ * de correlacao.
+ *
+ */
+typedef struct {
+    uint8_t type;  // link_frame_type_t
+    uint8_t id;    // id de correlacao, COMMAND_ID_NONE se o sensor nao enviou
+    uint16_t len;
+    char data[ASYNC_SRV_MSG_LENGTH + 1];
+} uart_frame_t;
+
+typedef enum : uint8_t {
+    COMMAND_STATE_FREE,
+    // enviado, aguardando o "ok,"
+    COMMAND_STATE_WAIT_ACK,
+    // ok recebido, respostas (008...) chegando
+    COMMAND_STATE_RUNNING,
+    // 009/007 ou timeout; resultado aguardando o leitor
+    COMMAND_STATE_DONE,
+} command_state_t;
+
+/**
+ * @brief Para onde vao as respostas de um comando.
+ *
+ */
+typedef enum : uint8_t {
+    // stream do slot, lido depois pelo /ans
+    COMMAND_SINK_STREAM,
+    // o proprio chamador le a fila de frames (/cmd e comandos internos)
+    COMMAND_SINK_DIRECT,
+    // cliente WebSocket
+    COMMAND_SINK_WS,
+} command_sink_t;
+
+/**
+ * @brief Quem pode liberar o slot. Cada troca de dono acontece com o lock da
+ * tabela, e release() so aceita o dono atual.
+ *
+ */
+typedef enum : uint8_t {
+    COMMAND_OWNER_NONE,
+    // quem reservou o slot (/out, /cmd, WebSocket, comandos internos)
+    COMMAND_OWNER_REQUESTER,
+    // resultado de um /out guardado na tabela, aguardando o /ans
+    COMMAND_OWNER_TABLE,
+    // /ans lendo o resultado
+    COMMAND_OWNER_READER,
+    // coletor de um comando do WebSocket, que libera o slot ao terminar
+    COMMAND_OWNER_COLLECTOR,
+} command_owner_t;
+
+typedef struct {
+    uint8_t id;
+    volatile command_state_t state;
+    command_sink_t sink;
+    volatile bool timeout;
+    command_owner_t owner;
+    // um coletor ainda usa o slot: a liberacao fica para o finish()
+    bool collecting;
+    bool release_pending;
+    int ws_fd;
+    uint32_t started_ms;
+    uint32_t timeout_ms;
+    uint32_t done_ms;
+    QueueHandle_t frames;
+    StreamBufferHandle_t stream;
+    volatile TaskHandle_t waiter;
+} command_slot_t;
+
+/**
+ * @brief Tabela dos comandos em andamento com o sensor, indexada pelo id de
+ * correlacao que vai no frame e volta em cada resposta. Permite ate window()
+ * comandos simultaneos, cada um com o seu timeout.
+ *
+ */
+class CommandTable {
+   private:
+    command_slot_t _slots[ASYNC_SRV_MAX_INFLIGHT_COMMANDS];
+    SemaphoreHandle_t _lock = NULL;
+    uint8_t _window = 1;
+    uint8_t _next_id = 1;
+
+    bool _id_in_use(uint8_t id) const;
+    void _reclaim_expired(uint32_t now);
+    void _free(command_slot_t* slot);
+    command_slot_t* _claim(uint8_t id, bool any);
+    command_slot_t* _route_target(const uart_frame_t& frame);
+
+   public:
+    CommandTable() {}
+
+    esp_err_t begin();
+
+    /**
+     * @brief Limita o numero de comandos simultaneos. Sem suporte a correlacao
+     * no sensor a janela deve ser 1.
+     *
+     * @param window
+     */
+    void setWindow(uint8_t window);
+    uint8_t window() const;
+
+    /**
+     * @brief Reserva um slot e gera um id de correlacao (1..255).
+     *
+     * @param sink
+     * @param timeout_ms Tempo maximo entre o envio e a resposta final
+     * @param ws_fd Cliente WebSocket quando sink == COMMAND_SINK_WS
+     * @return command_slot_t* NULL se a janela estiver cheia
+     */
+    command_slot_t* acquire(command_sink_t sink, uint32_t timeout_ms, int ws_fd = -1);
+
+    /**
+     * @brief Libera o slot. Ignorado (com erro no log) se owner nao for o dono
+     * atual; com um coletor ativo o slot so fica livre no finish().
+     *
+     * @param slot
+     * @param owner
+     */
+    void release(command_slot_t* slot, command_owner_t owner = COMMAND_OWNER_REQUESTER);
+
+    /**
+     * @brief Entrega o comando (ja com ok) ao coletor pela fila, sem bloquear.
+     * O slot passa para a tabela (COMMAND_SINK_STREAM) ou para o coletor
+     * (COMMAND_SINK_WS).
+     *
+     * @param slot Reservado pelo chamador
+     * @param queue Fila dos coletores
+     * @param job Item da fila
+     * @return false se a fila estiver cheia; o slot continua com o chamador
+     */
+    bool dispatch(command_slot_t* slot, QueueHandle_t queue, const void* job);
+
+    /**
+     * @brief Marca o fim do comando e acorda quem estiver esperando o resultado.
+     * Chamado pelo coletor.
+     *
+     * @param slot
+     * @param timeout true se terminou por timeout
+     */
+    void finish(command_slot_t* slot, bool timeout);
+
+    /**
+     * @brief Passa para o /ans o resultado do /out com o id informado.
+     *
+     * @param id
+     * @return command_slot_t* NULL se nao houver resultado disponivel com o id
+     */
+    command_slot_t* claim(uint8_t id);
+
+    /**
+     * @brief Passa para o /ans o resultado mais antigo de um /out ainda sem
+     * leitor. Usado pelo /ans sem id.
+     *
+     * @return command_slot_t*
+     */
+    command_slot_t* claimOldest();
+
+    /**
+     * @brief Entrega o frame ao comando dono do id. Frames sem id (sensor sem
+     * correlacao) vao para o comando mais antigo ainda em andamento.
+     *
+     * @param frame
+     * @return true se algum comando aceitou o frame
+     */
+    bool route(const uart_frame_t& frame);
+
+    /**
+     * @brief O route() entregaria o frame ao comando com o id informado.
+     *
+     * @param frame
+     * @param id
+     */
+    bool routesTo(const uart_frame_t& frame, uint8_t id);
+
+    uint8_t inflight();
+
+    static uint32_t remainingMs(const command_slot_t* slot);
+};
+
+}  // namespace Wetzel
+#endif
@@ -0,0 +1,207 @@
+#ifndef LINK_FRAME_CODEC_H_
+#define LINK_FRAME_CODEC_H_
+
+/**
+ * Codec do enquadramento binario do enlace UART entre a interface e o ESP do
+ * sensor. Header-only e sem dependencias da IDF para ser compartilhado com o
+ * firmware do sensor.
+ *
+ * Formato do frame (multi-byte em little-endian):
+ *
+ * | 0xA5 | 0x5A | len (u16) | type (u8) | seq (u8) | payload[len] | crc16 (u16) |
+ *
+ * O CRC16-CCITT (poly 0x1021, init 0xFFFF) cobre de len ate o fim do payload.
+ * seq carrega o id de correlacao do comando (0 = sem id), ecoado pelo sensor
+ * nas respostas quando a correlacao foi negociada.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+namespace Wetzel {
+
+#define LINK_FRAME_SOF_0                0xA5
+#define LINK_FRAME_SOF_1                0x5A
+#define LINK_FRAME_HEADER_SIZE          6
+#define LINK_FRAME_TRAILER_SIZE         2
+#define LINK_FRAME_OVERHEAD             (LINK_FRAME_HEADER_SIZE + LINK_FRAME_TRAILER_SIZE)
+#define LINK_FRAME_MAX_PAYLOAD          1024
+#define LINK_FRAME_MAX_SIZE             (LINK_FRAME_MAX_PAYLOAD + LINK_FRAME_OVERHEAD)
+
+// Mensagem ASCII enviada no inicio do enlace para pedir o modo binario. O
+// sensor responde "ok," (ainda em ASCII) e passa a usar frames binarios.
+#define LINK_BINARY_MODE_REQUEST        "9050,1,;"
+// Pede ao sensor que ecoe o id de correlacao ("@<id>," em ASCII, seq no binario)
+#define LINK_CORRELATION_REQUEST        "9051,1,;"
+// Pede o controle de fluxo no TX. O sensor responde "ok,<janela em bytes>" e
+// devolve creditos com "cr,<bytes>" conforme consome o seu buffer de RX
+#define LINK_FLOW_CONTROL_REQUEST       "9052,1,;"
+#define LINK_CREDIT_FRAME_PREFIX        "cr,"
+// Pede ao sensor que publique "<status>,<ssid>,<password>" a cada mudanca do mesh
+#define LINK_MESH_STATUS_PUSH_REQUEST   "9053,1,;"
+
+#define LINK_MAC_LENGTH                 6
+#define LINK_REPORT_ENTRY_SIZE          (LINK_MAC_LENGTH + 1)
+#define LINK_REPORT_BATCH_MAX_ENTRIES   64
+
+typedef enum : uint8_t {
+    // Uma mensagem ASCII do protocolo legado (o ';' final e opcional)
+    LINK_FRAME_TYPE_TEXT = 0x01,
+    // N pares (mac[6], pwm) de relatorio
+    LINK_FRAME_TYPE_REPORT_BATCH = 0x02,
+} link_frame_type_t;
+
+static inline uint16_t link_crc16_update(uint16_t crc, const uint8_t* data, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        crc ^= (uint16_t)data[i] << 8;
+        for (uint8_t bit = 0; bit < 8; bit++) {
+            crc = (crc & 0x8000) ? (uint16_t)((crc << 1) ^ 0x1021) : (uint16_t)(crc << 1);
+        }
+    }
+    return crc;
+}
+
+static inline uint16_t link_crc16(const uint8_t* data, size_t len) {
+    return link_crc16_update(0xFFFF, data, len);
+}
+
+/**
+ * @brief Monta um frame completo em out.
+ *
+ * @return size_t Bytes escritos em out, ou 0 se nao couber
+ */
+static inline size_t link_frame_encode(uint8_t* out, size_t out_size, uint8_t type, uint8_t seq,
+                                       const uint8_t* payload, uint16_t len) {
+    if (len > LINK_FRAME_MAX_PAYLOAD || out_size < (size_t)len + LINK_FRAME_OVERHEAD) {
+        return 0;
+    }
+    out[0] = LINK_FRAME_SOF_0;
+    out[1] = LINK_FRAME_SOF_1;
+    out[2] = (uint8_t)(len & 0xFF);
+    out[3] = (uint8_t)(len >> 8);
+    out[4] = type;
+    out[5] = seq;
+    if (len > 0) {
+        memcpy(out + LINK_FRAME_HEADER_SIZE, payload, len);
+    }
+    uint16_t crc = link_crc16(out + 2, LINK_FRAME_HEADER_SIZE - 2 + len);
+    out[LINK_FRAME_HEADER_SIZE + len] = (uint8_t)(crc & 0xFF);
+    out[LINK_FRAME_HEADER_SIZE + len + 1] = (uint8_t)(crc >> 8);
+    return (size_t)len + LINK_FRAME_OVERHEAD;
+}
+
+/**
+ * @brief Acrescenta um par (mac, pwm) ao payload de um frame REPORT_BATCH.
+ *
+ * @return uint16_t Novo tamanho do payload, ou 0 se o lote estiver cheio
+ */
+static inline uint16_t link_report_batch_append(uint8_t* payload, uint16_t len,
+                                                const uint8_t mac[LINK_MAC_LENGTH], uint8_t pwm) {
+    if (len + LINK_REPORT_ENTRY_SIZE > LINK_REPORT_BATCH_MAX_ENTRIES * LINK_REPORT_ENTRY_SIZE) {
+        return 0;
+    }
+    memcpy(payload + len, mac, LINK_MAC_LENGTH);
+    payload[len + LINK_MAC_LENGTH] = pwm;
+    return len + LINK_REPORT_ENTRY_SIZE;
+}
+
+static inline uint16_t link_report_batch_count(uint16_t len) {
+    return len / LINK_REPORT_ENTRY_SIZE;
+}
+
+static inline const uint8_t* link_report_batch_entry(const uint8_t* payload, uint16_t index) {
+    return payload + index * LINK_REPORT_ENTRY_SIZE;
+}
+
+/**
+ * @brief Decodificador incremental: recebe o stream byte a byte, se ressincroniza
+ * no SOF e valida o CRC.
+ *
+ */
+class LinkFrameDecoder {
+   public:
+    typedef enum {
+        NEED_MORE,
+        FRAME_READY,
+        FRAME_ERROR,
+    } result_t;
+
+    LinkFrameDecoder() { reset(); }
+
+    void reset() {
+        _state = WAIT_SOF_0;
+        _pos = 0;
+        _len = 0;
+    }
+
+    result_t push(uint8_t byte) {
+        switch (_state) {
+        case WAIT_SOF_0:
+            if (byte == LINK_FRAME_SOF_0) {
+                _state = WAIT_SOF_1;
+            }
+            return NEED_MORE;
+        case WAIT_SOF_1:
+            _state = byte == LINK_FRAME_SOF_1 ? HEADER
+                     : byte == LINK_FRAME_SOF_0 ? WAIT_SOF_1
+                                                : WAIT_SOF_0;
+            _pos = 0;
+            return NEED_MORE;
+        case HEADER:
+            _header[_pos++] = byte;
+            if (_pos < LINK_FRAME_HEADER_SIZE - 2) {
+                return NEED_MORE;
+            }
+            _len = (uint16_t)(_header[0] | (_header[1] << 8));
+            if (_len > LINK_FRAME_MAX_PAYLOAD) {
+                reset();
+                return FRAME_ERROR;
+            }
+            _pos = 0;
+            _state = _len > 0 ? PAYLOAD : CRC;
+            return NEED_MORE;
+        case PAYLOAD:
+            _payload[_pos++] = byte;
+            if (_pos == _len) {
+                _pos = 0;
+                _state = CRC;
+            }
+            return NEED_MORE;
+        case CRC:
+            _crc[_pos++] = byte;
+            if (_pos < LINK_FRAME_TRAILER_SIZE) {
+                return NEED_MORE;
+            }
+            _state = WAIT_SOF_0;
+            _pos = 0;
+            {
+                uint16_t crc = link_crc16(_header, LINK_FRAME_HEADER_SIZE - 2);
+                crc = link_crc16_update(crc, _payload, _len);
+                if (crc != (uint16_t)(_crc[0] | (_crc[1] << 8))) {
+                    return FRAME_ERROR;
+                }
+            }
+            return FRAME_READY;
+        }
+        return NEED_MORE;
+    }
+
+    uint8_t type() const { return _header[2]; }
+    uint8_t seq() const { return _header[3]; }
+    uint16_t length() const { return _len; }
+    const uint8_t* payload() const { return _payload; }
+
+   private:
+    typedef enum { WAIT_SOF_0, WAIT_SOF_1, HEADER, PAYLOAD, CRC } state_t;
+
+    state_t _state;
+    uint16_t _pos;
+    uint16_t _len;
+    uint8_t _header[LINK_FRAME_HEADER_SIZE - 2];
+    uint8_t _crc[LINK_FRAME_TRAILER_SIZE];
+    uint8_t _payload[LINK_FRAME_MAX_PAYLOAD];
+};
+
+}  // namespace Wetzel
+#endif
@@ -0,0 +1,163 @@
+#ifndef UART_LINK_H_
+#define UART_LINK_H_
+
+#include <driver/uart.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/semphr.h>
+
+#include "link_frame_codec.h"
+
+namespace Wetzel {
+
+typedef enum {
+    UART_LINK_MODE_ASCII,
+    UART_LINK_MODE_BINARY,
+} uart_link_mode_t;
+
+/**
+ * @brief Enlace UART com o ESP do sensor. Usa o driver da IDF com fila de
+ * eventos e deteccao do padrao ';' para acordar o leitor uma vez por frame
+ * completo, sem polling.
+ * 
+ */
+class UartLink {
+   private:
+    UartLink();
+
+    static UartLink* _instance;
+
+    uart_port_t _port = UART_NUM_2;
+    QueueHandle_t _event_queue = NULL;
+    SemaphoreHandle_t _tx_mutex = NULL;
+    bool _initialized = false;
+
+    volatile uart_link_mode_t _mode = UART_LINK_MODE_ASCII;
+    volatile uart_link_mode_t _pending_mode = UART_LINK_MODE_ASCII;
+    volatile bool _mode_change_pending = false;
+
+    // Controle de fluxo por creditos (bytes livres no RX do sensor)
+    SemaphoreHandle_t _credit_sem = NULL;
+    portMUX_TYPE _credit_mux = portMUX_INITIALIZER_UNLOCKED;
+    volatile bool _flow_control = false;
+    volatile uint16_t _credits = 0;
+    uint16_t _credit_window = 0;
+    uint32_t _credit_timeouts = 0;
+
+    // Estado do modo binario
+    LinkFrameDecoder _decoder;
+    uint8_t _rx_chunk[128];
+    size_t _rx_chunk_len = 0;
+    size_t _rx_chunk_pos = 0;
+    uint8_t _tx_frame[LINK_FRAME_MAX_SIZE];
+    uint32_t _frame_errors = 0;
+
+    int _read_ascii_frame(char* frame, size_t max_len, TickType_t timeout);
+    int _read_binary_frame(uint8_t* type, uint8_t* seq, char* frame, size_t max_len,
+                           TickType_t timeout);
+
+    /**
+     * @brief Descarta o conteudo do buffer de RX e as posicoes de padrao
+     * pendentes (usado apos overflow).
+     * 
+     */
+    void _reset_rx();
+
+    /**
+     * @brief Consome e descarta len bytes do buffer de RX.
+     * 
+     * @param len 
+     */
+    void _discard(size_t len);
+
+    /**
+     * @brief Escreve no ring de TX respeitando os creditos do sensor.
+     * 
+     * @param data 
+     * @param len 
+     * @return int Numero de bytes escritos, ou -1 em caso de erro
+     */
+    int _write_bytes(const void* data, size_t len);
+    void _take_credits(size_t len);
+
+   public:
+    void operator=(UartLink const&) = delete;
+    ~UartLink();
+
+    static UartLink* getInstance();
+
+    /**
+     * @brief Instala o driver da UART, configura pinos e habilita a deteccao
+     * do terminador de frame.
+     * 
+     * @param port UART utilizada (UART_NUM_2)
+     * @param baud_rate 
+     * @param tx_gpio 
+     * @param rx_gpio 
+     * @return esp_err_t 
+     */
+    esp_err_t begin(uart_port_t port, int baud_rate, int tx_gpio, int rx_gpio);
+
+    /**
+     * @brief Bloqueia ate receber um frame completo. Em modo ASCII o frame
+     * termina em ';'; em modo binario e um frame validado pelo CRC.
+     * 
+     * @param type Tipo do frame (link_frame_type_t). Sempre TEXT em modo ASCII
+     * @param seq Campo seq do frame. Sempre 0 em modo ASCII
+     * @param frame Buffer de saida. Frames TEXT terminam em '\0' e sem o ';'
+     * @param max_len Tamanho do buffer (incluindo o '\0')
+     * @param timeout Tempo maximo de espera por evento da UART
+     * @return int Tamanho do frame, ou -1 em caso de timeout
+     */
+    int readFrame(uint8_t* type, uint8_t* seq, char* frame, size_t max_len,
+                  TickType_t timeout = portMAX_DELAY);
+
+    /**
+     * @brief Escreve uma mensagem ASCII na UART. Em modo binario a mensagem e
+     * enviada dentro de um frame TEXT.
+     * 
+     * @param data 
+     * @param len 
+     * @param seq Campo seq do frame binario (id de correlacao)
+     * @return int Numero de bytes escritos, ou -1 em caso de erro
+     */
+    int write(const char* data, size_t len, uint8_t seq = 0);
+
+    /**
+     * @brief Liga o controle de fluxo: cada escrita consome creditos e aguarda
+     * o sensor devolve-los (addCredits) antes de exceder a janela.
+     * 
+     * @param window Bytes que o sensor aceita sem devolver creditos
+     */
+    void enableFlowControl(uint16_t window);
+    void addCredits(uint16_t credits);
+    bool flowControlEnabled() const;
+    uint32_t creditTimeouts() const;
+
+    /**
+     * @brief Aguarda o fim da transmissao dos bytes pendentes.
+     * 
+     * @param timeout 
+     * @return esp_err_t 
+     */
+    esp_err_t waitTxDone(TickType_t timeout);
+
+    /**
+     * @brief Agenda a troca de modo do enlace. A troca so e aplicada pela task
+     * leitora (applyPendingMode) ao receber o "ok," do sensor a esse pedido
+     * (quem le confere que o "ok," e do comando da troca), para que nenhum
+     * byte seguinte seja lido no modo antigo.
+     * 
+     * @param mode 
+     */
+    void requestMode(uart_link_mode_t mode);
+    bool modeChangePending() const;
+    void applyPendingMode();
+    void cancelPendingMode();
+    uart_link_mode_t mode() const;
+
+    uint32_t frameErrors() const;
+};
+
+}  // namespace Wetzel
+#endif
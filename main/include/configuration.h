@@ -30,15 +30,35 @@
 #define SPI_MISO_GPIO                                       GPIO_NUM_4
 // Feedback conecao celular
 #define LED_PIN                                             GPIO_NUM_25
+// UART2 (ESP do sensor)
+#define UART_TX_GPIO                                        GPIO_NUM_17
+#define UART_RX_GPIO                                        GPIO_NUM_16
 /**
  * =========================================================
  *                COMUNICACAO ENTRE ESPs (UART2)
  * =========================================================
 */
-#define UART_QUEUE_LENGTH                                   40
-#define UART_QUEUE_MSG_LENGTH                               500
 #define UART_BAUD_RATE                                      230400
 #define UART_RX_BUFFER                                      1024
+// Ring de TX do driver: uart_write_bytes copia e retorna, a ISR transmite
+#define UART_TX_BUFFER                                      2048
+#define UART_LINK_EVENT_QUEUE_LENGTH                        20
+#define UART_LINK_PATTERN_QUEUE_LENGTH                      20
+#define UART_LINK_READ_TIMEOUT_MS                           100
+// Negocia com o sensor o enquadramento binario (link_frame_codec.h)
+#define UART_LINK_BINARY_FRAMING_ENABLED                    1
+// Negocia com o sensor o id de correlacao nos comandos (command_table.h)
+#define UART_LINK_CORRELATION_ENABLED                       1
+// Negocia com o sensor o controle de fluxo por creditos no TX
+#define UART_LINK_FLOW_CONTROL_ENABLED                      1
+// Negocia com o sensor a publicacao do status do mesh a cada mudanca
+#define UART_LINK_MESH_STATUS_PUSH_ENABLED                  1
+// Sem credito devolvido nesse tempo a janela e considerada livre
+#define UART_LINK_CREDIT_TIMEOUT_MS                         500
+// Pausa entre blocos no TX para sensores sem controle de fluxo
+#define UART_LINK_LEGACY_CHUNK_DELAY_MS                     100
+// Fila de frames de status demultiplexados pela task de leitura da UART2
+#define UART_STATUS_FRAME_QUEUE_LENGTH                      2
 /**
  * =========================================================
  *                         FREERTOS
@@ -52,12 +72,25 @@
 //my_async_server
 #define ASYNC_SRV_MSG_LENGTH                                500
 #define ASYNC_SRV_SERVER_PORT                               80
-#define ASYNC_SRV_CHECK_MESH_TASK_STACK_SIZE                8 * TASK_STACK_REF_SIZE
-#define ASYNC_SRV_READ_REPORT_TASK_STACK_SIZE               8 * TASK_STACK_REF_SIZE
+#define ASYNC_SRV_CHECK_MESH_TASK_STACK_SIZE                (8 * TASK_STACK_REF_SIZE)
+#define ASYNC_SRV_UART_RX_TASK_STACK_SIZE                   (4 * TASK_STACK_REF_SIZE)
+#define ASYNC_SRV_MESH_STATUS_TASK_STACK_SIZE               (8 * TASK_STACK_REF_SIZE)
+#define ASYNC_SRV_COLLECTOR_TASK_STACK_SIZE                 (4 * TASK_STACK_REF_SIZE)
 #define ASYNC_SRV_CHECK_MESH_TASK_PRIORITY                  CONFIG_APP_TASK_DEFAULT_PRIORITY - 3
-#define ASYNC_SRV_REPORT_READ_TASK_PRIORITY                 CONFIG_APP_TASK_DEFAULT_PRIORITY - 2
+#define ASYNC_SRV_UART_RX_TASK_PRIORITY                     CONFIG_APP_TASK_DEFAULT_PRIORITY
+#define ASYNC_SRV_COLLECTOR_TASK_PRIORITY                   CONFIG_APP_TASK_DEFAULT_PRIORITY - 1
+// Tasks fixas que repassam as respostas dos comandos (stacks estaticas)
+#define ASYNC_SRV_COLLECTOR_WORKERS                         2
+// Tasks fixas que atendem as requisicoes que esperam o sensor (/out, /ans,
+// /cmd, /report e comandos do WebSocket), fora da task do httpd
+#define ASYNC_SRV_REQUEST_WORKERS                           2
+#define ASYNC_SRV_REQUEST_TASK_STACK_SIZE                   (6 * TASK_STACK_REF_SIZE)
+#define ASYNC_SRV_REQUEST_TASK_PRIORITY                     CONFIG_APP_TASK_DEFAULT_PRIORITY - 1
+// Requisicoes aguardando ou em atendimento nos workers (request_job_t)
+#define ASYNC_SRV_REQUEST_QUEUE_LENGTH                      4
+#define ASYNC_SRV_RANGE_HEADER_SIZE                         48
 
-#define ASYNC_SRV_WB_TASK_STACK_SIZE                        8 * TASK_STACK_REF_SIZE
+#define ASYNC_SRV_WB_TASK_STACK_SIZE                        (8 * TASK_STACK_REF_SIZE)
 // #define ASYNC_SRV_WB_TASK_PRIORITY                          CONFIG_APP_TASK_DEFAULT_PRIORITY - 1
 #define ASYNC_SRV_WB_TASK_FIRST_DELAY_MS                    3000
 #define ASYNC_SRV_WB_TASK_HTTP_REQUEST_TIMEOUT_MS           4000
@@ -65,11 +98,67 @@
 #define ASYNC_SRV_D_RESPONSE_REQUEST_TIMEOUT_MS             10000
 #define ASYNC_SRV_CLIENT_RESPONSE_REQUEST_TIMEOUT_MS        10000
 #define ASYNC_SRV_CHECK_CONNECTION_TASK_DELAY_MS            10000
+// Periodo do 9031 quando o sensor publica o status do mesh por conta propria
+#define ASYNC_SRV_MESH_STATUS_HEARTBEAT_MS                  120000
 #define ASYNC_HTTP_PACKET_BUFFER_SIZE                       4095 //tamanho exato do bloco do SPIFFS
+#define ASYNC_SRV_MAX_OPEN_SOCKETS                          2
+// Mensagens WebSocket aguardando a task do httpd (ws_async_msg_t, sem malloc);
+// cabe uma resposta do sensor com o prefixo "@<id>," e o ';' final
+#define ASYNC_SRV_WS_MSG_POOL_LENGTH                        8
+#define ASYNC_SRV_WS_MSG_PREFIX_SIZE                        5
+#define ASYNC_SRV_WS_MSG_SIZE                               (ASYNC_SRV_WS_MSG_PREFIX_SIZE + ASYNC_SRV_MSG_LENGTH + 1)
+// Comandos simultaneos com o sensor (janela 1 se o sensor nao suportar correlacao)
+#define ASYNC_SRV_MAX_INFLIGHT_COMMANDS                     4
+#define ASYNC_SRV_CMD_FRAME_QUEUE_LENGTH                    4
+// Respostas de cada comando aguardando o /ans (stream de bytes, sem copias por linha)
+#define ASYNC_SRV_CMD_STREAM_BUFFER_SIZE                    1024
+#define ASYNC_SRV_CMD_MAX_TIMEOUT_MS                        60000
+// Tempo que o resultado de um /out fica guardado esperando o /ans
+#define ASYNC_SRV_CMD_RESULT_RETENTION_MS                   30000
+// So o /direct, o /echo e a leitura dos frames WebSocket rodam na task do
+// httpd. Mantido nos 24 KB de antes ate haver a marca de agua medida na placa
+// (log de _log_stack_usage com /report e WebSocket simultaneos)
+#define ASYNC_SRV_HTTPD_STACK_SIZE                          (24 * TASK_STACK_REF_SIZE)
+// Abaixo disso de stack livre o log de uso de stack vira um aviso
+#define ASYNC_SRV_STACK_LOW_WATER_WARN                      1024
+// Buffers de cada sessao HTTP (request_arena_t) e de cada request worker
+// (request_scratch_t), fora das stacks. O frame WebSocket e lido no buffer de
+// parametro.
+#define ASYNC_SRV_QUERY_BUFFER_SIZE                         1500
+#define ASYNC_SRV_PARAM_BUFFER_SIZE                         1000
+#define ASYNC_SRV_RESPONSE_BUFFER_SIZE                      1600
 // HTTP
 #define HANDLE_HTTP_RESPONSE_CODE_OK                        200
 #define HANDLE_HTTP_RESPONSE_CODE_NOT_OK                    500
 #define HANDLE_HTTP_RESPONSE_CODE_TIEMOUT                   504
+/**
+ * =========================================================
+ *                         RELATORIO
+ * =========================================================
+*/
+// Arquivos diarios no formato binario de report_format.h
+#define REPORT_FILE_EXTENSION                               "rpt"
+// Limite do cadastro de dispositivos (o id no arquivo e um uint8_t)
+#define REPORT_MAX_DEVICES                                  256
+// Filas SPSC (potencia de 2): reports vindos da UART e entradas para o arquivo
+#define REPORT_MSG_RING_SIZE                                64
+#define REPORT_WRITING_RING_SIZE                            512
+// Maximo de arquivos diarios em um download do /report
+#define REPORT_DOWNLOAD_MAX_DAYS                            31
+// Leituras do SD alinhadas ao setor
+#define REPORT_READ_ALIGNMENT                               512
+#define REPORT_READER_TASK_STACK_SIZE                       3 * TASK_STACK_REF_SIZE
+#define REPORT_READER_TASK_PRIORITY                         CONFIG_APP_TASK_DEFAULT_PRIORITY - 1
+// O bloco que ainda nao encheu vai para o cartao (com fsync) no maximo a cada
+// COMMIT_PERIOD
+#define REPORT_WRITER_COMMIT_PERIOD_MS                      5 * 60000
+// Granularidade do indice de horario no cabecalho do arquivo diario; deve ser
+// maior que o COMMIT_PERIOD (folga de um bucket do ReportReader::findWindow)
+#define REPORT_INDEX_BUCKET_MINUTES                         15
+// Rollups por hora, dia e mes (report_rollup.h): um arquivo por dia, mes e ano
+#define REPORT_ROLLUP_HOUR_EXTENSION                        "rph"
+#define REPORT_ROLLUP_DAY_EXTENSION                         "rpd"
+#define REPORT_ROLLUP_MONTH_EXTENSION                       "rpm"
 /**
  * =========================================================
  *                           RSSI
@@ -0,0 +1,89 @@
+#ifndef WETZEL_DIRECT_MSG_REGISTRY_H_
+#define WETZEL_DIRECT_MSG_REGISTRY_H_
+
+#include <esp_err.h>
+#include <stddef.h>
+#include <stdint.h>
+
+namespace Wetzel {
+
+#define DIRECT_MSG_MAX_ARGS 7
+// Argumento opcional vazio enviado pelo app
+#define DIRECT_MSG_EMPTY_ARG '#'
+#define DIRECT_MSG_TERMINATOR ';'
+
+/**
+ * @brief Argumento de uma mensagem /direct. Aponta para dentro do buffer da
+ * mensagem (terminado em '\0' pelo tokenizador), sem copia.
+ *
+ */
+typedef struct {
+    const char* ptr;
+    uint16_t len;
+} msg_arg_t;
+
+typedef enum : uint8_t {
+    MSG_ARG_TEXT,      // nao vazio
+    MSG_ARG_OPTIONAL,  // texto ou '#' (vazio)
+    MSG_ARG_UINT,      // decimal sem sinal
+    MSG_ARG_FLAG,      // '0' ou '1'
+    MSG_ARG_MAC,       // 12 digitos hexadecimais
+} msg_arg_type_t;
+
+/**
+ * @brief Handler de uma mensagem /direct. Os argumentos ja foram validados
+ * contra a tabela.
+ *
+ * @param args argc argumentos, na ordem da mensagem
+ * @param response Conteudo opcional da resposta (so usado se has_content)
+ * @param response_size
+ */
+typedef esp_err_t (*direct_msg_handler_t)(const msg_arg_t* args, char* response,
+                                          size_t response_size);
+
+typedef struct {
+    uint8_t code;
+    direct_msg_handler_t handler;
+    uint8_t argc;
+    msg_arg_type_t types[DIRECT_MSG_MAX_ARGS];
+    bool has_content;
+} direct_msg_def_t;
+
+/**
+ * @brief Definicao da mensagem com o codigo informado (acesso direto por
+ * indice).
+ *
+ * @param code
+ * @return const direct_msg_def_t* NULL se o codigo nao existir
+ */
+const direct_msg_def_t* direct_msg_lookup(uint8_t code);
+
+/**
+ * @brief Separa "<codigo>,<arg>,...,<arg>,;" em uma unica passada, trocando
+ * as virgulas por '\0' no proprio buffer.
+ *
+ * @param msg Mensagem ja decodificada (alterada)
+ * @param code Codigo da mensagem
+ * @param args Ate DIRECT_MSG_MAX_ARGS argumentos
+ * @param argc Quantidade de argumentos encontrados
+ * @return esp_err_t ESP_ERR_INVALID_ARG se a mensagem estiver mal formada
+ */
+esp_err_t direct_msg_tokenize(char* msg, uint8_t* code, msg_arg_t* args, uint8_t* argc);
+
+/**
+ * @brief Tokeniza, valida contra a tabela e chama o handler da mensagem.
+ *
+ * @param msg Mensagem ja decodificada (alterada)
+ * @param response
+ * @param response_size
+ * @param def Recebe a definicao usada, NULL se o codigo for desconhecido
+ * @return esp_err_t
+ */
+esp_err_t direct_msg_dispatch(char* msg, char* response, size_t response_size,
+                              const direct_msg_def_t** def);
+
+uint32_t msg_arg_to_uint(const msg_arg_t& arg);
+void msg_arg_to_mac(const msg_arg_t& arg, uint8_t mac[6]);
+
+}  // namespace Wetzel
+#endif
@@ -6,9 +6,12 @@
 
 namespace Wetzel {
 
+// os testes de host apontam para um diretorio local
+#ifndef MOUNT_POINT
 #define MOUNT_POINT "/sdcard"
+#endif
 #define EXAMPLE_MAX_CHAR_SIZE 64  // Variável de configuração de exemplo (temporaria)
-#define MAX_FILES_OPENED 2        // 1 -> Read | 1 -> Write
+#define MAX_FILES_OPENED 3        // 1 -> Read | 1 -> Write | 1 -> Rollup
 #define ALLOCATION_UNIT_SIZE 1024 * 16
 #define MAX_FREQ_KHZ 20000 / 2
 #define FORMAT_IF_MOUNT_FAILED true
@@ -19,7 +22,13 @@ namespace Wetzel {
  * @brief Definições virtuais de FILEs. Apenas uma de cada tipo disponível.
  * 
  */
-typedef enum { WRITING_FILE, READING_FILE } file_type_t;
+typedef enum {
+    WRITING_FILE,
+    READING_FILE,
+    // arquivos de rollup, abertos por pouco tempo enquanto o WRITING_FILE
+    // segue com o arquivo do dia
+    ROLLUP_FILE,
+} file_type_t;
 
 class CartaoSD {
    private:
@@ -30,9 +39,11 @@ class CartaoSD {
 
     FILE* _writing_file = NULL;
     FILE* _reading_file = NULL;
+    FILE* _rollup_file = NULL;
 
     bool _writing_file_is_open = false;
     bool _reading_file_is_open = false;
+    bool _rollup_file_is_open = false;
 
     // Variáveis necessárias de configuração da SDMMC Lib
     sdmmc_host_t _host;
@@ -40,6 +51,7 @@ class CartaoSD {
 
     char writing_file_path[25];
     char reading_file_path[25];
+    char rollup_file_path[25];
 
    public:
     ~CartaoSD();
@@ -62,7 +74,9 @@ class CartaoSD {
 
     /**
      * @brief Abre FILE especificada e retorna seu ponteiro.
-     * @note Apenas uma FILE por tipo pode estar aberta ao mesmo tempo (Read / Write)
+     * @note Apenas uma FILE por tipo pode estar aberta ao mesmo tempo (Read / Write / Rollup)
+     * @note WRITING_FILE e ROLLUP_FILE sao abertas para leitura e escrita (criadas
+     * se nao existirem), posicionadas no inicio
      * 
      * @param file_path 
      * @param type 
@@ -71,7 +85,7 @@ class CartaoSD {
     FILE* openFile(const char* file_path, file_type_t type);
 
     /**
-     * @brief Fecha FILE relacionada ao tipo especificado (Read / Write)
+     * @brief Fecha FILE relacionada ao tipo especificado (Read / Write / Rollup)
      * 
      * @param file 
      * @return esp_err_t 
@@ -0,0 +1,101 @@
+#ifndef DEVICE_REGISTRY_H_
+#define DEVICE_REGISTRY_H_
+
+#include <esp_err.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <stdint.h>
+
+#include <atomic>
+
+namespace Wetzel {
+
+typedef enum { LUM_17K, LUM_23K, LUM_32K } luminaria_type_catalog_t;
+typedef uint8_t luminaria_type_t;
+
+typedef struct {
+    uint8_t id;
+    uint8_t qtd_luminarias;
+    luminaria_type_t modelo_luminarias;
+} device_report_info_t;
+
+/**
+ * @brief MAC de 48 bits como chave. O bit 48 marca a posicao como ocupada,
+ * entao a chave 0 indica posicao vazia.
+ *
+ */
+static inline uint64_t device_mac_key(const uint8_t mac[6]) {
+    return (1ULL << 48) | ((uint64_t)mac[0] << 40) | ((uint64_t)mac[1] << 32) |
+           ((uint64_t)mac[2] << 24) | ((uint64_t)mac[3] << 16) | ((uint64_t)mac[4] << 8) |
+           (uint64_t)mac[5];
+}
+
+typedef struct {
+    uint64_t key;
+    device_report_info_t info;
+} device_registry_slot_t;
+
+typedef struct {
+    device_registry_slot_t* slots;
+    std::atomic<uint32_t> readers;
+} device_registry_table_t;
+
+/**
+ * @brief Cadastro dos dispositivos de relatorio: tabela hash de enderecamento
+ * aberto (sondagem linear) indexada pelo MAC, alocada uma unica vez no begin().
+ *
+ * A leitura nao bloqueia nem aloca: usa a tabela ativa, contando leitores.
+ * O cadastro (raro, vindo do /direct) monta a nova versao na outra tabela,
+ * depois que ela nao tem mais leitores, e troca o ponteiro.
+ *
+ */
+class DeviceRegistry {
+   private:
+    device_registry_table_t _tables[2];
+    std::atomic<device_registry_table_t*> _active{NULL};
+    SemaphoreHandle_t _write_lock = NULL;
+    uint32_t _mask = 0;
+    uint16_t _max_devices = 0;
+    uint16_t _count = 0;
+
+    const device_registry_slot_t* _probe(const device_registry_slot_t* slots,
+                                         uint64_t key) const;
+
+   public:
+    DeviceRegistry() {}
+
+    /**
+     * @brief Aloca as duas tabelas com pelo menos o dobro de posicoes do
+     * numero de dispositivos (potencia de 2).
+     *
+     * @param max_devices
+     * @return esp_err_t
+     */
+    esp_err_t begin(uint16_t max_devices);
+
+    /**
+     * @brief Busca sem lock, pode ser chamada de qualquer task.
+     *
+     * @param mac
+     * @param info
+     * @return true se o dispositivo estiver cadastrado
+     */
+    bool find(const uint8_t mac[6], device_report_info_t* info);
+
+    /**
+     * @brief Cadastra o dispositivo com o proximo id.
+     *
+     * @param mac
+     * @param qtd_luminarias
+     * @param modelo_luminarias
+     * @return esp_err_t ESP_ERR_INVALID_STATE se ja cadastrado, ESP_ERR_NO_MEM
+     * se o limite de dispositivos foi atingido
+     */
+    esp_err_t add(const uint8_t mac[6], uint8_t qtd_luminarias,
+                  luminaria_type_t modelo_luminarias);
+
+    uint16_t count() const;
+};
+
+}  // namespace Wetzel
+#endif
@@ -0,0 +1,354 @@
+#ifndef REPORT_BLOCK_CODEC_H_
+#define REPORT_BLOCK_CODEC_H_
+
+/**
+ * Codec do payload dos blocos comprimidos (versao 2 de report_format.h).
+ * Header-only e sem dependencias da IDF, como o report_format.h.
+ *
+ * O estado recomeca no inicio de cada segmento de blocos: o primeiro registro
+ * de um dispositivo no segmento leva os metadados dele (qtd_luminarias,
+ * modelo) e o horario completo. Um bloco so seria pequeno demais para isso:
+ * com mais de ~55 dispositivos ele encheria antes de algum se repetir. Os
+ * seguintes sao previstos a partir do anterior do mesmo dispositivo: o
+ * horario avanca o mesmo passo da ultima vez (delta-of-delta) e o pwm se
+ * repete. O "proximo dispositivo" previsto e o proximo id ja visto no segmento,
+ * em ordem circular, que e a ordem em que o flush grava.
+ *
+ * Operacoes (primeiro byte):
+ *
+ * | 0x00..0x7F | RUN: 1 a 128 registros previstos (dod = 0, mesmo pwm)         |
+ * | 0x80..0xBF | SMALL: 1 registro previsto com dod zigzag de 6 bits          |
+ * | 0xC0       | NEW: id, qtd, modelo, pwm, unix_seconds (u32)                |
+ * | 0xC1       | FULL: id, pwm, dod zigzag em varint (LEB128)                 |
+ *
+ * O primeiro passo de um dispositivo e REPORT_CODEC_DEFAULT_STRIDE, o periodo
+ * de gravacao. Todas as contas de horario sao modulo 2^32.
+ *
+ * O decodificador gera um registro por vez; o estado e fixo (2852 bytes, 11
+ * bytes por id possivel mais o bitmap) e nao depende do tamanho do arquivo.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "report_format.h"
+
+namespace Wetzel {
+
+#define REPORT_CODEC_OP_RUN_MAX         0x7F
+#define REPORT_CODEC_OP_SMALL           0x80
+#define REPORT_CODEC_OP_SMALL_MAX       0xBF
+#define REPORT_CODEC_OP_NEW             0xC0
+#define REPORT_CODEC_OP_FULL            0xC1
+#define REPORT_CODEC_NEW_SIZE           9
+#define REPORT_CODEC_FULL_MAX_SIZE      8
+#define REPORT_CODEC_DEFAULT_STRIDE     60
+#define REPORT_CODEC_MAX_DEVICES        256
+
+static inline uint32_t report_zigzag_encode(int32_t value) {
+    return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+}
+
+static inline int32_t report_zigzag_decode(uint32_t value) {
+    return (int32_t)(value >> 1) ^ -(int32_t)(value & 1);
+}
+
+/**
+ * @brief Estado de previsao por dispositivo, o mesmo dos dois lados.
+ *
+ */
+typedef struct {
+    uint32_t unix_seconds[REPORT_CODEC_MAX_DEVICES];
+    uint32_t stride[REPORT_CODEC_MAX_DEVICES];
+    uint8_t pwm[REPORT_CODEC_MAX_DEVICES];
+    uint8_t qtd_luminarias[REPORT_CODEC_MAX_DEVICES];
+    uint8_t modelo_luminarias[REPORT_CODEC_MAX_DEVICES];
+    uint32_t known[REPORT_CODEC_MAX_DEVICES / 32];
+    uint8_t last_id;
+} report_codec_state_t;
+
+static inline void report_codec_reset(report_codec_state_t* state) {
+    memset(state->known, 0, sizeof(state->known));
+    state->last_id = 0;
+}
+
+static inline bool report_codec_is_known(const report_codec_state_t* state, uint8_t id) {
+    return state->known[id / 32] & (1UL << (id % 32));
+}
+
+/**
+ * @brief Proximo id ja visto no segmento depois de last_id, em ordem circular.
+ *
+ */
+static inline uint8_t report_codec_next_id(const report_codec_state_t* state) {
+    uint16_t start = state->last_id + 1;
+    for (uint16_t i = 0; i < REPORT_CODEC_MAX_DEVICES / 32 + 1; i++) {
+        uint16_t word = ((start / 32) + i) % (REPORT_CODEC_MAX_DEVICES / 32);
+        uint32_t bits = state->known[word];
+        if (i == 0) {
+            bits &= ~0UL << (start % 32);
+        }
+        if (bits) {
+            return word * 32 + __builtin_ctz(bits);
+        }
+    }
+    return state->last_id;
+}
+
+static inline void report_codec_apply(report_codec_state_t* state, const report_record_t& record) {
+    uint8_t id = record.id;
+    if (!report_codec_is_known(state, id)) {
+        state->stride[id] = REPORT_CODEC_DEFAULT_STRIDE;
+        state->known[id / 32] |= 1UL << (id % 32);
+    } else {
+        state->stride[id] = record.unix_seconds - state->unix_seconds[id];
+    }
+    state->unix_seconds[id] = record.unix_seconds;
+    state->pwm[id] = record.pwm_value;
+    state->qtd_luminarias[id] = record.qtd_luminarias;
+    state->modelo_luminarias[id] = record.modelo_luminarias;
+    state->last_id = id;
+}
+
+/**
+ * @brief Decodificador de um payload, registro a registro.
+ *
+ */
+class ReportBlockDecoder {
+   private:
+    report_codec_state_t* _state;
+    const uint8_t* _payload = NULL;
+    uint16_t _used = 0;
+    uint16_t _pos = 0;
+    uint16_t _remaining = 0;
+    uint8_t _run = 0;
+
+    void _predicted(report_record_t* record, int32_t dod) {
+        uint8_t id = report_codec_next_id(_state);
+        record->id = id;
+        record->qtd_luminarias = _state->qtd_luminarias[id];
+        record->modelo_luminarias = _state->modelo_luminarias[id];
+        record->pwm_value = _state->pwm[id];
+        record->unix_seconds = _state->unix_seconds[id] + _state->stride[id] + (uint32_t)dod;
+    }
+
+   public:
+    explicit ReportBlockDecoder(report_codec_state_t* state) : _state(state) {}
+
+    /**
+     * @brief Comeca um payload (o CRC do bloco ja deve ter sido conferido).
+     * Fora do inicio de segmento o estado continua o do bloco anterior.
+     *
+     */
+    void begin(const uint8_t* payload, uint16_t used, uint16_t count, bool segment_start) {
+        if (segment_start) {
+            report_codec_reset(_state);
+        }
+        _payload = payload;
+        _used = used;
+        _pos = 0;
+        _remaining = count;
+        _run = 0;
+    }
+
+    /**
+     * @brief Proximo registro do bloco.
+     *
+     * @return false no fim do bloco ou se o payload for invalido
+     */
+    bool next(report_record_t* record) {
+        if (_remaining == 0) {
+            return false;
+        }
+        if (_run > 0) {
+            _run--;
+            _predicted(record, 0);
+        } else {
+            if (_pos >= _used) {
+                return false;
+            }
+            uint8_t op = _payload[_pos++];
+            if (op <= REPORT_CODEC_OP_RUN_MAX) {
+                _run = op;
+                _predicted(record, 0);
+            } else if (op <= REPORT_CODEC_OP_SMALL_MAX) {
+                _predicted(record, report_zigzag_decode(op - REPORT_CODEC_OP_SMALL));
+            } else if (op == REPORT_CODEC_OP_NEW) {
+                if (_used - _pos < REPORT_CODEC_NEW_SIZE - 1) {
+                    return false;
+                }
+                record->id = _payload[_pos];
+                record->qtd_luminarias = _payload[_pos + 1];
+                record->modelo_luminarias = _payload[_pos + 2];
+                record->pwm_value = _payload[_pos + 3];
+                record->unix_seconds = report_get_le32(_payload + _pos + 4);
+                _pos += REPORT_CODEC_NEW_SIZE - 1;
+            } else if (op == REPORT_CODEC_OP_FULL) {
+                if (_used - _pos < 3) {
+                    return false;
+                }
+                uint8_t id = _payload[_pos];
+                if (!report_codec_is_known(_state, id)) {
+                    return false;
+                }
+                record->pwm_value = _payload[_pos + 1];
+                _pos += 2;
+                uint32_t zigzag = 0;
+                for (uint8_t shift = 0; shift < 35; shift += 7) {
+                    if (_pos >= _used) {
+                        return false;
+                    }
+                    uint8_t byte = _payload[_pos++];
+                    zigzag |= (uint32_t)(byte & 0x7F) << shift;
+                    if (!(byte & 0x80)) {
+                        break;
+                    }
+                }
+                record->id = id;
+                record->qtd_luminarias = _state->qtd_luminarias[id];
+                record->modelo_luminarias = _state->modelo_luminarias[id];
+                record->unix_seconds = _state->unix_seconds[id] + _state->stride[id] +
+                                       (uint32_t)report_zigzag_decode(zigzag);
+            } else {
+                return false;
+            }
+        }
+        report_codec_apply(_state, *record);
+        _remaining--;
+        return true;
+    }
+};
+
+/**
+ * @brief Codificador incremental de um payload de REPORT_V2_PAYLOAD_SIZE.
+ *
+ */
+class ReportBlockEncoder {
+   private:
+    report_codec_state_t* _state;
+    uint8_t* _payload = NULL;
+    uint16_t _used = 0;
+    uint16_t _count = 0;
+    // posicao do ultimo RUN, enquanto ele for a ultima operacao; -1 se nao
+    int16_t _run_pos = -1;
+
+   public:
+    explicit ReportBlockEncoder(report_codec_state_t* state) : _state(state) {}
+
+    void begin(uint8_t* payload, bool segment_start) {
+        if (segment_start) {
+            report_codec_reset(_state);
+        }
+        _payload = payload;
+        _used = 0;
+        _count = 0;
+        _run_pos = -1;
+    }
+
+    /**
+     * @brief Continua um payload ja gravado, refazendo o estado a partir dele.
+     * Fora do inicio de segmento o estado ja deve ter os blocos anteriores do
+     * segmento (decodificados com um ReportBlockDecoder no mesmo estado).
+     *
+     * @return false se o payload nao decodificar por inteiro
+     */
+    bool resume(uint8_t* payload, uint16_t used, uint16_t count, bool segment_start) {
+        ReportBlockDecoder decoder(_state);
+        report_record_t record;
+        uint16_t decoded = 0;
+
+        decoder.begin(payload, used, count, segment_start);
+        while (decoder.next(&record)) {
+            decoded++;
+        }
+        _payload = payload;
+        _used = used;
+        _count = count;
+        _run_pos = -1;
+        return decoded == count;
+    }
+
+    /**
+     * @brief Acrescenta o registro.
+     *
+     * @return false se ele nao couber no payload (o bloco esta cheio)
+     */
+    bool append(const report_record_t& record) {
+        uint8_t id = record.id;
+        uint16_t room = REPORT_V2_PAYLOAD_SIZE - _used;
+
+        if (!report_codec_is_known(_state, id) ||
+            _state->qtd_luminarias[id] != record.qtd_luminarias ||
+            _state->modelo_luminarias[id] != record.modelo_luminarias) {
+            if (room < REPORT_CODEC_NEW_SIZE) {
+                return false;
+            }
+            _payload[_used] = REPORT_CODEC_OP_NEW;
+            _payload[_used + 1] = id;
+            _payload[_used + 2] = record.qtd_luminarias;
+            _payload[_used + 3] = record.modelo_luminarias;
+            _payload[_used + 4] = record.pwm_value;
+            report_put_le32(_payload + _used + 5, record.unix_seconds);
+            _used += REPORT_CODEC_NEW_SIZE;
+            _run_pos = -1;
+        } else {
+            int32_t dod =
+                (int32_t)(record.unix_seconds - _state->unix_seconds[id] - _state->stride[id]);
+            uint32_t zigzag = report_zigzag_encode(dod);
+            bool predicted = id == report_codec_next_id(_state) &&
+                             record.pwm_value == _state->pwm[id];
+
+            if (predicted && dod == 0 && _run_pos >= 0 &&
+                _payload[_run_pos] < REPORT_CODEC_OP_RUN_MAX) {
+                _payload[_run_pos]++;
+            } else if (predicted && dod == 0) {
+                if (room < 1) {
+                    return false;
+                }
+                _run_pos = _used;
+                _payload[_used++] = 0;
+            } else if (predicted && zigzag <= REPORT_CODEC_OP_SMALL_MAX - REPORT_CODEC_OP_SMALL) {
+                if (room < 1) {
+                    return false;
+                }
+                _payload[_used++] = REPORT_CODEC_OP_SMALL + zigzag;
+                _run_pos = -1;
+            } else {
+                uint8_t varint[5];
+                uint8_t len = 0;
+                do {
+                    varint[len] = zigzag & 0x7F;
+                    zigzag >>= 7;
+                    if (zigzag) {
+                        varint[len] |= 0x80;
+                    }
+                    len++;
+                } while (zigzag);
+                if (room < 3 + len) {
+                    return false;
+                }
+                _payload[_used] = REPORT_CODEC_OP_FULL;
+                _payload[_used + 1] = id;
+                _payload[_used + 2] = record.pwm_value;
+                memcpy(_payload + _used + 3, varint, len);
+                _used += 3 + len;
+                _run_pos = -1;
+            }
+        }
+        report_codec_apply(_state, record);
+        _count++;
+        return true;
+    }
+
+    uint16_t used() const {
+        return _used;
+    }
+
+    uint16_t count() const {
+        return _count;
+    }
+};
+
+}  // namespace Wetzel
+#endif
@@ -2,15 +2,16 @@
 #define REPORT_DIRECT_MSG_HANDLER_LIGHTING_CONTROL_H_
 
 #include <esp_http_server.h>
-#include <string>
+
+#include "direct_msg_registry.h"
 
 namespace Wetzel {
 
 const uint8_t RTC_UPDATE_CODE = 7;
 const uint8_t REPORT_CONFIG_CODE = 8;
 
-esp_err_t msg_handler_rtc_update(char* msg);
-esp_err_t msg_handler_report_config(char* msg);
+esp_err_t msg_handler_rtc_update(const msg_arg_t* args, char* response, size_t response_size);
+esp_err_t msg_handler_report_config(const msg_arg_t* args, char* response, size_t response_size);
 }  // namespace Wetzel
 
 #endif
\ No newline at end of file
@@ -0,0 +1,132 @@
+#ifndef REPORT_FILE_WRITER_H_
+#define REPORT_FILE_WRITER_H_
+
+#include <esp_err.h>
+#include <freertos/FreeRTOS.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "configuration.h"
+#include "report_block_codec.h"
+#include "report_format.h"
+#include "sd_card_handler.h"
+
+namespace Wetzel {
+
+#define REPORT_INDEX_BUCKETS (24 * 60 / REPORT_INDEX_BUCKET_MINUTES)
+
+/**
+ * @brief Escritor do arquivo diario de relatorio (formato em report_format.h).
+ *
+ * Arquivos novos sao gravados na v2 (blocos comprimidos, report_block_codec.h);
+ * um arquivo v1 ja existente continua em v1.
+ *
+ * Acumula os registros no bloco de 512 bytes em RAM e so escreve no cartao
+ * blocos inteiros, com o arquivo aberto entre os flushes. Um bloco incompleto
+ * e gravado no seu lugar (e sincronizado) no commit, que acontece no maximo a
+ * cada REPORT_WRITER_COMMIT_PERIOD_MS: e o limite de perda em uma queda de
+ * energia. O mesmo bloco e regravado quando enche.
+ *
+ * Mantem tambem o indice de horario do cabecalho. O cabecalho e regravado
+ * antes do bloco que contem o primeiro registro de um novo bucket, entao apos
+ * uma queda o indice pode estar atrasado em relacao aos dados, nunca adiantado.
+ * O atraso e de no maximo um bucket, ja que o commit e mais frequente que os
+ * buckets (ReportReader::findWindow() tem essa folga).
+ *
+ * @note Usa o WRITING_FILE do CartaoSD; so a task de escrita deve chamar.
+ *
+ */
+class ReportFileWriter {
+   private:
+    CartaoSD* _card = NULL;
+    FILE* _file = NULL;
+    char _file_name[20];
+
+    uint8_t _block[REPORT_FORMAT_BLOCK_SIZE];
+    uint8_t _header[REPORT_FORMAT_HEADER_SIZE];
+
+    uint32_t _unix_day = 0;
+    uint32_t _index[REPORT_INDEX_BUCKETS];
+    bool _has_index = false;
+    bool _index_dirty = false;
+    // bucket do maior horario ja gravado, -1 se nenhum
+    int16_t _last_bucket = -1;
+
+    uint16_t _version = REPORT_FORMAT_VERSION;
+    // indice no arquivo do bloco em RAM
+    uint32_t _block_index = 0;
+    // v1: registros no bloco em RAM
+    uint8_t _count = 0;
+    // v2: numero do primeiro registro do bloco em RAM, se ele abre um segmento
+    // e o codificador (o estado dele vale para o segmento inteiro)
+    uint32_t _first_record = 0;
+    bool _segment_start = true;
+    report_codec_state_t _codec_state;
+    ReportBlockEncoder _encoder{&_codec_state};
+    // registros do bloco em RAM que ainda nao foram para o cartao
+    bool _pending = false;
+    // escrito sem fsync
+    bool _dirty = false;
+    TickType_t _last_commit = 0;
+
+    esp_err_t _write_block();
+    void _next_block();
+    esp_err_t _read_block(uint32_t block);
+    esp_err_t _recover(uint32_t unix_day);
+    esp_err_t _recover_plain(uint32_t blocks, bool* truncate_tail);
+    esp_err_t _recover_compressed(uint32_t blocks, bool* truncate_tail);
+    uint32_t _records() const;
+    bool _block_has_records() const;
+    esp_err_t _truncate(uint32_t size);
+    void _recover_index();
+    esp_err_t _write_header();
+
+   public:
+    ReportFileWriter() {}
+
+    esp_err_t begin(CartaoSD* card);
+
+    /**
+     * @brief Abre o arquivo para acrescentar registros. Se ele ja for o
+     * arquivo aberto nao faz nada; se for outro, faz commit e fecha o atual.
+     *
+     * Um arquivo novo recebe o cabecalho. Em um arquivo existente so o ultimo
+     * bloco e validado: bytes depois do ultimo bloco inteiro e um ultimo bloco
+     * com CRC invalido (escrita interrompida) sao truncados, e um ultimo bloco
+     * incompleto volta para a RAM para continuar sendo preenchido.
+     *
+     * @param file_name Nome relativo ao ponto de montagem ("/YYMMDD.rpt")
+     * @param unix_day Dia gravado no cabecalho
+     * @return esp_err_t ESP_ERR_INVALID_VERSION se o arquivo tiver outro formato
+     */
+    esp_err_t open(const char* file_name, uint32_t unix_day);
+
+    /**
+     * @brief Copia o registro para o bloco; escreve o bloco quando enche.
+     *
+     * @param record
+     * @return esp_err_t ESP_ERR_INVALID_STATE sem arquivo aberto
+     */
+    esp_err_t append(const report_record_t& record);
+
+    /**
+     * @brief Grava o bloco incompleto e sincroniza o arquivo (fsync).
+     *
+     * @return esp_err_t
+     */
+    esp_err_t commit();
+
+    /**
+     * @brief commit() se ja passou REPORT_WRITER_COMMIT_PERIOD_MS do ultimo.
+     *
+     * @return esp_err_t
+     */
+    esp_err_t commitIfDue();
+
+    esp_err_t close();
+
+    bool isOpen() const;
+};
+
+}  // namespace Wetzel
+#endif
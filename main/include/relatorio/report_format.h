@@ -0,0 +1,343 @@
+#ifndef REPORT_FORMAT_H_
+#define REPORT_FORMAT_H_
+
+/**
+ * Formato binario dos arquivos diarios de relatorio. Header-only e sem
+ * dependencias da IDF para poder ser usado por ferramentas de leitura.
+ *
+ * Multi-byte em little-endian. O arquivo e um cabecalho de 512 bytes seguido
+ * de blocos de 512 bytes, alinhados ao setor. A versao 1 grava os registros
+ * sem compressao; a versao 2 (report_block_codec.h) usa blocos comprimidos:
+ *
+ * Cabecalho: | "WRPT" | version (u16) | header_size (u16) | block_size (u16) |
+ *            | record_size (u16) | records_per_block (u16) | flags (u16) |
+ *            | unix_day (u32) | crc32 (u32) | zeros ate o byte 64 |
+ *            | indice (se flags tem REPORT_FORMAT_FLAG_TIME_INDEX) | zeros ate 512 |
+ *
+ * Indice:    | bucket_minutes (u16) | buckets (u16) | first_record (u32)[buckets] | crc32 (u32) |
+ *
+ * Bloco v1:  | "BL" | count (u8) | flags (u8) | crc32 (u32) | 63 registros |
+ *
+ * Bloco v2:  | "BC" | flags (u8) | reserved (u8) | crc32 (u32) | first_record (u32) |
+ *            | count (u16) | used (u16) | payload comprimido (496) |
+ *
+ * Registro:  | id (u8) | qtd_luminarias (u8) | modelo (u8) | pwm (u8) | unix_seconds (u32) |
+ *
+ * O CRC-32 (IEEE, reflexo, init e xor final 0xFFFFFFFF) do cabecalho cobre os
+ * 20 bytes anteriores a ele; o de um bloco v1 cobre os 4 primeiros bytes do
+ * bloco e os count registros usados. So o ultimo bloco do arquivo pode ter
+ * count menor que 63, entao na v1 o registro k fica em posicao fixa
+ * (report_record_offset). O de um bloco v2 cobre o cabecalho do bloco (menos o
+ * proprio CRC) e os used bytes do payload; first_record e o numero do primeiro
+ * registro do bloco no arquivo, o que permite achar o registro k por bisseccao.
+ * O estado do codec v2 recomeca a cada segmento de REPORT_V2_SEGMENT_BLOCKS
+ * blocos (flag REPORT_V2_FLAG_SEGMENT_START): para ler um bloco basta
+ * decodificar o segmento dele desde o inicio.
+ *
+ * O indice divide o dia em buckets de bucket_minutes e guarda, para cada um, o
+ * primeiro registro gravado com horario nesse bucket ou depois: nenhum
+ * registro antes dele e de um bucket posterior. Buckets ainda sem registro
+ * ficam com REPORT_INDEX_EMPTY. O indice tem CRC proprio porque e regravado
+ * no commit, e pode ficar atras dos dados apos uma queda de energia.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+namespace Wetzel {
+
+#define REPORT_FORMAT_VERSION_PLAIN     1
+#define REPORT_FORMAT_VERSION_COMPRESSED 2
+// versao usada nos arquivos novos
+#define REPORT_FORMAT_VERSION           REPORT_FORMAT_VERSION_COMPRESSED
+#define REPORT_FORMAT_HEADER_SIZE       512
+#define REPORT_FORMAT_BLOCK_SIZE        512
+#define REPORT_FORMAT_BLOCK_HEADER_SIZE 8
+#define REPORT_FORMAT_RECORD_SIZE       8
+#define REPORT_FORMAT_RECORDS_PER_BLOCK \
+    ((REPORT_FORMAT_BLOCK_SIZE - REPORT_FORMAT_BLOCK_HEADER_SIZE) / REPORT_FORMAT_RECORD_SIZE)
+#define REPORT_FORMAT_HEADER_CRC_OFFSET 20
+
+#define REPORT_V2_BLOCK_HEADER_SIZE     16
+#define REPORT_V2_PAYLOAD_SIZE          (REPORT_FORMAT_BLOCK_SIZE - REPORT_V2_BLOCK_HEADER_SIZE)
+// 16 KB, a unidade de alocacao do cartao
+#define REPORT_V2_SEGMENT_BLOCKS        32
+#define REPORT_V2_FLAG_SEGMENT_START    0x01
+
+#define REPORT_FORMAT_FLAG_TIME_INDEX   0x0001
+#define REPORT_INDEX_OFFSET             64
+#define REPORT_INDEX_MAX_BUCKETS        ((REPORT_FORMAT_HEADER_SIZE - REPORT_INDEX_OFFSET - 8) / 4)
+#define REPORT_INDEX_EMPTY              0xFFFFFFFF
+
+/**
+ * @brief Registro do arquivo diario (media de um dispositivo no minuto).
+ *
+ */
+typedef struct {
+    uint8_t id;
+    uint8_t qtd_luminarias;
+    uint8_t modelo_luminarias;
+    uint8_t pwm_value;
+    uint32_t unix_seconds;
+} report_record_t;
+
+static inline void report_put_le16(uint8_t* out, uint16_t value) {
+    out[0] = (uint8_t)(value & 0xFF);
+    out[1] = (uint8_t)(value >> 8);
+}
+
+static inline void report_put_le32(uint8_t* out, uint32_t value) {
+    out[0] = (uint8_t)(value & 0xFF);
+    out[1] = (uint8_t)(value >> 8);
+    out[2] = (uint8_t)(value >> 16);
+    out[3] = (uint8_t)(value >> 24);
+}
+
+static inline uint16_t report_get_le16(const uint8_t* in) {
+    return (uint16_t)(in[0] | (in[1] << 8));
+}
+
+static inline uint32_t report_get_le32(const uint8_t* in) {
+    return (uint32_t)in[0] | ((uint32_t)in[1] << 8) | ((uint32_t)in[2] << 16) |
+           ((uint32_t)in[3] << 24);
+}
+
+static inline uint32_t report_crc32_update(uint32_t crc, const uint8_t* data, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        crc ^= data[i];
+        for (uint8_t bit = 0; bit < 8; bit++) {
+            crc = (crc & 1) ? (crc >> 1) ^ 0xEDB88320 : crc >> 1;
+        }
+    }
+    return crc;
+}
+
+/**
+ * @brief Posicao do bloco no arquivo.
+ *
+ */
+static inline uint32_t report_block_offset(uint32_t block) {
+    return REPORT_FORMAT_HEADER_SIZE + block * REPORT_FORMAT_BLOCK_SIZE;
+}
+
+/**
+ * @brief Posicao do registro k (contado desde o inicio do arquivo).
+ *
+ */
+static inline uint32_t report_record_offset(uint32_t record) {
+    return report_block_offset(record / REPORT_FORMAT_RECORDS_PER_BLOCK) +
+           REPORT_FORMAT_BLOCK_HEADER_SIZE +
+           (record % REPORT_FORMAT_RECORDS_PER_BLOCK) * REPORT_FORMAT_RECORD_SIZE;
+}
+
+static inline void report_record_encode(uint8_t* out, const report_record_t& record) {
+    out[0] = record.id;
+    out[1] = record.qtd_luminarias;
+    out[2] = record.modelo_luminarias;
+    out[3] = record.pwm_value;
+    report_put_le32(out + 4, record.unix_seconds);
+}
+
+static inline void report_record_decode(const uint8_t* in, report_record_t* record) {
+    record->id = in[0];
+    record->qtd_luminarias = in[1];
+    record->modelo_luminarias = in[2];
+    record->pwm_value = in[3];
+    record->unix_seconds = report_get_le32(in + 4);
+}
+
+/**
+ * @brief Monta o cabecalho do arquivo em out (REPORT_FORMAT_HEADER_SIZE bytes).
+ *
+ */
+static inline void report_file_header_encode(uint8_t* out, uint16_t version, uint32_t unix_day,
+                                             uint16_t flags) {
+    memset(out, 0, REPORT_FORMAT_HEADER_SIZE);
+    memcpy(out, "WRPT", 4);
+    report_put_le16(out + 4, version);
+    report_put_le16(out + 6, REPORT_FORMAT_HEADER_SIZE);
+    report_put_le16(out + 8, REPORT_FORMAT_BLOCK_SIZE);
+    report_put_le16(out + 10, REPORT_FORMAT_RECORD_SIZE);
+    // na v2 o numero de registros por bloco varia
+    report_put_le16(out + 12, version == REPORT_FORMAT_VERSION_PLAIN
+                                  ? REPORT_FORMAT_RECORDS_PER_BLOCK
+                                  : 0);
+    report_put_le16(out + 14, flags);
+    report_put_le32(out + 16, unix_day);
+    uint32_t crc = ~report_crc32_update(0xFFFFFFFF, out, REPORT_FORMAT_HEADER_CRC_OFFSET);
+    report_put_le32(out + REPORT_FORMAT_HEADER_CRC_OFFSET, crc);
+}
+
+static inline uint16_t report_file_header_version(const uint8_t* in) {
+    return report_get_le16(in + 4);
+}
+
+/**
+ * @brief Confere assinatura, CRC e se a geometria e a de uma versao conhecida.
+ *
+ */
+static inline bool report_file_header_valid(const uint8_t* in) {
+    uint32_t crc = ~report_crc32_update(0xFFFFFFFF, in, REPORT_FORMAT_HEADER_CRC_OFFSET);
+    uint16_t version = report_file_header_version(in);
+    return memcmp(in, "WRPT", 4) == 0 &&
+           report_get_le32(in + REPORT_FORMAT_HEADER_CRC_OFFSET) == crc &&
+           (version == REPORT_FORMAT_VERSION_PLAIN || version == REPORT_FORMAT_VERSION_COMPRESSED) &&
+           report_get_le16(in + 6) == REPORT_FORMAT_HEADER_SIZE &&
+           report_get_le16(in + 8) == REPORT_FORMAT_BLOCK_SIZE &&
+           report_get_le16(in + 10) == REPORT_FORMAT_RECORD_SIZE &&
+           report_get_le16(in + 12) == (version == REPORT_FORMAT_VERSION_PLAIN
+                                            ? REPORT_FORMAT_RECORDS_PER_BLOCK
+                                            : 0);
+}
+
+static inline uint16_t report_file_header_flags(const uint8_t* in) {
+    return report_get_le16(in + 14);
+}
+
+static inline uint32_t report_file_header_unix_day(const uint8_t* in) {
+    return report_get_le32(in + 16);
+}
+
+/**
+ * @brief Grava o indice na area dele dentro do cabecalho.
+ *
+ */
+static inline void report_index_encode(uint8_t* header, uint16_t bucket_minutes,
+                                       const uint32_t* first_record, uint16_t buckets) {
+    uint8_t* out = header + REPORT_INDEX_OFFSET;
+    report_put_le16(out, bucket_minutes);
+    report_put_le16(out + 2, buckets);
+    for (uint16_t i = 0; i < buckets; i++) {
+        report_put_le32(out + 4 + 4 * i, first_record[i]);
+    }
+    uint32_t crc = ~report_crc32_update(0xFFFFFFFF, out, 4 + 4 * buckets);
+    report_put_le32(out + 4 + 4 * buckets, crc);
+}
+
+/**
+ * @brief Le o indice do cabecalho (ja validado).
+ *
+ * @return int Numero de buckets, ou -1 se o arquivo nao tiver indice ou o CRC
+ * do indice nao conferir
+ */
+static inline int report_index_decode(const uint8_t* header, uint16_t* bucket_minutes,
+                                      uint32_t* first_record, uint16_t max_buckets) {
+    const uint8_t* in = header + REPORT_INDEX_OFFSET;
+    uint16_t buckets = report_get_le16(in + 2);
+    if (!(report_file_header_flags(header) & REPORT_FORMAT_FLAG_TIME_INDEX) || buckets == 0 ||
+        buckets > max_buckets || buckets > REPORT_INDEX_MAX_BUCKETS || report_get_le16(in) == 0 ||
+        report_get_le32(in + 4 + 4 * buckets) != ~report_crc32_update(0xFFFFFFFF, in, 4 + 4 * buckets)) {
+        return -1;
+    }
+    *bucket_minutes = report_get_le16(in);
+    for (uint16_t i = 0; i < buckets; i++) {
+        first_record[i] = report_get_le32(in + 4 + 4 * i);
+    }
+    return buckets;
+}
+
+/**
+ * @brief Bucket do horario, limitado ao dia do arquivo (registros de um ciclo
+ * que comecou no dia anterior caem no primeiro bucket).
+ *
+ */
+static inline uint16_t report_index_bucket(uint32_t unix_day, uint16_t bucket_minutes,
+                                           uint16_t buckets, uint32_t unix_seconds) {
+    uint32_t day_start = unix_day * 86400UL;
+    if (unix_seconds < day_start) {
+        return 0;
+    }
+    uint32_t bucket = (unix_seconds - day_start) / (bucket_minutes * 60UL);
+    return bucket < buckets ? bucket : buckets - 1;
+}
+
+static inline uint8_t* report_block_record(uint8_t* block, uint8_t index) {
+    return block + REPORT_FORMAT_BLOCK_HEADER_SIZE + index * REPORT_FORMAT_RECORD_SIZE;
+}
+
+static inline uint32_t report_block_crc(const uint8_t* block, uint8_t count) {
+    uint32_t crc = report_crc32_update(0xFFFFFFFF, block, 4);
+    crc = report_crc32_update(crc, block + REPORT_FORMAT_BLOCK_HEADER_SIZE,
+                              count * REPORT_FORMAT_RECORD_SIZE);
+    return ~crc;
+}
+
+/**
+ * @brief Preenche o cabecalho do bloco (os registros ja devem estar no lugar).
+ *
+ */
+static inline void report_block_seal(uint8_t* block, uint8_t count) {
+    block[0] = 'B';
+    block[1] = 'L';
+    block[2] = count;
+    block[3] = 0;
+    report_put_le32(block + 4, report_block_crc(block, count));
+}
+
+/**
+ * @brief Valida o bloco.
+ *
+ * @return int Registros no bloco, ou -1 se o bloco estiver corrompido
+ */
+static inline int report_block_count(const uint8_t* block) {
+    uint8_t count = block[2];
+    if (block[0] != 'B' || block[1] != 'L' || count == 0 ||
+        count > REPORT_FORMAT_RECORDS_PER_BLOCK ||
+        report_get_le32(block + 4) != report_block_crc(block, count)) {
+        return -1;
+    }
+    return count;
+}
+
+static inline uint32_t report_v2_block_crc(const uint8_t* block, uint16_t used) {
+    uint32_t crc = report_crc32_update(0xFFFFFFFF, block, 4);
+    crc = report_crc32_update(crc, block + 8, REPORT_V2_BLOCK_HEADER_SIZE - 8 + used);
+    return ~crc;
+}
+
+/**
+ * @brief Preenche o cabecalho do bloco v2 (o payload ja deve estar no lugar).
+ *
+ */
+static inline void report_v2_block_seal(uint8_t* block, uint8_t flags, uint32_t first_record,
+                                        uint16_t count, uint16_t used) {
+    block[0] = 'B';
+    block[1] = 'C';
+    block[2] = flags;
+    block[3] = 0;
+    report_put_le32(block + 8, first_record);
+    report_put_le16(block + 12, count);
+    report_put_le16(block + 14, used);
+    report_put_le32(block + 4, report_v2_block_crc(block, used));
+}
+
+static inline uint32_t report_v2_block_first_record(const uint8_t* block) {
+    return report_get_le32(block + 8);
+}
+
+static inline bool report_v2_block_segment_start(const uint8_t* block) {
+    return block[2] & REPORT_V2_FLAG_SEGMENT_START;
+}
+
+static inline uint16_t report_v2_block_used(const uint8_t* block) {
+    return report_get_le16(block + 14);
+}
+
+/**
+ * @brief Valida o bloco v2.
+ *
+ * @return int32_t Registros no bloco, ou -1 se o bloco estiver corrompido
+ */
+static inline int32_t report_v2_block_count(const uint8_t* block) {
+    uint16_t count = report_get_le16(block + 12);
+    uint16_t used = report_v2_block_used(block);
+    if (block[0] != 'B' || block[1] != 'C' || count == 0 || used == 0 ||
+        used > REPORT_V2_PAYLOAD_SIZE || report_get_le32(block + 4) != report_v2_block_crc(block, used)) {
+        return -1;
+    }
+    return count;
+}
+
+}  // namespace Wetzel
+#endif
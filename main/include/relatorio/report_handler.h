@@ -3,49 +3,50 @@
 
 #include <freertos/FreeRTOS.h>
 #include <freertos/semphr.h>
-#include <map>
-#include <queue>
-
+#include "configuration.h"
+#include "device_registry.h"
 #include "real_time_clock.h"
+#include "report_file_writer.h"
+#include "report_rollup_writer.h"
 #include "sd_card_handler.h"
+#include "spsc_ring.h"
 
 namespace Wetzel {
 
-typedef enum { LUM_17K, LUM_23K, LUM_32K } luminaria_type_catalog_t;
-typedef uint8_t luminaria_type_t;
-
-typedef std::vector<uint8_t> device_mac_t;
-
 // typedef uint8_t device_id_t;
 
-typedef struct {
-    char msg[18];
+/**
+ * @brief Report de uma luminaria ja decodificado do frame da UART
+ * (texto "MACMACMACMAC,pwm" ou par binario de um REPORT_BATCH).
+ * 
+ */
+typedef struct __attribute__((packed)) {
+    uint8_t mac[6];
+    uint8_t pwm_value;
 } report_msg_entry_t;
 
-typedef struct {
-    uint8_t id;
-    uint8_t qtd_luminarias;
-    luminaria_type_t modelo_luminarias;
-} device_report_info_t;
+#define REPORT_DEVICE_BITMAP_WORDS ((REPORT_MAX_DEVICES + 31) / 32)
 
 /**
- * @brief Estrutura auxiliar para fazer amostragem de reports a cada 1minuto
+ * @brief Amostragem de reports a cada 1 minuto, um campo por array indexado
+ * pelo id do dispositivo (ids densos, dados pelo DeviceRegistry).
  * 
  */
 typedef struct {
-    uint8_t last_average_pwm;
-    uint8_t average_pwm;
-    uint8_t pwm_i;
-    uint8_t pwm_i_1;
-    uint32_t t_i;
-    uint32_t t_i_1;
-    uint32_t t_0;
-    uint8_t n_lum;
-    luminaria_type_t lum_type;
-    bool is_new_param;
-} report_sampling_param_t;
-
-typedef std::map<device_mac_t, device_report_info_t> device_report_info_map_t;
+    uint8_t last_average_pwm[REPORT_MAX_DEVICES];
+    uint8_t average_pwm[REPORT_MAX_DEVICES];
+    uint8_t pwm_i[REPORT_MAX_DEVICES];
+    uint8_t pwm_i_1[REPORT_MAX_DEVICES];
+    uint32_t t_i[REPORT_MAX_DEVICES];
+    uint32_t t_i_1[REPORT_MAX_DEVICES];
+    uint32_t t_0[REPORT_MAX_DEVICES];
+    uint8_t n_lum[REPORT_MAX_DEVICES];
+    luminaria_type_t lum_type[REPORT_MAX_DEVICES];
+    // ids que ja reportaram alguma vez
+    uint32_t known[REPORT_DEVICE_BITMAP_WORDS];
+    // ids com report no ciclo atual (gravados no proximo flush)
+    uint32_t changed[REPORT_DEVICE_BITMAP_WORDS];
+} report_sampling_state_t;
 
 typedef struct report_entry_t {
     device_report_info_t device_info;
@@ -53,7 +54,8 @@ typedef struct report_entry_t {
     uint32_t unix_seconds;
 };
 
-uint8_t calculate_average_pwm(report_sampling_param_t param);
+uint8_t calculate_average_pwm(uint8_t last_average_pwm, uint8_t pwm_i, uint8_t pwm_i_1, uint32_t t_0,
+                              uint32_t t_i, uint32_t t_i_1);
 
 class ReportHandler {
    private:
@@ -64,39 +66,66 @@ class ReportHandler {
     static CartaoSD* _card;
     static RealTimeClock* _rtc;
 
-    static FILE* _writing_file;
-    static FILE* _reading_file;
-
-    static std::queue<report_entry_t> _writing_buffer;
-    static std::queue<report_entry_t> _reading_buffer;
-    static std::queue<report_msg_entry_t> _report_msg_buffer;
+    static ReportFileWriter _writer;
+    static ReportRollupWriter _rollup;
 
-    static SemaphoreHandle_t _writing_queue_mutex;
-    static SemaphoreHandle_t _reading_queue_mutex;
-    static SemaphoreHandle_t _report_msg_queue_mutex;
-    static SemaphoreHandle_t _device_info_map_mutex;
+    // produtor: uart_rx_task | consumidor: report_entry_task
+    static SpscRing<report_msg_entry_t, REPORT_MSG_RING_SIZE> _report_msg_buffer;
+    // produtor: report_entry_task | consumidor: writing_file_task
+    static SpscRing<report_entry_t, REPORT_WRITING_RING_SIZE> _writing_buffer;
 
     static TaskHandle_t writing_file_handle;
+    static TaskHandle_t report_entry_handle;
 
+    // dia (unixDay) do arquivo aberto no _writer, -1 se nenhum
     static int _current_file_unix_day;
 
-    static device_report_info_map_t _mapa_de_info_de_devices;
+    static DeviceRegistry _devices;
+    static report_sampling_state_t _sampling;
+
     static void writing_file_handler(void* arg);
+    static void _sample_report_entry(const report_entry_t& report_entry);
+    static esp_err_t _write_changed_entries();
+    static esp_err_t _open_day_file(uint16_t unix_day);
     static void report_entry_handler(void* arg);
 
-    static esp_err_t createFileName(char* file_name, uint16_t year, uint8_t month, uint8_t day,
-                                    char* extension);
-
    public:
     ~ReportHandler();
 
     static ReportHandler* getInstance();
     esp_err_t begin();
 
+    static esp_err_t createFileName(char* file_name, uint16_t year, uint8_t month, uint8_t day,
+                                    const char* extension);
+    /**
+     * @brief Nome do arquivo de rollup do nivel que contem o dia: YYMMDD para
+     * horas, YYMM para dias e YY para meses.
+     *
+     * @param file_name
+     * @param tier
+     * @param unix_day
+     * @return esp_err_t
+     */
+    static esp_err_t createRollupFileName(char* file_name, report_rollup_tier_t tier,
+                                          uint16_t unix_day);
+
     static esp_err_t add_report_to_writing_buffer(report_entry_t& report);
     static esp_err_t add_entry_to_report_msg_buffer(report_msg_entry_t& report_msg);
-    static esp_err_t add_device_to_report_info_map(device_mac_t mac, uint8_t qtd_luminarias,
+    /**
+     * @brief Decodifica "MACMACMACMAC,pwm" direto dos bytes do frame, sem
+     * copia e sem sscanf.
+     * 
+     * @param msg Inicio do MAC no frame (nao precisa terminar em '\0')
+     * @param len Bytes disponiveis
+     * @param report_msg 
+     * @return esp_err_t 
+     */
+    static esp_err_t parse_report_msg(const char* msg, size_t len, report_msg_entry_t* report_msg);
+    static esp_err_t add_device_to_report_info_map(const uint8_t mac[6], uint8_t qtd_luminarias,
                                                    luminaria_type_t modelo_luminarias);
+
+    static ring_stats_t reportMsgQueueStats();
+    static ring_stats_t writingQueueStats();
 };
 
 }  // namespace Wetzel
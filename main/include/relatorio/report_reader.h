@@ -0,0 +1,189 @@
+#ifndef REPORT_READER_H_
+#define REPORT_READER_H_
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+
+#include "configuration.h"
+#include "report_block_codec.h"
+#include "report_format.h"
+#include "report_rollup.h"
+#include "sd_card_handler.h"
+
+namespace Wetzel {
+
+/**
+ * @brief Arquivo diario que faz parte de um download.
+ *
+ */
+typedef struct {
+    char name[16];
+    uint32_t size;
+} report_file_t;
+
+/**
+ * @brief Leitura sequencial dos arquivos diarios de relatorio, tratados como
+ * um unico stream de bytes. Enquanto um bloco e enviado, a task de leitura ja
+ * busca o proximo no SD no outro buffer.
+ *
+ * @note Um leitor por vez; usa o FILE de leitura do CartaoSD.
+ */
+class ReportReader {
+   private:
+    ReportReader();
+
+    static ReportReader* _instance;
+    static CartaoSD* _card;
+
+    static SemaphoreHandle_t _lock;
+    static QueueHandle_t _prefetch_requests;
+    static QueueHandle_t _prefetch_results;
+
+    static report_file_t _files[REPORT_DOWNLOAD_MAX_DAYS];
+    static uint8_t _file_count;
+    static uint8_t _file_index;
+    static bool _file_is_open;
+    static uint32_t _file_offset;
+    static uint32_t _total_size;
+    static uint32_t _remaining;
+
+    static uint8_t _record_block[REPORT_FORMAT_BLOCK_SIZE];
+    static uint32_t _index[REPORT_INDEX_MAX_BUCKETS];
+    static report_codec_state_t _codec_state;
+
+    static char* _buffers[2];
+    static size_t _block_size;
+    static uint8_t _next_buffer;
+    static bool _pending;
+
+    static void prefetch_handler(void* arg);
+    static int32_t _read_chain(char* buffer, size_t len);
+    static void _request_block();
+    static esp_err_t _read_plain(FILE* f, const char* name, uint32_t first,
+                                 report_record_t* records, uint16_t max_records, uint16_t* count);
+    static esp_err_t _read_compressed(FILE* f, const char* name, uint32_t first,
+                                      report_record_t* records, uint16_t max_records,
+                                      uint16_t* count);
+
+   public:
+    ~ReportReader();
+
+    static ReportReader* getInstance();
+    esp_err_t begin();
+
+    /**
+     * @brief Reserva o leitor e lista os arquivos existentes entre os dois
+     * dias (inclusive). Dias sem arquivo sao pulados.
+     *
+     * @param first_day Dia UNIX inicial
+     * @param last_day Dia UNIX final
+     * @param buffer_a
+     * @param buffer_b Buffers usados alternadamente na leitura
+     * @param buffer_size
+     * @return esp_err_t ESP_ERR_INVALID_STATE se outro download estiver em
+     * andamento, ESP_ERR_NOT_FOUND se nenhum arquivo existir
+     */
+    static esp_err_t open(int32_t first_day, int32_t last_day, char* buffer_a, char* buffer_b,
+                          size_t buffer_size);
+
+    /**
+     * @brief Soma dos tamanhos dos arquivos do download.
+     *
+     * @return uint32_t
+     */
+    static uint32_t totalSize();
+
+    /**
+     * @brief Limita a leitura a [offset, offset + length). Usado pelo Range do
+     * HTTP para retomar um download interrompido.
+     *
+     * @param offset
+     * @param length
+     * @return esp_err_t
+     */
+    static esp_err_t seek(uint32_t offset, uint32_t length);
+
+    /**
+     * @brief Proximo bloco do stream. O ponteiro vale ate a proxima chamada.
+     *
+     * @param data
+     * @return int32_t Bytes no bloco, 0 no fim, negativo em erro de leitura
+     */
+    static int32_t read(const char** data);
+
+    /**
+     * @brief Fecha o arquivo e libera o leitor.
+     *
+     */
+    static void close();
+
+    /**
+     * @brief Le registros de um arquivo diario a partir do registro first,
+     * indo direto ao bloco dele (sem varrer o arquivo; na v2, a partir do
+     * inicio do segmento do bloco). Cada bloco lido tem o
+     * CRC conferido; a leitura para no fim do arquivo ou no primeiro bloco
+     * invalido depois de registros lidos (o ultimo pode estar sendo
+     * regravado). Na v2, se first nao decodifica mais (esta em um segmento
+     * com bloco invalido), a leitura comeca no segmento seguinte.
+     *
+     * @param unix_day
+     * @param first Indice do primeiro registro no arquivo
+     * @param records
+     * @param max_records
+     * @param count Registros lidos
+     * @return esp_err_t ESP_ERR_INVALID_STATE se um download estiver em
+     * andamento, ESP_ERR_NOT_FOUND sem arquivo, ESP_ERR_INVALID_VERSION se o
+     * cabecalho nao for desta versao
+     */
+    static esp_err_t readRecords(int32_t unix_day, uint32_t first, report_record_t* records,
+                                 uint16_t max_records, uint16_t* count);
+
+    /**
+     * @brief Usa o indice do cabecalho para achar os registros de uma janela
+     * de horario, sem ler os dados. Depois e so chamar readRecords() a partir
+     * de first_record e filtrar pelo horario ate end_record.
+     *
+     * Todo registro com horario dentro de [from, to] esta entre first_record e
+     * end_record. A janela tem um bucket de folga de cada lado: o indice pode
+     * ter ficado um bucket atras dos dados apos uma queda de energia, e o
+     * horario de um registro fica ate dois periodos de gravacao atras do maior
+     * ja gravado (um registro adiado por falha de gravacao pode ficar fora).
+     * Sem indice valido a janela e o arquivo inteiro.
+     *
+     * @param unix_day
+     * @param from Inicio da janela (unix seconds)
+     * @param to Fim da janela (unix seconds, inclusive)
+     * @param first_record
+     * @param end_record REPORT_INDEX_EMPTY se a janela vai ate o fim do arquivo
+     * @return esp_err_t ESP_ERR_INVALID_STATE se um download estiver em
+     * andamento, ESP_ERR_NOT_FOUND sem arquivo, ESP_ERR_INVALID_VERSION se o
+     * cabecalho nao for desta versao
+     */
+    static esp_err_t findWindow(int32_t unix_day, uint32_t from, uint32_t to,
+                                uint32_t* first_record, uint32_t* end_record);
+
+    /**
+     * @brief Le linhas de um arquivo de rollup (report_rollup.h) a partir da
+     * linha first. Um mes inteiro sao as linhas diarias do arquivo do mes, um
+     * ano as mensais do arquivo do ano. Linhas com CRC invalido sao puladas.
+     *
+     * @param tier
+     * @param unix_day Qualquer dia do periodo do arquivo (dia, mes ou ano)
+     * @param first Indice da primeira linha no arquivo
+     * @param rows
+     * @param max_rows
+     * @param count Linhas lidas
+     * @return esp_err_t ESP_ERR_INVALID_STATE se um download estiver em
+     * andamento, ESP_ERR_NOT_FOUND sem arquivo
+     */
+    static esp_err_t readRollups(report_rollup_tier_t tier, int32_t unix_day, uint32_t first,
+                                 report_rollup_row_t* rows, uint16_t max_rows, uint16_t* count);
+
+    static int32_t unixDayFromDate(uint16_t year, uint8_t month, uint8_t day);
+    static void dateFromUnixDay(int32_t unix_day, uint16_t* year, uint8_t* month, uint8_t* day);
+};
+
+}  // namespace Wetzel
+#endif
@@ -0,0 +1,97 @@
+#ifndef REPORT_ROLLUP_H_
+#define REPORT_ROLLUP_H_
+
+/**
+ * Formato binario dos arquivos de rollup (agregados por dispositivo).
+ * Header-only e sem dependencias da IDF, como report_format.h.
+ *
+ * Cada nivel tem um arquivo pequeno, so com linhas de tamanho fixo, em ordem
+ * de periodo:
+ *
+ * Hora:  um arquivo por dia (YYMMDD), uma linha por dispositivo e hora
+ * Dia:   um arquivo por mes (YYMM), uma linha por dispositivo e dia
+ * Mes:   um arquivo por ano (YY), uma linha por dispositivo e mes
+ *
+ * Linha: | period_start (u32) | id (u8) | tier (u8) | samples (u16) |
+ *        | covered_seconds (u32) | on_seconds (u32) | pwm_seconds (u32) | crc32 (u32) |
+ *
+ * pwm_seconds e a soma de pwm * segundos: a media ponderada no tempo e
+ * pwm_seconds / covered_seconds. on_seconds e o tempo com pwm maior que zero.
+ * O CRC-32 (o mesmo de report_format.h) cobre os 20 bytes anteriores.
+ *
+ * Um periodo pode ter mais de uma linha do mesmo dispositivo (a hora em que o
+ * equipamento reiniciou e gravada em duas partes): quem le soma as linhas.
+ */
+
+#include <stdint.h>
+
+#include "report_format.h"
+
+namespace Wetzel {
+
+#define REPORT_ROLLUP_ROW_SIZE      24
+#define REPORT_ROLLUP_CRC_OFFSET    20
+
+typedef enum {
+    REPORT_ROLLUP_HOUR = 1,
+    REPORT_ROLLUP_DAY = 2,
+    REPORT_ROLLUP_MONTH = 3,
+} report_rollup_tier_t;
+
+/**
+ * @brief Agregado de um dispositivo em uma hora, dia ou mes.
+ *
+ */
+typedef struct {
+    uint32_t period_start;
+    uint8_t id;
+    uint8_t tier;
+    uint16_t samples;
+    uint32_t covered_seconds;
+    uint32_t on_seconds;
+    uint32_t pwm_seconds;
+} report_rollup_row_t;
+
+static inline void report_rollup_row_encode(uint8_t* out, const report_rollup_row_t& row) {
+    report_put_le32(out, row.period_start);
+    out[4] = row.id;
+    out[5] = row.tier;
+    report_put_le16(out + 6, row.samples);
+    report_put_le32(out + 8, row.covered_seconds);
+    report_put_le32(out + 12, row.on_seconds);
+    report_put_le32(out + 16, row.pwm_seconds);
+    report_put_le32(out + REPORT_ROLLUP_CRC_OFFSET,
+                    ~report_crc32_update(0xFFFFFFFF, out, REPORT_ROLLUP_CRC_OFFSET));
+}
+
+/**
+ * @return false se o CRC nao conferir
+ */
+static inline bool report_rollup_row_decode(const uint8_t* in, report_rollup_row_t* row) {
+    if (report_get_le32(in + REPORT_ROLLUP_CRC_OFFSET) !=
+        ~report_crc32_update(0xFFFFFFFF, in, REPORT_ROLLUP_CRC_OFFSET)) {
+        return false;
+    }
+    row->period_start = report_get_le32(in);
+    row->id = in[4];
+    row->tier = in[5];
+    row->samples = report_get_le16(in + 6);
+    row->covered_seconds = report_get_le32(in + 8);
+    row->on_seconds = report_get_le32(in + 12);
+    row->pwm_seconds = report_get_le32(in + 16);
+    return true;
+}
+
+/**
+ * @brief Media do pwm ponderada no tempo.
+ *
+ */
+static inline uint8_t report_rollup_mean_pwm(const report_rollup_row_t& row) {
+    if (row.covered_seconds == 0) {
+        return 0;
+    }
+    return (row.pwm_seconds + row.covered_seconds / 2) / row.covered_seconds;
+}
+
+}  // namespace Wetzel
+#endif
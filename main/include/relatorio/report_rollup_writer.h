@@ -0,0 +1,103 @@
+#ifndef REPORT_ROLLUP_WRITER_H_
+#define REPORT_ROLLUP_WRITER_H_
+
+#include <esp_err.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "configuration.h"
+#include "report_rollup.h"
+#include "sd_card_handler.h"
+
+namespace Wetzel {
+
+#define REPORT_ROLLUP_BITMAP_WORDS ((REPORT_MAX_DEVICES + 31) / 32)
+// linhas lidas ou gravadas de uma vez (cabem em um setor)
+#define REPORT_ROLLUP_IO_ROWS (REPORT_FORMAT_BLOCK_SIZE / REPORT_ROLLUP_ROW_SIZE)
+
+/**
+ * @brief Somas por dispositivo de um periodo, um campo por array indexado
+ * pelo id.
+ *
+ */
+typedef struct {
+    uint32_t covered_seconds[REPORT_MAX_DEVICES];
+    uint32_t on_seconds[REPORT_MAX_DEVICES];
+    uint32_t pwm_seconds[REPORT_MAX_DEVICES];
+    uint16_t samples[REPORT_MAX_DEVICES];
+    // ids com alguma amostra no periodo
+    uint32_t active[REPORT_ROLLUP_BITMAP_WORDS];
+} report_rollup_sums_t;
+
+/**
+ * @brief Mantem os rollups por hora, dia e mes (formato em report_rollup.h)
+ * enquanto os registros do minuto sao gravados.
+ *
+ * So a hora corrente fica em RAM. Na virada da hora as linhas dela sao
+ * acrescentadas ao arquivo de horas do dia; na virada do dia as linhas do dia
+ * saem da soma do arquivo de horas, e na do mes as do mes saem da soma do
+ * arquivo de dias. Os niveis de cima nao dependem de estado em RAM: um
+ * reinicio perde no maximo a hora corrente (que continua no arquivo diario).
+ * O fechamento de um dia ou mes nao e repetido se o arquivo de cima ja tiver
+ * linhas dele.
+ *
+ * @note Usa o ROLLUP_FILE do CartaoSD; o arquivo do dia continua aberto no
+ * WRITING_FILE.
+ *
+ */
+class ReportRollupWriter {
+   private:
+    CartaoSD* _card = NULL;
+    report_rollup_sums_t _sums;
+    // inicio da hora acumulada em _sums
+    uint32_t _hour_start = 0;
+
+    uint8_t _rows[REPORT_ROLLUP_IO_ROWS * REPORT_ROLLUP_ROW_SIZE];
+
+    void _clear();
+    void _sum_row(const report_rollup_row_t& row);
+    esp_err_t _sum_file(const char* name, uint32_t from, uint32_t to);
+    esp_err_t _append_rows(const char* name, report_rollup_tier_t tier, uint32_t period_start);
+    int64_t _last_period(const char* name);
+    esp_err_t _close_day(uint16_t unix_day);
+    esp_err_t _close_month(uint16_t unix_day);
+
+   public:
+    /**
+     * @brief Comeca a hora atual e fecha o dia anterior, se ele ainda nao foi
+     * fechado (equipamento desligado na virada do dia).
+     *
+     * @param card
+     * @param unix_seconds Horario atual
+     * @return esp_err_t
+     */
+    esp_err_t begin(CartaoSD* card, uint32_t unix_seconds);
+
+    /**
+     * @brief Soma um registro do minuto na hora corrente.
+     *
+     * @param id
+     * @param pwm_value Media do pwm no intervalo
+     * @param seconds Duracao do intervalo
+     */
+    void add(uint8_t id, uint8_t pwm_value, uint32_t seconds);
+
+    /**
+     * @brief A hora acumulada ja terminou.
+     *
+     * @param unix_seconds Horario atual
+     */
+    bool hourDue(uint32_t unix_seconds) const;
+
+    /**
+     * @brief Grava a hora acumulada e fecha o dia e o mes dela se eles
+     * terminaram.
+     *
+     * @param unix_seconds Horario atual; comeca a nova hora
+     * @return esp_err_t
+     */
+    esp_err_t closeHour(uint32_t unix_seconds);
+};
+
+}  // namespace Wetzel
+#endif
@@ -1,11 +1,19 @@
 #ifndef WETZEL_SERVER_HTTP_UTILITIES_H_
 #define WETZEL_SERVER_HTTP_UTILITIES_H_
 
+#include <stddef.h>
+
 namespace Wetzel {
 
-void convert_html_text_to_ascii(char* string);
-void convert_html_symbol(char* string, const char* code, char caracter);
-void convert_html_spaces(char* string);
+/**
+ * @brief Decodifica, no proprio buffer e em uma unica passada, os escapes de
+ * URL (%XX) e o '+' (espaco) de um parametro de query string. Sequencias %
+ * invalidas sao mantidas como estao.
+ * 
+ * @param string 
+ * @return size_t Tamanho da string decodificada
+ */
+size_t convert_html_text_to_ascii(char* string);
 
 };  // namespace Wetzel
-#endif
\ No newline at end of file
+#endif
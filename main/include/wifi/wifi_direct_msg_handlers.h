@@ -2,7 +2,8 @@
 #define DIRECT_MSG_HANDLER_LIGHTING_CONTROL_H_
 
 #include <esp_http_server.h>
-#include <string>
+
+#include "direct_msg_registry.h"
 
 namespace Wetzel {
 
@@ -13,12 +14,12 @@ const uint8_t WIFI_GET_SSID_LIST_CODE = 4;
 const uint8_t WIFI_AP_VALIDATE_CREDENTIALS_CODE = 5;
 const uint8_t INTERFACE_INFO_REQUEST_CODE = 6;
 
-esp_err_t msg_handler_wifi_mode_change(char* msg);
-esp_err_t msg_handler_wifi_ap_config_change(char* msg);
-esp_err_t msg_handler_wifi_sta_config_change(char* msg);
-esp_err_t msg_handler_get_ssid_list(char* msg);
-esp_err_t msg_handler_interface_info_requested(char* response);
-esp_err_t msg_handler_validate_ap_credentials(char* msg);
+esp_err_t msg_handler_wifi_mode_change(const msg_arg_t* args, char* response, size_t response_size);
+esp_err_t msg_handler_wifi_ap_config_change(const msg_arg_t* args, char* response, size_t response_size);
+esp_err_t msg_handler_wifi_sta_config_change(const msg_arg_t* args, char* response, size_t response_size);
+esp_err_t msg_handler_get_ssid_list(const msg_arg_t* args, char* response, size_t response_size);
+esp_err_t msg_handler_interface_info_requested(const msg_arg_t* args, char* response, size_t response_size);
+esp_err_t msg_handler_validate_ap_credentials(const msg_arg_t* args, char* response, size_t response_size);
 
 }  // namespace Wetzel
 
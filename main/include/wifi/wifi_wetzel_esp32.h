@@ -51,7 +51,7 @@ class WiFi {
     wifi_config_t default_ap_config();
     wifi_config_t default_sta_config();
 
-    esp_err_t sta_ip_configuration(char* ip, char* mask, char* gateway);
+    esp_err_t sta_ip_configuration(const char* ip, const char* mask, const char* gateway);
     esp_err_t sta_ip_configuration(uint8_t* ip, uint8_t* mask,
                                    uint8_t* gateway);
     esp_err_t sta_ip_configuration(ipv4_information_t ipv4_info);
@@ -1,18 +1,18 @@
 #include "async_server.h"
 
-#include <HardwareSerial.h>
 #include <IPAddress.h>
-#include <driver/uart.h>
 #include <errno.h>
+#include <esp_timer.h>
 #include <freertos/portmacro.h>
 #include <sys\stat.h>
+#include <unistd.h>
 
 #include "debug.h"
+#include "direct_msg_registry.h"
 #include "macros.h"
-#include "report_direct_msg_handlers.h"
 #include "report_handler.h"
+#include "report_reader.h"
 #include "server_html_utils.h"
-#include "wifi_direct_msg_handlers.h"
 #include "wifi_event_listener.h"
 #include "wifi_wetzel_esp32.h"
 
@@ -23,19 +23,45 @@ static const char* TAG = __FILE__;
 
 bool AsyncServer::_read_report_task_block = false;
 bool AsyncServer::_msg_received = false;
-char AsyncServer::_msg[ASYNC_SRV_MSG_LENGTH];
 bool AsyncServer::_client_is_connected = false;
 uint8_t AsyncServer::_reset_counter = 0;
 SemaphoreHandle_t AsyncServer::_uart_mutex;
 bool AsyncServer::_http_request = false;
-char AsyncServer::_last_ssid[33] = "";
-Wifi_Status AsyncServer::_last_status = Wifi_Status::WIFI_NOT_CONNECTED;
-char AsyncServer::_last_password[65] = "";
-bool AsyncServer::_waiting_for_ans = false;
+mesh_status_t AsyncServer::_mesh_shadow = {Wifi_Status::WIFI_NOT_CONNECTED, "", 0};
+bool AsyncServer::_mesh_shadow_valid = false;
+uint32_t AsyncServer::_mesh_shadow_updated_ms = 0;
+bool AsyncServer::_mesh_status_push = false;
 char AsyncServer::http_packet_buffer[ASYNC_HTTP_PACKET_BUFFER_SIZE];
-QueueHandle_t AsyncServer::_queue_uart_msg;
-bool AsyncServer::_uart_response_is_complete = false;
-bool AsyncServer::_uart_response_is_timeout = false;
+char AsyncServer::report_packet_buffer[ASYNC_HTTP_PACKET_BUFFER_SIZE];
+UartLink* AsyncServer::_uart_link = NULL;
+CommandTable AsyncServer::_commands;
+bool AsyncServer::_correlation_enabled = false;
+volatile uint8_t AsyncServer::_mode_request_id = COMMAND_ID_NONE;
+QueueHandle_t AsyncServer::_queue_status_frames;
+QueueHandle_t AsyncServer::_collector_queue;
+StaticTask_t AsyncServer::_collector_tcbs[ASYNC_SRV_COLLECTOR_WORKERS];
+StackType_t AsyncServer::_collector_stacks[ASYNC_SRV_COLLECTOR_WORKERS]
+                                          [ASYNC_SRV_COLLECTOR_TASK_STACK_SIZE];
+QueueHandle_t AsyncServer::_request_queue;
+StaticTask_t AsyncServer::_request_tcbs[ASYNC_SRV_REQUEST_WORKERS];
+StackType_t AsyncServer::_request_stacks[ASYNC_SRV_REQUEST_WORKERS]
+                                        [ASYNC_SRV_REQUEST_TASK_STACK_SIZE];
+collector_stats_t AsyncServer::_collector_stats = {};
+portMUX_TYPE AsyncServer::_collector_stats_mux = portMUX_INITIALIZER_UNLOCKED;
+
+/**
+ * @brief Comando com ok recebido, aguardando um coletor livre.
+ * 
+ */
+typedef struct {
+    command_slot_t* slot;
+    int64_t enqueued_us;
+} collector_job_t;
+
+QueueHandle_t AsyncServer::_free_jobs;
+request_job_t AsyncServer::_jobs[ASYNC_SRV_REQUEST_QUEUE_LENGTH];
+portMUX_TYPE AsyncServer::_jobs_mux = portMUX_INITIALIZER_UNLOCKED;
+request_scratch_t AsyncServer::_request_scratch[ASYNC_SRV_REQUEST_WORKERS];
 uint32_t AsyncServer::http_requests_received = 0;
 const httpd_uri_t AsyncServer::echo = {.uri = "/echo",
                                        .method = HTTP_GET,
@@ -49,6 +75,28 @@ const httpd_uri_t AsyncServer::out = {.uri = "/out",
                                       .method = HTTP_GET,
                                       .handler = out_get_handler,
                                       .user_ctx = NULL};
+const httpd_uri_t AsyncServer::cmd = {.uri = "/cmd",
+                                      .method = HTTP_GET,
+                                      .handler = cmd_get_handler,
+                                      .user_ctx = NULL};
+const httpd_uri_t AsyncServer::ws = {.uri = "/ws",
+                                     .method = HTTP_GET,
+                                     .handler = ws_handler,
+                                     .user_ctx = NULL,
+                                     .is_websocket = true};
+const httpd_uri_t AsyncServer::report = {.uri = "/report",
+                                         .method = HTTP_GET,
+                                         .handler = report_get_handler,
+                                         .user_ctx = NULL};
+httpd_handle_t AsyncServer::_server = NULL;
+// preenchido com -1 no begin()
+int AsyncServer::_ws_fds[ASYNC_SRV_MAX_OPEN_SOCKETS];
+request_arena_t AsyncServer::_arenas[ASYNC_SRV_MAX_OPEN_SOCKETS];
+bool AsyncServer::_arena_in_use[ASYNC_SRV_MAX_OPEN_SOCKETS] = {};
+
+QueueHandle_t AsyncServer::_free_ws_msgs;
+ws_async_msg_t AsyncServer::_ws_msgs[ASYNC_SRV_WS_MSG_POOL_LENGTH];
+
 const httpd_uri_t AsyncServer::upgrade = {.uri = "/upgrade",
                                           .method = HTTP_POST,
                                           .handler = upgrade_post_handler,
@@ -64,7 +112,17 @@ void AsyncServer::begin() {
     static httpd_handle_t server = NULL;
     BaseType_t xReturned;
     IPAddress IP;
-    _queue_uart_msg = xQueueCreate(UART_QUEUE_LENGTH, UART_QUEUE_MSG_LENGTH);
+    // fd 0 e valido: as posicoes livres sao -1
+    for (int i = 0; i < ASYNC_SRV_MAX_OPEN_SOCKETS; i++) {
+        _ws_fds[i] = -1;
+    }
+    _uart_link = UartLink::getInstance();
+    ESP_ERROR_CHECK(_commands.begin());
+    _start_collectors();
+    _start_request_workers();
+    _start_ws_msg_pool();
+    _queue_status_frames =
+        xQueueCreate(UART_STATUS_FRAME_QUEUE_LENGTH, sizeof(uart_frame_t));
     // ESP_ERROR_CHECK(esp_event_handler_register(IP_EVENT, IP_EVENT_STA_GOT_IP, &connect_handler, &server));
     ESP_ERROR_CHECK(esp_event_handler_register(IP_EVENT, ESP_EVENT_ANY_ID,
                                                &ip_any_handler, &server));
@@ -87,15 +145,45 @@ void AsyncServer::begin() {
         abort();
     }
 
-    xReturned =
-        xTaskCreate(read_report_in_serial_task, "read_report_in_serial_task",
-                    ASYNC_SRV_CHECK_MESH_TASK_STACK_SIZE, NULL,
-                    ASYNC_SRV_REPORT_READ_TASK_PRIORITY, NULL);
+    xReturned = xTaskCreate(mesh_status_task, "mesh_status_task",
+                            ASYNC_SRV_MESH_STATUS_TASK_STACK_SIZE, NULL,
+                            ASYNC_SRV_CHECK_MESH_TASK_PRIORITY, NULL);
 
     if (xReturned != pdPASS) {
-        MY_LOGI("Nao foi possivel criar a _serial_report_task");
+        MY_LOGI("Nao foi possivel criar a mesh_status_task");
         abort();
     }
+
+    xReturned = xTaskCreate(uart_rx_task, "uart_rx_task",
+                            ASYNC_SRV_UART_RX_TASK_STACK_SIZE, NULL,
+                            ASYNC_SRV_UART_RX_TASK_PRIORITY, NULL);
+
+    if (xReturned != pdPASS) {
+        MY_LOGI("Nao foi possivel criar a uart_rx_task");
+        abort();
+    }
+
+    // um sensor com firmware antigo nao responde a nenhum pedido: depois do
+    // primeiro timeout os demais nao sao feitos, cada um custaria
+    // ASYNC_SRV_WAIT_OK_TIMEOUT_MS no boot
+    bool sensor_answers = true;
+    // a correlacao vem antes: com ela o "ok," da troca de modo e reconhecido
+    // pelo id
+#if UART_LINK_CORRELATION_ENABLED
+    sensor_answers = sensor_answers && _negotiate_correlation();
+#endif
+#if UART_LINK_BINARY_FRAMING_ENABLED
+    sensor_answers = sensor_answers && _negotiate_link_mode();
+#endif
+#if UART_LINK_FLOW_CONTROL_ENABLED
+    sensor_answers = sensor_answers && _negotiate_flow_control();
+#endif
+#if UART_LINK_MESH_STATUS_PUSH_ENABLED
+    sensor_answers = sensor_answers && _negotiate_mesh_status_push();
+#endif
+    if (!sensor_answers) {
+        MY_LOGW("Sensor sem resposta as negociacoes, enlace com os padroes antigos");
+    }
 }
 
 //TODO analisar e remover se necessário função (unused?)
@@ -118,123 +206,339 @@ void AsyncServer::begin_task() {
     }
 }
 
-uint16_t AsyncServer::_wait_for_ok(char* response) {
-    uint32_t tempo = millis();
-    char ent[ASYNC_SRV_MSG_LENGTH + 1];
+uint16_t AsyncServer::_wait_for_ok(command_slot_t* slot, char* response) {
+    uart_frame_t frame;
     bool ok_received = false;
     bool not_ok_received = false;
-    // limpa qualquer mensagem de entrada antes de começar a requisicao.
-    while (millis() - tempo < ASYNC_SRV_WAIT_OK_TIMEOUT_MS) {
-        if (Serial2.available()) {
-            memset(ent, 0, ASYNC_SRV_MSG_LENGTH);
-            uint8_t value;
-            MY_LOGI("Tem dado a ser lido UART2");
-            MY_LOGI("Antes do readBytes");
-            value = Serial2.readBytesUntil(';', ent, ASYNC_SRV_MSG_LENGTH);
-
-            if (ent[0] ==
-                '#') {  // ignora mensagem de relatorio, sinalizada pela inicio '#'
-                MY_LOGD("Mensagem de report ignorada: %s", ent);
-                report_msg_entry_t new_entry;
-                strcpy(new_entry.msg, ent + 4);
-                ReportHandler::add_entry_to_report_msg_buffer(new_entry);
-                continue;
-            }
 
-            MY_LOGI("Dado lido: %s", ent);
-            strcat(ent, ";");
-            MY_LOGI("%s", ent);
-            // if(strstr(ent, "ok;") != NULL)
-            if (strncmp(ent, "ok,", 3) == 0)
-                ok_received = true;
-            else
-                not_ok_received = true;
-            break;
-        }
-        vTaskDelay(10 / portTICK_PERIOD_MS);
+    frame.len = 0;
+    frame.data[0] = '\0';
+    // a uart_rx_task entrega aqui so os frames com o id deste comando
+    if (xQueueReceive(slot->frames, &frame,
+                      pdMS_TO_TICKS(ASYNC_SRV_WAIT_OK_TIMEOUT_MS)) == pdTRUE) {
+        MY_LOGI("Dado lido: %s", frame.data);
+        if (strncmp(frame.data, "ok,", 3) == 0)
+            ok_received = true;
+        else
+            not_ok_received = true;
+        strlcat(frame.data, END_OF_MESSAGE_IDENTIFIER, sizeof(frame.data));
     }
 
     if (response != NULL)
-        strcpy(response, ent);
+        strcpy(response, frame.data);
 
-    // se recebeu o ok, cria a task que recebe as mensagens e repassa para o app
+    // se recebeu o ok, o comando passa a aguardar as respostas (008, 009...)
     if (ok_received) {
-        MY_LOGI("Ok recebido");
+        MY_LOGI("Ok recebido (comando %u)", slot->id);
+        slot->state = COMMAND_STATE_RUNNING;
         return HANDLE_HTTP_RESPONSE_CODE_OK;
-        // if(create_task) xTaskCreate(_send_ans_to_app, "send_ans_to_app", 10 * 1024, NULL, 20, NULL);
     } else if (not_ok_received) {
-        MY_LOGI("Not Ok recebido");
+        MY_LOGI("Not Ok recebido (comando %u)", slot->id);
         return HANDLE_HTTP_RESPONSE_CODE_NOT_OK;
     } else {
-        MY_LOGI("Timeout!");
+        MY_LOGI("Timeout! (comando %u)", slot->id);
         return HANDLE_HTTP_RESPONSE_CODE_TIEMOUT;
     }
 }
 
-void AsyncServer::_send_data_to_sensor(const char* msg) {
-    Serial2.flush();
-    const uint8_t SEND_LEN = ASYNC_SRV_MSG_LENGTH;
+/**
+ * @brief Envia o comando com o id do slot e aguarda o "ok,". O mutex da UART
+ * so e mantido durante a escrita, as respostas sao separadas pelo id.
+ * 
+ * @param slot 
+ * @param msg 
+ * @param response Recebe o ack (ou a recusa) do sensor, com ';'
+ * @return uint16_t HANDLE_HTTP_RESPONSE_CODE_*
+ */
+uint16_t AsyncServer::_send_command(command_slot_t* slot, const char* msg, char* response) {
+    if (xSemaphoreTake(_uart_mutex, 1000 / portTICK_RATE_MS) != pdTRUE) {
+        MY_LOGI("Nao foi possivel pegar o mutex!");
+        if (response != NULL)
+            response[0] = '\0';
+        return HANDLE_HTTP_RESPONSE_CODE_TIEMOUT;
+    }
+    _send_data_to_sensor(msg, slot->id);
+    xSemaphoreGive(_uart_mutex);
+    return _wait_for_ok(slot, response);
+}
+
+uint32_t AsyncServer::_query_timeout_ms(const char* query) {
+    char value[8];
+    if (query == NULL || httpd_query_key_value(query, "timeout", value, sizeof(value)) != ESP_OK) {
+        return ASYNC_SRV_D_RESPONSE_REQUEST_TIMEOUT_MS;
+    }
+    uint32_t timeout_ms = strtoul(value, NULL, 10);
+    if (timeout_ms == 0)
+        return ASYNC_SRV_D_RESPONSE_REQUEST_TIMEOUT_MS;
+    return timeout_ms > ASYNC_SRV_CMD_MAX_TIMEOUT_MS ? ASYNC_SRV_CMD_MAX_TIMEOUT_MS : timeout_ms;
+}
+
+void AsyncServer::_route_uart_frame(uart_frame_t& frame) {
+    report_msg_entry_t new_entry;
+
+    char event[24];
+
+    if (frame.type == LINK_FRAME_TYPE_REPORT_BATCH) {
+        const uint8_t* payload = (const uint8_t*)frame.data;
+        uint16_t count = link_report_batch_count(frame.len);
+        uint16_t accepted = 0;
+        for (uint16_t i = 0; i < count; i++) {
+            const uint8_t* entry = link_report_batch_entry(payload, i);
+            memcpy(new_entry.mac, entry, LINK_MAC_LENGTH);
+            new_entry.pwm_value = entry[LINK_MAC_LENGTH];
+            if (ReportHandler::add_entry_to_report_msg_buffer(new_entry) == ESP_OK)
+                accepted++;
+        }
+        if (_ws_has_clients()) {
+            int len = snprintf(event, sizeof(event), WS_EVENT_REPORT "%u;", accepted);
+            _ws_broadcast(event, len);
+        }
+        return;
+    }
+    if (frame.type != LINK_FRAME_TYPE_TEXT) {
+        MY_LOGW("Tipo de frame desconhecido: %u", frame.type);
+        return;
+    }
+
+    if (frame.data[0] == '#') {
+        // +4 no endereço para remover código inicial da mensagem de report
+        if (frame.len > 4 &&
+            ReportHandler::parse_report_msg(frame.data + 4, frame.len - 4, &new_entry) == ESP_OK &&
+            ReportHandler::add_entry_to_report_msg_buffer(new_entry) == ESP_OK &&
+            _ws_has_clients()) {
+            int len = snprintf(event, sizeof(event), WS_EVENT_REPORT "1;");
+            _ws_broadcast(event, len);
+        }
+        return;
+    }
+
+    if (strncmp(frame.data, LINK_CREDIT_FRAME_PREFIX, strlen(LINK_CREDIT_FRAME_PREFIX)) == 0) {
+        _uart_link->addCredits(atoi(frame.data + strlen(LINK_CREDIT_FRAME_PREFIX)));
+        return;
+    }
+
+    if (_is_mesh_status_frame(frame)) {
+        if (xQueueSend(_queue_status_frames, &frame, 0) != pdPASS) {
+            MY_LOGW("Fila de status cheia, frame descartado: %s", frame.data);
+        }
+        return;
+    }
+
+    if (!_commands.route(frame)) {
+        MY_LOGW("Nenhum comando consumindo a resposta, frame descartado: %u %s",
+                frame.id, frame.data);
+    }
+}
+
+/**
+ * @brief Separa o id de correlacao: seq do frame binario ou prefixo "@<id>,"
+ * em ASCII. Sem correlacao negociada o id fica COMMAND_ID_NONE.
+ * 
+ * @param frame 
+ * @param seq 
+ */
+void AsyncServer::_extract_command_id(uart_frame_t& frame, uint8_t seq) {
+    frame.id = COMMAND_ID_NONE;
+    if (!_correlation_enabled || frame.type != LINK_FRAME_TYPE_TEXT) {
+        return;
+    }
+    if (_uart_link->mode() == UART_LINK_MODE_BINARY) {
+        frame.id = seq;
+        return;
+    }
+    if (frame.data[0] != COMMAND_ID_PREFIX) {
+        return;
+    }
+    char* end;
+    unsigned long id = strtoul(frame.data + 1, &end, 10);
+    if (*end != ',' || id > UINT8_MAX) {
+        return;
+    }
+    end++;
+    frame.len -= end - frame.data;
+    memmove(frame.data, end, frame.len + 1);
+    frame.id = id;
+}
+
+bool AsyncServer::_is_mesh_status_frame(const uart_frame_t& frame) {
+    // resposta do 9031 ou publicacao do sensor -> "<status>,<ssid>,<password>"
+    return frame.len > 2 &&
+           (frame.data[0] == '0' + Wifi_Status::WIFI_NOT_CONNECTED ||
+            frame.data[0] == '0' + Wifi_Status::WIFI_CONNECTED) &&
+           frame.data[1] == ',';
+}
+
+/**
+ * @brief Pede ao sensor o enquadramento binario. Sensores com firmware antigo
+ * nao respondem "ok," e o enlace permanece em ASCII.
+ * 
+ * @return false se o sensor nao respondeu no prazo
+ */
+bool AsyncServer::_negotiate_link_mode() {
+    command_slot_t* slot = _commands.acquire(COMMAND_SINK_DIRECT, ASYNC_SRV_WAIT_OK_TIMEOUT_MS);
+    if (slot == NULL) {
+        return true;
+    }
+    // a troca e aplicada pela uart_rx_task no instante em que o "ok," deste
+    // comando chega
+    _mode_request_id = slot->id;
+    _uart_link->requestMode(UART_LINK_MODE_BINARY);
+    uint16_t result = _send_command(slot, LINK_BINARY_MODE_REQUEST);
+    if (result == HANDLE_HTTP_RESPONSE_CODE_OK) {
+        MY_LOGI("Enlace com o sensor em modo binario");
+    } else {
+        _uart_link->cancelPendingMode();
+        MY_LOGW("Sensor sem suporte ao modo binario, enlace segue em ASCII");
+    }
+    _commands.release(slot);
+    return result != HANDLE_HTTP_RESPONSE_CODE_TIEMOUT;
+}
+
+/**
+ * @brief Pede ao sensor o controle de fluxo por creditos. A resposta
+ * "ok,<janela>" informa quantos bytes ele aceita sem devolver creditos.
+ * 
+ * @return false se o sensor nao respondeu no prazo
+ */
+bool AsyncServer::_negotiate_flow_control() {
+    char response[ASYNC_SRV_MSG_LENGTH + 1];
+    command_slot_t* slot = _commands.acquire(COMMAND_SINK_DIRECT, ASYNC_SRV_WAIT_OK_TIMEOUT_MS);
+    if (slot == NULL) {
+        return true;
+    }
+    uint16_t result = _send_command(slot, LINK_FLOW_CONTROL_REQUEST, response);
+    if (result == HANDLE_HTTP_RESPONSE_CODE_OK) {
+        // "ok,<janela>;"
+        long window = strtol(response + 3, NULL, 10);
+        if (window > 0 && window <= UINT16_MAX) {
+            _uart_link->enableFlowControl(window);
+            MY_LOGI("Controle de fluxo no TX com janela de %ld bytes", window);
+        } else {
+            MY_LOGW("Janela de creditos invalida: %s", response);
+        }
+    } else {
+        MY_LOGW("Sensor sem controle de fluxo, TX em blocos com pausa");
+    }
+    _commands.release(slot);
+    return result != HANDLE_HTTP_RESPONSE_CODE_TIEMOUT;
+}
+
+/**
+ * @brief Pede ao sensor que ecoe o id de correlacao nas respostas. So entao a
+ * janela de comandos simultaneos e aberta; sensores antigos seguem com um
+ * comando por vez.
+ * 
+ * @return false se o sensor nao respondeu no prazo
+ */
+bool AsyncServer::_negotiate_correlation() {
+    command_slot_t* slot = _commands.acquire(COMMAND_SINK_DIRECT, ASYNC_SRV_WAIT_OK_TIMEOUT_MS);
+    if (slot == NULL) {
+        return true;
+    }
+    uint16_t result = _send_command(slot, LINK_CORRELATION_REQUEST);
+    if (result == HANDLE_HTTP_RESPONSE_CODE_OK) {
+        _correlation_enabled = true;
+        _commands.setWindow(ASYNC_SRV_MAX_INFLIGHT_COMMANDS);
+        MY_LOGI("Sensor com suporte a correlacao de comandos");
+    } else {
+        MY_LOGW("Sensor sem suporte a correlacao, um comando por vez");
+    }
+    _commands.release(slot);
+    return result != HANDLE_HTTP_RESPONSE_CODE_TIEMOUT;
+}
+
+/**
+ * @brief Escreve a mensagem inteira no ring de TX da UART e aguarda ela sair
+ * (o prazo do ok so comeca depois). O ritmo vem dos creditos do sensor;
+ * sensores sem controle de fluxo recebem blocos com a pausa antiga.
+ * 
+ * @param msg 
+ * @param id Id de correlacao (ignorado se o sensor nao suportar)
+ */
+void AsyncServer::_send_data_to_sensor(const char* msg, uint8_t id) {
+    const uint16_t SEND_LEN = ASYNC_SRV_MSG_LENGTH;
     uint16_t len = strlen(msg);
     uint16_t i = 0;
-    uint8_t sum;
-    char send[SEND_LEN + 1];
-    MY_LOGI("Mensagem completa: %s", msg);
-    do {
-        sum = (len - i > SEND_LEN) ? SEND_LEN : len - i + 1;
-        memcpy(send, msg + i, sum);
-        i += sum;
-        MY_LOGI("Enviando %d : %s", sum, send);
-        Serial2.print(send);
-        vTaskDelay(100 / portTICK_PERIOD_MS);
-    } while (i < len);
-    MY_LOGI("Fim envio para o sensor");
-}
-
-bool AsyncServer::_att_wifi_ssid(bool send_data) {
-    MY_LOGD("inicio semaphore_take");
-    if (xSemaphoreTake(_uart_mutex, portMAX_DELAY) != pdTRUE) {
-        MY_LOGI("Nao foi possivel pegar o mutex!");
+    uint16_t sum;
+    int64_t start_us = esp_timer_get_time();
+    if (!_correlation_enabled)
+        id = COMMAND_ID_NONE;
+    MY_LOGI("Mensagem completa (comando %u): %s", id, msg);
+    if (_uart_link->mode() == UART_LINK_MODE_BINARY) {
+        // um frame TEXT por mensagem, o CRC dispensa a fragmentacao
+        _uart_link->write(msg, len, id);
+    } else {
+        if (id != COMMAND_ID_NONE) {
+            char prefix[6];
+            int prefix_len = snprintf(prefix, sizeof(prefix), "%c%u,", COMMAND_ID_PREFIX, id);
+            _uart_link->write(prefix, prefix_len);
+        }
+        if (_uart_link->flowControlEnabled()) {
+            _uart_link->write(msg, len);
+        } else {
+            while (1) {
+                sum = (len - i > SEND_LEN) ? SEND_LEN : len - i;
+                MY_LOGD("Enviando %d : %.*s", sum, sum, msg + i);
+                _uart_link->write(msg + i, sum);
+                i += sum;
+                if (i >= len)
+                    break;
+                _uart_link->waitTxDone(portMAX_DELAY);
+                vTaskDelay(pdMS_TO_TICKS(UART_LINK_LEGACY_CHUNK_DELAY_MS));
+            }
+        }
+    }
+    _uart_link->waitTxDone(portMAX_DELAY);
+    MY_LOGI("Fim envio para o sensor: %u bytes em %u us", len,
+            (uint32_t)(esp_timer_get_time() - start_us));
+}
+
+/**
+ * @brief Pede ao sensor o status do mesh (9031). A resposta chega pela fila
+ * de status como qualquer publicacao do sensor e e tratada pela
+ * mesh_status_task. Para ler o status atual use meshStatus().
+ * 
+ * @return true se o sensor aceitou o pedido
+ */
+bool AsyncServer::_att_wifi_ssid() {
+    command_slot_t* slot = _commands.acquire(COMMAND_SINK_DIRECT, ASYNC_SRV_WAIT_OK_TIMEOUT_MS);
+    if (slot == NULL) {
+        MY_LOGI("Janela de comandos cheia, 9031 adiado");
         return false;
     }
-    MY_LOGD("semaphore_taken!");
-
-    if (send_data) {
-        char msg[] = "9031,;";
-        MY_LOGD("Inicio serial.available()");
-        // while (Serial.available()) Serial.read();
-        MY_LOGD("inicio _send data to sensor");
-        _send_data_to_sensor(msg);
-        MY_LOGD("inicio ");
-        uint16_t response = _wait_for_ok();
-        MY_LOGD("end _wait_for_ok");
-        if (response != HANDLE_HTTP_RESPONSE_CODE_OK) {
-            xSemaphoreGive(_uart_mutex);
-            MY_LOGI("Semaphore _uart_mutex given");
-            return false;
-        }
+    MY_LOGD("inicio _send_command");
+    uint16_t response = _send_command(slot, "9031,;");
+    MY_LOGD("end _send_command");
+    _commands.release(slot);
+    return response == HANDLE_HTTP_RESPONSE_CODE_OK;
+}
+
+bool AsyncServer::meshStatus(mesh_status_t* status) {
+    if (!_mesh_shadow_valid) {
+        return false;
     }
-    //TODO verificar possivel erro onde mensagemd e relatorio é equivocadamente lida por esse trecho do codigo
-    char ent[1500];
-    memset(ent, 0, 1500);
-    MY_LOGD("inicio readBytesUntil");
-    uint16_t char_read = Serial2.readBytesUntil(';', ent, ASYNC_SRV_MSG_LENGTH);
-    // strncat(ent, ";", 1);
-    MY_LOGD("char_read: %u", char_read);
-    MY_LOGD(" RESP = %s", ent);
-    if (char_read > 4)
-        _update_ssid(ent);
-    xSemaphoreGive(_uart_mutex);
+    *status = _mesh_shadow;
     return true;
 }
 
-void AsyncServer::_update_ssid(char* msg) {
-    MY_LOGI("msg completa: %s", msg);
-    WiFi* wifi = WiFi::getInstance();
-    uint8_t len = strlen(msg);
-    bool ssid_change = true;
-    bool status_change = true;
-    bool password_change = true;
-    uint8_t status;
+static uint32_t _fnv1a32(const char* str) {
+    uint32_t hash = 2166136261u;
+    while (*str) {
+        hash ^= (uint8_t)*str++;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+/**
+ * @brief "<status>,<ssid>,<password>" -> mesh_status_t. A senha so e guardada
+ * como hash, suficiente para detectar a troca.
+ * 
+ * @param msg Alterada pelo strtok_r
+ * @param status 
+ * @return esp_err_t 
+ */
+esp_err_t AsyncServer::_parse_mesh_status(char* msg, mesh_status_t* status) {
     char* next_char;
 
     char* status_str = strtok_r(msg, ",", &next_char);
@@ -243,50 +547,89 @@ void AsyncServer::_update_ssid(char* msg) {
 
     if (status_str == NULL) {
         MY_LOGW("status_str NULL");
-        return;
+        return ESP_FAIL;
     }
     if (ssid == NULL) {
         MY_LOGW("ssid NULL");
-        return;
+        return ESP_FAIL;
     }
     if (password == NULL) {
         MY_LOGW("password NULL");
-        return;
+        return ESP_FAIL;
     }
     if (strtok_r(NULL, ",", &next_char) != NULL) {
         MY_LOGE("Mais argumentos que o esperado");
-        while (strtok_r(NULL, ",", &next_char) != NULL)
-            ;
-        return;
+        return ESP_FAIL;
     }
 
-    status = atoi(status_str);
-    MY_LOGD("Valores novos  : %d %s %s", status, ssid, password);
-    MY_LOGD("Valores antigos: %d %s %s", _last_status, _last_ssid,
-            _last_password);
-    if (_last_status == status) {
-        MY_LOGI("Status nao mudou");
-        status_change = false;
+    status->status = (Wifi_Status)atoi(status_str);
+    strlcpy(status->ssid, ssid, sizeof(status->ssid));
+    status->password_hash = _fnv1a32(password);
+    return ESP_OK;
+}
+
+/**
+ * @brief Consome os frames de status do mesh, publicados pelo sensor a cada
+ * mudanca ou em resposta ao 9031, mantendo a sombra local atualizada.
+ * 
+ * @param arg 
+ */
+void AsyncServer::mesh_status_task(void* arg) {
+    uart_frame_t frame;
+    mesh_status_t status;
+
+    while (1) {
+        if (xQueueReceive(_queue_status_frames, &frame, portMAX_DELAY) != pdTRUE) {
+            continue;
+        }
+        MY_LOGD("Status do mesh: %s", frame.data);
+        if (_parse_mesh_status(frame.data, &status) != ESP_OK) {
+            continue;
+        }
+        _mesh_shadow_updated_ms = millis();
+        _update_ssid(status);
     }
+}
 
-    if (strcmp(ssid, _last_ssid) == 0) {
-        MY_LOGI("SSID nao mudou");
-        ssid_change = false;
+void AsyncServer::_update_ssid(const mesh_status_t& fresh) {
+    WiFi* wifi = WiFi::getInstance();
+    const char* ssid = fresh.ssid;
+    uint8_t status = fresh.status;
+    mesh_status_t previous = _mesh_shadow;
+    bool was_valid = _mesh_shadow_valid;
+    bool ssid_change = true;
+    bool status_change = true;
+
+    MY_LOGD("Valores novos  : %d %s %08x", status, ssid, fresh.password_hash);
+    MY_LOGD("Valores antigos: %d %s %08x", previous.status, previous.ssid,
+            previous.password_hash);
+    _mesh_shadow = fresh;
+    _mesh_shadow_valid = true;
+
+    if (was_valid && previous.status == status) {
+        MY_LOGI("Status nao mudou");
+        status_change = false;
     }
 
-    if (strcmp(password, _last_password) == 0) {
-        MY_LOGI("Password nao mudou");
+    if (was_valid && strcmp(ssid, previous.ssid) == 0 &&
+        fresh.password_hash == previous.password_hash) {
+        MY_LOGI("SSID e Password nao mudaram");
         ssid_change = false;
     }
 
     if (!(ssid_change || status_change)) {
-        MY_LOGI("SSID e Password não mudaram");
         return;
     }
 
+    if (_ws_has_clients()) {
+        char event[64];
+        int event_len = snprintf(event, sizeof(event), WS_EVENT_MESH_STATUS "%u,%s;",
+                                 status, ssid);
+        _ws_broadcast(event, MIN((size_t)event_len, sizeof(event) - 1));
+    }
+
     if (status_change && !ssid_change) {
         MY_LOGI("status changed and ssid not changed");
-        _last_status = (Wifi_Status)status;
         switch (status) {
         case Wifi_Status::WIFI_NOT_CONNECTED:
             MY_LOGI("mesh nao conectado");
@@ -314,23 +657,17 @@ void AsyncServer::_update_ssid(char* msg) {
         if (status == Wifi_Status::WIFI_NOT_CONNECTED) {
             MY_LOGI("Mudando para Rede Inicial");
             wifi->restart(WIFI_DEFAULT_MODE);
-            strcpy(_last_ssid, ssid);
             MY_LOGI("mesh not connected! return");
             return;
         }
         if (strcmp(ssid, "123456") == 0) {
             MY_LOGI("Mudando para Rede Inicial");
-            wifi->restart(WIFI_DEFAULT_MODE);
-            strcpy(_last_ssid, ssid);
         } else if (strcmp(ssid, "wetzel") == 0) {
             MY_LOGI("Mudando para Rede Configuracao");
-            wifi->restart(WIFI_DEFAULT_MODE);
-            strcpy(_last_ssid, ssid);
         } else {
             MY_LOGI("Nenhum valor encontrado");
-            wifi->restart(WIFI_DEFAULT_MODE);
-            strcpy(_last_ssid, ssid);
         }
+        wifi->restart(WIFI_DEFAULT_MODE);
         return;
     }
 
@@ -344,69 +681,77 @@ void AsyncServer::_update_ssid(char* msg) {
 
     if (strcmp(ssid, "123456") == 0) {
         MY_LOGI("Mudando para Rede Inicial");
-        wifi->restart(WIFI_DEFAULT_MODE);
-        strcpy(_last_ssid, ssid);
     } else if (strcmp(ssid, "wetzel") == 0) {
         MY_LOGI("Mudando para Rede Configuracao");
-        wifi->restart(WIFI_DEFAULT_MODE);
-        strcpy(_last_ssid, ssid);
     } else {
         MY_LOGI("Nenhum valor encontrado");
-        wifi->restart(WIFI_DEFAULT_MODE);
-        strcpy(_last_ssid, ssid);
     }
+    wifi->restart(WIFI_DEFAULT_MODE);
+}
+
+/**
+ * @brief Pede ao sensor que publique o status do mesh a cada mudanca. Com a
+ * publicacao ativa o 9031 vira apenas um heartbeat lento.
+ * 
+ * @return false se o sensor nao respondeu no prazo
+ */
+bool AsyncServer::_negotiate_mesh_status_push() {
+    command_slot_t* slot = _commands.acquire(COMMAND_SINK_DIRECT, ASYNC_SRV_WAIT_OK_TIMEOUT_MS);
+    if (slot == NULL) {
+        return true;
+    }
+    uint16_t result = _send_command(slot, LINK_MESH_STATUS_PUSH_REQUEST);
+    if (result == HANDLE_HTTP_RESPONSE_CODE_OK) {
+        _mesh_status_push = true;
+        MY_LOGI("Sensor publica o status do mesh");
+    } else {
+        MY_LOGW("Sensor sem publicacao de status, mantendo o 9031 periodico");
+    }
+    _commands.release(slot);
+    return result != HANDLE_HTTP_RESPONSE_CODE_TIEMOUT;
 }
 
 void AsyncServer::check_mesh_connection_task(void* arg) {
     while (1) {
-        vTaskDelay(ASYNC_SRV_CHECK_CONNECTION_TASK_DELAY_MS /
-                   portTICK_PERIOD_MS);
-        if (_http_request || _waiting_for_ans)
+        uint32_t period_ms = _mesh_status_push ? ASYNC_SRV_MESH_STATUS_HEARTBEAT_MS
+                                               : ASYNC_SRV_CHECK_CONNECTION_TASK_DELAY_MS;
+        vTaskDelay(pdMS_TO_TICKS(period_ms));
+        if (_http_request || _commands.inflight() > 0)
+            continue;
+        // sombra atualizada ha pouco por publicacao do sensor dispensa o pedido
+        if (_mesh_shadow_valid && millis() - _mesh_shadow_updated_ms < period_ms)
             continue;
-        _att_wifi_ssid(true);
+        _att_wifi_ssid();
     }
 }
 
-void AsyncServer::read_report_in_serial_task(void* arg) {
-    char serial_msg[ASYNC_SRV_MSG_LENGTH + 1];
-    ReportHandler* report_handler = ReportHandler::getInstance();
+/**
+ * @brief Unica task que le a UART2. Separa o stream em frames terminados em
+ * ';' e encaminha cada um para o seu consumidor: relatorio ('#'), status do
+ * mesh (resposta do 9031) ou o comando dono do id (ok, 007, 008, 009...).
+ * 
+ * @param arg 
+ */
+void AsyncServer::uart_rx_task(void* arg) {
+    uart_frame_t frame;
+    uint8_t seq;
 
     while (1) {
-        // MY_LOGD("inicio semaphore_uart_take");
-        if (xSemaphoreTake(_uart_mutex, portMAX_DELAY) != pdTRUE) {
-            MY_LOGW("Nao pude pegar _uart_mutex");
-            vTaskDelay(50 / portTICK_PERIOD_MS);
+        // acorda uma vez por frame completo (deteccao de ';' pelo driver)
+        int len = _uart_link->readFrame(&frame.type, &seq, frame.data, sizeof(frame.data));
+        if (len <= 0) {
             continue;
         }
-        // MY_LOGD("semaphore_uart_taken!");
-
-        if (Serial2.available()) {
-
-            memset(serial_msg, 0, ASYNC_SRV_MSG_LENGTH);
-            uint8_t value;
-            MY_LOGI("Tem dado a ser lido UART2");
-            value =
-                Serial2.readBytesUntil(';', serial_msg, ASYNC_SRV_MSG_LENGTH);
-            MY_LOGI("Dado lido: %s", serial_msg);
-
-            xSemaphoreGive(_uart_mutex);
-            // MY_LOGD("semaphore_uart given...");
-
-            if (serial_msg[0] != '#') {
-                MY_LOGE("Mensagem não indentificada recebida: %s\nAbortando...",serial_msg);
-                continue;
-            }
-            char* strtok_ptr;
-            report_msg_entry_t new_entry;
-            strcpy(new_entry.msg, serial_msg + 4);
-            MY_LOGD("report_msg_entry-> %s", new_entry.msg);
-            // +4 no endereço para remover código inicial da mensagem de report
-            report_handler->add_entry_to_report_msg_buffer(new_entry);
-
-        } else {
-            xSemaphoreGive(_uart_mutex);
+        frame.len = len;
+        _extract_command_id(frame, seq);
+        // um "ok," atrasado de outro comando nao troca o modo: so a resposta
+        // do pedido (pelo id, ou o comando mais antigo sem correlacao)
+        if (_uart_link->modeChangePending() && frame.type == LINK_FRAME_TYPE_TEXT &&
+            strncmp(frame.data, "ok,", 3) == 0 && _commands.routesTo(frame, _mode_request_id)) {
+            _uart_link->applyPendingMode();
         }
-        vTaskDelay(50 / portTICK_PERIOD_MS);
+        MY_LOGD("Dado lido: %s", frame.data);
+        _route_uart_frame(frame);
     }
 }
 
@@ -442,126 +787,440 @@ esp_err_t AsyncServer::echo_post_handler(httpd_req_t* req) {
 }
 
 esp_err_t AsyncServer::out_get_handler(httpd_req_t* req) {
-    MY_LOGI("Recebido requisicao HTTP GET /out: %s", req->uri);
-    char buf[1500];
-    char param[1000];
-    size_t buf_len;
-    BaseType_t xReturned;
-    // String     send_buffer((char *)0);
+    return _submit_to_worker(req, _out_worker);
+}
+
+esp_err_t AsyncServer::_out_worker(request_job_t* job) {
+    MY_LOGI("Recebido requisicao HTTP GET /out: %s", job->query);
+    char* param = job->scratch->param;
+    char* wait_for_ok_response = job->scratch->frame.data;
+    // os buffers do worker sao reaproveitados entre requisicoes
+    param[0] = '\0';
+    wait_for_ok_response[0] = '\0';
     uint16_t response;
     char status[6];
-    char wait_for_ok_response[10] = {0};
+    char headers[24];
+    uint32_t timeout_ms = ASYNC_SRV_D_RESPONSE_REQUEST_TIMEOUT_MS;
 
     http_requests_received++;
 
-    memset(buf, 0, 1500);
+    if (job->query[0] != '\0') {
+        ESP_LOGI(TAG, "Found URL query => %s", job->query);
 
-    if (_waiting_for_ans) {
-        MY_LOGI("/out ignorado, pois ja esta aguardando uma resposta");
-        httpd_resp_set_type(req, "text/plain; charset=utf-16");
-        httpd_resp_send(req, "OK", HTTPD_RESP_USE_STRLEN);
-        return ESP_OK;
-    }
-    _waiting_for_ans = true;
-    MY_LOGD("_waiting_for_ans = true");
-
-    buf_len = httpd_req_get_url_query_len(req) + 1;
-    if (buf_len > 1) {
-        if (httpd_req_get_url_query_str(req, buf, buf_len) == ESP_OK) {
-            ESP_LOGI(TAG, "Found URL query => %s", buf);
-
-            /* Get value of expected key from query string */
-            if (httpd_query_key_value(buf, "text", param, sizeof(param)) ==
-                ESP_OK) {
-                ESP_LOGI(TAG, "Found URL query parameter => text=%s", param);
-            }
+        /* Get value of expected key from query string */
+        if (httpd_query_key_value(job->query, "text", param, sizeof(job->scratch->param)) ==
+            ESP_OK) {
+            ESP_LOGI(TAG, "Found URL query parameter => text=%s", param);
         }
+        timeout_ms = _query_timeout_ms(job->query);
     }
     convert_html_text_to_ascii(param);
 
-    MY_LOGI("Send buffer: %s", param);
-    uart_flush_input(2);
-    xQueueReset(_queue_uart_msg);
-    _uart_response_is_complete = false;
-    _uart_response_is_timeout = false;
-
-    if (xSemaphoreTake(_uart_mutex, 1000 / portTICK_RATE_MS) != pdTRUE) {
-        MY_LOGI("Nao foi possivel pegar o mutex!");
-        _waiting_for_ans = false;
-        return false;
+    command_slot_t* slot = _commands.acquire(COMMAND_SINK_STREAM, timeout_ms);
+    if (slot == NULL) {
+        MY_LOGI("/out ignorado, janela de comandos cheia");
+        sprintf(status, "%d", HANDLE_HTTP_RESPONSE_CODE_NOT_OK);
+        _job_resp_send(job, status, "text/plain; charset=utf-16", NULL, "Busy");
+        return ESP_OK;
     }
-    _send_data_to_sensor(param);
 
-    response = _wait_for_ok(wait_for_ok_response);
+    MY_LOGI("Send buffer: %s", param);
+    response = _send_command(slot, param, wait_for_ok_response);
     const char* answer =
         response == HANDLE_HTTP_RESPONSE_CODE_OK        ? "OK"
         : response == HANDLE_HTTP_RESPONSE_CODE_NOT_OK  ? "Not fine"
         : response == HANDLE_HTTP_RESPONSE_CODE_TIEMOUT ? "Timeout"
                                                         : "Unexpected error";
 
-    sprintf(status, "%d", response);
-    if (response != HANDLE_HTTP_RESPONSE_CODE_OK) {
-        MY_LOGD("_waiting_for_ans = false");
-        _waiting_for_ans = false;
-    }
-    if (response == HANDLE_HTTP_RESPONSE_CODE_OK) {
-        xReturned = xTaskCreate(_uart_receive_response_task,
-                                "_uart_receive_response_task",
-                                ASYNC_SRV_CHECK_MESH_TASK_STACK_SIZE, NULL,
-                                CONFIG_APP_TASK_DEFAULT_PRIORITY - 1, NULL);
-
-        // TODO: EU TIREI DAQUI
-        //xSemaphoreGive(_uart_mutex);
-        if (xReturned != pdPASS) {
-            MY_LOGI("Nao foi possivel criar a _webserver_task");
-            abort();
-        }
+    // o app informa o id no /ans?id= para buscar as respostas deste comando;
+    // lido antes de o slot ir para o coletor
+    snprintf(headers, sizeof(headers), "X-Command-Id: %u\r\n", slot->id);
+    if (response == HANDLE_HTTP_RESPONSE_CODE_OK && !_dispatch_to_collector(slot)) {
+        response = HANDLE_HTTP_RESPONSE_CODE_NOT_OK;
+        answer = "Busy";
     }
-    httpd_resp_set_status(req, status);
-    httpd_resp_set_type(req, "text/plain; charset=utf-16");
+    sprintf(status, "%d", response);
     if (response != HANDLE_HTTP_RESPONSE_CODE_OK) {
-        httpd_resp_send(req, answer, HTTPD_RESP_USE_STRLEN);
+        _commands.release(slot);
+        _job_resp_send(job, status, "text/plain; charset=utf-16", NULL, answer);
     } else {
-        httpd_resp_send(req, wait_for_ok_response, HTTPD_RESP_USE_STRLEN);
+        _job_resp_send(job, status, "text/plain; charset=utf-16", headers,
+                       wait_for_ok_response);
     }
 
-    /* After sending the HTTP response the old HTTP request
-         * headers are lost. Check if HTTP request headers can be read now. */
-    if (httpd_req_get_hdr_value_len(req, "Host") == 0) {
-        ESP_LOGI(TAG, "Request headers lost");
-    }
-    // TODO: Antes de finalizar sempre devolve o recurso (COLOQUEI AQUI)
-    xSemaphoreGive(_uart_mutex);
+    _log_stack_usage("/out");
     return ESP_OK;
 }
 
+/**
+ * @brief /ans[?id=N] -> respostas do comando N enviado pelo /out. Sem id
+ * entrega o resultado mais antigo ainda nao lido.
+ * 
+ * @param req 
+ * @return esp_err_t 
+ */
 esp_err_t AsyncServer::ans_get_handler(httpd_req_t* req) {
-    MY_LOGI("Recebido requisicao HTTP GET /ans: %s", req->uri);
+    return _submit_to_worker(req, _ans_worker);
+}
+
+esp_err_t AsyncServer::_ans_worker(request_job_t* job) {
+    MY_LOGI("Recebido requisicao HTTP GET /ans: %s", job->query);
+    char value[4];
+    char status[6];
+    command_slot_t* slot = NULL;
 
     http_requests_received++;
 
-    if (!_waiting_for_ans) {
+    // o slot passa para este /ans com o lock da tabela: outro /ans, o /out e
+    // o descarte por retencao nao o liberam mais
+    if (httpd_query_key_value(job->query, "id", value, sizeof(value)) == ESP_OK) {
+        slot = _commands.claim(atoi(value));
+    } else {
+        slot = _commands.claimOldest();
+    }
+
+    if (slot == NULL) {
         MY_LOGI("/ans ignorado, pois nao veio um /out antes");
+        sprintf(status, "%d", HANDLE_HTTP_RESPONSE_CODE_NOT_OK);
+        _job_resp_send(job, status, "text/plain; charset=utf-16", NULL, "Not fine");
         return ESP_OK;
     }
-    _device_response_from_uart_task(req);
+    _device_response_from_uart_task(job, slot, job->scratch->response,
+                                    sizeof(job->scratch->response));
+    // com o coletor ainda ativo (timeout da notificacao) a tabela so libera
+    // o slot no finish()
+    _commands.release(slot, COMMAND_OWNER_READER);
     _http_request = false;
-    MY_LOGD("_waiting_for_ans = false");
-    _waiting_for_ans = false;
 
     return ESP_OK;
 }
 
+/**
+ * @brief /cmd?text=... -> envia o comando ao sensor, aguarda o ok e transmite
+ * cada frame de resposta (008...) em chunked encoding ate o 009/007 ou timeout.
+ * Substitui o par /out + /ans em uma unica requisicao.
+ * 
+ * @param req 
+ * @return esp_err_t 
+ */
+esp_err_t AsyncServer::cmd_get_handler(httpd_req_t* req) {
+    return _submit_to_worker(req, _cmd_worker);
+}
+
+esp_err_t AsyncServer::_cmd_worker(request_job_t* job) {
+    MY_LOGI("Recebido requisicao HTTP GET /cmd: %s", job->query);
+    char* param = job->scratch->param;
+    uart_frame_t& frame = job->scratch->frame;
+    param[0] = '\0';
+    char status[6];
+    uint16_t response;
+    uint32_t timeout_ms = ASYNC_SRV_D_RESPONSE_REQUEST_TIMEOUT_MS;
+
+    http_requests_received++;
+
+    // query maior que o buffer chega vazia do httpd
+    if (job->query[0] != '\0') {
+        httpd_query_key_value(job->query, "text", param, sizeof(job->scratch->param));
+        timeout_ms = _query_timeout_ms(job->query);
+    }
+    convert_html_text_to_ascii(param);
+    if (param[0] == '\0') {
+        MY_LOGE("/cmd sem parametro text");
+        _job_resp_send(job, "400 Bad Request", "text/html", NULL, "text");
+        return ESP_OK;
+    }
+
+    command_slot_t* slot = _commands.acquire(COMMAND_SINK_DIRECT, timeout_ms);
+    if (slot == NULL) {
+        MY_LOGI("/cmd ignorado, janela de comandos cheia");
+        sprintf(status, "%d", HANDLE_HTTP_RESPONSE_CODE_NOT_OK);
+        _job_resp_send(job, status, "text/plain; charset=utf-16", NULL, "Busy");
+        return ESP_OK;
+    }
+
+    response = _send_command(slot, param, frame.data);
+
+    sprintf(status, "%d", response);
+    if (response != HANDLE_HTTP_RESPONSE_CODE_OK) {
+        _job_resp_send(job, status, "text/plain; charset=utf-16", NULL,
+                       response == HANDLE_HTTP_RESPONSE_CODE_NOT_OK ? "Not fine" : "Timeout");
+        _commands.release(slot);
+        return ESP_OK;
+    }
+    // o ack vai imediatamente, as respostas seguem no mesmo corpo
+    _job_resp_start(job, status, "text/plain; charset=utf-16", NULL);
+    _job_resp_chunk(job, frame.data, strlen(frame.data));
+
+    uint32_t remaining;
+    while ((remaining = CommandTable::remainingMs(slot)) > 0) {
+        if (xQueueReceive(slot->frames, &frame, pdMS_TO_TICKS(remaining)) != pdTRUE) {
+            continue;
+        }
+        if (!_is_response_frame(frame.data)) {
+            MY_LOGE("A mensagem veio com erro!");
+            continue;
+        }
+        bool request_is_complete = _is_final_response_frame(frame.data);
+        strlcat(frame.data, END_OF_MESSAGE_IDENTIFIER, sizeof(frame.data));
+        if (!_job_resp_chunk(job, frame.data, strlen(frame.data))) {
+            MY_LOGW("Cliente desconectou durante o /cmd");
+            break;
+        }
+        if (request_is_complete) {
+            MY_LOGI("REQUEST IS COMPLETE");
+            break;
+        }
+    }
+    if (remaining == 0) {
+        MY_LOGI("REQUEST TIMEOUT");
+    }
+    _job_resp_chunk(job, NULL, 0);
+
+    _commands.release(slot);
+    _log_stack_usage("/cmd");
+    return ESP_OK;
+}
+
+/**
+ * @brief /ws -> canal persistente com o aplicativo. Comandos sobem como frames
+ * de texto (mesmo conteudo do text= do /cmd); ack, respostas do sensor e
+ * eventos (WS_EVENT_*) descem como frames de texto assim que chegam pela UART2.
+ * 
+ * @param req 
+ * @return esp_err_t 
+ */
+esp_err_t AsyncServer::ws_handler(httpd_req_t* req) {
+    if (req->method == HTTP_GET) {
+        int fd = httpd_req_to_sockfd(req);
+        MY_LOGI("Handshake WebSocket, fd %d", fd);
+        for (int i = 0; i < ASYNC_SRV_MAX_OPEN_SOCKETS; i++) {
+            if (_ws_fds[i] < 0 || _ws_fds[i] == fd) {
+                _ws_fds[i] = fd;
+                break;
+            }
+        }
+        return ESP_OK;
+    }
+
+    request_arena_t* arena = _get_arena(req);
+    if (arena == NULL) {
+        return ESP_FAIL;
+    }
+    char* command = arena->param;
+    httpd_ws_frame_t ws_frame;
+    memset(&ws_frame, 0, sizeof(ws_frame));
+
+    // primeira chamada so le o cabecalho para descobrir o tamanho
+    esp_err_t err = httpd_ws_recv_frame(req, &ws_frame, 0);
+    if (err != ESP_OK) {
+        MY_LOGE("httpd_ws_recv_frame falhou (%s)", esp_err_to_name(err));
+        return err;
+    }
+    if (ws_frame.type != HTTPD_WS_TYPE_TEXT || ws_frame.len == 0) {
+        return ESP_OK;
+    }
+    if (ws_frame.len >= sizeof(arena->param)) {
+        MY_LOGE("Frame WebSocket de %u bytes excede o limite", ws_frame.len);
+        return ESP_FAIL;
+    }
+    ws_frame.payload = (uint8_t*)command;
+    err = httpd_ws_recv_frame(req, &ws_frame, ws_frame.len);
+    if (err != ESP_OK) {
+        return err;
+    }
+    command[ws_frame.len] = '\0';
+
+    http_requests_received++;
+    int fd = httpd_req_to_sockfd(req);
+    // o ok do sensor pode demorar; o comando segue para um request worker
+    if (_submit_ws_command(fd, command) != ESP_OK) {
+        _ws_send_async(fd, "Busy;", 5);
+    }
+    _log_stack_usage("/ws");
+    return ESP_OK;
+}
+
+esp_err_t AsyncServer::_ws_command_worker(request_job_t* job) {
+    _ws_handle_command(job->fd, job->query);
+    return ESP_OK;
+}
+
+void AsyncServer::_ws_handle_command(int fd, const char* command) {
+    // espaco para o prefixo "@<id>,"
+    char ack[ASYNC_SRV_WS_MSG_SIZE];
+    size_t ack_size = sizeof(ack);
+    uint16_t response;
+
+    MY_LOGI("Comando via WebSocket: %s", command);
+    command_slot_t* slot =
+        _commands.acquire(COMMAND_SINK_WS, ASYNC_SRV_D_RESPONSE_REQUEST_TIMEOUT_MS, fd);
+    if (slot == NULL) {
+        _ws_send_async(fd, "Busy;", 5);
+        return;
+    }
+
+    // tudo que desce para o WebSocket leva o id, pois varios comandos podem
+    // estar em andamento na mesma conexao
+    int prefix_len = snprintf(ack, ack_size, "%c%u,", COMMAND_ID_PREFIX, slot->id);
+    response = _send_command(slot, command, ack + prefix_len);
+
+    if (response != HANDLE_HTTP_RESPONSE_CODE_OK) {
+        strlcpy(ack + prefix_len,
+                response == HANDLE_HTTP_RESPONSE_CODE_NOT_OK ? "Not fine;" : "Timeout;",
+                ack_size - prefix_len);
+        _ws_send_async(fd, ack, strlen(ack));
+        _commands.release(slot);
+        return;
+    }
+    _ws_send_async(fd, ack, strlen(ack));
+
+    // as respostas seguem pelos mesmos coletores do /out, entregues neste fd
+    if (!_dispatch_to_collector(slot)) {
+        snprintf(ack, ack_size, "%c%u,Busy;", COMMAND_ID_PREFIX, slot->id);
+        _ws_send_async(fd, ack, strlen(ack));
+        _commands.release(slot);
+    }
+}
+
+bool AsyncServer::_ws_has_clients() {
+    for (int i = 0; i < ASYNC_SRV_MAX_OPEN_SOCKETS; i++) {
+        if (_ws_fds[i] >= 0)
+            return true;
+    }
+    return false;
+}
+
+void AsyncServer::_ws_broadcast(const char* msg, size_t len) {
+    _ws_send_async(-1, msg, len);
+}
+
+void AsyncServer::_ws_send_async(int fd, const char* msg, size_t len) {
+    if (_server == NULL) {
+        return;
+    }
+    ws_async_msg_t* async_msg = NULL;
+    if (xQueueReceive(_free_ws_msgs, &async_msg, 0) != pdTRUE) {
+        MY_LOGW("Mensagens WebSocket esgotadas, descartando");
+        return;
+    }
+    if (len > sizeof(async_msg->data)) {
+        MY_LOGW("Mensagem WebSocket truncada: %u bytes", len);
+        len = sizeof(async_msg->data);
+    }
+    async_msg->fd = fd;
+    async_msg->len = len;
+    memcpy(async_msg->data, msg, len);
+    // o envio acontece na task do httpd, que e a dona dos sockets
+    if (httpd_queue_work(_server, _ws_send_work, async_msg) != ESP_OK) {
+        xQueueSend(_free_ws_msgs, &async_msg, 0);
+    }
+}
+
+void AsyncServer::_ws_send_work(void* arg) {
+    ws_async_msg_t* async_msg = (ws_async_msg_t*)arg;
+    httpd_ws_frame_t ws_frame;
+    memset(&ws_frame, 0, sizeof(ws_frame));
+    ws_frame.final = true;
+    ws_frame.type = HTTPD_WS_TYPE_TEXT;
+    ws_frame.payload = (uint8_t*)async_msg->data;
+    ws_frame.len = async_msg->len;
+
+    for (int i = 0; i < ASYNC_SRV_MAX_OPEN_SOCKETS; i++) {
+        int fd = _ws_fds[i];
+        if (fd < 0 || (async_msg->fd >= 0 && async_msg->fd != fd)) {
+            continue;
+        }
+        if (httpd_ws_get_fd_info(_server, fd) != HTTPD_WS_CLIENT_WEBSOCKET) {
+            _ws_fds[i] = -1;
+            continue;
+        }
+        httpd_ws_send_frame_async(_server, fd, &ws_frame);
+    }
+    xQueueSend(_free_ws_msgs, &async_msg, 0);
+}
+
+void AsyncServer::_on_socket_close(httpd_handle_t hd, int sockfd) {
+    bool in_use = false;
+    for (int i = 0; i < ASYNC_SRV_MAX_OPEN_SOCKETS; i++) {
+        if (_ws_fds[i] == sockfd) {
+            MY_LOGI("Cliente WebSocket desconectado, fd %d", sockfd);
+            _ws_fds[i] = -1;
+        }
+    }
+    // um worker ainda escrevendo neste fd fecha o socket quando terminar, para
+    // o numero nao ser reaproveitado por outra conexao no meio da resposta
+    portENTER_CRITICAL(&_jobs_mux);
+    for (int i = 0; i < ASYNC_SRV_REQUEST_QUEUE_LENGTH; i++) {
+        if (_jobs[i].fd == sockfd) {
+            _jobs[i].closed = true;
+            in_use = true;
+        }
+    }
+    portEXIT_CRITICAL(&_jobs_mux);
+    if (!in_use) {
+        close(sockfd);
+    }
+}
+
+/**
+ * @brief Buffers da sessao HTTP. Na primeira requisicao da conexao um arena do
+ * pool e vinculado ao sess_ctx e volta ao pool quando o httpd fecha a sessao.
+ * 
+ * @param req 
+ * @return request_arena_t* NULL se o pool estiver esgotado
+ */
+request_arena_t* AsyncServer::_get_arena(httpd_req_t* req) {
+    if (req->sess_ctx != NULL) {
+        return (request_arena_t*)req->sess_ctx;
+    }
+    for (int i = 0; i < ASYNC_SRV_MAX_OPEN_SOCKETS; i++) {
+        if (!_arena_in_use[i]) {
+            _arena_in_use[i] = true;
+            req->sess_ctx = &_arenas[i];
+            req->free_ctx = _release_arena;
+            return &_arenas[i];
+        }
+    }
+    MY_LOGE("Nenhum request_arena_t livre");
+    httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, NULL);
+    return NULL;
+}
+
+void AsyncServer::_release_arena(void* ctx) {
+    for (int i = 0; i < ASYNC_SRV_MAX_OPEN_SOCKETS; i++) {
+        if (ctx == &_arenas[i]) {
+            _arena_in_use[i] = false;
+        }
+    }
+}
+
+void AsyncServer::_log_stack_usage(const char* uri) {
+    // o handler roda na task do httpd ou em um request worker
+    UBaseType_t free_bytes = uxTaskGetStackHighWaterMark(NULL);
+    if (free_bytes < ASYNC_SRV_STACK_LOW_WATER_WARN) {
+        MY_LOGW("%s: stack livre minima da task %s em %u bytes", uri, pcTaskGetTaskName(NULL),
+                free_bytes);
+    } else {
+        MY_LOGI("%s: stack livre minima da task %s em %u bytes", uri, pcTaskGetTaskName(NULL),
+                free_bytes);
+    }
+}
+
 esp_err_t AsyncServer::direct_msg_handler(httpd_req_t* req) {
     MY_LOGI("Recebido requisicao HTTP GET /direct: %s", req->uri);
-    char buffer[1500];
-    size_t buffer_max_size = sizeof(buffer);
-    char param[1000];
+    request_arena_t* arena = _get_arena(req);
+    if (arena == NULL) {
+        return ESP_FAIL;
+    }
+    // o buffer da query e reaproveitado para o conteudo da resposta do handler
+    char* buffer = arena->query;
+    size_t buffer_max_size = sizeof(arena->query);
+    char* param = arena->param;
     char status[6];
+    param[0] = '\0';
     size_t buf_len;
-    bool responses_with_content = false;
     bool multiple_responses = false;
-    char* next_char;
+    const direct_msg_def_t* msg_def;
 
     http_requests_received++;
 
@@ -570,11 +1229,11 @@ esp_err_t AsyncServer::direct_msg_handler(httpd_req_t* req) {
     buf_len = httpd_req_get_url_query_len(req) + 1;
 
     if (buf_len > 1) {
-        if (httpd_req_get_url_query_str(req, buffer, buf_len) == ESP_OK) {
+        if (httpd_req_get_url_query_str(req, buffer, buffer_max_size) == ESP_OK) {
             ESP_LOGI(TAG, "Found URL query => %s", buffer);
 
             /* Get value of expected key from query string */
-            if (httpd_query_key_value(buffer, "text", param, sizeof(param)) ==
+            if (httpd_query_key_value(buffer, "text", param, sizeof(arena->param)) ==
                 ESP_OK) {
                 ESP_LOGI(TAG, "Found URL query parameter => text=%s", param);
             }
@@ -583,63 +1242,15 @@ esp_err_t AsyncServer::direct_msg_handler(httpd_req_t* req) {
     convert_html_text_to_ascii(param);
 
     MY_LOGD("Decoded parameter => %s", param);
-    char* msg_code = strtok_r(param, ",", &next_char);
-    if (msg_code == NULL) {
-        MY_LOGE("Código inválido de mensagem");
-        return ESP_FAIL;
-    }
-
-    char* msg_content;
-
-    uint8_t msg_code_uint8 = strtol(msg_code, &msg_content, 10);
-    // Para pular '/0' gerado por strtok_r
-    msg_content++;
-
-    MY_LOGD("Msg code test %u | msg test %s", msg_code_uint8, msg_content);
-
-    esp_err_t err;
-    // memset(buf, 0, 1500);
-
-    // char* msg_response_content = buf;
-    switch (msg_code_uint8) {
-    case WIFI_MODE_CHANGE_CODE:
-        err = msg_handler_wifi_mode_change(msg_content);
-        // strcpy(msg_response_content, ";\0");
-        break;
-    case WIFI_AP_CONFIG_CHANGE_CODE:
-        err = msg_handler_wifi_ap_config_change(msg_content);
-        // strcpy(msg_response_content, ";\0");
-        break;
-    case WIFI_STA_CONFIG_CHANGE_CODE:
-        err = msg_handler_wifi_sta_config_change(msg_content);
-        // strcpy(msg_response_content, ";\0");
-        break;
-    case WIFI_GET_SSID_LIST_CODE:
-        err = msg_handler_get_ssid_list(msg_content);
-        break;
-    case WIFI_AP_VALIDATE_CREDENTIALS_CODE:
-        err = msg_handler_validate_ap_credentials(msg_content);
-        break;
-    case INTERFACE_INFO_REQUEST_CODE:
-        memset(buffer, 0, buffer_max_size);
-        err = msg_handler_interface_info_requested(buffer);
-        responses_with_content = true;
-        break;
-    case RTC_UPDATE_CODE:
-        err = msg_handler_rtc_update(msg_content);
-        break;
-    case REPORT_CONFIG_CODE:
-        err = msg_handler_report_config(msg_content);
-        break;
-    default:
-        MY_LOGE("Código de mensagem inválido");
-        return ESP_FAIL;
-    }
+    // codigo, quantidade e tipo dos argumentos vem da tabela (direct_msg_registry)
+    memset(buffer, 0, buffer_max_size);
+    // codigo desconhecido (msg_def NULL) volta como qualquer outra recusa
+    esp_err_t err = direct_msg_dispatch(param, buffer, buffer_max_size, &msg_def);
 
     httpd_resp_set_type(req, "text/plain; charset=utf-16");
 
-    char handler_result_msg[1600];
-    size_t size_of_handler_result_msg = sizeof(handler_result_msg);
+    char* handler_result_msg = arena->response;
+    size_t size_of_handler_result_msg = sizeof(arena->response);
 
     if (err == ESP_OK) {
         snprintf(status, 6, "%d", HANDLE_HTTP_RESPONSE_CODE_OK);
@@ -649,7 +1260,7 @@ esp_err_t AsyncServer::direct_msg_handler(httpd_req_t* req) {
                 multiple_responses ? DIRECT_MSG_MULTI_RESPONSE_OK
                                    : DIRECT_MSG_FINAL_RESPONSE_OK,
                 size_of_handler_result_msg);
-        if (responses_with_content) {
+        if (msg_def->has_content) {
             strlcat(handler_result_msg, buffer, size_of_handler_result_msg);
         }
         strlcat(handler_result_msg, END_OF_MESSAGE_IDENTIFIER,
@@ -665,6 +1276,7 @@ esp_err_t AsyncServer::direct_msg_handler(httpd_req_t* req) {
 
     httpd_resp_send(req, handler_result_msg, HTTPD_RESP_USE_STRLEN);
 
+    _log_stack_usage("/direct");
     return err;
 }
 
@@ -680,103 +1292,255 @@ esp_err_t clear_file(const char* filename, bool is_binary = true) {
     return ESP_OK;
 }
 
-esp_err_t AsyncServer::upgrade_post_handler(httpd_req_t* req) {
-    // WIP
-    return ESP_OK;
+bool AsyncServer::_parse_report_day(const char* text, int32_t* unix_day) {
+    uint8_t digits[6];
+    for (uint8_t i = 0; i < 6; i++) {
+        if (text[i] < '0' || text[i] > '9')
+            return false;
+        digits[i] = text[i] - '0';
+    }
+    if (text[6] != '\0')
+        return false;
+    uint8_t month = digits[2] * 10 + digits[3];
+    uint8_t day = digits[4] * 10 + digits[5];
+    if (month < 1 || month > 12 || day < 1 || day > 31)
+        return false;
+    *unix_day = ReportReader::unixDayFromDate(2000 + digits[0] * 10 + digits[1], month, day);
+    return true;
 }
 
-void AsyncServer::_device_response_string(char* response) {
-    // AsyncWebServerRequest *request = (AsyncWebServerRequest*) param;
-    char ent[1500];
-    bool request_is_complete = false;
-    uint32_t request_timer,
-        REQUEST_TIMEOUT = ASYNC_SRV_D_RESPONSE_REQUEST_TIMEOUT_MS;
-    uint32_t client_wait_timer,
-        CLIENT_WAIT_TIMEOUT = ASYNC_SRV_CLIENT_RESPONSE_REQUEST_TIMEOUT_MS;
-    bool request_timeout = false;
-    request_timer = millis();
-    // recebe as mensagens via UART e repassa para o aplicativo ate receber
-    // a mensagem final. Se nao receber a mensagem a tempo retorna uma mensagem de erro
-    while (!request_is_complete || !request_timeout) {
-
-        if (Serial2.available()) {
-            uint8_t value;
-            memset(ent, 0, 1499);
-            value = Serial2.readBytesUntil(';', ent, ASYNC_SRV_MSG_LENGTH);
-            MY_LOGD("Dado lido2: %s", ent);
-            // se for uma das mensagens de fim, finaliza a requisicao
-
-            // if(strstr(ent, "009") != NULL || strstr(ent, "007") != NULL)
-            if (strncmp(ent, "009", 3) == 0 || strncmp(ent, "007", 3) == 0) {
-                MY_LOGI("REQUEST IS COMPLETE");
-                request_is_complete = true;
-            }
-            if (!request_is_complete && strncmp(ent, "008", 3) != 0) {
-                MY_LOGE("A mensagem veio com erro!");
-                continue;
-            }
-            strcat(ent, ";");
-            strncpy(_msg, ent, ASYNC_SRV_MSG_LENGTH);
-            MY_LOGI("Tudo certo, enviando a mensagem %s", _msg);
-            strcat(response, ent);
-        }
-        // se o tempo de espera da requisicao passar de TIMEOUT
-        if (millis() - request_timer >
-            ASYNC_SRV_D_RESPONSE_REQUEST_TIMEOUT_MS) {
-            MY_LOGI("REQUEST TIMEOUT");
-            request_timeout = true;
+/**
+ * @brief Dias pedidos no /report: ?day=AAMMDD ou ?from=AAMMDD&to=AAMMDD.
+ * 
+ */
+bool AsyncServer::_report_days_from_query(const char* query, int32_t* first_day,
+                                          int32_t* last_day) {
+    char value[8];
+
+    if (httpd_query_key_value(query, "day", value, sizeof(value)) == ESP_OK) {
+        if (!_parse_report_day(value, first_day))
+            return false;
+        *last_day = *first_day;
+        return true;
+    }
+    if (httpd_query_key_value(query, "from", value, sizeof(value)) != ESP_OK ||
+        !_parse_report_day(value, first_day))
+        return false;
+    if (httpd_query_key_value(query, "to", value, sizeof(value)) != ESP_OK ||
+        !_parse_report_day(value, last_day))
+        return false;
+    return true;
+}
+
+/**
+ * @brief Interpreta "bytes=a-b", "bytes=a-" e "bytes=-n". De uma lista de
+ * intervalos so o primeiro e atendido.
+ * 
+ * @param header Valor do cabecalho Range
+ * @param total Tamanho do conteudo
+ * @param start 
+ * @param end Inclusivo
+ * @return false se o intervalo nao puder ser atendido
+ */
+bool AsyncServer::_parse_range(const char* header, uint32_t total, uint32_t* start,
+                               uint32_t* end) {
+    const char* p = header;
+    uint32_t first = 0, last = 0;
+    bool has_first = false, has_last = false;
+
+    if (strncmp(p, "bytes=", 6) != 0 || total == 0)
+        return false;
+    p += 6;
+    while (*p >= '0' && *p <= '9') {
+        first = first * 10 + (*p++ - '0');
+        has_first = true;
+    }
+    if (*p++ != '-')
+        return false;
+    while (*p >= '0' && *p <= '9') {
+        last = last * 10 + (*p++ - '0');
+        has_last = true;
+    }
+    if (*p != '\0' && *p != ',')
+        return false;
+
+    if (!has_first) {
+        // sufixo: os ultimos n bytes
+        if (!has_last || last == 0)
+            return false;
+        *start = last >= total ? 0 : total - last;
+        *end = total - 1;
+        return true;
+    }
+    if (first >= total || (has_last && last < first))
+        return false;
+    *start = first;
+    *end = (!has_last || last >= total) ? total - 1 : last;
+    return true;
+}
+
+/**
+ * @brief Download dos arquivos diarios de relatorio como um unico stream
+ * (chunked). O SD le o proximo bloco enquanto o atual e enviado. Com Range
+ * responde 206, permitindo retomar um download interrompido.
+ * 
+ * @param req 
+ * @return esp_err_t 
+ */
+esp_err_t AsyncServer::report_get_handler(httpd_req_t* req) {
+    return _submit_to_worker(req, _report_worker);
+}
+
+esp_err_t AsyncServer::_report_worker(request_job_t* job) {
+    MY_LOGI("Recebido requisicao HTTP GET /report: %s", job->query);
+    // o buffer de parametro guarda os cabecalhos da resposta
+    char* headers = job->scratch->param;
+    size_t headers_size = sizeof(job->scratch->param);
+    int32_t first_day, last_day;
+    uint32_t start, end, total;
+    bool partial = false;
+
+    http_requests_received++;
+
+    if (!_report_days_from_query(job->query, &first_day, &last_day)) {
+        _job_resp_send(job, "400 Bad Request", "text/html", NULL,
+                       "Use day=AAMMDD ou from=AAMMDD&to=AAMMDD");
+        return ESP_FAIL;
+    }
+
+    esp_err_t err = ReportReader::open(first_day, last_day, http_packet_buffer,
+                                       report_packet_buffer, sizeof(http_packet_buffer));
+    if (err == ESP_ERR_INVALID_STATE) {
+        _job_resp_send(job, "503 Busy", "text/html", NULL, "Busy;");
+        return ESP_OK;
+    } else if (err == ESP_ERR_NOT_FOUND) {
+        _job_resp_send(job, "404 Not Found", "text/html", NULL, "Nenhum relatorio no periodo");
+        return ESP_FAIL;
+    } else if (err != ESP_OK) {
+        _job_resp_send(job, "400 Bad Request", "text/html", NULL, "Periodo invalido");
+        return ESP_FAIL;
+    }
+
+    total = ReportReader::totalSize();
+    start = 0;
+    end = total - 1;
+    if (job->range[0] != '\0') {
+        if (!_parse_range(job->range, total, &start, &end)) {
+            ReportReader::close();
+            snprintf(headers, headers_size, "Content-Range: bytes */%u\r\n", total);
+            _job_resp_send(job, "416 Range Not Satisfiable", "text/html", headers, "");
+            return ESP_OK;
+        }
+        partial = true;
+    }
+    ReportReader::seek(start, end - start + 1);
+
+    if (partial) {
+        snprintf(headers, headers_size,
+                 "Content-Range: bytes %u-%u/%u\r\nAccept-Ranges: bytes\r\n", start, end,
+                 total);
+    } else {
+        strlcpy(headers, "Accept-Ranges: bytes\r\n", headers_size);
+    }
+    _job_resp_start(job, partial ? "206 Partial Content" : "200 OK", "application/octet-stream",
+                    headers);
+
+    const char* data;
+    int32_t len;
+    uint32_t sent = 0;
+    int64_t started_us = esp_timer_get_time();
+    while ((len = ReportReader::read(&data)) > 0) {
+        if (!_job_resp_chunk(job, data, len)) {
             break;
         }
-        vTaskDelay(1 / portTICK_PERIOD_MS);
+        sent += len;
     }
+    ReportReader::close();
+
+    uint32_t elapsed_ms = (esp_timer_get_time() - started_us) / 1000;
+    MY_LOGI("/report: %u de %u bytes em %u ms", sent, end - start + 1, elapsed_ms);
+    if (sent != end - start + 1) {
+        // sem o chunk final o cliente percebe o download incompleto e pode
+        // retomar com Range
+        MY_LOGE("/report interrompido (%d)", len);
+        return ESP_FAIL;
+    }
+    _job_resp_chunk(job, NULL, 0);
+    _log_stack_usage("/report");
+    return ESP_OK;
 }
 
-void AsyncServer::_device_response_from_uart_task(httpd_req_t* req) {
-    uint16_t queue_lenght = 65535;
-    char uart_queue_msg[UART_QUEUE_MSG_LENGTH];
-    MY_LOGD("Iniciando _device_response_from_uart_task");
-    // recebe as mensagens via UART e repassa para o aplicativo ate receber
-    // a mensagem final. Se nao receber a mensagem a tempo retorna uma mensagem de erro
+esp_err_t AsyncServer::upgrade_post_handler(httpd_req_t* req) {
+    // WIP
+    return ESP_OK;
+}
 
-    while ((!_uart_response_is_complete && !_uart_response_is_timeout) ||
-           uxQueueMessagesWaiting(_queue_uart_msg) > 0) {
-        queue_lenght = uxQueueMessagesWaiting(_queue_uart_msg);
-        while (queue_lenght > 0) {
-            if (xQueueReceive(_queue_uart_msg, uart_queue_msg, 10) == pdTRUE) {
-                MY_LOGD("Adicionando na response: %s", uart_queue_msg);
-                if (req != nullptr) {
-                    MY_LOGI("Req is not null, sending chunk");
-                    httpd_resp_send_chunk(req, uart_queue_msg,
-                                          strlen(uart_queue_msg));
-                }
-            }
-            queue_lenght = uxQueueMessagesWaiting(_queue_uart_msg);
-            vTaskDelay(1 / portTICK_PERIOD_MS);
+void AsyncServer::_device_response_from_uart_task(request_job_t* job, command_slot_t* slot,
+                                                  char* buffer, size_t buffer_size) {
+    size_t len;
+    MY_LOGD("Iniciando _device_response_from_uart_task (comando %u)", slot->id);
+    _job_resp_start(job, "200 OK", "text/html", NULL);
+    // recebe as mensagens do coletor e repassa para o
+    // aplicativo ate a mensagem final ou o timeout. Dorme ate ser notificada.
+    slot->waiter = xTaskGetCurrentTaskHandle();
+
+    while (1) {
+        // o fim e sinalizado depois da escrita do ultimo frame, entao ler o
+        // estado antes de drenar garante que nada fica para tras
+        bool finished = slot->state == COMMAND_STATE_DONE;
+
+        while ((len = xStreamBufferReceive(slot->stream, buffer, buffer_size, 0)) > 0) {
+            MY_LOGD("Adicionando na response: %.*s", len, buffer);
+            _job_resp_chunk(job, buffer, len);
+        }
+        if (finished) {
+            break;
+        }
+        // o coletor sempre termina no prazo do comando, que pode ser maior que
+        // o timeout padrao do cliente
+        uint32_t wait_ms = CommandTable::remainingMs(slot);
+        if (wait_ms < ASYNC_SRV_CLIENT_RESPONSE_REQUEST_TIMEOUT_MS)
+            wait_ms = ASYNC_SRV_CLIENT_RESPONSE_REQUEST_TIMEOUT_MS;
+        if (ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(wait_ms)) == 0) {
+            MY_LOGW("Nenhuma resposta do coletor do comando %u", slot->id);
+            break;
         }
-        vTaskDelay(10 / portTICK_PERIOD_MS);
     }
+    slot->waiter = NULL;
+
     MY_LOGD("Ending _device_response_from_uart_task");
-    if (req != nullptr) {
-        MY_LOGI("Req is not null, sending final chunk");
-        httpd_resp_send_chunk(req, NULL, 0);
-    }
+    _job_resp_chunk(job, NULL, 0);
+}
+
+bool AsyncServer::_is_final_response_frame(const char* msg) {
+    return strncmp(msg, "009", 3) == 0 || strncmp(msg, "007", 3) == 0;
+}
+
+bool AsyncServer::_is_response_frame(const char* msg) {
+    return _is_final_response_frame(msg) || strncmp(msg, "008", 3) == 0;
 }
 
 httpd_handle_t AsyncServer::start_webserver(void) {
     httpd_handle_t server = NULL;
     httpd_config_t config = HTTPD_DEFAULT_CONFIG();
     config.lru_purge_enable = true;
-    config.max_open_sockets = 2;
-    config.stack_size = 1024 * 24;
+    config.max_open_sockets = ASYNC_SRV_MAX_OPEN_SOCKETS;
+    config.close_fn = _on_socket_close;
+    // buffers grandes das requisicoes ficam no request_arena_t da sessao
+    config.stack_size = ASYNC_SRV_HTTPD_STACK_SIZE;
     ESP_LOGI(TAG, "Starting server on port: '%d'", config.server_port);
     if (httpd_start(&server, &config) == ESP_OK) {
         ESP_LOGI(TAG, "Registering URI handlers");
         httpd_register_uri_handler(server, &echo);
         httpd_register_uri_handler(server, &ans);
         httpd_register_uri_handler(server, &out);
+        httpd_register_uri_handler(server, &cmd);
+        httpd_register_uri_handler(server, &ws);
         httpd_register_uri_handler(server, &direct);
+        httpd_register_uri_handler(server, &report);
 
         // httpd_register_uri_handler(server, &upgrade);
+        _server = server;
         return server;
     }
 
@@ -787,6 +1551,10 @@ httpd_handle_t AsyncServer::start_webserver(void) {
 
 void AsyncServer::stop_webserver(httpd_handle_t server) {
     httpd_stop(server);
+    _server = NULL;
+    for (int i = 0; i < ASYNC_SRV_MAX_OPEN_SOCKETS; i++) {
+        _ws_fds[i] = -1;
+    }
 }
 
 void AsyncServer::disconnect_handler(void* arg, esp_event_base_t event_base,
@@ -829,70 +1597,344 @@ void AsyncServer::ip_any_handler(void* arg, esp_event_base_t event_base,
     }
 }
 
-void AsyncServer::_uart_receive_response_task(void* arg) {
-    MY_LOGI("Iniciando _uart_receive_response_task")
-    char ent[1500];
-    bool request_is_complete = false;
-    uint32_t request_timer,
-        REQUEST_TIMEOUT = ASYNC_SRV_D_RESPONSE_REQUEST_TIMEOUT_MS;
-    uint32_t client_wait_timer,
-        CLIENT_WAIT_TIMEOUT = ASYNC_SRV_CLIENT_RESPONSE_REQUEST_TIMEOUT_MS;
-    bool request_timeout = false;
-    request_timer = millis();
-
-    if (xSemaphoreTake(_uart_mutex, portMAX_DELAY) != pdTRUE) {
-        return;
+/**
+ * @brief Cria os coletores de resposta uma unica vez, com stacks estaticas,
+ * evitando criar e destruir uma task a cada comando.
+ * 
+ */
+void AsyncServer::_start_collectors() {
+    _collector_queue = xQueueCreate(ASYNC_SRV_MAX_INFLIGHT_COMMANDS, sizeof(collector_job_t));
+    if (_collector_queue == NULL) {
+        MY_LOGE("Nao foi possivel criar a fila dos coletores");
+        abort();
     }
+    for (uint8_t i = 0; i < ASYNC_SRV_COLLECTOR_WORKERS; i++) {
+        char name[16];
+        snprintf(name, sizeof(name), "collector_%u", i);
+        TaskHandle_t handle = xTaskCreateStatic(
+            _collector_worker_task, name, ASYNC_SRV_COLLECTOR_TASK_STACK_SIZE, NULL,
+            ASYNC_SRV_COLLECTOR_TASK_PRIORITY, _collector_stacks[i], &_collector_tcbs[i]);
+        if (handle == NULL) {
+            MY_LOGE("Nao foi possivel criar o coletor %u", i);
+            abort();
+        }
+    }
+}
 
-    // recebe as mensagens via UART e repassa para o aplicativo ate receber
-    // a mensagem final. Se nao receber a mensagem a tempo retorna uma mensagem de erro
-    while (!_uart_response_is_complete && !_uart_response_is_timeout) {
-        if (Serial2.available()) {
-            uint8_t value;
-            memset(ent, 0, 1499);
-            value = Serial2.readBytesUntil(';', ent, ASYNC_SRV_MSG_LENGTH);
-
-            if (ent[0] ==
-                '#') {  // ignora mensagem de relatorio, sinalizada pela inicio '#'
-                MY_LOGD("Mensagem de report ignorada: %s", ent);
-                report_msg_entry_t new_entry;
-                strcpy(new_entry.msg, ent + 4);
-                ReportHandler::add_entry_to_report_msg_buffer(new_entry);
-                continue;
-            }
+/**
+ * @brief Cria os request workers, que atendem as requisicoes que esperam o
+ * sensor enquanto a task do httpd continua livre para o /direct e o /echo.
+ * 
+ */
+void AsyncServer::_start_request_workers() {
+    _request_queue = xQueueCreate(ASYNC_SRV_REQUEST_QUEUE_LENGTH, sizeof(request_job_t*));
+    _free_jobs = xQueueCreate(ASYNC_SRV_REQUEST_QUEUE_LENGTH, sizeof(request_job_t*));
+    if (_request_queue == NULL || _free_jobs == NULL) {
+        MY_LOGE("Nao foi possivel criar a fila dos request workers");
+        abort();
+    }
+    for (uint8_t i = 0; i < ASYNC_SRV_REQUEST_QUEUE_LENGTH; i++) {
+        request_job_t* job = &_jobs[i];
+        job->fd = -1;
+        xQueueSend(_free_jobs, &job, 0);
+    }
+    for (uint8_t i = 0; i < ASYNC_SRV_REQUEST_WORKERS; i++) {
+        char name[16];
+        snprintf(name, sizeof(name), "request_%u", i);
+        TaskHandle_t handle = xTaskCreateStatic(
+            _request_worker_task, name, ASYNC_SRV_REQUEST_TASK_STACK_SIZE, &_request_scratch[i],
+            ASYNC_SRV_REQUEST_TASK_PRIORITY, _request_stacks[i], &_request_tcbs[i]);
+        if (handle == NULL) {
+            MY_LOGE("Nao foi possivel criar o request worker %u", i);
+            abort();
+        }
+    }
+}
 
-            MY_LOGD("Dado lido2: %s", ent);
-            // se for uma das mensagens de fim, finaliza a requisicao
-            if (strncmp(ent, "009", 3) == 0 || strncmp(ent, "007", 3) == 0) {
-                MY_LOGI("REQUEST IS COMPLETE");
-                request_is_complete = true;
-            }
-            if (!request_is_complete && strncmp(ent, "008", 3) != 0) {
-                MY_LOGE("A mensagem veio com erro!");
+/**
+ * @brief Prepara as mensagens WebSocket, reaproveitadas entre envios no lugar
+ * de um malloc por mensagem.
+ * 
+ */
+void AsyncServer::_start_ws_msg_pool() {
+    _free_ws_msgs = xQueueCreate(ASYNC_SRV_WS_MSG_POOL_LENGTH, sizeof(ws_async_msg_t*));
+    if (_free_ws_msgs == NULL) {
+        MY_LOGE("Nao foi possivel criar a fila das mensagens WebSocket");
+        abort();
+    }
+    for (uint8_t i = 0; i < ASYNC_SRV_WS_MSG_POOL_LENGTH; i++) {
+        ws_async_msg_t* async_msg = &_ws_msgs[i];
+        xQueueSend(_free_ws_msgs, &async_msg, 0);
+    }
+}
+
+/**
+ * @brief Pega um job livre para o fd. Chamado so pela task do httpd.
+ * 
+ * @return request_job_t* NULL se todos os jobs estiverem em uso
+ */
+request_job_t* AsyncServer::_take_job(int fd, request_handler_t handler) {
+    request_job_t* job = NULL;
+    if (xQueueReceive(_free_jobs, &job, 0) != pdTRUE) {
+        MY_LOGE("Request workers ocupados");
+        return NULL;
+    }
+    job->handler = handler;
+    job->failed = false;
+    job->query[0] = '\0';
+    job->range[0] = '\0';
+    portENTER_CRITICAL(&_jobs_mux);
+    job->fd = fd;
+    job->closed = false;
+    portEXIT_CRITICAL(&_jobs_mux);
+    return job;
+}
+
+/**
+ * @brief Passa a requisicao para um request worker. A task do httpd copia a
+ * query e o Range para o job e retorna sem responder; o worker escreve a
+ * resposta no socket (_job_resp_*). Os clientes nao usam pipelining, entao o
+ * httpd so le a proxima requisicao da conexao depois dessa resposta.
+ * 
+ * @param req 
+ * @param handler Executado no worker
+ * @return esp_err_t 
+ */
+esp_err_t AsyncServer::_submit_to_worker(httpd_req_t* req, request_handler_t handler) {
+    request_job_t* job = _take_job(httpd_req_to_sockfd(req), handler);
+    if (job == NULL) {
+        httpd_resp_set_status(req, "503 Busy");
+        httpd_resp_send(req, "Busy;", HTTPD_RESP_USE_STRLEN);
+        return ESP_OK;
+    }
+    // query maior que o buffer segue vazia, como uma requisicao sem parametros
+    if (httpd_req_get_url_query_str(req, job->query, sizeof(job->query)) != ESP_OK) {
+        job->query[0] = '\0';
+    }
+    if (httpd_req_get_hdr_value_str(req, "Range", job->range, sizeof(job->range)) != ESP_OK) {
+        job->range[0] = '\0';
+    }
+    // a fila tem uma posicao por job
+    xQueueSend(_request_queue, &job, 0);
+    return ESP_OK;
+}
+
+esp_err_t AsyncServer::_submit_ws_command(int fd, const char* command) {
+    if (strlen(command) > ASYNC_SRV_MSG_LENGTH) {
+        MY_LOGE("Comando WebSocket maior que %u bytes", ASYNC_SRV_MSG_LENGTH);
+        return ESP_ERR_INVALID_SIZE;
+    }
+    request_job_t* job = _take_job(fd, _ws_command_worker);
+    if (job == NULL) {
+        return ESP_FAIL;
+    }
+    strlcpy(job->query, command, sizeof(job->query));
+    xQueueSend(_request_queue, &job, 0);
+    return ESP_OK;
+}
+
+void AsyncServer::_request_worker_task(void* arg) {
+    // buffers do worker, fora da stack
+    request_scratch_t* scratch = (request_scratch_t*)arg;
+    request_job_t* job;
+
+    while (1) {
+        if (xQueueReceive(_request_queue, &job, portMAX_DELAY) != pdTRUE) {
+            continue;
+        }
+        job->scratch = scratch;
+        esp_err_t err = job->handler(job);
+
+        portENTER_CRITICAL(&_jobs_mux);
+        bool closed = job->closed;
+        int fd = job->fd;
+        job->fd = -1;
+        portEXIT_CRITICAL(&_jobs_mux);
+
+        if (closed) {
+            // o httpd ja descartou a sessao e deixou o socket para o worker
+            close(fd);
+        } else if (err != ESP_OK || job->failed) {
+            // como o httpd faz quando um handler falha
+            httpd_sess_trigger_close(_server, fd);
+        }
+        xQueueSend(_free_jobs, &job, 0);
+    }
+}
+
+bool AsyncServer::_job_send(request_job_t* job, const char* data, size_t len) {
+    while (len > 0) {
+        if (job->failed || job->closed) {
+            return false;
+        }
+        int sent = httpd_socket_send(_server, job->fd, data, len, 0);
+        if (sent <= 0) {
+            MY_LOGW("Falha ao enviar no fd %d (%d)", job->fd, sent);
+            job->failed = true;
+            return false;
+        }
+        data += sent;
+        len -= sent;
+    }
+    return true;
+}
+
+/**
+ * @brief Linha de status e cabecalhos de uma resposta em chunked encoding.
+ * 
+ * @param headers Cabecalhos extras, cada um terminado em "\r\n" (ou NULL)
+ */
+bool AsyncServer::_job_resp_start(request_job_t* job, const char* status, const char* type,
+                                  const char* headers) {
+    char head[128];
+    int len = snprintf(head, sizeof(head),
+                       "HTTP/1.1 %s\r\nContent-Type: %s\r\nTransfer-Encoding: chunked\r\n",
+                       status, type);
+    return _job_send(job, head, len) &&
+           (headers == NULL || _job_send(job, headers, strlen(headers))) &&
+           _job_send(job, "\r\n", 2);
+}
+
+/**
+ * @brief Envia um chunk; len 0 termina a resposta.
+ * 
+ */
+bool AsyncServer::_job_resp_chunk(request_job_t* job, const char* data, size_t len) {
+    if (len == 0) {
+        return _job_send(job, "0\r\n\r\n", 5);
+    }
+    char size[12];
+    int size_len = snprintf(size, sizeof(size), "%x\r\n", (unsigned)len);
+    return _job_send(job, size, size_len) && _job_send(job, data, len) &&
+           _job_send(job, "\r\n", 2);
+}
+
+/**
+ * @brief Resposta completa, com Content-Length.
+ * 
+ * @param headers Cabecalhos extras, cada um terminado em "\r\n" (ou NULL)
+ */
+bool AsyncServer::_job_resp_send(request_job_t* job, const char* status, const char* type,
+                                 const char* headers, const char* body) {
+    char head[128];
+    size_t body_len = strlen(body);
+    int len = snprintf(head, sizeof(head),
+                       "HTTP/1.1 %s\r\nContent-Type: %s\r\nContent-Length: %u\r\n", status,
+                       type, (unsigned)body_len);
+    return _job_send(job, head, len) &&
+           (headers == NULL || _job_send(job, headers, strlen(headers))) &&
+           _job_send(job, "\r\n", 2) && _job_send(job, body, body_len);
+}
+
+/**
+ * @brief Entrega o comando (ja com ok) a um coletor. Nao bloqueia: a fila tem
+ * uma posicao por slot da tabela de comandos.
+ * 
+ * @param slot 
+ * @return true se algum coletor vai atender o comando
+ */
+bool AsyncServer::_dispatch_to_collector(command_slot_t* slot) {
+    collector_job_t job = {.slot = slot, .enqueued_us = esp_timer_get_time()};
+    if (!_commands.dispatch(slot, _collector_queue, &job)) {
+        MY_LOGE("Fila dos coletores cheia, comando %u abandonado", slot->id);
+        portENTER_CRITICAL(&_collector_stats_mux);
+        _collector_stats.rejected++;
+        portEXIT_CRITICAL(&_collector_stats_mux);
+        return false;
+    }
+    return true;
+}
+
+collector_stats_t AsyncServer::collectorStats() {
+    collector_stats_t stats;
+    portENTER_CRITICAL(&_collector_stats_mux);
+    stats = _collector_stats;
+    portEXIT_CRITICAL(&_collector_stats_mux);
+    return stats;
+}
+
+void AsyncServer::_collector_worker_task(void* arg) {
+    collector_job_t job;
+
+    while (1) {
+        if (xQueueReceive(_collector_queue, &job, portMAX_DELAY) != pdTRUE) {
+            continue;
+        }
+        uint32_t wait_us = (uint32_t)(esp_timer_get_time() - job.enqueued_us);
+        portENTER_CRITICAL(&_collector_stats_mux);
+        _collector_stats.jobs++;
+        _collector_stats.total_wait_us += wait_us;
+        _collector_stats.last_wait_us = wait_us;
+        if (wait_us > _collector_stats.max_wait_us)
+            _collector_stats.max_wait_us = wait_us;
+        portEXIT_CRITICAL(&_collector_stats_mux);
+        MY_LOGD("Comando %u aguardou %u us por um coletor", job.slot->id, wait_us);
+
+        _collect_command_responses(job.slot);
+    }
+}
+
+void AsyncServer::_collect_command_responses(command_slot_t* slot) {
+    MY_LOGI("Coletando respostas do comando %u", slot->id);
+    uart_frame_t frame;
+    // resposta com o prefixo "@<id>," e o ';' do WebSocket, mais o '\0'
+    char ent[ASYNC_SRV_WS_MSG_SIZE + 1];
+    bool request_is_complete = false;
+    uint32_t remaining;
+    // depois do finish() o slot de um /out pode ser liberado e reaproveitado
+    command_sink_t sink = slot->sink;
+    uint8_t id = slot->id;
+    int ws_fd = slot->ws_fd;
+
+    // recebe as mensagens deste comando e repassa para o aplicativo ate
+    // receber a mensagem final. Se nao receber a tempo sinaliza o timeout
+    while (!request_is_complete && (remaining = CommandTable::remainingMs(slot)) > 0) {
+        if (xQueueReceive(slot->frames, &frame, pdMS_TO_TICKS(remaining)) != pdTRUE) {
+            continue;
+        }
+        MY_LOGD("Dado lido2: %s", frame.data);
+        if (!_is_response_frame(frame.data)) {
+            MY_LOGE("A mensagem veio com erro!");
+            continue;
+        }
+        // se for uma das mensagens de fim, finaliza a requisicao
+        request_is_complete = _is_final_response_frame(frame.data);
+        if (slot->sink == COMMAND_SINK_WS) {
+            int len = snprintf(ent, sizeof(ent), "%c%u,%s" END_OF_MESSAGE_IDENTIFIER,
+                               COMMAND_ID_PREFIX, slot->id, frame.data);
+            if (len < 0 || (size_t)len >= sizeof(ent)) {
+                MY_LOGE("Resposta do comando %u grande demais para o WebSocket", slot->id);
                 continue;
             }
-            strcat(ent, ";");
-            strncpy(_msg, ent, ASYNC_SRV_MSG_LENGTH);
-            MY_LOGD("Tudo certo, adicionando na queue a mensagem %s", _msg);
-            uint8_t ret =
-                xQueueSend(_queue_uart_msg, ent, DEVICE_XQUEUE_SEND_WAIT_MS);
-            if (ret != pdPASS) {
-                MY_LOGE("Error: queue _to_send is full!");
-            }
-            if (request_is_complete)
-                _uart_response_is_complete = true;
-        }
-        // se o tempo de espera da requisicao passar de TIMEOUT
-        if (millis() - request_timer >
-            ASYNC_SRV_D_RESPONSE_REQUEST_TIMEOUT_MS) {
-            MY_LOGI("REQUEST TIMEOUT");
-            _uart_response_is_timeout = true;
-            break;
+            _ws_send_async(slot->ws_fd, ent, len);
+            continue;
+        }
+        strlcat(frame.data, END_OF_MESSAGE_IDENTIFIER, sizeof(frame.data));
+        MY_LOGD("Tudo certo, adicionando no stream a mensagem %s", frame.data);
+        size_t len = strlen(frame.data);
+        if (xStreamBufferSend(slot->stream, frame.data, len, DEVICE_XQUEUE_SEND_WAIT_MS) != len) {
+            MY_LOGE("Error: stream do comando %u cheio!", slot->id);
+        }
+        TaskHandle_t waiter = slot->waiter;
+        if (waiter != NULL && !request_is_complete) {
+            xTaskNotifyGive(waiter);
         }
-        vTaskDelay(1 / portTICK_PERIOD_MS);
     }
-    xSemaphoreGive(_uart_mutex);
-    MY_LOGD("Finalizando a tarefa _uart_receive_response_task");
-    vTaskDelete(NULL);
+    if (request_is_complete) {
+        MY_LOGI("REQUEST IS COMPLETE (comando %u)", slot->id);
+    } else {
+        MY_LOGI("REQUEST TIMEOUT (comando %u)", slot->id);
+    }
+    _commands.finish(slot, !request_is_complete);
+
+    if (sink == COMMAND_SINK_WS) {
+        if (!request_is_complete) {
+            size_t len = snprintf(ent, sizeof(ent), "%c%u,Timeout;", COMMAND_ID_PREFIX, id);
+            _ws_send_async(ws_fd, ent, len);
+        }
+        // no WebSocket nao ha /ans para buscar o resultado
+        _commands.release(slot, COMMAND_OWNER_COLLECTOR);
+    }
 }
+
 }  // namespace Wetzel
\ No newline at end of file
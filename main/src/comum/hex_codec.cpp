@@ -0,0 +1,38 @@
+#include "hex_codec.h"
+
+namespace Wetzel {
+
+#define XX HEX_INVALID
+const uint8_t HEX_NIBBLE_TABLE[256] = {
+    XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+    XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+    XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+    0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, XX, XX, XX, XX, XX, XX,
+    XX, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+    XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+    XX, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+    XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+    XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+    XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+    XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+    XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+    XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+    XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+    XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+    XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+};
+#undef XX
+
+bool hex_decode(const char* text, uint8_t* out, size_t count) {
+    uint8_t invalid = 0;
+    for (size_t i = 0; i < count; i++) {
+        uint8_t high = hex_nibble(text[2 * i]);
+        uint8_t low = hex_nibble(text[2 * i + 1]);
+        // HEX_INVALID tem o nibble alto ligado, os digitos validos nao
+        invalid |= high | low;
+        out[i] = (high << 4) | (low & 0x0F);
+    }
+    return (invalid & 0xF0) == 0;
+}
+
+}  // namespace Wetzel
@@ -0,0 +1,257 @@
+#include "command_table.h"
+
+#include <string.h>
+
+#include "debug.h"
+
+static const char* TAG = __FILE__;
+
+namespace Wetzel {
+
+static inline uint32_t _now_ms() {
+    return pdTICKS_TO_MS(xTaskGetTickCount());
+}
+
+esp_err_t CommandTable::begin() {
+    _lock = xSemaphoreCreateMutex();
+    if (_lock == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    for (uint8_t i = 0; i < ASYNC_SRV_MAX_INFLIGHT_COMMANDS; i++) {
+        command_slot_t* slot = &_slots[i];
+        memset(slot, 0, sizeof(command_slot_t));
+        slot->state = COMMAND_STATE_FREE;
+        slot->ws_fd = -1;
+        // recursos alocados uma unica vez, reaproveitados a cada comando
+        slot->frames = xQueueCreate(ASYNC_SRV_CMD_FRAME_QUEUE_LENGTH, sizeof(uart_frame_t));
+        slot->stream = xStreamBufferCreate(ASYNC_SRV_CMD_STREAM_BUFFER_SIZE, 1);
+        if (slot->frames == NULL || slot->stream == NULL) {
+            MY_LOGE("Sem memoria para a tabela de comandos");
+            return ESP_ERR_NO_MEM;
+        }
+    }
+    return ESP_OK;
+}
+
+void CommandTable::setWindow(uint8_t window) {
+    if (window < 1) {
+        window = 1;
+    }
+    _window = window > ASYNC_SRV_MAX_INFLIGHT_COMMANDS ? ASYNC_SRV_MAX_INFLIGHT_COMMANDS : window;
+    MY_LOGI("Janela de comandos simultaneos: %u", _window);
+}
+
+uint8_t CommandTable::window() const {
+    return _window;
+}
+
+bool CommandTable::_id_in_use(uint8_t id) const {
+    for (uint8_t i = 0; i < ASYNC_SRV_MAX_INFLIGHT_COMMANDS; i++) {
+        if (_slots[i].state != COMMAND_STATE_FREE && _slots[i].id == id) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void CommandTable::_reclaim_expired(uint32_t now) {
+    // resultados de /out que ninguem veio buscar pelo /ans
+    for (uint8_t i = 0; i < ASYNC_SRV_MAX_INFLIGHT_COMMANDS; i++) {
+        command_slot_t* slot = &_slots[i];
+        if (slot->state == COMMAND_STATE_DONE && slot->owner == COMMAND_OWNER_TABLE &&
+            now - slot->done_ms > ASYNC_SRV_CMD_RESULT_RETENTION_MS) {
+            MY_LOGW("Resultado do comando %u descartado sem leitura", slot->id);
+            slot->owner = COMMAND_OWNER_NONE;
+            slot->state = COMMAND_STATE_FREE;
+        }
+    }
+}
+
+command_slot_t* CommandTable::acquire(command_sink_t sink, uint32_t timeout_ms, int ws_fd) {
+    command_slot_t* free_slot = NULL;
+    uint8_t used = 0;
+    uint32_t now = _now_ms();
+
+    xSemaphoreTake(_lock, portMAX_DELAY);
+    _reclaim_expired(now);
+    for (uint8_t i = 0; i < ASYNC_SRV_MAX_INFLIGHT_COMMANDS; i++) {
+        if (_slots[i].state != COMMAND_STATE_FREE) {
+            used++;
+        } else if (free_slot == NULL) {
+            free_slot = &_slots[i];
+        }
+    }
+    if (free_slot == NULL || used >= _window) {
+        xSemaphoreGive(_lock);
+        return NULL;
+    }
+    while (_next_id == COMMAND_ID_NONE || _id_in_use(_next_id)) {
+        _next_id++;
+    }
+    free_slot->id = _next_id++;
+    free_slot->sink = sink;
+    free_slot->timeout = false;
+    free_slot->owner = COMMAND_OWNER_REQUESTER;
+    free_slot->collecting = false;
+    free_slot->release_pending = false;
+    free_slot->ws_fd = ws_fd;
+    free_slot->started_ms = now;
+    free_slot->timeout_ms = timeout_ms;
+    free_slot->done_ms = 0;
+    free_slot->waiter = NULL;
+    xQueueReset(free_slot->frames);
+    xStreamBufferReset(free_slot->stream);
+    free_slot->state = COMMAND_STATE_WAIT_ACK;
+    xSemaphoreGive(_lock);
+    return free_slot;
+}
+
+/**
+ * @brief Deixa o slot livre. Chamado com o lock.
+ *
+ */
+void CommandTable::_free(command_slot_t* slot) {
+    slot->waiter = NULL;
+    slot->owner = COMMAND_OWNER_NONE;
+    slot->release_pending = false;
+    slot->state = COMMAND_STATE_FREE;
+}
+
+void CommandTable::release(command_slot_t* slot, command_owner_t owner) {
+    if (slot == NULL) {
+        return;
+    }
+    xSemaphoreTake(_lock, portMAX_DELAY);
+    if (slot->state == COMMAND_STATE_FREE || slot->owner != owner) {
+        MY_LOGE("Liberacao do comando %u ignorada (dono %u, pedido por %u)", slot->id,
+                slot->owner, owner);
+    } else if (slot->collecting) {
+        // o coletor ainda escreve no slot; ele e liberado no finish()
+        slot->waiter = NULL;
+        slot->owner = COMMAND_OWNER_NONE;
+        slot->release_pending = true;
+    } else {
+        _free(slot);
+    }
+    xSemaphoreGive(_lock);
+}
+
+bool CommandTable::dispatch(command_slot_t* slot, QueueHandle_t queue, const void* job) {
+    bool queued = false;
+    xSemaphoreTake(_lock, portMAX_DELAY);
+    // com o lock o coletor so chega ao finish() depois da troca de dono
+    if (slot->owner == COMMAND_OWNER_REQUESTER && xQueueSend(queue, job, 0) == pdPASS) {
+        slot->collecting = true;
+        slot->owner =
+            slot->sink == COMMAND_SINK_STREAM ? COMMAND_OWNER_TABLE : COMMAND_OWNER_COLLECTOR;
+        queued = true;
+    }
+    xSemaphoreGive(_lock);
+    return queued;
+}
+
+void CommandTable::finish(command_slot_t* slot, bool timeout) {
+    xSemaphoreTake(_lock, portMAX_DELAY);
+    slot->timeout = timeout;
+    slot->done_ms = _now_ms();
+    slot->collecting = false;
+    slot->state = COMMAND_STATE_DONE;
+    if (slot->release_pending) {
+        _free(slot);
+    } else if (slot->waiter != NULL) {
+        xTaskNotifyGive(slot->waiter);
+    }
+    xSemaphoreGive(_lock);
+}
+
+command_slot_t* CommandTable::_claim(uint8_t id, bool any) {
+    command_slot_t* found = NULL;
+    xSemaphoreTake(_lock, portMAX_DELAY);
+    for (uint8_t i = 0; i < ASYNC_SRV_MAX_INFLIGHT_COMMANDS; i++) {
+        command_slot_t* slot = &_slots[i];
+        // so resultados de /out ja entregues a tabela
+        if (slot->sink != COMMAND_SINK_STREAM || slot->owner != COMMAND_OWNER_TABLE ||
+            (slot->state != COMMAND_STATE_RUNNING && slot->state != COMMAND_STATE_DONE)) {
+            continue;
+        }
+        if (!any) {
+            if (slot->id == id) {
+                found = slot;
+                break;
+            }
+        } else if (found == NULL || (int32_t)(slot->started_ms - found->started_ms) < 0) {
+            found = slot;
+        }
+    }
+    if (found != NULL) {
+        found->owner = COMMAND_OWNER_READER;
+    }
+    xSemaphoreGive(_lock);
+    return found;
+}
+
+command_slot_t* CommandTable::claim(uint8_t id) {
+    return _claim(id, false);
+}
+
+command_slot_t* CommandTable::claimOldest() {
+    return _claim(COMMAND_ID_NONE, true);
+}
+
+/**
+ * @brief Comando que recebe o frame, NULL se nenhum. Chamado com o _lock.
+ *
+ */
+command_slot_t* CommandTable::_route_target(const uart_frame_t& frame) {
+    command_slot_t* target = NULL;
+
+    for (uint8_t i = 0; i < ASYNC_SRV_MAX_INFLIGHT_COMMANDS; i++) {
+        command_slot_t* slot = &_slots[i];
+        if (slot->state != COMMAND_STATE_WAIT_ACK && slot->state != COMMAND_STATE_RUNNING) {
+            continue;
+        }
+        if (frame.id != COMMAND_ID_NONE) {
+            if (slot->id == frame.id) {
+                return slot;
+            }
+        } else if (target == NULL || (int32_t)(slot->started_ms - target->started_ms) < 0) {
+            target = slot;
+        }
+    }
+    return target;
+}
+
+bool CommandTable::route(const uart_frame_t& frame) {
+    xSemaphoreTake(_lock, portMAX_DELAY);
+    command_slot_t* target = _route_target(frame);
+    // o envio para a fila nao bloqueia, pode ser feito com o lock
+    bool delivered = target != NULL && xQueueSend(target->frames, &frame, 0) == pdPASS;
+    xSemaphoreGive(_lock);
+    return delivered;
+}
+
+bool CommandTable::routesTo(const uart_frame_t& frame, uint8_t id) {
+    xSemaphoreTake(_lock, portMAX_DELAY);
+    command_slot_t* target = _route_target(frame);
+    bool matches = target != NULL && target->id == id;
+    xSemaphoreGive(_lock);
+    return matches;
+}
+
+uint8_t CommandTable::inflight() {
+    uint8_t count = 0;
+    for (uint8_t i = 0; i < ASYNC_SRV_MAX_INFLIGHT_COMMANDS; i++) {
+        command_state_t state = _slots[i].state;
+        if (state == COMMAND_STATE_WAIT_ACK || state == COMMAND_STATE_RUNNING) {
+            count++;
+        }
+    }
+    return count;
+}
+
+uint32_t CommandTable::remainingMs(const command_slot_t* slot) {
+    uint32_t elapsed = _now_ms() - slot->started_ms;
+    return elapsed < slot->timeout_ms ? slot->timeout_ms - elapsed : 0;
+}
+
+}  // namespace Wetzel
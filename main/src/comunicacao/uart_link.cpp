@@ -0,0 +1,322 @@
+#include "uart_link.h"
+
+#include <string.h>
+
+#include "configuration.h"
+#include "debug.h"
+
+static const char* TAG = __FILE__;
+
+namespace Wetzel {
+
+#define UART_LINK_FRAME_TERMINATOR ';'
+
+UartLink* UartLink::_instance = nullptr;
+
+UartLink::UartLink() = default;
+
+UartLink::~UartLink() {
+    delete _instance;
+}
+
+UartLink* UartLink::getInstance() {
+    if (_instance == nullptr) {
+        _instance = new UartLink();
+    }
+    return _instance;
+}
+
+esp_err_t UartLink::begin(uart_port_t port, int baud_rate, int tx_gpio, int rx_gpio) {
+    esp_err_t err;
+
+    if (_initialized) {
+        MY_LOGE("UartLink já inicializado");
+        return ESP_FAIL;
+    }
+
+    uart_config_t uart_config = {
+        .baud_rate = baud_rate,
+        .data_bits = UART_DATA_8_BITS,
+        .parity = UART_PARITY_DISABLE,
+        .stop_bits = UART_STOP_BITS_1,
+        .flow_ctrl = UART_HW_FLOWCTRL_DISABLE,
+        .rx_flow_ctrl_thresh = 0,
+        .source_clk = UART_SCLK_APB,
+    };
+
+    _port = port;
+    _tx_mutex = xSemaphoreCreateMutex();
+    _credit_sem = xSemaphoreCreateBinary();
+    err = uart_driver_install(_port, UART_RX_BUFFER, UART_TX_BUFFER, UART_LINK_EVENT_QUEUE_LENGTH,
+                              &_event_queue, 0);
+    if (err != ESP_OK) {
+        MY_LOGE("Falha ao instalar driver da UART%d (%s)", _port, esp_err_to_name(err));
+        return err;
+    }
+    ESP_ERROR_CHECK(uart_param_config(_port, &uart_config));
+    ESP_ERROR_CHECK(
+        uart_set_pin(_port, tx_gpio, rx_gpio, UART_PIN_NO_CHANGE, UART_PIN_NO_CHANGE));
+
+    // Uma interrupcao por terminador recebido, ao inves de uma por bloco de bytes
+    ESP_ERROR_CHECK(
+        uart_enable_pattern_det_baud_intr(_port, UART_LINK_FRAME_TERMINATOR, 1, 9, 0, 0));
+    ESP_ERROR_CHECK(uart_pattern_queue_reset(_port, UART_LINK_PATTERN_QUEUE_LENGTH));
+
+    _initialized = true;
+    return ESP_OK;
+}
+
+int UartLink::readFrame(uint8_t* type, uint8_t* seq, char* frame, size_t max_len,
+                        TickType_t timeout) {
+    if (_mode == UART_LINK_MODE_BINARY) {
+        return _read_binary_frame(type, seq, frame, max_len, timeout);
+    }
+    *type = LINK_FRAME_TYPE_TEXT;
+    *seq = 0;
+    return _read_ascii_frame(frame, max_len, timeout);
+}
+
+int UartLink::_read_ascii_frame(char* frame, size_t max_len, TickType_t timeout) {
+    uart_event_t event;
+
+    while (xQueueReceive(_event_queue, &event, timeout) == pdTRUE) {
+        switch (event.type) {
+        case UART_PATTERN_DET: {
+            int pos = uart_pattern_pop_pos(_port);
+            if (pos < 0) {
+                // fila de posicoes estourou, nao da para saber onde o frame termina
+                MY_LOGW("Fila de padroes cheia, descartando RX");
+                _reset_rx();
+                break;
+            }
+            if ((size_t)pos >= max_len) {
+                MY_LOGW("Frame de %d bytes maior que o buffer, descartado", pos);
+                _discard(pos + 1);
+                break;
+            }
+            int len = uart_read_bytes(_port, frame, pos,
+                                      pdMS_TO_TICKS(UART_LINK_READ_TIMEOUT_MS));
+            // remove o terminador do buffer
+            _discard(1);
+            if (len < 0) {
+                break;
+            }
+            frame[len] = '\0';
+            return len;
+        }
+        case UART_FIFO_OVF:
+        case UART_BUFFER_FULL:
+            MY_LOGW("Overflow na UART%d (evento %d)", _port, event.type);
+            _reset_rx();
+            break;
+        default:
+            // UART_DATA e demais eventos: aguarda o terminador
+            break;
+        }
+    }
+    return -1;
+}
+
+int UartLink::_read_binary_frame(uint8_t* type, uint8_t* seq, char* frame, size_t max_len,
+                                 TickType_t timeout) {
+    uart_event_t event;
+
+    while (1) {
+        while (_rx_chunk_pos < _rx_chunk_len) {
+            LinkFrameDecoder::result_t result = _decoder.push(_rx_chunk[_rx_chunk_pos++]);
+            if (result == LinkFrameDecoder::FRAME_ERROR) {
+                _frame_errors++;
+                MY_LOGW("Frame binario invalido descartado (%u erros)", _frame_errors);
+                continue;
+            }
+            if (result != LinkFrameDecoder::FRAME_READY) {
+                continue;
+            }
+            uint16_t len = _decoder.length();
+            if (len >= max_len) {
+                MY_LOGW("Frame de %u bytes maior que o buffer, descartado", len);
+                continue;
+            }
+            memcpy(frame, _decoder.payload(), len);
+            if (_decoder.type() == LINK_FRAME_TYPE_TEXT && len > 0 &&
+                frame[len - 1] == UART_LINK_FRAME_TERMINATOR) {
+                len--;
+            }
+            frame[len] = '\0';
+            *type = _decoder.type();
+            *seq = _decoder.seq();
+            return len;
+        }
+
+        // le primeiro o que ja esta no buffer do driver (inclusive bytes que
+        // chegaram antes da troca de modo) e so entao espera um evento
+        size_t buffered = 0;
+        uart_get_buffered_data_len(_port, &buffered);
+        if (buffered == 0) {
+            if (xQueueReceive(_event_queue, &event, timeout) != pdTRUE) {
+                return -1;
+            }
+            if (event.type == UART_FIFO_OVF || event.type == UART_BUFFER_FULL) {
+                MY_LOGW("Overflow na UART%d (evento %d)", _port, event.type);
+                _reset_rx();
+                _decoder.reset();
+            }
+            continue;
+        }
+        int read = uart_read_bytes(_port, _rx_chunk,
+                                   buffered > sizeof(_rx_chunk) ? sizeof(_rx_chunk) : buffered, 0);
+        _rx_chunk_len = read > 0 ? read : 0;
+        _rx_chunk_pos = 0;
+    }
+}
+
+int UartLink::write(const char* data, size_t len, uint8_t seq) {
+    if (xSemaphoreTake(_tx_mutex, portMAX_DELAY) != pdTRUE) {
+        return -1;
+    }
+    int written = -1;
+    if (_mode != UART_LINK_MODE_BINARY) {
+        written = _write_bytes(data, len);
+    } else {
+        size_t frame_len = link_frame_encode(_tx_frame, sizeof(_tx_frame), LINK_FRAME_TYPE_TEXT,
+                                             seq, (const uint8_t*)data, len);
+        if (frame_len > 0 && _write_bytes(_tx_frame, frame_len) == (int)frame_len) {
+            written = len;
+        }
+    }
+    xSemaphoreGive(_tx_mutex);
+    return written;
+}
+
+int UartLink::_write_bytes(const void* data, size_t len) {
+    if (!_flow_control) {
+        return uart_write_bytes(_port, data, len);
+    }
+    const char* ptr = (const char*)data;
+    size_t sent = 0;
+    while (sent < len) {
+        // nunca mais que a janela de uma vez, senao os creditos nunca bastariam
+        size_t chunk = len - sent > _credit_window ? _credit_window : len - sent;
+        _take_credits(chunk);
+        int written = uart_write_bytes(_port, ptr + sent, chunk);
+        if (written < 0) {
+            return -1;
+        }
+        sent += written;
+    }
+    return sent;
+}
+
+void UartLink::_take_credits(size_t len) {
+    while (1) {
+        portENTER_CRITICAL(&_credit_mux);
+        if (_credits >= len) {
+            _credits -= len;
+            portEXIT_CRITICAL(&_credit_mux);
+            return;
+        }
+        portEXIT_CRITICAL(&_credit_mux);
+        if (xSemaphoreTake(_credit_sem, pdMS_TO_TICKS(UART_LINK_CREDIT_TIMEOUT_MS)) != pdTRUE) {
+            // credito perdido (frame corrompido ou sensor reiniciado): assume o
+            // buffer do sensor vazio para nao travar o TX
+            _credit_timeouts++;
+            MY_LOGW("Sem creditos do sensor em %d ms (%u vezes), reabrindo a janela",
+                    UART_LINK_CREDIT_TIMEOUT_MS, _credit_timeouts);
+            portENTER_CRITICAL(&_credit_mux);
+            _credits = _credit_window;
+            portEXIT_CRITICAL(&_credit_mux);
+        }
+    }
+}
+
+void UartLink::enableFlowControl(uint16_t window) {
+    portENTER_CRITICAL(&_credit_mux);
+    _credit_window = window;
+    _credits = window;
+    portEXIT_CRITICAL(&_credit_mux);
+    _flow_control = window > 0;
+}
+
+void UartLink::addCredits(uint16_t credits) {
+    portENTER_CRITICAL(&_credit_mux);
+    uint32_t total = (uint32_t)_credits + credits;
+    _credits = total > _credit_window ? _credit_window : total;
+    portEXIT_CRITICAL(&_credit_mux);
+    xSemaphoreGive(_credit_sem);
+}
+
+bool UartLink::flowControlEnabled() const {
+    return _flow_control;
+}
+
+uint32_t UartLink::creditTimeouts() const {
+    return _credit_timeouts;
+}
+
+esp_err_t UartLink::waitTxDone(TickType_t timeout) {
+    return uart_wait_tx_done(_port, timeout);
+}
+
+void UartLink::requestMode(uart_link_mode_t mode) {
+    _pending_mode = mode;
+    _mode_change_pending = true;
+}
+
+bool UartLink::modeChangePending() const {
+    return _mode_change_pending;
+}
+
+void UartLink::applyPendingMode() {
+    if (!_mode_change_pending) {
+        return;
+    }
+    _mode_change_pending = false;
+    if (_pending_mode == _mode) {
+        return;
+    }
+    if (_pending_mode == UART_LINK_MODE_BINARY) {
+        // ';' pode aparecer dentro do payload binario
+        uart_disable_pattern_det_intr(_port);
+        uart_pattern_queue_reset(_port, UART_LINK_PATTERN_QUEUE_LENGTH);
+        _decoder.reset();
+        _rx_chunk_len = 0;
+        _rx_chunk_pos = 0;
+    } else {
+        uart_enable_pattern_det_baud_intr(_port, UART_LINK_FRAME_TERMINATOR, 1, 9, 0, 0);
+        uart_pattern_queue_reset(_port, UART_LINK_PATTERN_QUEUE_LENGTH);
+    }
+    _mode = _pending_mode;
+    MY_LOGI("UART%d em modo %s", _port, _mode == UART_LINK_MODE_BINARY ? "binario" : "ASCII");
+}
+
+void UartLink::cancelPendingMode() {
+    _mode_change_pending = false;
+}
+
+uart_link_mode_t UartLink::mode() const {
+    return _mode;
+}
+
+uint32_t UartLink::frameErrors() const {
+    return _frame_errors;
+}
+
+void UartLink::_reset_rx() {
+    uart_flush_input(_port);
+    xQueueReset(_event_queue);
+    uart_pattern_queue_reset(_port, UART_LINK_PATTERN_QUEUE_LENGTH);
+}
+
+void UartLink::_discard(size_t len) {
+    uint8_t trash[32];
+    while (len > 0) {
+        size_t chunk = len > sizeof(trash) ? sizeof(trash) : len;
+        int read = uart_read_bytes(_port, trash, chunk, pdMS_TO_TICKS(UART_LINK_READ_TIMEOUT_MS));
+        if (read <= 0) {
+            return;
+        }
+        len -= read;
+    }
+}
+
+}  // namespace Wetzel
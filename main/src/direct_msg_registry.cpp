@@ -0,0 +1,165 @@
+#include "direct_msg_registry.h"
+
+#include <string.h>
+
+#include "debug.h"
+#include "hex_codec.h"
+#include "report_direct_msg_handlers.h"
+#include "wifi_direct_msg_handlers.h"
+
+static const char* TAG = __FILE__;
+
+namespace Wetzel {
+
+/**
+ * Tabela das mensagens /direct, na ordem dos codigos (o codigo e o indice + 1).
+ * Um codigo novo e uma linha nova aqui.
+ */
+static constexpr direct_msg_def_t DIRECT_MSG_TABLE[] = {
+    {WIFI_MODE_CHANGE_CODE, msg_handler_wifi_mode_change, 1, {MSG_ARG_FLAG}, false},
+    {WIFI_AP_CONFIG_CHANGE_CODE, msg_handler_wifi_ap_config_change, 2,
+     {MSG_ARG_TEXT, MSG_ARG_TEXT}, false},
+    {WIFI_STA_CONFIG_CHANGE_CODE, msg_handler_wifi_sta_config_change, 7,
+     {MSG_ARG_TEXT, MSG_ARG_OPTIONAL, MSG_ARG_OPTIONAL, MSG_ARG_OPTIONAL, MSG_ARG_OPTIONAL,
+      MSG_ARG_OPTIONAL, MSG_ARG_OPTIONAL},
+     false},
+    {WIFI_GET_SSID_LIST_CODE, msg_handler_get_ssid_list, 0, {}, false},
+    {WIFI_AP_VALIDATE_CREDENTIALS_CODE, msg_handler_validate_ap_credentials, 2,
+     {MSG_ARG_TEXT, MSG_ARG_TEXT}, false},
+    {INTERFACE_INFO_REQUEST_CODE, msg_handler_interface_info_requested, 0, {}, true},
+    {RTC_UPDATE_CODE, msg_handler_rtc_update, 1, {MSG_ARG_UINT}, false},
+    {REPORT_CONFIG_CODE, msg_handler_report_config, 3,
+     {MSG_ARG_MAC, MSG_ARG_UINT, MSG_ARG_UINT}, false},
+};
+
+static constexpr size_t DIRECT_MSG_TABLE_SIZE =
+    sizeof(DIRECT_MSG_TABLE) / sizeof(DIRECT_MSG_TABLE[0]);
+
+static constexpr bool _table_is_indexed(size_t i) {
+    return i == DIRECT_MSG_TABLE_SIZE ||
+           (DIRECT_MSG_TABLE[i].code == i + 1 && DIRECT_MSG_TABLE[i].argc <= DIRECT_MSG_MAX_ARGS &&
+            _table_is_indexed(i + 1));
+}
+static_assert(_table_is_indexed(0), "DIRECT_MSG_TABLE fora da ordem dos codigos");
+
+static bool _validate_arg(msg_arg_t& arg, msg_arg_type_t type) {
+    switch (type) {
+    case MSG_ARG_TEXT:
+        return arg.len > 0;
+    case MSG_ARG_OPTIONAL:
+        if (arg.len == 1 && arg.ptr[0] == DIRECT_MSG_EMPTY_ARG) {
+            arg.ptr = "";
+            arg.len = 0;
+        }
+        return true;
+    case MSG_ARG_UINT:
+        if (arg.len == 0 || arg.len > 10)
+            return false;
+        for (uint16_t i = 0; i < arg.len; i++) {
+            if (arg.ptr[i] < '0' || arg.ptr[i] > '9')
+                return false;
+        }
+        return true;
+    case MSG_ARG_FLAG:
+        return arg.len == 1 && (arg.ptr[0] == '0' || arg.ptr[0] == '1');
+    case MSG_ARG_MAC: {
+        uint8_t mac[6];
+        return arg.len == 12 && hex_decode(arg.ptr, mac, sizeof(mac));
+    }
+    }
+    return false;
+}
+
+const direct_msg_def_t* direct_msg_lookup(uint8_t code) {
+    if (code == 0 || code > DIRECT_MSG_TABLE_SIZE) {
+        return NULL;
+    }
+    return &DIRECT_MSG_TABLE[code - 1];
+}
+
+esp_err_t direct_msg_tokenize(char* msg, uint8_t* code, msg_arg_t* args, uint8_t* argc) {
+    char* p = msg;
+    uint32_t value = 0;
+
+    if (*p < '0' || *p > '9') {
+        return ESP_ERR_INVALID_ARG;
+    }
+    while (*p >= '0' && *p <= '9') {
+        value = value * 10 + (*p++ - '0');
+        if (value > UINT8_MAX)
+            return ESP_ERR_INVALID_ARG;
+    }
+    if (*p != ',' && *p != '\0') {
+        return ESP_ERR_INVALID_ARG;
+    }
+    *code = value;
+    if (*p == ',')
+        p++;
+
+    *argc = 0;
+    while (*p != '\0') {
+        // ",;" final encerra a mensagem
+        if (*p == DIRECT_MSG_TERMINATOR && p[1] == '\0') {
+            break;
+        }
+        if (*argc == DIRECT_MSG_MAX_ARGS) {
+            return ESP_ERR_INVALID_ARG;
+        }
+        char* start = p;
+        while (*p != ',' && *p != '\0') {
+            p++;
+        }
+        args[*argc].ptr = start;
+        args[*argc].len = p - start;
+        (*argc)++;
+        if (*p == ',') {
+            *p++ = '\0';
+        }
+    }
+    return ESP_OK;
+}
+
+esp_err_t direct_msg_dispatch(char* msg, char* response, size_t response_size,
+                              const direct_msg_def_t** def) {
+    msg_arg_t args[DIRECT_MSG_MAX_ARGS];
+    uint8_t argc;
+    uint8_t code = 0;
+
+    *def = NULL;
+    esp_err_t err = direct_msg_tokenize(msg, &code, args, &argc);
+    *def = direct_msg_lookup(code);
+    if (*def == NULL) {
+        MY_LOGE("Código de mensagem inválido: %u", code);
+        return ESP_ERR_NOT_FOUND;
+    }
+    if (err != ESP_OK) {
+        MY_LOGE("Mensagem %u mal formada", code);
+        return err;
+    }
+    if (argc != (*def)->argc) {
+        MY_LOGE("Mensagem %u com %u argumentos, esperado %u", code, argc, (*def)->argc);
+        return ESP_ERR_INVALID_ARG;
+    }
+    for (uint8_t i = 0; i < argc; i++) {
+        if (!_validate_arg(args[i], (*def)->types[i])) {
+            MY_LOGE("Mensagem %u: argumento %u invalido (%.*s)", code, i, args[i].len,
+                    args[i].ptr);
+            return ESP_ERR_INVALID_ARG;
+        }
+    }
+    return (*def)->handler(args, response, response_size);
+}
+
+uint32_t msg_arg_to_uint(const msg_arg_t& arg) {
+    uint32_t value = 0;
+    for (uint16_t i = 0; i < arg.len; i++) {
+        value = value * 10 + (arg.ptr[i] - '0');
+    }
+    return value;
+}
+
+void msg_arg_to_mac(const msg_arg_t& arg, uint8_t mac[6]) {
+    hex_decode(arg.ptr, mac, 6);
+}
+
+}  // namespace Wetzel
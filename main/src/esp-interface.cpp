@@ -15,7 +15,9 @@
 #include "debug.h"
 #include "real_time_clock.h"
 #include "report_handler.h"
+#include "report_reader.h"
 #include "sd_card_handler.h"
+#include "uart_link.h"
 #include "wifi_wetzel_esp32.h"
 
 static const char* TAG = __FILE__;
@@ -47,8 +49,9 @@ void app_main() {
     vTaskDelay(100 / portTICK_PERIOD_MS);
     MY_LOGI("FIRMWARE: WETZEL-IIOT-INTERFACE VERSION %s", FIRMWARE_VERSION);
 
-    Serial2.setRxBufferSize(UART_RX_BUFFER);
-    Serial2.begin(UART_BAUD_RATE);
+    Wetzel::UartLink* uart_link = Wetzel::UartLink::getInstance();
+    ESP_ERROR_CHECK(uart_link->begin(UART_NUM_2, UART_BAUD_RATE, UART_TX_GPIO,
+                                     UART_RX_GPIO));
     pinMode(LED_PIN, OUTPUT);
 
     Wetzel::WiFi* wifi = Wetzel::WiFi::getInstance();
@@ -63,6 +66,7 @@ void app_main() {
     Wetzel::ReportHandler* report_handler =
         Wetzel::ReportHandler::getInstance();
     report_handler->begin();
+    Wetzel::ReportReader::getInstance()->begin();
     // ENDIF
 
     Wetzel::AsyncServer::begin();
@@ -121,6 +125,12 @@ static void print_system_info_timercb(void* timer) {
 
     MY_LOGT("INICIALIZANDO PRINT CALLBACK");
     MY_LOGT("System information, free heap: %u", esp_get_free_heap_size());
+    Wetzel::ring_stats_t msg_stats = Wetzel::ReportHandler::reportMsgQueueStats();
+    Wetzel::ring_stats_t writing_stats = Wetzel::ReportHandler::writingQueueStats();
+    MY_LOGT("Filas de report: msg %u/%u (max %u, perdidos %u) | escrita %u/%u (max %u, perdidos %u)",
+            msg_stats.size, msg_stats.capacity, msg_stats.high_water_mark, msg_stats.overflows,
+            writing_stats.size, writing_stats.capacity, writing_stats.high_water_mark,
+            writing_stats.overflows);
 
     if (!heap_caps_check_integrity_all(true)) {
         MY_LOGE("At least one heap is corrupt");
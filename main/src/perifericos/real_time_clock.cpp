@@ -53,6 +53,7 @@ void RealTimeClock::update_local_clock_1s_handler(void* arg) {
             _unixSeconds++;
             _dateTime = DateTime(_unixSeconds);
         }
+        _unixDay = _unixSeconds / (60 * 60 * 24);
         xSemaphoreGive(_rtc_mutex);
     }
 }
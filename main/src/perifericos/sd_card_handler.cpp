@@ -136,6 +136,7 @@ esp_err_t CartaoSD::begin(gpio_num_t mosi_port, gpio_num_t miso_port,
 
     memset(writing_file_path,0,sizeof(writing_file_path));
     memset(reading_file_path,0,sizeof(reading_file_path));
+    memset(rollup_file_path,0,sizeof(rollup_file_path));
     
     return ESP_OK;
 }
@@ -159,7 +160,11 @@ FILE* CartaoSD::openFile(const char* file_path, file_type_t type) {
             MY_LOGD("Writing file already in use. Closing it...");
             closeFile(WRITING_FILE);
         }
-        file = fopen(complete_file_path, "ab");
+        // leitura e escrita em qualquer posicao, criando o arquivo se preciso
+        file = fopen(complete_file_path, "r+b");
+        if (file == NULL) {
+            file = fopen(complete_file_path, "w+b");
+        }
         if (file == NULL) {
             MY_LOGE("Failed to open file for writing");
             return NULL;
@@ -181,6 +186,23 @@ FILE* CartaoSD::openFile(const char* file_path, file_type_t type) {
         _reading_file = file;
         _reading_file_is_open = true;
         strncpy(reading_file_path, complete_file_path, 25);
+        break;
+    case ROLLUP_FILE:
+        if (_rollup_file_is_open) {
+            MY_LOGD("Rollup file already in use. Closing it...");
+            closeFile(ROLLUP_FILE);
+        }
+        file = fopen(complete_file_path, "r+b");
+        if (file == NULL) {
+            file = fopen(complete_file_path, "w+b");
+        }
+        if (file == NULL) {
+            MY_LOGE("Failed to open rollup file");
+            return NULL;
+        }
+        _rollup_file = file;
+        _rollup_file_is_open = true;
+        strncpy(rollup_file_path, complete_file_path, 25);
     }
     return file;
 }
@@ -208,6 +230,14 @@ esp_err_t CartaoSD::closeFile(file_type_t file) {
             _reading_file_is_open = false;
             _reading_file = NULL;
         }
+        break;
+
+    case ROLLUP_FILE:
+        if (_rollup_file_is_open) {
+            result = fclose(_rollup_file);
+            _rollup_file_is_open = false;
+            _rollup_file = NULL;
+        }
     }
 
     switch (result) {
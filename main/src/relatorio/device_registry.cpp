@@ -0,0 +1,121 @@
+#include "device_registry.h"
+
+#include <freertos/task.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "debug.h"
+
+static const char* TAG = __FILE__;
+
+namespace Wetzel {
+
+static inline uint32_t _hash(uint64_t key) {
+    return (uint32_t)((key * 0x9E3779B97F4A7C15ULL) >> 32);
+}
+
+esp_err_t DeviceRegistry::begin(uint16_t max_devices) {
+    uint32_t size = 1;
+    while (size < 2 * (uint32_t)max_devices) {
+        size <<= 1;
+    }
+    for (uint8_t i = 0; i < 2; i++) {
+        _tables[i].slots = (device_registry_slot_t*)calloc(size, sizeof(device_registry_slot_t));
+        _tables[i].readers = 0;
+        if (_tables[i].slots == NULL) {
+            MY_LOGE("Sem memoria para o cadastro de dispositivos");
+            return ESP_ERR_NO_MEM;
+        }
+    }
+    _write_lock = xSemaphoreCreateMutex();
+    if (_write_lock == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    _mask = size - 1;
+    _max_devices = max_devices;
+    _count = 0;
+    _active.store(&_tables[0]);
+    return ESP_OK;
+}
+
+/**
+ * @brief Posicao da chave ou a posicao vazia onde ela entraria. A tabela nunca
+ * passa de metade cheia, entao a sondagem sempre termina.
+ *
+ */
+const device_registry_slot_t* DeviceRegistry::_probe(const device_registry_slot_t* slots,
+                                                     uint64_t key) const {
+    uint32_t i = _hash(key) & _mask;
+    while (slots[i].key != 0 && slots[i].key != key) {
+        i = (i + 1) & _mask;
+    }
+    return &slots[i];
+}
+
+bool DeviceRegistry::find(const uint8_t mac[6], device_report_info_t* info) {
+    device_registry_table_t* table;
+
+    // marca a tabela como em uso; se ela deixou de ser a ativa nesse meio
+    // tempo o escritor pode estar reescrevendo, entao tenta de novo
+    while (1) {
+        table = _active.load();
+        if (table == NULL) {
+            return false;
+        }
+        table->readers.fetch_add(1);
+        if (table == _active.load()) {
+            break;
+        }
+        table->readers.fetch_sub(1);
+    }
+
+    uint64_t key = device_mac_key(mac);
+    const device_registry_slot_t* slot = _probe(table->slots, key);
+    bool found = slot->key == key;
+    if (found) {
+        *info = slot->info;
+    }
+    table->readers.fetch_sub(1);
+    return found;
+}
+
+esp_err_t DeviceRegistry::add(const uint8_t mac[6], uint8_t qtd_luminarias,
+                              luminaria_type_t modelo_luminarias) {
+    uint64_t key = device_mac_key(mac);
+
+    if (_write_lock == NULL || xSemaphoreTake(_write_lock, portMAX_DELAY) != pdTRUE) {
+        return ESP_FAIL;
+    }
+    device_registry_table_t* active = _active.load();
+    if (_probe(active->slots, key)->key == key) {
+        xSemaphoreGive(_write_lock);
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (_count >= _max_devices) {
+        xSemaphoreGive(_write_lock);
+        return ESP_ERR_NO_MEM;
+    }
+
+    device_registry_table_t* spare = active == &_tables[0] ? &_tables[1] : &_tables[0];
+    // leitores que pegaram a tabela antes da ultima troca
+    while (spare->readers.load() != 0) {
+        vTaskDelay(1);
+    }
+    memcpy(spare->slots, active->slots, (_mask + 1) * sizeof(device_registry_slot_t));
+    device_registry_slot_t* slot = (device_registry_slot_t*)_probe(spare->slots, key);
+    slot->info.id = _count;
+    slot->info.qtd_luminarias = qtd_luminarias;
+    slot->info.modelo_luminarias = modelo_luminarias;
+    slot->key = key;
+    _active.store(spare);
+    _count++;
+
+    xSemaphoreGive(_write_lock);
+    return ESP_OK;
+}
+
+uint16_t DeviceRegistry::count() const {
+    return _count;
+}
+
+}  // namespace Wetzel
@@ -16,40 +16,35 @@ static const char* TAG = __FILE__;
 namespace Wetzel {
 
 
-esp_err_t msg_handler_rtc_update(char* msg) {
-    esp_err_t err;
-    char* next_char;
-    char* updated_unix_time_char = strtok_r(msg, ",", &next_char);
+/**
+ * args[0] -> unix time
+ */
+esp_err_t msg_handler_rtc_update(const msg_arg_t* args, char* response, size_t response_size) {
+    uint32_t updated_unix_time = msg_arg_to_uint(args[0]);
 
-    uint32_t updated_unix_time = strtoul(updated_unix_time_char, &next_char, 10);
-
-    MY_LOGD("unixtime_char: %s", updated_unix_time_char);
-    MY_LOGD("unixtime: %lu", strtoul(updated_unix_time_char, &next_char, 10));
+    MY_LOGD("unixtime: %u", updated_unix_time);
     RealTimeClock* rtc = RealTimeClock::getInstance();
-    err = rtc->configureRtc(updated_unix_time);
-
-    return err;
+    return rtc->configureRtc(updated_unix_time);
 }
 
+/**
+ * args[0] -> mac do dispositivo de relatorio (hex, sem separadores)
+ * args[1] -> quantidade de luminarias
+ * args[2] -> modelo das luminarias
+ */
 // TODO completar metodo de input em mada de report_device_info
-esp_err_t msg_handler_report_config(char* msg) {
-    esp_err_t err;
-    char* next_char;
-    device_mac_t mac;
+esp_err_t msg_handler_report_config(const msg_arg_t* args, char* response,
+                                    size_t response_size) {
+    uint8_t mac_bytes[6];
     ReportHandler* report = ReportHandler::getInstance();
 
-    char* report_device_mac_Str = strtok_r(msg, ",", &next_char);
-    uint8_t qtd_luminarias = atoi(strtok_r(NULL, ",", &next_char));
-    uint8_t modelo_luminarias = atoi(strtok_r(NULL, ",", &next_char));
+    msg_arg_to_mac(args[0], mac_bytes);
+    uint8_t qtd_luminarias = msg_arg_to_uint(args[1]);
+    uint8_t modelo_luminarias = msg_arg_to_uint(args[2]);
 
-    MY_LOGD("Mac: %s    |   qtd_Lum: %d     |   modelo_lum: %d", report_device_mac_Str,
+    MY_LOGD("Mac: %s    |   qtd_Lum: %d     |   modelo_lum: %d", args[0].ptr,
             qtd_luminarias, modelo_luminarias);
 
-    sscanf(report_device_mac_Str, "%2hhx%2hhx%2hhx%2hhx%2hhx%2hhx", &mac[0], &mac[1], &mac[2],
-           &mac[3], &mac[4], &mac[5]);
-
-    err = report->add_device_to_report_info_map(mac, qtd_luminarias, modelo_luminarias);
-
-    return err;
+    return report->add_device_to_report_info_map(mac_bytes, qtd_luminarias, modelo_luminarias);
 }
 }  // namespace Wetzel
\ No newline at end of file
@@ -0,0 +1,479 @@
+#include "report_file_writer.h"
+
+#include <freertos/task.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "debug.h"
+#include "report_block_codec.h"
+
+static const char* TAG = __FILE__;
+
+namespace Wetzel {
+
+esp_err_t ReportFileWriter::begin(CartaoSD* card) {
+    if (card == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    _card = card;
+    _last_commit = xTaskGetTickCount();
+    return ESP_OK;
+}
+
+esp_err_t ReportFileWriter::open(const char* file_name, uint32_t unix_day) {
+    if (_card == NULL || file_name == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (_file != NULL && strcmp(file_name, _file_name) == 0) {
+        return ESP_OK;
+    }
+    close();
+
+    strncpy(_file_name, file_name, sizeof(_file_name) - 1);
+    _file_name[sizeof(_file_name) - 1] = '\0';
+    _file = _card->openFile(_file_name, WRITING_FILE);
+    if (_file == NULL) {
+        return ESP_FAIL;
+    }
+    // o bloco ja e o buffer; sem isso cada fwrite passaria pelo do stdio
+    setvbuf(_file, NULL, _IONBF, 0);
+
+    esp_err_t err = _recover(unix_day);
+    if (err != ESP_OK) {
+        _card->closeFile(WRITING_FILE);
+        _file = NULL;
+        return err;
+    }
+    _dirty = false;
+    _last_commit = xTaskGetTickCount();
+    MY_LOGD("Arquivo %s (v%u) aberto para escrita (bloco %u, %u registros)", _file_name, _version,
+            _block_index, _records());
+    return ESP_OK;
+}
+
+/**
+ * @brief Le so o cabecalho e o ultimo bloco, entao o custo nao depende do
+ * tamanho do arquivo.
+ *
+ */
+esp_err_t ReportFileWriter::_recover(uint32_t unix_day) {
+    long size = -1;
+    if (fseek(_file, 0, SEEK_END) == 0) {
+        size = ftell(_file);
+    }
+    if (size < 0) {
+        return ESP_FAIL;
+    }
+
+    memset(_block, 0, sizeof(_block));
+    _block_index = 0;
+    _count = 0;
+    _first_record = 0;
+    _segment_start = true;
+    _pending = false;
+
+    bool header_ok = false;
+    if (size >= REPORT_FORMAT_HEADER_SIZE) {
+        header_ok = fseek(_file, 0, SEEK_SET) == 0 &&
+                    fread(_header, 1, REPORT_FORMAT_HEADER_SIZE, _file) == REPORT_FORMAT_HEADER_SIZE &&
+                    report_file_header_valid(_header);
+    }
+    if (!header_ok) {
+        if (size > REPORT_FORMAT_HEADER_SIZE) {
+            MY_LOGE("%s nao esta no formato de relatorio v%u", _file_name, REPORT_FORMAT_VERSION);
+            return ESP_ERR_INVALID_VERSION;
+        }
+        // arquivo novo ou cabecalho interrompido na criacao
+        report_file_header_encode(_header, REPORT_FORMAT_VERSION, unix_day,
+                                  REPORT_FORMAT_FLAG_TIME_INDEX);
+        _version = REPORT_FORMAT_VERSION;
+        _encoder.begin(_block + REPORT_V2_BLOCK_HEADER_SIZE, true);
+        _unix_day = unix_day;
+        _has_index = true;
+        _last_bucket = -1;
+        memset(_index, 0xFF, sizeof(_index));
+        if (_write_header() != ESP_OK || fsync(fileno(_file)) != 0) {
+            MY_LOGE("Falha ao gravar o cabecalho de %s", _file_name);
+            return ESP_FAIL;
+        }
+        return ESP_OK;
+    }
+    _unix_day = report_file_header_unix_day(_header);
+    // um arquivo do dia criado antes da v2 continua na versao dele
+    _version = report_file_header_version(_header);
+
+    uint32_t data_size = size - REPORT_FORMAT_HEADER_SIZE;
+    uint32_t blocks = data_size / REPORT_FORMAT_BLOCK_SIZE;
+    bool truncate_tail = data_size % REPORT_FORMAT_BLOCK_SIZE != 0;
+
+    esp_err_t err = _version == REPORT_FORMAT_VERSION_PLAIN
+                        ? _recover_plain(blocks, &truncate_tail)
+                        : _recover_compressed(blocks, &truncate_tail);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    _recover_index();
+
+    if (truncate_tail) {
+        uint32_t valid_size = report_block_offset(_block_index);
+        if (_block_has_records()) {
+            valid_size += REPORT_FORMAT_BLOCK_SIZE;
+        }
+        MY_LOGW("%s truncado de %ld para %u bytes", _file_name, size, valid_size);
+        err = _truncate(valid_size);
+        if (err != ESP_OK) {
+            return err;
+        }
+    }
+    // buckets que apontavam para registros perdidos nao podem sobreviver a
+    // novos registros gravados nessas posicoes
+    if (_index_dirty && (_write_header() != ESP_OK || fsync(fileno(_file)) != 0)) {
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+esp_err_t ReportFileWriter::_read_block(uint32_t block) {
+    if (fseek(_file, report_block_offset(block), SEEK_SET) != 0 ||
+        fread(_block, 1, REPORT_FORMAT_BLOCK_SIZE, _file) != REPORT_FORMAT_BLOCK_SIZE) {
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+esp_err_t ReportFileWriter::_recover_plain(uint32_t blocks, bool* truncate_tail) {
+    _block_index = blocks;
+    if (blocks == 0) {
+        return ESP_OK;
+    }
+    int count = _read_block(blocks - 1) == ESP_OK ? report_block_count(_block) : -1;
+    if (count < 0) {
+        MY_LOGW("Ultimo bloco de %s invalido, descartado", _file_name);
+        _block_index = blocks - 1;
+        *truncate_tail = true;
+        memset(_block, 0, sizeof(_block));
+    } else if (count < REPORT_FORMAT_RECORDS_PER_BLOCK) {
+        _block_index = blocks - 1;
+        _count = count;
+    } else {
+        memset(_block, 0, sizeof(_block));
+    }
+    return ESP_OK;
+}
+
+/**
+ * @brief Na v2 o ultimo bloco valido volta para a RAM (pode ter espaco ainda)
+ * e o estado do codec e refeito com os blocos anteriores do segmento dele:
+ * no maximo REPORT_V2_SEGMENT_BLOCKS leituras, qualquer que seja o arquivo.
+ * Se algum desses blocos nao decodificar, o proximo bloco comeca um segmento.
+ *
+ */
+esp_err_t ReportFileWriter::_recover_compressed(uint32_t blocks, bool* truncate_tail) {
+    int32_t last_count = -1;
+    report_record_t record;
+
+    _block_index = blocks;
+    // o valor do arquivo aberto antes deste nao vale aqui
+    _first_record = 0;
+    if (blocks > 0) {
+        last_count = _read_block(blocks - 1) == ESP_OK ? report_v2_block_count(_block) : -1;
+        _block_index = blocks - 1;
+        if (last_count < 0) {
+            MY_LOGW("Ultimo bloco de %s invalido, descartado", _file_name);
+            *truncate_tail = true;
+        }
+    }
+
+    // primeiro registro do bloco em RAM e estado do codec ate ele
+    uint32_t segment = _block_index - _block_index % REPORT_V2_SEGMENT_BLOCKS;
+    uint32_t from = _block_index > segment ? segment : _block_index;
+    if (from == _block_index && _block_index > 0) {
+        from = _block_index - 1;
+    }
+    bool state_ok = true;
+    bool first_known = _block_index == 0;
+    ReportBlockDecoder decoder(&_codec_state);
+    report_codec_reset(&_codec_state);
+    for (uint32_t block = from; block < _block_index; block++) {
+        int32_t count = _read_block(block) == ESP_OK ? report_v2_block_count(_block) : -1;
+        if (count < 0) {
+            MY_LOGE("Bloco %u de %s invalido", block, _file_name);
+            state_ok = false;
+            continue;
+        }
+        _first_record = report_v2_block_first_record(_block) + count;
+        first_known = true;
+        // segmento aberto depois de um bloco invalido: o estado recomeca nele
+        if (report_v2_block_segment_start(_block)) {
+            state_ok = true;
+        }
+        if (block >= segment && state_ok) {
+            decoder.begin(_block + REPORT_V2_BLOCK_HEADER_SIZE, report_v2_block_used(_block), count,
+                          report_v2_block_segment_start(_block));
+            while (decoder.next(&record)) {
+            }
+        }
+    }
+    // nenhum bloco valido antes do bloco em RAM dentro do trecho lido: a
+    // numeracao continua do ultimo bloco valido antes dele
+    for (uint32_t block = from; !first_known && block > 0; block--) {
+        int32_t count = _read_block(block - 1) == ESP_OK ? report_v2_block_count(_block) : -1;
+        if (count >= 0) {
+            _first_record = report_v2_block_first_record(_block) + count;
+            first_known = true;
+        }
+    }
+    if (!state_ok) {
+        // sem o estado nao da para continuar o bloco: ele fica como esta e a
+        // escrita segue no proximo, abrindo um segmento
+        if (last_count >= 0 && _read_block(_block_index) == ESP_OK) {
+            _first_record = report_v2_block_first_record(_block) + last_count;
+            _block_index++;
+        }
+        last_count = -1;
+        _segment_start = true;
+        MY_LOGW("%s: novo segmento no bloco %u", _file_name, _block_index);
+    } else {
+        _segment_start = _block_index % REPORT_V2_SEGMENT_BLOCKS == 0;
+    }
+
+    if (last_count >= 0) {
+        if (_read_block(_block_index) != ESP_OK) {
+            return ESP_FAIL;
+        }
+        _first_record = report_v2_block_first_record(_block);
+        _segment_start = report_v2_block_segment_start(_block);
+        if (!_encoder.resume(_block + REPORT_V2_BLOCK_HEADER_SIZE, report_v2_block_used(_block),
+                             last_count, _segment_start)) {
+            MY_LOGE("Ultimo bloco de %s nao decodifica", _file_name);
+            return ESP_FAIL;
+        }
+    } else {
+        memset(_block, 0, sizeof(_block));
+        _encoder.begin(_block + REPORT_V2_BLOCK_HEADER_SIZE, _segment_start);
+    }
+    return ESP_OK;
+}
+
+uint32_t ReportFileWriter::_records() const {
+    if (_version == REPORT_FORMAT_VERSION_PLAIN) {
+        return _block_index * REPORT_FORMAT_RECORDS_PER_BLOCK + _count;
+    }
+    return _first_record + _encoder.count();
+}
+
+bool ReportFileWriter::_block_has_records() const {
+    return _version == REPORT_FORMAT_VERSION_PLAIN ? _count > 0 : _encoder.count() > 0;
+}
+
+/**
+ * @brief Carrega o indice do cabecalho e descarta os buckets que apontam para
+ * registros perdidos. Sem indice valido (arquivo sem indice ou indice
+ * interrompido) o arquivo segue sem indice, e os leitores o varrem inteiro.
+ *
+ */
+void ReportFileWriter::_recover_index() {
+    uint16_t bucket_minutes = 0;
+    uint32_t records = _records();
+
+    _last_bucket = -1;
+    _index_dirty = false;
+    _has_index = report_index_decode(_header, &bucket_minutes, _index, REPORT_INDEX_BUCKETS) ==
+                     REPORT_INDEX_BUCKETS &&
+                 bucket_minutes == REPORT_INDEX_BUCKET_MINUTES;
+    if (!_has_index) {
+        MY_LOGW("%s sem indice de horario valido", _file_name);
+        return;
+    }
+    for (uint16_t i = 0; i < REPORT_INDEX_BUCKETS; i++) {
+        if (_index[i] == REPORT_INDEX_EMPTY) {
+            continue;
+        }
+        if (_index[i] > records) {
+            _index[i] = REPORT_INDEX_EMPTY;
+            _index_dirty = true;
+        } else {
+            _last_bucket = i;
+        }
+    }
+}
+
+esp_err_t ReportFileWriter::_write_header() {
+    if (_has_index) {
+        report_index_encode(_header, REPORT_INDEX_BUCKET_MINUTES, _index, REPORT_INDEX_BUCKETS);
+    }
+    if (fseek(_file, 0, SEEK_SET) != 0 ||
+        fwrite(_header, 1, REPORT_FORMAT_HEADER_SIZE, _file) != REPORT_FORMAT_HEADER_SIZE) {
+        MY_LOGE("Falha ao gravar o cabecalho de %s", _file_name);
+        return ESP_FAIL;
+    }
+    _index_dirty = false;
+    _dirty = true;
+    return ESP_OK;
+}
+
+esp_err_t ReportFileWriter::_truncate(uint32_t size) {
+    char path[sizeof(MOUNT_POINT) + sizeof(_file_name)];
+    snprintf(path, sizeof(path), MOUNT_POINT "%s", _file_name);
+
+    // a FAT nao deixa truncar um arquivo aberto para escrita
+    _card->closeFile(WRITING_FILE);
+    int result = truncate(path, size);
+    _file = _card->openFile(_file_name, WRITING_FILE);
+    if (_file == NULL) {
+        return ESP_FAIL;
+    }
+    setvbuf(_file, NULL, _IONBF, 0);
+    if (result != 0) {
+        MY_LOGE("Falha ao truncar %s", _file_name);
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+/**
+ * @brief Grava o bloco da RAM no seu lugar.
+ *
+ */
+esp_err_t ReportFileWriter::_write_block() {
+    // o indice vai para o cartao antes dos registros que ele aponta
+    if (_index_dirty && _write_header() != ESP_OK) {
+        return ESP_FAIL;
+    }
+    if (_version == REPORT_FORMAT_VERSION_PLAIN) {
+        report_block_seal(_block, _count);
+    } else {
+        report_v2_block_seal(_block, _segment_start ? REPORT_V2_FLAG_SEGMENT_START : 0,
+                             _first_record, _encoder.count(), _encoder.used());
+    }
+    if (fseek(_file, report_block_offset(_block_index), SEEK_SET) != 0 ||
+        fwrite(_block, 1, REPORT_FORMAT_BLOCK_SIZE, _file) != REPORT_FORMAT_BLOCK_SIZE) {
+        MY_LOGE("Falha ao gravar o bloco %u de %s", _block_index, _file_name);
+        return ESP_FAIL;
+    }
+    _pending = false;
+    _dirty = true;
+    return ESP_OK;
+}
+
+/**
+ * @brief Passa para o proximo bloco, depois que o atual foi gravado cheio.
+ *
+ */
+void ReportFileWriter::_next_block() {
+    if (_version == REPORT_FORMAT_VERSION_PLAIN) {
+        _count = 0;
+    } else {
+        _first_record += _encoder.count();
+    }
+    _block_index++;
+    memset(_block, 0, sizeof(_block));
+    if (_version != REPORT_FORMAT_VERSION_PLAIN) {
+        _segment_start = _block_index % REPORT_V2_SEGMENT_BLOCKS == 0;
+        _encoder.begin(_block + REPORT_V2_BLOCK_HEADER_SIZE, _segment_start);
+    }
+}
+
+esp_err_t ReportFileWriter::append(const report_record_t& record) {
+    if (_file == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (_has_index) {
+        // o bucket segue o maior horario ja gravado: os registros de um flush
+        // vem em ordem de id, entao o horario nao e monotono entre eles
+        int16_t bucket = report_index_bucket(_unix_day, REPORT_INDEX_BUCKET_MINUTES,
+                                             REPORT_INDEX_BUCKETS, record.unix_seconds);
+        if (bucket > _last_bucket) {
+            uint32_t record_index = _records();
+            for (int16_t i = _last_bucket + 1; i <= bucket; i++) {
+                _index[i] = record_index;
+            }
+            _last_bucket = bucket;
+            _index_dirty = true;
+        }
+    }
+    _pending = true;
+
+    if (_version == REPORT_FORMAT_VERSION_PLAIN) {
+        report_record_encode(report_block_record(_block, _count), record);
+        _count++;
+        if (_count == REPORT_FORMAT_RECORDS_PER_BLOCK) {
+            esp_err_t err = _write_block();
+            if (err != ESP_OK) {
+                return err;
+            }
+            _next_block();
+        }
+        return ESP_OK;
+    }
+
+    if (!_encoder.append(record)) {
+        // bloco cheio; um registro sempre cabe em um bloco vazio
+        esp_err_t err = _write_block();
+        if (err != ESP_OK) {
+            return err;
+        }
+        _next_block();
+        _encoder.append(record);
+        _pending = true;
+    }
+    return ESP_OK;
+}
+
+esp_err_t ReportFileWriter::commit() {
+    if (_file == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    _last_commit = xTaskGetTickCount();
+    if (_pending) {
+        esp_err_t err = _write_block();
+        if (err != ESP_OK) {
+            return err;
+        }
+    }
+    if (_index_dirty && _write_header() != ESP_OK) {
+        return ESP_FAIL;
+    }
+    if (!_dirty) {
+        return ESP_OK;
+    }
+    // atualiza o tamanho e a FAT no cartao
+    if (fsync(fileno(_file)) != 0) {
+        MY_LOGE("Falha no fsync de %s", _file_name);
+        return ESP_FAIL;
+    }
+    _dirty = false;
+    return ESP_OK;
+}
+
+esp_err_t ReportFileWriter::commitIfDue() {
+    if (_file == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (xTaskGetTickCount() - _last_commit < pdMS_TO_TICKS(REPORT_WRITER_COMMIT_PERIOD_MS)) {
+        return ESP_OK;
+    }
+    return commit();
+}
+
+esp_err_t ReportFileWriter::close() {
+    if (_file == NULL) {
+        return ESP_OK;
+    }
+    esp_err_t err = commit();
+    _card->closeFile(WRITING_FILE);
+    _file = NULL;
+    _count = 0;
+    _first_record = 0;
+    _encoder.begin(_block + REPORT_V2_BLOCK_HEADER_SIZE, true);
+    _pending = false;
+    MY_LOGD("Arquivo %s fechado", _file_name);
+    return err;
+}
+
+bool ReportFileWriter::isOpen() const {
+    return _file != NULL;
+}
+
+}  // namespace Wetzel
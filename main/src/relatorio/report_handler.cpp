@@ -3,11 +3,11 @@
 #include <freertos/FreeRTOS.h>
 #include <freertos/semphr.h>
 #include <freertos/task.h>
-#include <map>
-#include <unordered_map>
 
 #include "debug.h"
+#include "hex_codec.h"
 #include "real_time_clock.h"
+#include "report_reader.h"
 #include "sd_card_handler.h"
 
 static const char* TAG = __FILE__;
@@ -18,186 +18,265 @@ namespace Wetzel {
 
 #define MS_PERIOD_TO_CHECK 1000
 #define MS_PERIOD_TO_WRITE_FILE 60000
+#define SECONDS_PER_DAY 86400
 /**
  * @brief instanciações de variáveis static
  * 
  */
 ReportHandler* ReportHandler::_instance = NULL;
 TaskHandle_t ReportHandler::writing_file_handle = NULL;
-SemaphoreHandle_t ReportHandler::_writing_queue_mutex;
-SemaphoreHandle_t ReportHandler::_reading_queue_mutex;
-SemaphoreHandle_t ReportHandler::_report_msg_queue_mutex;
-SemaphoreHandle_t ReportHandler::_device_info_map_mutex;
-
-std::queue<report_entry_t> ReportHandler::_writing_buffer;
-std::queue<report_entry_t> ReportHandler::_reading_buffer;
-std::queue<report_msg_entry_t> ReportHandler::_report_msg_buffer;
+TaskHandle_t ReportHandler::report_entry_handle = NULL;
+
+SpscRing<report_msg_entry_t, REPORT_MSG_RING_SIZE> ReportHandler::_report_msg_buffer;
+SpscRing<report_entry_t, REPORT_WRITING_RING_SIZE> ReportHandler::_writing_buffer;
 CartaoSD* ReportHandler::_card = NULL;
 RealTimeClock* ReportHandler::_rtc = NULL;
-FILE* ReportHandler::_writing_file = NULL;
-FILE* ReportHandler::_reading_file = NULL;
-int ReportHandler::_current_file_unix_day = 0;
-device_report_info_map_t ReportHandler::_mapa_de_info_de_devices;
+ReportFileWriter ReportHandler::_writer;
+ReportRollupWriter ReportHandler::_rollup;
+int ReportHandler::_current_file_unix_day = -1;
+DeviceRegistry ReportHandler::_devices;
+report_sampling_state_t ReportHandler::_sampling;
 
 ReportHandler::ReportHandler() = default;
 
 void ReportHandler::report_entry_handler(void* arg) {
-    char msg_holder[20];
-    char* strtok_ptr;
     RealTimeClock* rtc = RealTimeClock::getInstance();
 
-    while (1) {
-        if (xSemaphoreTake(_report_msg_queue_mutex, portMAX_DELAY) != pdTRUE) {
-            continue;
-        }
-
-        while (!_report_msg_buffer.empty()) {
-            strcpy(msg_holder, _report_msg_buffer.front().msg);
-
-            device_mac_t mac(6);
-            uint8_t pwm_value;
+    report_msg_entry_t report_msg;
+    device_report_info_t device_info;
 
-            sscanf(strtok_r(msg_holder, ",", &strtok_ptr), "%2hhx%2hhx%2hhx%2hhx%2hhx%2hhx",
-                   &mac[0], &mac[1], &mac[2], &mac[3], &mac[4], &mac[5]);
-
-            pwm_value = atoi(strtok_r(NULL, ",", &strtok_ptr));
-
-            _report_msg_buffer.pop();
-            xSemaphoreGive(_report_msg_queue_mutex);
-
-            auto map_iterator = _mapa_de_info_de_devices.find(mac);
+    while (1) {
+        // acordada pelo produtor; o timeout e so uma garantia
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(MS_PERIOD_TO_CHECK));
 
-            if (map_iterator == _mapa_de_info_de_devices.end()) {
+        while (_report_msg_buffer.pop(report_msg)) {
+            if (!_devices.find(report_msg.mac, &device_info)) {
                 MY_LOGE("Dispositivo não configurado para relatório...");
                 continue;
             }
 
             report_entry_t new_report_entry = {
-                .device_info =
-                    {
-                        .id = map_iterator->second.id,
-                        .qtd_luminarias = map_iterator->second.qtd_luminarias,
-                        .modelo_luminarias = map_iterator->second.modelo_luminarias,
-                    },
-                .pwm_value = pwm_value,
+                .device_info = device_info,
+                .pwm_value = report_msg.pwm_value,
                 .unix_seconds = rtc->unixSeconds(),
             };
 
             add_report_to_writing_buffer(new_report_entry);
         }
-        vTaskDelay(pdMS_TO_TICKS(MS_PERIOD_TO_CHECK));
     }
 }
 
 void ReportHandler::writing_file_handler(void* arg) {
-    uint32_t ulInterruptStatus;
     TickType_t last_execution_time;
     const TickType_t frequency = pdMS_TO_TICKS(MS_PERIOD_TO_WRITE_FILE);
     last_execution_time = xTaskGetTickCount();
-    RealTimeClock* rtc = RealTimeClock::getInstance();
-    // first:id     |   second:report_informations
-    std::unordered_map<uint8_t, report_sampling_param_t> entradas;
+
+    report_entry_t report_entry;
+    bool new_entry_added = false;
 
     while (1) {
-        vTaskDelayUntil(&last_execution_time, frequency);
+        // a fila e drenada sempre que passa da metade e o arquivo e gravado
+        // a cada MS_PERIOD_TO_WRITE_FILE
+        TickType_t elapsed = xTaskGetTickCount() - last_execution_time;
+        if (elapsed < frequency) {
+            ulTaskNotifyTake(pdTRUE, frequency - elapsed);
+        }
 
-        bool new_entry_added = false;
-        char file_name[20];
-        createFileName(file_name, _rtc->dateTime().year(), _rtc->dateTime().month(),
-                       _rtc->dateTime().day(), "txt");
+        while (_writing_buffer.pop(report_entry)) {
+            new_entry_added = true;
+            _sample_report_entry(report_entry);
+        }
 
-        if (xSemaphoreTake(_writing_queue_mutex, portTICK_RATE_MS) != pdTRUE) {
+        if (xTaskGetTickCount() - last_execution_time < frequency) {
             continue;
         }
-        while (!_writing_buffer.empty()) {
-            new_entry_added = true;
-            report_entry_t report_entry = _writing_buffer.front();
-            _writing_buffer.pop();
-            MY_LOGD("Processing new report_entry");
-            auto iterator = entradas.find(report_entry.device_info.id);
-
-            // É nova entrada no mapa (ID nao reconhecido)
-            if (iterator == entradas.end()) {
-                MY_LOGD("New ID found => ID: %d", (iterator->first));
-                report_sampling_param_t param = {
-                    .last_average_pwm = report_entry.pwm_value,
-                    .average_pwm = report_entry.pwm_value,
-                    .pwm_i = report_entry.pwm_value,
-                    .pwm_i_1 = report_entry.pwm_value,
-                    .t_i = report_entry.unix_seconds,
-                    .t_i_1 = report_entry.unix_seconds,
-                    .t_0 = report_entry.unix_seconds,
-                    .n_lum = report_entry.device_info.qtd_luminarias,
-                    .lum_type = report_entry.device_info.modelo_luminarias,
-                    .is_new_param = true,
-                };
-                entradas[report_entry.device_info.id] = param;
-
-            } else {
-                auto param = &iterator->second;
-                MY_LOGD("New entry from ID: %d", (iterator->first));
-
-                // Se for novo ciclo de amostragem
-                if (iterator->second.is_new_param == false) {
-                    MY_LOGD("First entry from cycle from ID: %d", (iterator->first));
-
-                    param->n_lum = report_entry.device_info.qtd_luminarias;
-                    param->lum_type = report_entry.device_info.modelo_luminarias;
-                    param->t_0 = param->t_i;
-                    param->last_average_pwm = param->pwm_i;
-                } else {
-                    param->last_average_pwm = param->average_pwm;
-                }
+        last_execution_time += frequency;
+
+        // com falha na abertura os registros ficam marcados para o proximo
+        // ciclo; a virada do dia e os rollups seguem rodando mesmo assim
+        if (new_entry_added == true && _write_changed_entries() == ESP_OK) {
+            new_entry_added = false;
+        }
+
+        // virada do dia: o ciclo que acabou de ser gravado foi para o arquivo
+        // do dia das amostras; o arquivo anterior e fechado aqui uma unica
+        // vez e o do novo dia so e aberto quando chegar o primeiro report
+        uint16_t today = _rtc->unixDay();
+        if (_writer.isOpen() && today != _current_file_unix_day) {
+            MY_LOGI("Virada do dia, fechando arquivo do dia %d", _current_file_unix_day);
+            _writer.close();
+            _current_file_unix_day = -1;
+        } else if (_writer.isOpen()) {
+            _writer.commitIfDue();
+        }
 
-                param->pwm_i_1 = param->pwm_i;
-                param->t_i_1 = param->t_i;
+        // os rollups tem o seu proprio FILE, o arquivo do dia segue aberto
+        uint32_t now = _rtc->unixSeconds();
+        if (_rollup.hourDue(now)) {
+            _rollup.closeHour(now);
+        }
+    }
+}
+
+esp_err_t ReportHandler::_open_day_file(uint16_t unix_day) {
+    char file_name[20];
+    uint16_t year;
+    uint8_t month, day;
+
+    ReportReader::dateFromUnixDay(unix_day, &year, &month, &day);
+    createFileName(file_name, year, month, day, REPORT_FILE_EXTENSION);
+    esp_err_t err = _writer.open(file_name, unix_day);
+    if (err != ESP_OK) {
+        return err;
+    }
+    _current_file_unix_day = unix_day;
+    MY_LOGD("WRITING FILE %s", file_name);
+    return ESP_OK;
+}
+
+void ReportHandler::_sample_report_entry(const report_entry_t& report_entry) {
+    report_sampling_state_t& s = _sampling;
+    const uint8_t id = report_entry.device_info.id;
+    const uint32_t bit = 1UL << (id % 32);
+    uint32_t& known = s.known[id / 32];
+    uint32_t& changed = s.changed[id / 32];
+
+    MY_LOGD("Processing new report_entry");
+    // É nova entrada (ID nao reconhecido)
+    if (!(known & bit)) {
+        MY_LOGD("New ID found => ID: %d", id);
+        s.last_average_pwm[id] = report_entry.pwm_value;
+        s.average_pwm[id] = report_entry.pwm_value;
+        s.pwm_i[id] = report_entry.pwm_value;
+        s.pwm_i_1[id] = report_entry.pwm_value;
+        s.t_i[id] = report_entry.unix_seconds;
+        s.t_i_1[id] = report_entry.unix_seconds;
+        s.t_0[id] = report_entry.unix_seconds;
+        s.n_lum[id] = report_entry.device_info.qtd_luminarias;
+        s.lum_type[id] = report_entry.device_info.modelo_luminarias;
+        known |= bit;
+        changed |= bit;
+        return;
+    }
+
+    MY_LOGD("New entry from ID: %d", id);
+    // Se for novo ciclo de amostragem
+    if (!(changed & bit)) {
+        MY_LOGD("First entry from cycle from ID: %d", id);
+        s.n_lum[id] = report_entry.device_info.qtd_luminarias;
+        s.lum_type[id] = report_entry.device_info.modelo_luminarias;
+        s.t_0[id] = s.t_i[id];
+        s.last_average_pwm[id] = s.pwm_i[id];
+    } else {
+        s.last_average_pwm[id] = s.average_pwm[id];
+    }
+
+    s.pwm_i_1[id] = s.pwm_i[id];
+    s.t_i_1[id] = s.t_i[id];
+    s.pwm_i[id] = report_entry.pwm_value;
+    s.t_i[id] = report_entry.unix_seconds;
+    changed |= bit;
 
-                param->pwm_i = report_entry.pwm_value;
-                param->t_i = report_entry.unix_seconds;
-                param->is_new_param = true;
+    s.average_pwm[id] = calculate_average_pwm(s.last_average_pwm[id], s.pwm_i[id], s.pwm_i_1[id],
+                                              s.t_0[id], s.t_i[id], s.t_i_1[id]);
+    MY_LOGD("AVERAGE_PWM: %d", s.average_pwm[id]);
+}
 
-                param->average_pwm = calculate_average_pwm(*param);
-                MY_LOGD("AVERAGE_PWM: %d", param->average_pwm);
+/**
+ * @brief Passa para o escritor os dispositivos com report no ciclo,
+ * percorrendo so os bits ligados do bitmap, em ordem de id. Cada registro vai
+ * para o arquivo do dia da sua amostra (t_0): o ciclo gravado logo apos a
+ * meia-noite ainda pertence ao dia anterior. A media do ciclo entra tambem no
+ * rollup da hora, pesada pela duracao do ciclo (limitada a um periodo de
+ * gravacao: o tempo sem report nao conta como medido).
+ *
+ * O t_0 de um dispositivo que ficou calado e o ultimo report antigo, que pode
+ * ser de dias atras. Ele e trazido para no minimo um periodo antes do inicio
+ * do ciclo (e nunca antes do dia em que o ciclo comecou), para o registro ir
+ * para o arquivo do dia corrente, dentro do intervalo do indice, e nao reabrir
+ * um arquivo antigo.
+ * 
+ * @return esp_err_t Falha ao abrir o arquivo do dia; os registros nao
+ * gravados continuam marcados em changed
+ */
+esp_err_t ReportHandler::_write_changed_entries() {
+    report_sampling_state_t& s = _sampling;
+    uint32_t pending[REPORT_DEVICE_BITMAP_WORDS];
+    bool any = false;
+
+    const uint32_t period = MS_PERIOD_TO_WRITE_FILE / 1000;
+    const uint32_t now = _rtc->unixSeconds();
+    const uint32_t cycle_start = now - period;
+    uint32_t oldest_t_0 = cycle_start - cycle_start % SECONDS_PER_DAY;
+    if (cycle_start - period > oldest_t_0) {
+        oldest_t_0 = cycle_start - period;
+    }
+
+    for (uint16_t word = 0; word < REPORT_DEVICE_BITMAP_WORDS; word++) {
+        pending[word] = s.changed[word];
+        s.changed[word] = 0;
+        any = any || pending[word] != 0;
+        for (uint32_t bits = pending[word]; bits; bits &= bits - 1) {
+            uint8_t id = word * 32 + __builtin_ctz(bits);
+            // registro adiado por falha de gravacao mantem t_0 <= t_i
+            if (s.t_0[id] < oldest_t_0) {
+                s.t_0[id] = s.t_i[id] < oldest_t_0 ? s.t_i[id] : oldest_t_0;
             }
         }
-        xSemaphoreGive(_writing_queue_mutex);
-
-        if (new_entry_added == true) {
-            _card->openFile(file_name, WRITING_FILE);
-            MY_LOGD("WRITING FILE %s", file_name);
-            for (auto iterator = entradas.begin(); iterator != entradas.end(); iterator++) {
-                if (iterator->second.is_new_param) {
-                    report_entry_t new_entry = {
-                        .device_info =
-                            {
-                                .id = iterator->first,
-                                .qtd_luminarias = iterator->second.n_lum,
-                                .modelo_luminarias = iterator->second.lum_type,
-                            },
-                        .pwm_value = iterator->second.average_pwm,
-                        .unix_seconds = iterator->second.t_0,
-                    };
-                    fwrite(&new_entry.device_info.id, sizeof(new_entry.device_info.id), 1,
-                           _writing_file);
-                    fwrite(&new_entry.device_info.qtd_luminarias,
-                           sizeof(new_entry.device_info.qtd_luminarias), 1, _writing_file);
-                    fwrite(&new_entry.device_info.modelo_luminarias,
-                           sizeof(new_entry.device_info.modelo_luminarias), 1, _writing_file);
-                    fwrite(&new_entry.pwm_value, sizeof(new_entry.pwm_value), 1, _writing_file);
-                    fwrite(&new_entry.unix_seconds, sizeof(new_entry.unix_seconds), 1,
-                           _writing_file);
-
-                    iterator->second.is_new_param = false;
+    }
+
+    // um ciclo cruza no maximo uma meia-noite: grava o dia mais antigo primeiro
+    while (any) {
+        uint16_t unix_day = UINT16_MAX;
+        for (uint16_t word = 0; word < REPORT_DEVICE_BITMAP_WORDS; word++) {
+            for (uint32_t bits = pending[word]; bits; bits &= bits - 1) {
+                uint16_t day = s.t_0[word * 32 + __builtin_ctz(bits)] / SECONDS_PER_DAY;
+                if (day < unix_day) {
+                    unix_day = day;
                 }
             }
-            _card->closeFile(WRITING_FILE);
-            MY_LOGD("FILE %s CLOSED", file_name);
+        }
+        if (unix_day != _current_file_unix_day && _open_day_file(unix_day) != ESP_OK) {
+            for (uint16_t word = 0; word < REPORT_DEVICE_BITMAP_WORDS; word++) {
+                s.changed[word] |= pending[word];
+            }
+            return ESP_FAIL;
+        }
+
+        any = false;
+        for (uint16_t word = 0; word < REPORT_DEVICE_BITMAP_WORDS; word++) {
+            uint32_t bits = pending[word];
+            while (bits) {
+                uint8_t id = word * 32 + __builtin_ctz(bits);
+                bits &= bits - 1;
+                if (s.t_0[id] / SECONDS_PER_DAY != unix_day) {
+                    continue;
+                }
+                pending[word] &= ~(1UL << (id % 32));
+
+                report_record_t record = {
+                    .id = id,
+                    .qtd_luminarias = s.n_lum[id],
+                    .modelo_luminarias = s.lum_type[id],
+                    .pwm_value = s.average_pwm[id],
+                    .unix_seconds = s.t_0[id],
+                };
+                _writer.append(record);
+
+                uint32_t seconds = s.t_i[id] - s.t_0[id];
+                if (seconds > MS_PERIOD_TO_WRITE_FILE / 1000) {
+                    seconds = MS_PERIOD_TO_WRITE_FILE / 1000;
+                }
+                _rollup.add(id, s.average_pwm[id], seconds);
+            }
+            any = any || pending[word] != 0;
         }
     }
+    return ESP_OK;
 }
 
 esp_err_t ReportHandler::createFileName(char* file_name, uint16_t year, uint8_t month, uint8_t day,
-                                        char* extension) {
+                                        const char* extension) {
     if (file_name == NULL) {
         return ESP_FAIL;
     }
@@ -208,6 +287,29 @@ esp_err_t ReportHandler::createFileName(char* file_name, uint16_t year, uint8_t
     }
     return ESP_OK;
 }
+
+esp_err_t ReportHandler::createRollupFileName(char* file_name, report_rollup_tier_t tier,
+                                              uint16_t unix_day) {
+    uint16_t year;
+    uint8_t month, day;
+
+    if (file_name == NULL) {
+        return ESP_FAIL;
+    }
+    ReportReader::dateFromUnixDay(unix_day, &year, &month, &day);
+    switch (tier) {
+    case REPORT_ROLLUP_HOUR:
+        return createFileName(file_name, year, month, day, REPORT_ROLLUP_HOUR_EXTENSION);
+    case REPORT_ROLLUP_DAY:
+        sprintf(file_name, "/%02u%02u.%s", year % 100, month, REPORT_ROLLUP_DAY_EXTENSION);
+        return ESP_OK;
+    case REPORT_ROLLUP_MONTH:
+        sprintf(file_name, "/%02u.%s", year % 100, REPORT_ROLLUP_MONTH_EXTENSION);
+        return ESP_OK;
+    }
+    return ESP_FAIL;
+}
+
 ReportHandler::~ReportHandler() {
     delete _instance;
 }
@@ -223,10 +325,18 @@ esp_err_t ReportHandler::begin() {
     _rtc = RealTimeClock::getInstance();
     _card = CartaoSD::getInstance();
 
-    _reading_queue_mutex = xSemaphoreCreateMutex();
-    _writing_queue_mutex = xSemaphoreCreateMutex();
-    _report_msg_queue_mutex = xSemaphoreCreateMutex();
-    _device_info_map_mutex = xSemaphoreCreateMutex();
+    esp_err_t err = _devices.begin(REPORT_MAX_DEVICES);
+    if (err != ESP_OK) {
+        return err;
+    }
+    err = _writer.begin(_card);
+    if (err != ESP_OK) {
+        return err;
+    }
+    err = _rollup.begin(_card, _rtc->unixSeconds());
+    if (err != ESP_OK) {
+        return err;
+    }
 
     BaseType_t xReturned = pdFAIL;
     writing_file_handle = NULL;
@@ -248,7 +358,7 @@ esp_err_t ReportHandler::begin() {
         4 * TASK_STACK_REF_SIZE,              /* Stack size in words, not bytes. */
         NULL,                                 /* Parameter passed into the task. */
         REPORT_HANDLER_DEFAULT_TASK_PRIORITY, /* Priority at which the task is created. */
-        NULL);                                /* Used to pass out the created task's handle. */
+        &report_entry_handle);                /* Used to pass out the created task's handle. */
     if (xReturned != pdPASS) {
         MY_LOGE("report_entry_task creation failed");
         vTaskSuspend(writing_file_handle);
@@ -259,71 +369,90 @@ esp_err_t ReportHandler::begin() {
 }
 
 esp_err_t ReportHandler::add_entry_to_report_msg_buffer(report_msg_entry_t& report_msg) {
-    esp_err_t err;
-
-    if (xSemaphoreTake(_report_msg_queue_mutex, pdMS_TO_TICKS(1000)) != pdTRUE) {
+    if (!_report_msg_buffer.push(report_msg)) {
+        MY_LOGE("Fila de report_msg cheia");
         return ESP_FAIL;
     }
-
-    if (_report_msg_buffer.size() > 5) {
-        MY_LOGE("Test max size of queue...");
-        xSemaphoreGive(_report_msg_queue_mutex);
-        return ESP_FAIL;
+    if (report_entry_handle != NULL) {
+        xTaskNotifyGive(report_entry_handle);
     }
-    _report_msg_buffer.push(report_msg);
-    xSemaphoreGive(_report_msg_queue_mutex);
 
-    MY_LOGD("Report_msg added to report_msg_queue: %s", report_msg.msg);
+    MY_LOGD("Report_msg added to report_msg_queue: " MACSTR " pwm: %u", MAC2STR(report_msg.mac),
+            report_msg.pwm_value);
 
     return ESP_OK;
 }
 
-esp_err_t ReportHandler::add_device_to_report_info_map(device_mac_t mac, uint8_t qtd_luminarias,
-                                                       luminaria_type_t modelo_luminarias) {
+esp_err_t ReportHandler::parse_report_msg(const char* msg, size_t len,
+                                          report_msg_entry_t* report_msg) {
+    const size_t mac_digits = 2 * sizeof(report_msg->mac);
+    uint16_t pwm_value = 0;
+    size_t i = mac_digits + 1;
 
-    if (xSemaphoreTake(_device_info_map_mutex, portMAX_DELAY) != pdTRUE) {
+    if (len < mac_digits + 2 || msg[mac_digits] != ',' ||
+        !hex_decode(msg, report_msg->mac, sizeof(report_msg->mac))) {
+        MY_LOGE("Mensagem de report invalida: %.*s", len, msg);
         return ESP_FAIL;
     }
-    auto iterator = _mapa_de_info_de_devices.find(mac);
-    if (iterator == _mapa_de_info_de_devices.end()) {
-        device_report_info_t new_device_info = {
-            id: (uint8_t)_mapa_de_info_de_devices.size(),
-            qtd_luminarias: qtd_luminarias,
-            modelo_luminarias: modelo_luminarias,
-        };
-        _mapa_de_info_de_devices[mac] = new_device_info;
+    // pwm decimal de 1 a 3 digitos, ate o fim, ',' ou ';'
+    for (; i < len && i < mac_digits + 4; i++) {
+        uint8_t digit = msg[i] - '0';
+        if (digit > 9)
+            break;
+        pwm_value = pwm_value * 10 + digit;
+    }
+    if (i == mac_digits + 1 || pwm_value > UINT8_MAX ||
+        (i < len && msg[i] != ',' && msg[i] != ';' && msg[i] != '\0')) {
+        MY_LOGE("Mensagem de report invalida: %.*s", len, msg);
+        return ESP_FAIL;
+    }
+    report_msg->pwm_value = pwm_value;
+    return ESP_OK;
+}
+
+esp_err_t ReportHandler::add_device_to_report_info_map(const uint8_t mac[6],
+                                                       uint8_t qtd_luminarias,
+                                                       luminaria_type_t modelo_luminarias) {
+    esp_err_t err = _devices.add(mac, qtd_luminarias, modelo_luminarias);
+    if (err == ESP_OK) {
         MY_LOGD("Novo dispositivo adicionado a mapa de report: " MACSTR
                 "   | qtd_lum: %d   | n_lum: %d",
                 MAC2STR(mac), qtd_luminarias, modelo_luminarias);
-        xSemaphoreGive(_device_info_map_mutex);
-        return ESP_OK;
+    } else if (err == ESP_ERR_NO_MEM) {
+        MY_LOGE("Limite de %u dispositivos de relatorio atingido", REPORT_MAX_DEVICES);
     }
-    xSemaphoreGive(_device_info_map_mutex);
-    return ESP_FAIL;
+    return err == ESP_OK ? ESP_OK : ESP_FAIL;
 }
 
 esp_err_t ReportHandler::add_report_to_writing_buffer(report_entry_t& report) {
-    esp_err_t err;
-
-    if (xSemaphoreTake(_writing_queue_mutex, pdMS_TO_TICKS(1000)) != pdTRUE) {
+    if (!_writing_buffer.push(report)) {
+        MY_LOGE("Fila de escrita cheia, report descartado");
         return ESP_FAIL;
     }
-    _writing_buffer.push(report);
-    xTaskNotify(writing_file_handle, 0, eNoAction);
-    xSemaphoreGive(_writing_queue_mutex);
+    // acorda a escrita antes de a fila encher, sem troca de contexto por report
+    if (_writing_buffer.size() >= REPORT_WRITING_RING_SIZE / 2) {
+        xTaskNotifyGive(writing_file_handle);
+    }
 
     MY_LOGD("Report_entry added to writing file queue");
 
     return ESP_OK;
 }
 
-uint8_t calculate_average_pwm(report_sampling_param_t param) {
-    const auto t0 = param.t_0;
-    const auto ti = param.t_i;
-    const auto ti_1 = param.t_i_1;
-    const auto avg_pwm_i_1 = param.last_average_pwm;
-    const auto pwm_i = param.pwm_i;
-    const auto pwm_i_1 = param.pwm_i_1;
+ring_stats_t ReportHandler::reportMsgQueueStats() {
+    return _report_msg_buffer.stats();
+}
+
+ring_stats_t ReportHandler::writingQueueStats() {
+    return _writing_buffer.stats();
+}
+
+uint8_t calculate_average_pwm(uint8_t last_average_pwm, uint8_t pwm_i, uint8_t pwm_i_1, uint32_t t_0,
+                              uint32_t t_i, uint32_t t_i_1) {
+    const auto t0 = t_0;
+    const auto ti = t_i;
+    const auto ti_1 = t_i_1;
+    const auto avg_pwm_i_1 = last_average_pwm;
 
     if (t0 == ti) {
         MY_LOGE("to == ti");
@@ -0,0 +1,548 @@
+#include "report_reader.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "debug.h"
+#include "report_handler.h"
+
+static const char* TAG = __FILE__;
+
+namespace Wetzel {
+
+/**
+ * @brief Pedido de leitura para a task de prefetch.
+ *
+ */
+typedef struct {
+    uint8_t buffer;
+    uint32_t len;
+} prefetch_request_t;
+
+typedef struct {
+    uint8_t buffer;
+    int32_t len;
+} prefetch_result_t;
+
+ReportReader* ReportReader::_instance = NULL;
+CartaoSD* ReportReader::_card = NULL;
+SemaphoreHandle_t ReportReader::_lock;
+QueueHandle_t ReportReader::_prefetch_requests;
+QueueHandle_t ReportReader::_prefetch_results;
+report_file_t ReportReader::_files[REPORT_DOWNLOAD_MAX_DAYS];
+uint8_t ReportReader::_file_count = 0;
+uint8_t ReportReader::_file_index = 0;
+bool ReportReader::_file_is_open = false;
+uint32_t ReportReader::_file_offset = 0;
+uint32_t ReportReader::_total_size = 0;
+uint32_t ReportReader::_remaining = 0;
+uint8_t ReportReader::_record_block[REPORT_FORMAT_BLOCK_SIZE];
+uint32_t ReportReader::_index[REPORT_INDEX_MAX_BUCKETS];
+report_codec_state_t ReportReader::_codec_state;
+char* ReportReader::_buffers[2] = {NULL, NULL};
+size_t ReportReader::_block_size = 0;
+uint8_t ReportReader::_next_buffer = 0;
+bool ReportReader::_pending = false;
+
+ReportReader::ReportReader() = default;
+
+ReportReader::~ReportReader() {
+    delete _instance;
+}
+
+ReportReader* ReportReader::getInstance() {
+    if (_instance == nullptr) {
+        _instance = new ReportReader();
+    }
+    return _instance;
+}
+
+esp_err_t ReportReader::begin() {
+    _card = CartaoSD::getInstance();
+    _lock = xSemaphoreCreateMutex();
+    _prefetch_requests = xQueueCreate(1, sizeof(prefetch_request_t));
+    _prefetch_results = xQueueCreate(1, sizeof(prefetch_result_t));
+    if (_lock == NULL || _prefetch_requests == NULL || _prefetch_results == NULL) {
+        MY_LOGE("Sem memoria para o ReportReader");
+        return ESP_ERR_NO_MEM;
+    }
+
+    BaseType_t xReturned =
+        xTaskCreate(prefetch_handler, "report_reader_task", REPORT_READER_TASK_STACK_SIZE, NULL,
+                    REPORT_READER_TASK_PRIORITY, NULL);
+    if (xReturned != pdPASS) {
+        MY_LOGE("report_reader_task creation failed");
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+void ReportReader::prefetch_handler(void* arg) {
+    prefetch_request_t request;
+    prefetch_result_t result;
+
+    while (1) {
+        if (xQueueReceive(_prefetch_requests, &request, portMAX_DELAY) != pdTRUE) {
+            continue;
+        }
+        result.buffer = request.buffer;
+        result.len = _read_chain(_buffers[request.buffer], request.len);
+        xQueueSend(_prefetch_results, &result, portMAX_DELAY);
+    }
+}
+
+/**
+ * @brief Le len bytes seguindo a lista de arquivos, passando para o proximo
+ * arquivo quando o atual termina. Cada arquivo e lido so ate o tamanho
+ * registrado no open(), pois o arquivo do dia pode crescer durante o download.
+ *
+ * @param buffer
+ * @param len
+ * @return int32_t
+ */
+int32_t ReportReader::_read_chain(char* buffer, size_t len) {
+    size_t total = 0;
+
+    while (total < len && _file_index < _file_count) {
+        report_file_t* file = &_files[_file_index];
+        if (!_file_is_open) {
+            FILE* f = _card->openFile(file->name, READING_FILE);
+            if (f == NULL || fseek(f, _file_offset, SEEK_SET) != 0) {
+                MY_LOGE("Falha ao abrir %s", file->name);
+                return -1;
+            }
+            _file_is_open = true;
+        }
+
+        size_t wanted = len - total;
+        if (wanted > file->size - _file_offset) {
+            wanted = file->size - _file_offset;
+        }
+        size_t n = fread(buffer + total, 1, wanted, _card->readingFile());
+        total += n;
+        _file_offset += n;
+        if (n < wanted && ferror(_card->readingFile())) {
+            MY_LOGE("Erro de leitura em %s", file->name);
+            return -1;
+        }
+        if (n < wanted || _file_offset >= file->size) {
+            _card->closeFile(READING_FILE);
+            _file_is_open = false;
+            _file_index++;
+            _file_offset = 0;
+        }
+    }
+    return total;
+}
+
+void ReportReader::_request_block() {
+    // o primeiro bloco de um Range termina no proximo limite de setor, os
+    // seguintes ficam alinhados
+    prefetch_request_t request = {
+        .buffer = _next_buffer,
+        .len = (uint32_t)(_block_size - (_file_offset % REPORT_READ_ALIGNMENT)),
+    };
+    if (request.len > _remaining) {
+        request.len = _remaining;
+    }
+    _pending = true;
+    xQueueSend(_prefetch_requests, &request, portMAX_DELAY);
+}
+
+esp_err_t ReportReader::open(int32_t first_day, int32_t last_day, char* buffer_a,
+                             char* buffer_b, size_t buffer_size) {
+    if (last_day < first_day || last_day - first_day >= REPORT_DOWNLOAD_MAX_DAYS) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (xSemaphoreTake(_lock, 0) != pdTRUE) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    _file_count = 0;
+    _total_size = 0;
+    for (int32_t unix_day = first_day; unix_day <= last_day; unix_day++) {
+        uint16_t year;
+        uint8_t month, day;
+        char path[sizeof(MOUNT_POINT) + sizeof(_files[0].name)];
+        struct stat st;
+        report_file_t* file = &_files[_file_count];
+
+        dateFromUnixDay(unix_day, &year, &month, &day);
+        ReportHandler::createFileName(file->name, year, month, day, REPORT_FILE_EXTENSION);
+        snprintf(path, sizeof(path), MOUNT_POINT "%s", file->name);
+        if (stat(path, &st) != 0 || st.st_size == 0) {
+            continue;
+        }
+        file->size = st.st_size;
+        _total_size += file->size;
+        _file_count++;
+    }
+    if (_file_count == 0) {
+        xSemaphoreGive(_lock);
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    _buffers[0] = buffer_a;
+    _buffers[1] = buffer_b;
+    _block_size = buffer_size - (buffer_size % REPORT_READ_ALIGNMENT);
+    if (_block_size == 0) {
+        _block_size = buffer_size;
+    }
+    _next_buffer = 0;
+    _pending = false;
+    _file_is_open = false;
+    return seek(0, _total_size);
+}
+
+uint32_t ReportReader::totalSize() {
+    return _total_size;
+}
+
+esp_err_t ReportReader::seek(uint32_t offset, uint32_t length) {
+    if (_pending || offset > _total_size || length > _total_size - offset) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (_file_is_open) {
+        _card->closeFile(READING_FILE);
+        _file_is_open = false;
+    }
+    _file_index = 0;
+    while (_file_index < _file_count && offset >= _files[_file_index].size) {
+        offset -= _files[_file_index].size;
+        _file_index++;
+    }
+    _file_offset = offset;
+    _remaining = length;
+    return ESP_OK;
+}
+
+int32_t ReportReader::read(const char** data) {
+    prefetch_result_t result;
+
+    if (!_pending) {
+        if (_remaining == 0) {
+            return 0;
+        }
+        _request_block();
+    }
+    xQueueReceive(_prefetch_results, &result, portMAX_DELAY);
+    _pending = false;
+    if (result.len <= 0) {
+        // arquivo encurtado ou erro de leitura
+        return result.len < 0 ? result.len : -1;
+    }
+
+    _remaining -= result.len;
+    _next_buffer = result.buffer ^ 1;
+    // o proximo bloco vai para o outro buffer enquanto este e enviado
+    if (_remaining > 0) {
+        _request_block();
+    }
+    *data = _buffers[result.buffer];
+    return result.len;
+}
+
+void ReportReader::close() {
+    prefetch_result_t result;
+
+    if (_pending) {
+        xQueueReceive(_prefetch_results, &result, portMAX_DELAY);
+        _pending = false;
+    }
+    if (_file_is_open) {
+        _card->closeFile(READING_FILE);
+        _file_is_open = false;
+    }
+    _remaining = 0;
+    xSemaphoreGive(_lock);
+}
+
+esp_err_t ReportReader::_read_plain(FILE* f, const char* name, uint32_t first,
+                                     report_record_t* records, uint16_t max_records,
+                                     uint16_t* count) {
+    uint32_t block = first / REPORT_FORMAT_RECORDS_PER_BLOCK;
+    uint8_t index = first % REPORT_FORMAT_RECORDS_PER_BLOCK;
+    if (fseek(f, report_block_offset(block), SEEK_SET) != 0) {
+        return ESP_FAIL;
+    }
+    while (*count < max_records) {
+        if (fread(_record_block, 1, REPORT_FORMAT_BLOCK_SIZE, f) != REPORT_FORMAT_BLOCK_SIZE) {
+            break;
+        }
+        int block_count = report_block_count(_record_block);
+        if (block_count < 0) {
+            MY_LOGW("Bloco %u de %s invalido", block, name);
+            break;
+        }
+        for (; index < block_count && *count < max_records; index++) {
+            report_record_decode(report_block_record(_record_block, index), &records[*count]);
+            (*count)++;
+        }
+        if (block_count < REPORT_FORMAT_RECORDS_PER_BLOCK) {
+            break;
+        }
+        block++;
+        index = 0;
+    }
+    return ESP_OK;
+}
+
+/**
+ * @brief Primeiro registro de um bloco v2, lendo so o cabecalho dele.
+ *
+ * @return int64_t -1 se nao der para ler
+ */
+static int64_t block_first_record(FILE* f, uint32_t block, uint8_t* header) {
+    if (fseek(f, report_block_offset(block), SEEK_SET) != 0 ||
+        fread(header, 1, REPORT_V2_BLOCK_HEADER_SIZE, f) != REPORT_V2_BLOCK_HEADER_SIZE ||
+        header[0] != 'B' || header[1] != 'C') {
+        return -1;
+    }
+    return report_v2_block_first_record(header);
+}
+
+/**
+ * @brief Na v2 os blocos tem numero variavel de registros: o bloco de first e
+ * achado por bissecao nos cabecalhos dos blocos (first_record e crescente) e
+ * a decodificacao comeca no inicio do segmento dele, no maximo
+ * REPORT_V2_SEGMENT_BLOCKS blocos antes.
+ *
+ */
+esp_err_t ReportReader::_read_compressed(FILE* f, const char* name, uint32_t first,
+                                          report_record_t* records, uint16_t max_records,
+                                          uint16_t* count) {
+    if (fseek(f, 0, SEEK_END) != 0) {
+        return ESP_FAIL;
+    }
+    long size = ftell(f);
+    if (size <= REPORT_FORMAT_HEADER_SIZE) {
+        return ESP_OK;
+    }
+    uint32_t blocks = (size - REPORT_FORMAT_HEADER_SIZE) / REPORT_FORMAT_BLOCK_SIZE;
+
+    // ultimo bloco com first_record <= first
+    uint32_t low = 0, high = blocks;
+    while (high - low > 1) {
+        uint32_t middle = low + (high - low) / 2;
+        int64_t middle_first = block_first_record(f, middle, _record_block);
+        if (middle_first < 0 || middle_first > first) {
+            high = middle;
+        } else {
+            low = middle;
+        }
+    }
+    uint32_t block = low - low % REPORT_V2_SEGMENT_BLOCKS;
+
+    ReportBlockDecoder decoder(&_codec_state);
+    report_record_t record;
+    uint32_t record_index = 0;
+    // um bloco invalido no meio do segmento faz o gravador abrir outro
+    // segmento logo depois; ate la nao ha estado para decodificar. Se first
+    // esta nesse trecho, a leitura comeca no proximo segmento
+    bool synced = false;
+    for (; block < blocks && *count < max_records; block++) {
+        if (fseek(f, report_block_offset(block), SEEK_SET) != 0 ||
+            fread(_record_block, 1, REPORT_FORMAT_BLOCK_SIZE, f) != REPORT_FORMAT_BLOCK_SIZE) {
+            break;
+        }
+        int32_t block_count = report_v2_block_count(_record_block);
+        if (block_count < 0) {
+            MY_LOGW("Bloco %u de %s invalido", block, name);
+            if (*count > 0) {
+                break;
+            }
+            synced = false;
+            continue;
+        }
+        bool segment_start = report_v2_block_segment_start(_record_block);
+        synced = synced || segment_start;
+        if (!synced) {
+            continue;
+        }
+        record_index = report_v2_block_first_record(_record_block);
+        decoder.begin(_record_block + REPORT_V2_BLOCK_HEADER_SIZE,
+                      report_v2_block_used(_record_block), block_count, segment_start);
+        while (*count < max_records && decoder.next(&record)) {
+            if (record_index++ >= first) {
+                records[(*count)++] = record;
+            }
+        }
+    }
+    return ESP_OK;
+}
+
+esp_err_t ReportReader::readRecords(int32_t unix_day, uint32_t first, report_record_t* records,
+                                     uint16_t max_records, uint16_t* count) {
+    uint16_t year;
+    uint8_t month, day;
+    char name[sizeof(_files[0].name)];
+
+    if (records == NULL || count == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    *count = 0;
+    if (xSemaphoreTake(_lock, 0) != pdTRUE) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    dateFromUnixDay(unix_day, &year, &month, &day);
+    ReportHandler::createFileName(name, year, month, day, REPORT_FILE_EXTENSION);
+    FILE* f = _card->openFile(name, READING_FILE);
+    if (f == NULL) {
+        xSemaphoreGive(_lock);
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    esp_err_t err = ESP_OK;
+    if (fread(_record_block, 1, REPORT_FORMAT_HEADER_SIZE, f) != REPORT_FORMAT_HEADER_SIZE ||
+        !report_file_header_valid(_record_block)) {
+        err = ESP_ERR_INVALID_VERSION;
+    } else if (report_file_header_version(_record_block) == REPORT_FORMAT_VERSION_PLAIN) {
+        err = _read_plain(f, name, first, records, max_records, count);
+    } else {
+        err = _read_compressed(f, name, first, records, max_records, count);
+    }
+
+    _card->closeFile(READING_FILE);
+    xSemaphoreGive(_lock);
+    return err;
+}
+
+esp_err_t ReportReader::readRollups(report_rollup_tier_t tier, int32_t unix_day, uint32_t first,
+                                     report_rollup_row_t* rows, uint16_t max_rows,
+                                     uint16_t* count) {
+    char name[sizeof(_files[0].name)];
+
+    if (rows == NULL || count == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    *count = 0;
+    if (xSemaphoreTake(_lock, 0) != pdTRUE) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    ReportHandler::createRollupFileName(name, tier, unix_day);
+    FILE* f = _card->openFile(name, READING_FILE);
+    if (f == NULL) {
+        xSemaphoreGive(_lock);
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    esp_err_t err = ESP_OK;
+    if (fseek(f, first * REPORT_ROLLUP_ROW_SIZE, SEEK_SET) != 0) {
+        err = ESP_FAIL;
+    }
+    while (err == ESP_OK && *count < max_rows) {
+        size_t read = fread(_record_block, REPORT_ROLLUP_ROW_SIZE,
+                            sizeof(_record_block) / REPORT_ROLLUP_ROW_SIZE, f);
+        for (size_t i = 0; i < read && *count < max_rows; i++) {
+            if (report_rollup_row_decode(_record_block + i * REPORT_ROLLUP_ROW_SIZE,
+                                         &rows[*count])) {
+                (*count)++;
+            }
+        }
+        if (read < sizeof(_record_block) / REPORT_ROLLUP_ROW_SIZE) {
+            break;
+        }
+    }
+
+    _card->closeFile(READING_FILE);
+    xSemaphoreGive(_lock);
+    return err;
+}
+
+esp_err_t ReportReader::findWindow(int32_t unix_day, uint32_t from, uint32_t to,
+                                    uint32_t* first_record, uint32_t* end_record) {
+    uint16_t year;
+    uint8_t month, day;
+    char name[sizeof(_files[0].name)];
+
+    if (first_record == NULL || end_record == NULL || to < from) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    *first_record = 0;
+    *end_record = REPORT_INDEX_EMPTY;
+    if (xSemaphoreTake(_lock, 0) != pdTRUE) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    dateFromUnixDay(unix_day, &year, &month, &day);
+    ReportHandler::createFileName(name, year, month, day, REPORT_FILE_EXTENSION);
+    FILE* f = _card->openFile(name, READING_FILE);
+    if (f == NULL) {
+        xSemaphoreGive(_lock);
+        return ESP_ERR_NOT_FOUND;
+    }
+    bool header_ok =
+        fread(_record_block, 1, REPORT_FORMAT_HEADER_SIZE, f) == REPORT_FORMAT_HEADER_SIZE &&
+        report_file_header_valid(_record_block);
+    _card->closeFile(READING_FILE);
+    if (!header_ok) {
+        xSemaphoreGive(_lock);
+        return ESP_ERR_INVALID_VERSION;
+    }
+
+    uint16_t bucket_minutes;
+    int buckets = report_index_decode(_record_block, &bucket_minutes, _index,
+                                      REPORT_INDEX_MAX_BUCKETS);
+    if (buckets < 0) {
+        MY_LOGD("%s sem indice, janela e o arquivo inteiro", name);
+        xSemaphoreGive(_lock);
+        return ESP_OK;
+    }
+
+    // inicio: o bucket anterior ao de from ou, se ele ainda nao tem registro,
+    // o ultimo antes dele que tem. Depois de uma queda o indice pode ter
+    // perdido o bucket mais novo, e o writer o recria depois dos registros
+    // que ja existiam nele
+    int first_bucket = report_index_bucket(unix_day, bucket_minutes, buckets, from) - 1;
+    for (int i = first_bucket; i >= 0; i--) {
+        if (_index[i] != REPORT_INDEX_EMPTY) {
+            *first_record = _index[i];
+            break;
+        }
+    }
+    // fim: o primeiro bucket com registro a partir do segundo depois do de to.
+    // O horario de um registro fica ate dois periodos de gravacao atras do
+    // maior ja gravado (t_0 fora de ordem no flush, dispositivo que ficou
+    // calado), entao so depois desse bucket nao ha mais registros da janela
+    int last_bucket = report_index_bucket(unix_day, bucket_minutes, buckets, to);
+    for (int i = last_bucket + 2; i < buckets; i++) {
+        if (_index[i] != REPORT_INDEX_EMPTY) {
+            *end_record = _index[i];
+            break;
+        }
+    }
+
+    xSemaphoreGive(_lock);
+    return ESP_OK;
+}
+
+/**
+ * @brief Dias desde 1970-01-01 no calendario gregoriano.
+ *
+ */
+int32_t ReportReader::unixDayFromDate(uint16_t year, uint8_t month, uint8_t day) {
+    int32_t y = year - (month <= 2);
+    int32_t era = (y >= 0 ? y : y - 399) / 400;
+    uint32_t yoe = y - era * 400;
+    uint32_t doy = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+    uint32_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + (int32_t)doe - 719468;
+}
+
+void ReportReader::dateFromUnixDay(int32_t unix_day, uint16_t* year, uint8_t* month,
+                                   uint8_t* day) {
+    int32_t z = unix_day + 719468;
+    int32_t era = (z >= 0 ? z : z - 146096) / 146097;
+    uint32_t doe = z - era * 146097;
+    uint32_t yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    uint32_t doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    uint32_t mp = (5 * doy + 2) / 153;
+    *day = doy - (153 * mp + 2) / 5 + 1;
+    *month = mp < 10 ? mp + 3 : mp - 9;
+    *year = yoe + era * 400 + (*month <= 2);
+}
+
+}  // namespace Wetzel
@@ -0,0 +1,290 @@
+#include "report_rollup_writer.h"
+
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "debug.h"
+#include "report_handler.h"
+#include "report_reader.h"
+
+static const char* TAG = __FILE__;
+
+namespace Wetzel {
+
+#define SECONDS_PER_HOUR 3600
+#define SECONDS_PER_DAY 86400
+
+esp_err_t ReportRollupWriter::begin(CartaoSD* card, uint32_t unix_seconds) {
+    if (card == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    _card = card;
+    _clear();
+    _hour_start = unix_seconds - unix_seconds % SECONDS_PER_HOUR;
+
+    // equipamento desligado na virada do dia: o dia anterior nao foi fechado
+    uint16_t today = unix_seconds / SECONDS_PER_DAY;
+    if (today > 0 && _close_day(today - 1) != ESP_OK) {
+        MY_LOGW("Rollup do dia %u nao fechado", today - 1);
+    }
+    _clear();
+    return ESP_OK;
+}
+
+void ReportRollupWriter::add(uint8_t id, uint8_t pwm_value, uint32_t seconds) {
+    _sums.covered_seconds[id] += seconds;
+    if (pwm_value > 0) {
+        _sums.on_seconds[id] += seconds;
+    }
+    _sums.pwm_seconds[id] += pwm_value * seconds;
+    if (_sums.samples[id] < UINT16_MAX) {
+        _sums.samples[id]++;
+    }
+    _sums.active[id / 32] |= 1UL << (id % 32);
+}
+
+bool ReportRollupWriter::hourDue(uint32_t unix_seconds) const {
+    return unix_seconds - unix_seconds % SECONDS_PER_HOUR != _hour_start;
+}
+
+esp_err_t ReportRollupWriter::closeHour(uint32_t unix_seconds) {
+    char name[20];
+    uint16_t day = _hour_start / SECONDS_PER_DAY;
+    esp_err_t err = ESP_OK;
+
+    ReportHandler::createRollupFileName(name, REPORT_ROLLUP_HOUR, day);
+    err = _append_rows(name, REPORT_ROLLUP_HOUR, _hour_start);
+    if (err != ESP_OK) {
+        MY_LOGE("Falha ao gravar o rollup da hora %u em %s", _hour_start, name);
+    }
+    _clear();
+
+    if (unix_seconds / SECONDS_PER_DAY != day) {
+        esp_err_t day_err = _close_day(day);
+        if (day_err != ESP_OK) {
+            MY_LOGE("Falha ao fechar o rollup do dia %u", day);
+            err = day_err;
+        }
+        _clear();
+    }
+    _hour_start = unix_seconds - unix_seconds % SECONDS_PER_HOUR;
+    return err;
+}
+
+void ReportRollupWriter::_clear() {
+    memset(&_sums, 0, sizeof(_sums));
+}
+
+void ReportRollupWriter::_sum_row(const report_rollup_row_t& row) {
+    uint8_t id = row.id;
+    uint32_t samples = _sums.samples[id] + row.samples;
+
+    _sums.covered_seconds[id] += row.covered_seconds;
+    _sums.on_seconds[id] += row.on_seconds;
+    _sums.pwm_seconds[id] += row.pwm_seconds;
+    _sums.samples[id] = samples > UINT16_MAX ? UINT16_MAX : samples;
+    _sums.active[id / 32] |= 1UL << (id % 32);
+}
+
+/**
+ * @brief Soma as linhas validas do arquivo com periodo em [from, to).
+ *
+ * @return esp_err_t ESP_ERR_NOT_FOUND se o arquivo nao existir
+ */
+esp_err_t ReportRollupWriter::_sum_file(const char* name, uint32_t from, uint32_t to) {
+    char path[25];
+    struct stat st;
+    report_rollup_row_t row;
+
+    snprintf(path, sizeof(path), MOUNT_POINT "%s", name);
+    if (stat(path, &st) != 0) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    FILE* f = _card->openFile(name, ROLLUP_FILE);
+    if (f == NULL) {
+        return ESP_FAIL;
+    }
+    size_t rows;
+    while ((rows = fread(_rows, REPORT_ROLLUP_ROW_SIZE, REPORT_ROLLUP_IO_ROWS, f)) > 0) {
+        for (size_t i = 0; i < rows; i++) {
+            if (!report_rollup_row_decode(_rows + i * REPORT_ROLLUP_ROW_SIZE, &row)) {
+                MY_LOGW("Linha invalida em %s", name);
+                continue;
+            }
+            if (row.period_start >= from && row.period_start < to) {
+                _sum_row(row);
+            }
+        }
+    }
+    _card->closeFile(ROLLUP_FILE);
+    return ESP_OK;
+}
+
+/**
+ * @brief Acrescenta uma linha por dispositivo ativo em _sums. Uma linha
+ * incompleta no fim do arquivo (queda de energia) e sobrescrita.
+ *
+ */
+esp_err_t ReportRollupWriter::_append_rows(const char* name, report_rollup_tier_t tier,
+                                           uint32_t period_start) {
+    bool any = false;
+    for (uint16_t word = 0; word < REPORT_ROLLUP_BITMAP_WORDS; word++) {
+        any = any || _sums.active[word] != 0;
+    }
+    if (!any) {
+        return ESP_OK;
+    }
+
+    FILE* f = _card->openFile(name, ROLLUP_FILE);
+    if (f == NULL) {
+        return ESP_FAIL;
+    }
+    long size = -1;
+    if (fseek(f, 0, SEEK_END) == 0) {
+        size = ftell(f);
+    }
+    if (size < 0 || fseek(f, size - size % REPORT_ROLLUP_ROW_SIZE, SEEK_SET) != 0) {
+        _card->closeFile(ROLLUP_FILE);
+        return ESP_FAIL;
+    }
+
+    esp_err_t err = ESP_OK;
+    size_t rows = 0;
+    for (uint16_t word = 0; word < REPORT_ROLLUP_BITMAP_WORDS && err == ESP_OK; word++) {
+        uint32_t pending = _sums.active[word];
+        while (pending) {
+            uint8_t id = word * 32 + __builtin_ctz(pending);
+            pending &= pending - 1;
+
+            report_rollup_row_t row = {
+                .period_start = period_start,
+                .id = id,
+                .tier = (uint8_t)tier,
+                .samples = _sums.samples[id],
+                .covered_seconds = _sums.covered_seconds[id],
+                .on_seconds = _sums.on_seconds[id],
+                .pwm_seconds = _sums.pwm_seconds[id],
+            };
+            report_rollup_row_encode(_rows + rows * REPORT_ROLLUP_ROW_SIZE, row);
+            if (++rows == REPORT_ROLLUP_IO_ROWS) {
+                if (fwrite(_rows, REPORT_ROLLUP_ROW_SIZE, rows, f) != rows) {
+                    err = ESP_FAIL;
+                    break;
+                }
+                rows = 0;
+            }
+        }
+    }
+    if (err == ESP_OK && rows > 0 && fwrite(_rows, REPORT_ROLLUP_ROW_SIZE, rows, f) != rows) {
+        err = ESP_FAIL;
+    }
+    if (err == ESP_OK && (fflush(f) != 0 || fsync(fileno(f)) != 0)) {
+        err = ESP_FAIL;
+    }
+    _card->closeFile(ROLLUP_FILE);
+    return err;
+}
+
+/**
+ * @brief Periodo da ultima linha valida do arquivo.
+ *
+ * @return int64_t -1 se o arquivo nao existir ou nao tiver linha valida
+ */
+int64_t ReportRollupWriter::_last_period(const char* name) {
+    char path[25];
+    struct stat st;
+    report_rollup_row_t row;
+
+    snprintf(path, sizeof(path), MOUNT_POINT "%s", name);
+    if (stat(path, &st) != 0 || st.st_size < REPORT_ROLLUP_ROW_SIZE) {
+        return -1;
+    }
+    FILE* f = _card->openFile(name, ROLLUP_FILE);
+    if (f == NULL) {
+        return -1;
+    }
+    int64_t period = -1;
+    long rows = st.st_size / REPORT_ROLLUP_ROW_SIZE;
+    // uma linha rasgada no fim nao esconde as anteriores
+    for (long i = rows - 1; i >= 0 && i >= rows - REPORT_ROLLUP_IO_ROWS; i--) {
+        if (fseek(f, i * REPORT_ROLLUP_ROW_SIZE, SEEK_SET) != 0 ||
+            fread(_rows, 1, REPORT_ROLLUP_ROW_SIZE, f) != REPORT_ROLLUP_ROW_SIZE) {
+            break;
+        }
+        if (report_rollup_row_decode(_rows, &row)) {
+            period = row.period_start;
+            break;
+        }
+    }
+    _card->closeFile(ROLLUP_FILE);
+    return period;
+}
+
+/**
+ * @brief Linhas do dia a partir do arquivo de horas; no ultimo dia do mes,
+ * fecha tambem o mes.
+ *
+ */
+esp_err_t ReportRollupWriter::_close_day(uint16_t unix_day) {
+    char day_name[20];
+    char hour_name[20];
+    uint32_t day_start = (uint32_t)unix_day * SECONDS_PER_DAY;
+    esp_err_t err = ESP_OK;
+
+    ReportHandler::createRollupFileName(day_name, REPORT_ROLLUP_DAY, unix_day);
+    if (_last_period(day_name) < (int64_t)day_start) {
+        ReportHandler::createRollupFileName(hour_name, REPORT_ROLLUP_HOUR, unix_day);
+        _clear();
+        err = _sum_file(hour_name, day_start, day_start + SECONDS_PER_DAY);
+        if (err == ESP_OK) {
+            err = _append_rows(day_name, REPORT_ROLLUP_DAY, day_start);
+            MY_LOGI("Rollup do dia %u gravado em %s", unix_day, day_name);
+        } else if (err == ESP_ERR_NOT_FOUND) {
+            err = ESP_OK;
+        }
+    }
+
+    uint16_t year;
+    uint8_t month, day;
+    ReportReader::dateFromUnixDay(unix_day + 1, &year, &month, &day);
+    if (day == 1) {
+        esp_err_t month_err = _close_month(unix_day);
+        if (err == ESP_OK) {
+            err = month_err;
+        }
+    }
+    return err;
+}
+
+/**
+ * @brief Linhas do mes que termina em unix_day, a partir do arquivo de dias.
+ *
+ */
+esp_err_t ReportRollupWriter::_close_month(uint16_t unix_day) {
+    char month_name[20];
+    char day_name[20];
+    uint16_t year;
+    uint8_t month, day;
+
+    ReportReader::dateFromUnixDay(unix_day, &year, &month, &day);
+    uint32_t month_start = (uint32_t)ReportReader::unixDayFromDate(year, month, 1) * SECONDS_PER_DAY;
+
+    ReportHandler::createRollupFileName(month_name, REPORT_ROLLUP_MONTH, unix_day);
+    if (_last_period(month_name) >= (int64_t)month_start) {
+        return ESP_OK;
+    }
+    ReportHandler::createRollupFileName(day_name, REPORT_ROLLUP_DAY, unix_day);
+    _clear();
+    esp_err_t err = _sum_file(day_name, month_start, (uint32_t)(unix_day + 1) * SECONDS_PER_DAY);
+    if (err == ESP_ERR_NOT_FOUND) {
+        return ESP_OK;
+    }
+    if (err != ESP_OK) {
+        return err;
+    }
+    MY_LOGI("Rollup do mes %02u/%u gravado em %s", month, year, month_name);
+    return _append_rows(month_name, REPORT_ROLLUP_MONTH, month_start);
+}
+
+}  // namespace Wetzel
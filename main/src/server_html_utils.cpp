@@ -1,41 +1,34 @@
 #include "server_html_utils.h"
 
-#include <string.h>
-#include <stdio.h>
+#include <stdint.h>
 
-namespace Wetzel {
+#include "hex_codec.h"
 
-void convert_html_text_to_ascii(char* string) {
-    convert_html_symbol(string, "\%2C", ',');
-    convert_html_symbol(string, "\%3B", ';');
-    convert_html_symbol(string, "\%20", ';');
-    convert_html_symbol(string, "\%7B", '{');
-    convert_html_symbol(string, "\%22", '\"');
-    convert_html_symbol(string, "\%3A", ':');
-    convert_html_symbol(string, "\%7D", '}');
-    convert_html_spaces(string);
-}
+namespace Wetzel {
 
-void convert_html_symbol(char* string, const char* code, char caracter) {
-    char* code_pos = strstr(string, code);
-    if (code_pos == NULL) {
-        return;
-    }
-    int pos = code_pos - string;
-    string[pos] = caracter;
-    for (int i = pos + 3; i < strlen(string) + 1; i++) {
-        string[i - 2] = string[i];
-    }
-    convert_html_symbol(string, code, caracter);
-}
+size_t convert_html_text_to_ascii(char* string) {
+    const char* read = string;
+    char* write = string;
 
-void convert_html_spaces(char* string) {
-    const int char_to_replace = '+';
-    char* current_pos = strchr(string, char_to_replace);
-    while (current_pos) {
-        *current_pos = ' ';
-        current_pos = strchr(current_pos, char_to_replace);
+    // a escrita nunca passa a leitura, entao o buffer pode ser o mesmo
+    while (*read) {
+        if (*read == '+') {
+            *write++ = ' ';
+            read++;
+            continue;
+        }
+        if (*read == '%') {
+            uint8_t high = hex_nibble(read[1]);
+            uint8_t low = high == HEX_INVALID ? HEX_INVALID : hex_nibble(read[2]);
+            if (low != HEX_INVALID) {
+                *write++ = (char)((high << 4) | low);
+                read += 3;
+                continue;
+            }
+        }
+        *write++ = *read++;
     }
-    return;
+    *write = '\0';
+    return write - string;
 }
-}  // namespace Wetzel
\ No newline at end of file
+}  // namespace Wetzel
@@ -14,24 +14,10 @@
 static const char* TAG = __FILE__;
 
 namespace Wetzel {
-esp_err_t msg_handler_wifi_mode_change(char* msg) {
-
-    char* next_char;
-    char* token = strtok_r(msg, ",", &next_char);
-    wifi_mode_t new_mode = *token == '1'   ? WIFI_MODE_APSTA
-                           : *token == '0' ? WIFI_MODE_AP
-                                           : WIFI_MODE_NULL;
-    if (new_mode == WIFI_MODE_NULL) {
-        MY_LOGE("New WiFi mode invalid");
-        return ESP_FAIL;
-    }
-    MY_LOGD("WIFI_MODE %c", *token);
-
-    //Esperado final da mensagem
-    if (*(strtok_r(NULL, ",", &next_char)) != ';') {
-        MY_LOGE("Mensagem com argumentos a mais");
-        return ESP_FAIL;
-    }
+esp_err_t msg_handler_wifi_mode_change(const msg_arg_t* args, char* response,
+                                       size_t response_size) {
+    wifi_mode_t new_mode = args[0].ptr[0] == '1' ? WIFI_MODE_APSTA : WIFI_MODE_AP;
+    MY_LOGD("WIFI_MODE %c", args[0].ptr[0]);
 
     WiFi* wifi = WiFi::getInstance();
     esp_err_t err = wifi->restart(new_mode);
@@ -39,21 +25,24 @@ esp_err_t msg_handler_wifi_mode_change(char* msg) {
     return err;
 }
 
-esp_err_t msg_handler_wifi_ap_config_change(char* msg) {
-    char* next_char;
-    char* new_ssid = strtok_r(msg, ",", &next_char);
-    char* new_password = strtok_r(NULL, ",", &next_char);
-    if (*(strtok_r(NULL, ",", &next_char)) != ';') {
-        MY_LOGE("Mensagem com argumentos a mais");
-        return ESP_FAIL;
-    }
+/**
+ * args[0] -> ssid
+ * args[1] -> password
+ */
+esp_err_t msg_handler_wifi_ap_config_change(const msg_arg_t* args, char* response,
+                                            size_t response_size) {
     MY_LOGD("ESTOU CONFIGURANDO AP");
     WiFi* wifi = WiFi::getInstance();
     wifi_config_t new_config = wifi->ap_configuration();
 
-    strcpy((char*)new_config.ap.ssid, new_ssid);
-    strcpy((char*)new_config.ap.password, new_password);
-    new_config.ap.ssid_len = strlen(new_ssid);
+    if (args[0].len >= sizeof(new_config.ap.ssid) ||
+        args[1].len >= sizeof(new_config.ap.password)) {
+        MY_LOGE("SSID ou senha grandes demais");
+        return ESP_ERR_INVALID_ARG;
+    }
+    strlcpy((char*)new_config.ap.ssid, args[0].ptr, sizeof(new_config.ap.ssid));
+    strlcpy((char*)new_config.ap.password, args[1].ptr, sizeof(new_config.ap.password));
+    new_config.ap.ssid_len = args[0].len;
 
     wifi->ap_configuration(new_config);
     MY_LOGD("ap comfigurated");
@@ -64,49 +53,32 @@ esp_err_t msg_handler_wifi_ap_config_change(char* msg) {
 }
 
 /**
- * msg_component[0] -> ssid
- * msg_component[1] -> password
- * msg_component[2] -> ip
- * msg_component[3] -> submask
- * msg_component[4] -> gateway
- * msg_component[5] -> dns primario
- * msg_component[6] -> dns secundario
+ * args[0] -> ssid
+ * args[1] -> password
+ * args[2] -> ip
+ * args[3] -> submask
+ * args[4] -> gateway
+ * args[5] -> dns primario
+ * args[6] -> dns secundario
  */
-esp_err_t msg_handler_wifi_sta_config_change(char* msg) {
-    char* next_char;
+esp_err_t msg_handler_wifi_sta_config_change(const msg_arg_t* args, char* response,
+                                             size_t response_size) {
     esp_err_t err;
-    char* msg_components[7];
-    msg_components[0] = strtok_r(msg, ",", &next_char);
-
-    if (msg_components[0] == NULL) {
-        MY_LOGE("Mensagem sem argumentos");
-    }
-    for (int i = 1; i < 7; i++) {
-
-        msg_components[i] = strtok_r(NULL, ",", &next_char);
-        if (msg_components[i][0] == '#') {
-            msg_components[i][0] = '\0';
-        } else if (msg_components[i][0] == ';') {
-            MY_LOGE("Argumentos insuficientes");
-            return ESP_FAIL;
-        }
-        MY_LOGD("ITERACAO %d    MENSAGEM: %s", i, msg_components[i]);
-    }
-    if (*(strtok_r(NULL, ",", &next_char)) != ';') {
-        MY_LOGE("Argumentos a mais");
-        return ESP_FAIL;
-    }
 
     WiFi* wifi = WiFi::getInstance();
     wifi_config_t new_config = wifi->sta_configuration();
 
-    strcpy((char*)new_config.sta.ssid, msg_components[0]);
-    strcpy((char*)new_config.sta.password, msg_components[1]);
+    if (args[0].len >= sizeof(new_config.sta.ssid) ||
+        args[1].len >= sizeof(new_config.sta.password)) {
+        MY_LOGE("SSID ou senha grandes demais");
+        return ESP_ERR_INVALID_ARG;
+    }
+    strlcpy((char*)new_config.sta.ssid, args[0].ptr, sizeof(new_config.sta.ssid));
+    strlcpy((char*)new_config.sta.password, args[1].ptr, sizeof(new_config.sta.password));
 
     wifi->sta_configuration(new_config);
 
-    err = wifi->sta_ip_configuration(msg_components[2], msg_components[3],
-                                     msg_components[4]);
+    err = wifi->sta_ip_configuration(args[2].ptr, args[3].ptr, args[4].ptr);
     if (err != ESP_OK) {
         MY_LOGW("Falha na configuração do sta | abortada configuração");
     }
@@ -118,11 +90,13 @@ esp_err_t msg_handler_wifi_sta_config_change(char* msg) {
 
 // TODO Criar método para retornar redes disponiveis e intensidade de seus sinais
 // para realizar conexão STA com servidor
-esp_err_t msg_handler_get_ssid_list(char* msg) {
+esp_err_t msg_handler_get_ssid_list(const msg_arg_t* args, char* response,
+                                    size_t response_size) {
     return ESP_OK;
 }
 
-esp_err_t msg_handler_interface_info_requested(char* response) {
+esp_err_t msg_handler_interface_info_requested(const msg_arg_t* args, char* response,
+                                               size_t response_size) {
 
     WiFi* wifi = WiFi::getInstance();
     wifi_ap_config_t ap_config = wifi->ap_configuration().ap;
@@ -144,21 +118,17 @@ esp_err_t msg_handler_interface_info_requested(char* response) {
         ipv4_uint8_array_to_str(ip_info.secondary_dns, secondary_dns_str));
 
     // Max char lenght = 204;
-    snprintf(response, 1500, "%d,%s,%s,%s,%s,%s,%s,%s,", wifi->current_mode(),
+    snprintf(response, response_size, "%d,%s,%s,%s,%s,%s,%s,%s,", wifi->current_mode(),
              ap_config.ssid, sta_config.ssid, ip_str, mask_str, gateway_str,
              primary_dns_str, secondary_dns_str);
 
     return ESP_OK;
 }
 
-esp_err_t msg_handler_validate_ap_credentials(char* msg) {
-    char* next_char;
-    char* ssid = strtok_r(msg, ",", &next_char);
-    char* password = strtok_r(NULL, ",", &next_char);
-    if (*(strtok_r(NULL, ",", &next_char)) != ';') {
-        MY_LOGE("Argumentos a mais");
-        return ESP_FAIL;
-    }
+esp_err_t msg_handler_validate_ap_credentials(const msg_arg_t* args, char* response,
+                                              size_t response_size) {
+    const char* ssid = args[0].ptr;
+    const char* password = args[1].ptr;
     WiFi* wifi = WiFi::getInstance();
     if (strcmp(ssid, (char*)wifi->ap_configuration().ap.ssid) != 0) {
         MY_LOGI("SSID incorreto");
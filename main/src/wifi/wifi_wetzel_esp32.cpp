@@ -385,7 +385,7 @@ esp_err_t WiFi::sta_ip_configuration(esp_netif_ip_info_t& ip_info) {
     return ESP_OK;
 }
 
-esp_err_t WiFi::sta_ip_configuration(char* ip, char* mask, char* gateway) {
+esp_err_t WiFi::sta_ip_configuration(const char* ip, const char* mask, const char* gateway) {
     esp_netif_ip_info_t ip_info;
     esp_err_t err;
     char ip_copy[IPV4_MAX_SIZE], mask_copy[IPV4_MAX_SIZE],
@@ -0,0 +1,45 @@
+/**
+ * Decodificacao de um parametro de query de 990 bytes (330 x "%2C", o pior
+ * caso do decodificador antigo) e de um JSON tipico de comando.
+ */
+
+#include <string.h>
+
+#include "host_test.h"
+#include "legacy_html_decode.h"
+#include "server_html_utils.h"
+
+using namespace Wetzel;
+
+#define PARAM_SIZE 1000
+
+template <typename F>
+static double time_per_call_us(const char* input, int rounds, F decode) {
+    char buffer[PARAM_SIZE + 1];
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < rounds; i++) {
+        strcpy(buffer, input);
+        decode(buffer);
+    }
+    double elapsed = host_elapsed_us(start) / rounds;
+    CHECK(buffer[0] != '%');
+    return elapsed;
+}
+
+static void run(const char* name, const char* input, int legacy_rounds) {
+    double legacy = time_per_call_us(input, legacy_rounds,
+                                     [](char* s) { Legacy::convert_html_text_to_ascii(s); });
+    double current = time_per_call_us(input, 20000, [](char* s) { convert_html_text_to_ascii(s); });
+    printf("%-8s %4u B  antigo %10.2f us  novo %6.2f us\n", name, (unsigned)strlen(input), legacy,
+           current);
+}
+
+int main() {
+    char worst[PARAM_SIZE + 1] = "";
+    for (int i = 0; i < 330; i++) {
+        strcat(worst, "%2C");
+    }
+    run("virgulas", worst, 50);
+    run("json", "%7B%22id%22%3A12%2C%22pwm%22%3A80%2C%22nome%22%3A%22Sala+2%22%7D", 20000);
+    return HOST_TEST_RESULT();
+}
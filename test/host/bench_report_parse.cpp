@@ -0,0 +1,55 @@
+/**
+ * Decodificacao de frames de report "MACMACMACMAC,pwm": sscanf antigo contra
+ * ReportHandler::parse_report_msg (hex_decode por tabela).
+ */
+
+#include <stdlib.h>
+
+#include "host_test.h"
+#include "legacy_report_parse.h"
+
+using namespace Wetzel;
+
+#define FRAMES 4096
+#define ROUNDS 100
+
+static char frames[FRAMES][32];
+static size_t lengths[FRAMES];
+static volatile uint32_t sink;
+
+template <typename F>
+static double ns_per_frame(F parse) {
+    report_msg_entry_t entry;
+    uint32_t sum = 0;
+    int failures = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int round = 0; round < ROUNDS; round++) {
+        for (int i = 0; i < FRAMES; i++) {
+            failures += parse(i, &entry) != ESP_OK;
+            sum += entry.pwm_value + entry.mac[5];
+        }
+    }
+    double elapsed = host_elapsed_us(start) * 1000 / ((double)FRAMES * ROUNDS);
+    sink = sum;
+    CHECK_EQ(failures, 0);
+    return elapsed;
+}
+
+int main() {
+    srand(17);
+    for (int i = 0; i < FRAMES; i++) {
+        lengths[i] = snprintf(frames[i], sizeof(frames[i]), "%02X%02x%02X%02x%02X%02x,%u",
+                              rand() & 0xFF, rand() & 0xFF, rand() & 0xFF, rand() & 0xFF,
+                              rand() & 0xFF, rand() & 0xFF, (unsigned)(rand() % 256));
+    }
+
+    double legacy = ns_per_frame([](int i, report_msg_entry_t* entry) {
+        return Legacy::parse_report_msg(frames[i], entry);
+    });
+    double current = ns_per_frame([](int i, report_msg_entry_t* entry) {
+        return ReportHandler::parse_report_msg(frames[i], lengths[i], entry);
+    });
+    printf("%d frames x %d: sscanf %.1f ns/frame, hex_decode %.1f ns/frame\n", FRAMES, ROUNDS,
+           legacy, current);
+    return HOST_TEST_RESULT();
+}
@@ -0,0 +1,90 @@
+/**
+ * Download de REPORT_DOWNLOAD_MAX_DAYS dias de relatorio pelo ReportReader
+ * (leitura do proximo bloco em paralelo ao envio), comparado com ler e enviar
+ * em sequencia com um buffer so. O envio e simulado por um tempo fixo por
+ * bloco; no host a leitura do "cartao" vem do cache do sistema, entao o
+ * numero mede o custo da troca entre as tasks, nao o ganho com o SD real.
+ */
+
+#include <stdlib.h>
+
+#include <thread>
+
+#include "fake_sd_card.h"
+#include "host_test.h"
+#include "report_days.h"
+
+using namespace Wetzel;
+
+#define FIRST_DAY 20000
+#define DAY_FILE_SIZE (48 * 1024)
+#define BUFFER_SIZE ASYNC_HTTP_PACKET_BUFFER_SIZE
+
+static char buffer_a[BUFFER_SIZE];
+static char buffer_b[BUFFER_SIZE];
+static volatile uint32_t sink;
+
+static void send_block(const char* data, size_t len, std::chrono::microseconds send_time) {
+    sink += data[0] + data[len - 1];
+    if (send_time.count() > 0) {
+        std::this_thread::sleep_for(send_time);
+    }
+}
+
+static uint32_t download_reader(std::chrono::microseconds send_time) {
+    const char* data;
+    int32_t len;
+    uint32_t total = 0;
+    CHECK_EQ(ReportReader::open(FIRST_DAY, FIRST_DAY + REPORT_DOWNLOAD_MAX_DAYS - 1, buffer_a,
+                                buffer_b, BUFFER_SIZE),
+             ESP_OK);
+    while ((len = ReportReader::read(&data)) > 0) {
+        send_block(data, len, send_time);
+        total += len;
+    }
+    ReportReader::close();
+    return total;
+}
+
+static uint32_t download_sequential(std::chrono::microseconds send_time) {
+    uint32_t total = 0;
+    for (int32_t day = FIRST_DAY; day < FIRST_DAY + REPORT_DOWNLOAD_MAX_DAYS; day++) {
+        FILE* f = fopen(report_day_path(day).c_str(), "rb");
+        size_t len;
+        while ((len = fread(buffer_a, 1, BUFFER_SIZE, f)) > 0) {
+            send_block(buffer_a, len, send_time);
+            total += len;
+        }
+        fclose(f);
+    }
+    return total;
+}
+
+static void run(const char* name, uint32_t (*download)(std::chrono::microseconds),
+                std::chrono::microseconds send_time) {
+    auto start = std::chrono::steady_clock::now();
+    uint32_t total = download(send_time);
+    double elapsed_us = host_elapsed_us(start);
+    CHECK_EQ(total, (uint32_t)REPORT_DOWNLOAD_MAX_DAYS * DAY_FILE_SIZE);
+    printf("%-12s envio %4ld us/bloco  %8.1f ms  %7.2f MB/s\n", name, (long)send_time.count(),
+           elapsed_us / 1000, total / elapsed_us);
+}
+
+int main() {
+    CHECK(fake_sd_card_format());
+    CHECK_EQ(CartaoSD::getInstance()->begin(23, 19, 18, 5), ESP_OK);
+    CHECK_EQ(ReportReader::getInstance()->begin(), ESP_OK);
+    for (int32_t day = FIRST_DAY; day < FIRST_DAY + REPORT_DOWNLOAD_MAX_DAYS; day++) {
+        CHECK(report_day_write(day, report_random_bytes(DAY_FILE_SIZE)));
+    }
+
+    printf("%d dias de %d KB, blocos de ate %d B\n", REPORT_DOWNLOAD_MAX_DAYS, DAY_FILE_SIZE / 1024,
+           BUFFER_SIZE);
+    const std::chrono::microseconds send_times[] = {std::chrono::microseconds(0),
+                                                    std::chrono::microseconds(500)};
+    for (std::chrono::microseconds send_time : send_times) {
+        run("sequencial", download_sequential, send_time);
+        run("ReportReader", download_reader, send_time);
+    }
+    return HOST_TEST_RESULT();
+}
@@ -0,0 +1,205 @@
+/**
+ * Amostragem dos reports do minuto: estado em std::unordered_map por id (como
+ * era) contra arrays por id com bitmaps known/changed (report_sampling_state_t).
+ * Cada ciclo recebe 4 reports por dispositivo e termina com o flush dos ids
+ * que mudaram. Os dois lados usam o calculate_average_pwm do firmware; o
+ * passo de amostragem e uma copia de ReportHandler::_sample_report_entry
+ * (privado), parametrizada no estado para rodar tambem com 4096 ids, alem dos
+ * REPORT_MAX_DEVICES do firmware.
+ */
+
+#include <string.h>
+
+#include <unordered_map>
+#include <vector>
+
+#include "host_test.h"
+#include "report_handler.h"
+
+using namespace Wetzel;
+
+#define CYCLES 200
+#define REPORTS_PER_CYCLE 4
+
+typedef struct {
+    uint16_t id;
+    uint8_t pwm_value;
+    uint32_t unix_seconds;
+} sample_t;
+
+// report_sampling_state_t com N ids
+template <int N>
+struct wide_sampling_state_t {
+    uint8_t last_average_pwm[N];
+    uint8_t average_pwm[N];
+    uint8_t pwm_i[N];
+    uint8_t pwm_i_1[N];
+    uint32_t t_i[N];
+    uint32_t t_i_1[N];
+    uint32_t t_0[N];
+    uint8_t n_lum[N];
+    luminaria_type_t lum_type[N];
+    uint32_t known[(N + 31) / 32];
+    uint32_t changed[(N + 31) / 32];
+};
+
+typedef struct {
+    uint8_t last_average_pwm;
+    uint8_t average_pwm;
+    uint8_t pwm_i;
+    uint8_t pwm_i_1;
+    uint32_t t_i;
+    uint32_t t_i_1;
+    uint32_t t_0;
+    uint8_t n_lum;
+    luminaria_type_t lum_type;
+    bool is_new_param;
+} map_sampling_param_t;
+
+static volatile uint64_t sink;
+
+static uint64_t run_map(const std::vector<sample_t>& samples) {
+    std::unordered_map<uint16_t, map_sampling_param_t> entries;
+    uint64_t written = 0;
+
+    for (int cycle = 0; cycle < CYCLES; cycle++) {
+        for (size_t n = cycle * samples.size() / CYCLES; n < (cycle + 1) * samples.size() / CYCLES;
+             n++) {
+            const sample_t& sample = samples[n];
+            auto iterator = entries.find(sample.id);
+            if (iterator == entries.end()) {
+                map_sampling_param_t param = {
+                    sample.pwm_value, sample.pwm_value, sample.pwm_value, sample.pwm_value,
+                    sample.unix_seconds, sample.unix_seconds, sample.unix_seconds, 1, LUM_17K,
+                    true};
+                entries[sample.id] = param;
+                continue;
+            }
+            map_sampling_param_t* param = &iterator->second;
+            if (!param->is_new_param) {
+                param->t_0 = param->t_i;
+                param->last_average_pwm = param->pwm_i;
+            } else {
+                param->last_average_pwm = param->average_pwm;
+            }
+            param->pwm_i_1 = param->pwm_i;
+            param->t_i_1 = param->t_i;
+            param->pwm_i = sample.pwm_value;
+            param->t_i = sample.unix_seconds;
+            param->is_new_param = true;
+            param->average_pwm = calculate_average_pwm(param->last_average_pwm, param->pwm_i,
+                                                       param->pwm_i_1, param->t_0, param->t_i,
+                                                       param->t_i_1);
+        }
+        for (auto& entry : entries) {
+            if (entry.second.is_new_param) {
+                written += entry.first + entry.second.average_pwm + entry.second.t_0;
+                entry.second.is_new_param = false;
+            }
+        }
+    }
+    return written;
+}
+
+template <typename S>
+static uint64_t run_arrays(S& s, uint16_t devices, const std::vector<sample_t>& samples) {
+    const uint16_t words = (devices + 31) / 32;
+    uint64_t written = 0;
+
+    memset(&s, 0, sizeof(s));
+    for (int cycle = 0; cycle < CYCLES; cycle++) {
+        for (size_t n = cycle * samples.size() / CYCLES; n < (cycle + 1) * samples.size() / CYCLES;
+             n++) {
+            const sample_t& sample = samples[n];
+            const uint16_t id = sample.id;
+            const uint32_t bit = 1UL << (id % 32);
+            uint32_t& known = s.known[id / 32];
+            uint32_t& changed = s.changed[id / 32];
+
+            if (!(known & bit)) {
+                s.last_average_pwm[id] = sample.pwm_value;
+                s.average_pwm[id] = sample.pwm_value;
+                s.pwm_i[id] = sample.pwm_value;
+                s.pwm_i_1[id] = sample.pwm_value;
+                s.t_i[id] = sample.unix_seconds;
+                s.t_i_1[id] = sample.unix_seconds;
+                s.t_0[id] = sample.unix_seconds;
+                s.n_lum[id] = 1;
+                s.lum_type[id] = LUM_17K;
+                known |= bit;
+                changed |= bit;
+                continue;
+            }
+            if (!(changed & bit)) {
+                s.t_0[id] = s.t_i[id];
+                s.last_average_pwm[id] = s.pwm_i[id];
+            } else {
+                s.last_average_pwm[id] = s.average_pwm[id];
+            }
+            s.pwm_i_1[id] = s.pwm_i[id];
+            s.t_i_1[id] = s.t_i[id];
+            s.pwm_i[id] = sample.pwm_value;
+            s.t_i[id] = sample.unix_seconds;
+            changed |= bit;
+            s.average_pwm[id] = calculate_average_pwm(s.last_average_pwm[id], s.pwm_i[id],
+                                                      s.pwm_i_1[id], s.t_0[id], s.t_i[id],
+                                                      s.t_i_1[id]);
+        }
+        for (uint16_t word = 0; word < words; word++) {
+            uint32_t bits = s.changed[word];
+            s.changed[word] = 0;
+            while (bits) {
+                uint16_t id = word * 32 + __builtin_ctz(bits);
+                bits &= bits - 1;
+                written += id + s.average_pwm[id] + s.t_0[id];
+            }
+        }
+    }
+    return written;
+}
+
+static std::vector<sample_t> make_samples(uint16_t devices) {
+    std::vector<sample_t> samples;
+    uint32_t now = 1700000000;
+    for (int cycle = 0; cycle < CYCLES; cycle++) {
+        for (int report = 0; report < REPORTS_PER_CYCLE; report++) {
+            for (uint32_t i = 0; i < devices; i++) {
+                // ordem de chegada espalhada pelos ids
+                sample_t sample = {(uint16_t)((i * 7919 + report) % devices),
+                                   (uint8_t)((i + cycle * 3 + report) % 256), ++now};
+                samples.push_back(sample);
+            }
+        }
+    }
+    return samples;
+}
+
+template <typename S>
+static void run(const char* state_name, S& state, uint16_t devices) {
+    std::vector<sample_t> samples = make_samples(devices);
+
+    auto start = std::chrono::steady_clock::now();
+    uint64_t map_written = run_map(samples);
+    double map_ns = host_elapsed_us(start) * 1000 / samples.size();
+
+    start = std::chrono::steady_clock::now();
+    uint64_t arrays_written = run_arrays(state, devices, samples);
+    double arrays_ns = host_elapsed_us(start) * 1000 / samples.size();
+
+    // os dois gravam os mesmos registros
+    CHECK_EQ(map_written, arrays_written);
+    sink = map_written + arrays_written;
+    printf("%4u ids: unordered_map %5.1f ns/report, %s %5.1f ns/report\n", devices, map_ns,
+           state_name, arrays_ns);
+}
+
+static report_sampling_state_t firmware_state;
+static wide_sampling_state_t<4096> wide_state;
+
+int main() {
+    for (int round = 0; round < 2; round++) {
+        run("report_sampling_state_t", firmware_state, REPORT_MAX_DEVICES);
+        run("arrays de 4096 ids      ", wide_state, 4096);
+    }
+    return HOST_TEST_RESULT();
+}
@@ -0,0 +1,182 @@
+/**
+ * Recepcao de frames do sensor: UartLink (evento por ';') contra o laco antigo
+ * da uart_rx_task, que consultava Serial2.available() a cada 5 ms e lia ate o
+ * ';'. O sensor falso escreve no ritmo de UART_BAUD_RATE.
+ *
+ * Mede frames/s com frames seguidos, a latencia entre o ';' chegar e o frame
+ * ser entregue, e quantas vezes a task acordou (inclusive sem trafego). No
+ * caminho por evento cada evento da fila do driver e um wakeup; a UART falsa
+ * gera um UART_DATA a cada 16 bytes, mais do que o driver real.
+ */
+
+#include <math.h>
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "configuration.h"
+#include "fake_uart.h"
+#include "freertos/task.h"
+#include "host_test.h"
+#include "uart_link.h"
+
+using namespace Wetzel;
+using clock_type = std::chrono::steady_clock;
+
+// periodo do laco de polling substituido (UART_RX_POLL_PERIOD_MS)
+#define LEGACY_POLL_PERIOD_MS 5
+#define LEGACY_PORT UART_NUM_1
+#define BURST_FRAMES 2000
+#define SPACED_FRAMES 200
+#define SPACED_GAP_US 3000
+#define IDLE_MS 200
+
+typedef struct {
+    int frames;
+    int bad_frames;
+    uint32_t wakeups;
+    std::vector<clock_type::time_point> received;
+} rx_result_t;
+
+static int frame_text(char* out, size_t size, int index) {
+    // tamanho de um report ASCII com prefixo ("#rp,MACMACMACMAC,pwm;")
+    return snprintf(out, size, "#rp,A1B2C3D4E5%02X,%03d;", index & 0xff, index % 256);
+}
+
+/**
+ * @brief Sensor falso: escreve os frames no RX em pedacos de 16 bytes no
+ * ritmo do baud rate e anota quando cada ';' chegou.
+ */
+static void sensor(uart_port_t port, int frames, int gap_us,
+                   std::vector<clock_type::time_point>* landed) {
+    const auto byte_time = std::chrono::nanoseconds(10 * 1000000000ULL / UART_BAUD_RATE);
+    auto deadline = clock_type::now();
+    char frame[40];
+    for (int i = 0; i < frames; i++) {
+        int len = frame_text(frame, sizeof(frame), i);
+        for (int pos = 0; pos < len; pos += 16) {
+            int chunk = std::min(16, len - pos);
+            deadline += byte_time * chunk;
+            std::this_thread::sleep_until(deadline);
+            fake_uart_rx_feed(port, frame + pos, chunk);
+        }
+        (*landed)[i] = clock_type::now();
+        if (gap_us > 0) {
+            deadline += std::chrono::microseconds(gap_us);
+        }
+    }
+}
+
+static bool frame_ok(const char* frame, int len, int index) {
+    char expected[40];
+    int expected_len = frame_text(expected, sizeof(expected), index) - 1;
+    return len == expected_len && memcmp(frame, expected, len) == 0;
+}
+
+static void event_reader(int frames, rx_result_t* result) {
+    UartLink* link = UartLink::getInstance();
+    char frame[ASYNC_SRV_MSG_LENGTH + 1];
+    uint8_t type, seq;
+    size_t events = fake_uart_events_posted(UART_NUM_2);
+    while (result->frames < frames) {
+        int len = link->readFrame(&type, &seq, frame, sizeof(frame), pdMS_TO_TICKS(1000));
+        result->wakeups = fake_uart_events_posted(UART_NUM_2) - events;
+        if (len < 0) {
+            break;
+        }
+        result->received[result->frames] = clock_type::now();
+        result->bad_frames += !frame_ok(frame, len, result->frames);
+        result->frames++;
+    }
+}
+
+static void polling_reader(int frames, rx_result_t* result) {
+    char frame[ASYNC_SRV_MSG_LENGTH + 1];
+    while (result->frames < frames) {
+        size_t buffered = 0;
+        uart_get_buffered_data_len(LEGACY_PORT, &buffered);
+        result->wakeups++;
+        if (buffered == 0) {
+            vTaskDelay(pdMS_TO_TICKS(LEGACY_POLL_PERIOD_MS));
+            continue;
+        }
+        // Serial2.readBytesUntil(';', ...): um byte por vez, timeout de 1 s
+        int len = 0;
+        char c = 0;
+        while (len < ASYNC_SRV_MSG_LENGTH &&
+               uart_read_bytes(LEGACY_PORT, &c, 1, pdMS_TO_TICKS(1000)) == 1 && c != ';') {
+            frame[len++] = c;
+        }
+        if (c != ';') {
+            break;
+        }
+        result->received[result->frames] = clock_type::now();
+        result->bad_frames += !frame_ok(frame, len, result->frames);
+        result->frames++;
+    }
+}
+
+static void run(const char* name, uart_port_t port, void (*reader)(int, rx_result_t*)) {
+    // rajada: frames seguidos na linha
+    rx_result_t burst = {0, 0, 0, std::vector<clock_type::time_point>(BURST_FRAMES)};
+    std::vector<clock_type::time_point> landed(BURST_FRAMES);
+    auto start = clock_type::now();
+    std::thread reader_thread(reader, BURST_FRAMES, &burst);
+    sensor(port, BURST_FRAMES, 0, &landed);
+    reader_thread.join();
+    double burst_s = host_elapsed_us(start) / 1e6;
+
+    // frames espacados: latencia de cada um
+    rx_result_t spaced = {0, 0, 0, std::vector<clock_type::time_point>(SPACED_FRAMES)};
+    landed.assign(SPACED_FRAMES, clock_type::time_point());
+    reader_thread = std::thread(reader, SPACED_FRAMES, &spaced);
+    sensor(port, SPACED_FRAMES, SPACED_GAP_US, &landed);
+    reader_thread.join();
+    std::vector<double> latency_us;
+    for (int i = 0; i < spaced.frames; i++) {
+        latency_us.push_back(
+            std::chrono::duration<double, std::micro>(spaced.received[i] - landed[i]).count());
+    }
+    std::sort(latency_us.begin(), latency_us.end());
+    double mean = 0;
+    for (double value : latency_us) {
+        mean += value;
+    }
+    mean /= latency_us.empty() ? 1 : latency_us.size();
+    double p99 = latency_us.empty() ? NAN : latency_us[latency_us.size() * 99 / 100];
+
+    // sem trafego: quantas vezes a task acordou
+    rx_result_t idle = {0, 0, 0, std::vector<clock_type::time_point>(1)};
+    reader_thread = std::thread(reader, 1, &idle);
+    size_t events = fake_uart_events_posted(port);
+    std::this_thread::sleep_for(std::chrono::milliseconds(IDLE_MS));
+    uint32_t idle_wakeups = reader == polling_reader ? idle.wakeups
+                                                     : fake_uart_events_posted(port) - events;
+    char last[] = "#rp,A1B2C3D4E500,000;";
+    fake_uart_rx_feed(port, last, strlen(last));
+    reader_thread.join();
+
+    printf("%-8s %6.0f frames/s  latencia media %7.1f us  p99 %7.1f us  "
+           "wakeups %.2f/frame  ocioso %u em %d ms\n",
+           name, burst.frames / burst_s, mean, p99, (double)burst.wakeups / burst.frames,
+           idle_wakeups, IDLE_MS);
+    CHECK_EQ(burst.frames, BURST_FRAMES);
+    CHECK_EQ(burst.bad_frames, 0);
+    CHECK_EQ(spaced.frames, SPACED_FRAMES);
+    CHECK_EQ(spaced.bad_frames, 0);
+}
+
+int main() {
+    UartLink* link = UartLink::getInstance();
+    CHECK_EQ(link->begin(UART_NUM_2, UART_BAUD_RATE, 17, 16), ESP_OK);
+    CHECK_EQ(uart_driver_install(LEGACY_PORT, UART_RX_BUFFER, 0, 0, NULL, 0), ESP_OK);
+
+    printf("%d frames de %d bytes a %d baud\n", BURST_FRAMES,
+           frame_text(NULL, 0, 0), UART_BAUD_RATE);
+    run("evento", UART_NUM_2, event_reader);
+    run("polling", LEGACY_PORT, polling_reader);
+    return HOST_TEST_RESULT();
+}
@@ -0,0 +1,91 @@
+/**
+ * Envio de mensagens ao sensor (100 B, 1 KB e 4 KB) por tres caminhos:
+ *  - antigo: pedacos de ASYNC_SRV_MSG_LENGTH com vTaskDelay de 100 ms depois
+ *    de cada Serial2.print, como no _send_data_to_sensor original;
+ *  - sem controle de fluxo (sensor antigo): os mesmos pedacos, com a pausa so
+ *    entre eles e uart_wait_tx_done;
+ *  - com creditos: a mensagem inteira no ring de TX, limitada pela janela do
+ *    sensor.
+ * Mede a latencia ate o ultimo byte sair e os bytes/s resultantes.
+ */
+
+#include <string.h>
+
+#include <chrono>
+#include <vector>
+
+#include "configuration.h"
+#include "freertos/task.h"
+#include "host_test.h"
+#include "sensor_credits.h"
+
+using namespace Wetzel;
+
+// janela e atraso do credito de um sensor tipico (RX de 1 KB, "cr," a cada
+// bloco processado)
+#define SENSOR_WINDOW 512
+#define SENSOR_CREDIT_DELAY_US 500
+
+typedef void (*send_fn_t)(UartLink* link, const char* msg, size_t len);
+
+static void send_legacy(UartLink* link, const char* msg, size_t len) {
+    for (size_t i = 0; i < len; i += ASYNC_SRV_MSG_LENGTH) {
+        size_t chunk = len - i > ASYNC_SRV_MSG_LENGTH ? ASYNC_SRV_MSG_LENGTH : len - i;
+        link->write(msg + i, chunk);
+        vTaskDelay(pdMS_TO_TICKS(100));
+    }
+}
+
+static void send_chunked(UartLink* link, const char* msg, size_t len) {
+    for (size_t i = 0; i < len; i += ASYNC_SRV_MSG_LENGTH) {
+        size_t chunk = len - i > ASYNC_SRV_MSG_LENGTH ? ASYNC_SRV_MSG_LENGTH : len - i;
+        link->write(msg + i, chunk);
+        if (i + chunk >= len) {
+            break;
+        }
+        link->waitTxDone(portMAX_DELAY);
+        vTaskDelay(pdMS_TO_TICKS(UART_LINK_LEGACY_CHUNK_DELAY_MS));
+    }
+    link->waitTxDone(portMAX_DELAY);
+}
+
+static void send_credits(UartLink* link, const char* msg, size_t len) {
+    link->write(msg, len);
+    link->waitTxDone(portMAX_DELAY);
+}
+
+static void run(UartLink* link, SensorCredits* sensor, const char* name, send_fn_t send,
+                uint16_t window) {
+    const size_t sizes[] = {100, 1024, 4096};
+    link->enableFlowControl(window);
+    for (size_t size : sizes) {
+        std::vector<char> msg(size, 'm');
+        sensor->resetStats();
+        auto start = std::chrono::steady_clock::now();
+        send(link, msg.data(), size);
+        double elapsed_us = host_elapsed_us(start);
+        // o antigo so dormia, o ultimo pedaco pode ainda estar saindo
+        link->waitTxDone(portMAX_DELAY);
+        printf("%-10s %5u B  %9.1f ms  %8.0f B/s\n", name, (unsigned)size, elapsed_us / 1000,
+               size / (elapsed_us / 1e6));
+        CHECK_EQ(sensor->takeData().size(), size);
+        if (window > 0) {
+            CHECK(sensor->maxOutstanding() <= window);
+        }
+        vTaskDelay(pdMS_TO_TICKS(5));
+    }
+}
+
+int main() {
+    UartLink* link = UartLink::getInstance();
+    CHECK_EQ(link->begin(UART_NUM_2, UART_BAUD_RATE, 17, 16), ESP_OK);
+    SensorCredits* sensor = new SensorCredits(
+        link, UART_NUM_2, std::chrono::microseconds(SENSOR_CREDIT_DELAY_US));
+
+    printf("%d baud, janela de %d B\n", UART_BAUD_RATE, SENSOR_WINDOW);
+    run(link, sensor, "antigo", send_legacy, 0);
+    run(link, sensor, "sem fluxo", send_chunked, 0);
+    run(link, sensor, "creditos", send_credits, SENSOR_WINDOW);
+    CHECK_EQ(link->creditTimeouts(), 0);
+    return HOST_TEST_RESULT();
+}
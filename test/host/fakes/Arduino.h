@@ -0,0 +1,12 @@
+#ifndef FAKE_ARDUINO_H_
+#define FAKE_ARDUINO_H_
+
+// como no core do ESP32, traz os cabecalhos da IDF que o firmware usa sem
+// incluir
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "esp_system.h"
+#include "freertos/FreeRTOS.h"
+
+#endif
@@ -0,0 +1,33 @@
+#ifndef FAKE_RTCLIB_H_
+#define FAKE_RTCLIB_H_
+
+#include "Arduino.h"
+#include "Wire.h"
+
+/**
+ * DateTime e RTC_DS3231 do host: o RTC guarda o horario ajustado e nao anda
+ * sozinho.
+ */
+class DateTime {
+   public:
+    DateTime(uint32_t t = 0) : _unixtime(t) {}
+    uint32_t unixtime() const { return _unixtime; }
+
+   private:
+    uint32_t _unixtime;
+};
+
+enum Ds3231SqwPinMode { DS3231_OFF, DS3231_SquareWave1Hz };
+
+class RTC_DS3231 {
+   public:
+    bool begin(TwoWire* wire) { return wire != 0; }
+    DateTime now() { return _now; }
+    void adjust(const DateTime& dt) { _now = dt; }
+    void writeSqwPinMode(Ds3231SqwPinMode) {}
+
+   private:
+    DateTime _now;
+};
+
+#endif
@@ -0,0 +1,8 @@
+#ifndef FAKE_WIRE_H_
+#define FAKE_WIRE_H_
+
+class TwoWire {};
+
+extern TwoWire Wire;
+
+#endif
@@ -0,0 +1,8 @@
+#ifndef FAKE_DRIVER_GPIO_H_
+#define FAKE_DRIVER_GPIO_H_
+
+#include "esp_err.h"
+
+typedef int gpio_num_t;
+
+#endif
@@ -0,0 +1,14 @@
+#ifndef FAKE_DRIVER_SDMMC_HOST_H_
+#define FAKE_DRIVER_SDMMC_HOST_H_
+
+// so os tipos que o CartaoSD guarda; o cartao do host e o fake_sd_card.cpp
+#include "driver/gpio.h"
+
+typedef struct {
+    int slot;
+    int max_freq_khz;
+} sdmmc_host_t;
+
+typedef struct sdmmc_card_s sdmmc_card_t;
+
+#endif
@@ -0,0 +1,15 @@
+#ifndef FAKE_DRIVER_SDSPI_HOST_H_
+#define FAKE_DRIVER_SDSPI_HOST_H_
+
+#include "driver/sdmmc_host.h"
+#include "driver/spi_common.h"
+
+typedef struct {
+    spi_host_device_t host_id;
+    gpio_num_t gpio_cs;
+} sdspi_device_config_t;
+
+#define SDSPI_HOST_DEFAULT() {1, 20000}
+#define SDSPI_DEVICE_CONFIG_DEFAULT() {1, -1}
+
+#endif
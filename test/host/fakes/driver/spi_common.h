@@ -0,0 +1,21 @@
+#ifndef FAKE_DRIVER_SPI_COMMON_H_
+#define FAKE_DRIVER_SPI_COMMON_H_
+
+#include "esp_err.h"
+
+typedef int spi_host_device_t;
+
+#define SPI_DMA_CH_AUTO 3
+
+typedef struct {
+    int mosi_io_num;
+    int miso_io_num;
+    int sclk_io_num;
+    int quadwp_io_num;
+    int quadhd_io_num;
+    int max_transfer_sz;
+} spi_bus_config_t;
+
+esp_err_t spi_bus_initialize(spi_host_device_t host, const spi_bus_config_t* config, int dma);
+
+#endif
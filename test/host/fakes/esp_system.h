@@ -0,0 +1,9 @@
+#ifndef FAKE_ESP_SYSTEM_H_
+#define FAKE_ESP_SYSTEM_H_
+
+#include "esp_err.h"
+
+#define MAC2STR(a) (a)[0], (a)[1], (a)[2], (a)[3], (a)[4], (a)[5]
+#define MACSTR "%02x:%02x:%02x:%02x:%02x:%02x"
+
+#endif
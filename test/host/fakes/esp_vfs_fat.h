@@ -0,0 +1,23 @@
+#ifndef FAKE_ESP_VFS_FAT_H_
+#define FAKE_ESP_VFS_FAT_H_
+
+#include <stddef.h>
+
+#include "driver/sdspi_host.h"
+#include "esp_err.h"
+// a IDF traz o FreeRTOS junto com o driver
+#include "freertos/task.h"
+
+typedef struct {
+    bool format_if_mount_failed;
+    int max_files;
+    size_t allocation_unit_size;
+} esp_vfs_fat_sdmmc_mount_config_t;
+
+// cria o diretorio base_path, que faz o papel do cartao
+esp_err_t esp_vfs_fat_sdspi_mount(const char* base_path, const sdmmc_host_t* host,
+                                  const sdspi_device_config_t* slot,
+                                  const esp_vfs_fat_sdmmc_mount_config_t* config,
+                                  sdmmc_card_t** card);
+
+#endif
@@ -0,0 +1,15 @@
+#ifndef FAKE_FREERTOS_CONTROL_H_
+#define FAKE_FREERTOS_CONTROL_H_
+
+#include "freertos/FreeRTOS.h"
+
+/**
+ * @brief Adianta o xTaskGetTickCount() sem esperar, para testar o que depende
+ * de periodos longos (commit, rollups). As esperas das tasks continuam em
+ * tempo real.
+ *
+ * @param ticks
+ */
+void fake_tick_advance(TickType_t ticks);
+
+#endif
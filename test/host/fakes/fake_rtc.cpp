@@ -0,0 +1,67 @@
+#include "fake_rtc.h"
+
+#include "real_time_clock.h"
+
+TwoWire Wire;
+
+namespace Wetzel {
+
+RTC_DS3231 RealTimeClock::_rtc;
+RealTimeClock* RealTimeClock::_instance = nullptr;
+uint32_t RealTimeClock::_unixSeconds = 0;
+uint16_t RealTimeClock::_unixDay = 0;
+DateTime RealTimeClock::_dateTime;
+SemaphoreHandle_t RealTimeClock::_rtc_mutex = NULL;
+TaskHandle_t RealTimeClock::update_local_clock_1s_handle = NULL;
+bool RealTimeClock::lost_track = false;
+
+RealTimeClock::RealTimeClock() {}
+
+RealTimeClock::~RealTimeClock() {}
+
+RealTimeClock* RealTimeClock::getInstance() {
+    if (_instance == nullptr) {
+        _instance = new RealTimeClock();
+    }
+    return _instance;
+}
+
+esp_err_t RealTimeClock::begin(TwoWire* wireInstance) {
+    _rtc.begin(wireInstance);
+    rtc_initialized = true;
+    return update_local_clock_with_rtc();
+}
+
+esp_err_t RealTimeClock::update_local_clock_with_rtc() {
+    _dateTime = _rtc.now();
+    _unixSeconds = _dateTime.unixtime();
+    _unixDay = _unixSeconds / (60 * 60 * 24);
+    return ESP_OK;
+}
+
+esp_err_t RealTimeClock::configureRtc(uint32_t new_unix_seconds) {
+    _rtc.adjust(DateTime(new_unix_seconds));
+    return update_local_clock_with_rtc();
+}
+
+RTC_DS3231* RealTimeClock::rtc() {
+    return &_rtc;
+}
+
+uint32_t RealTimeClock::unixSeconds() const {
+    return _unixSeconds;
+}
+
+uint16_t RealTimeClock::unixDay() const {
+    return _unixDay;
+}
+
+DateTime RealTimeClock::dateTime() const {
+    return _dateTime;
+}
+
+}  // namespace Wetzel
+
+void fake_rtc_set(uint32_t unix_seconds) {
+    Wetzel::RealTimeClock::getInstance()->configureRtc(unix_seconds);
+}
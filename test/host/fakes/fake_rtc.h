@@ -0,0 +1,14 @@
+#ifndef FAKE_RTC_H_
+#define FAKE_RTC_H_
+
+#include <stdint.h>
+
+/**
+ * @brief Acerta o RealTimeClock do host. Ele nao anda sozinho: o teste avanca
+ * o horario chamando de novo.
+ *
+ * @param unix_seconds
+ */
+void fake_rtc_set(uint32_t unix_seconds);
+
+#endif
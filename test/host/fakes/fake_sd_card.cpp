@@ -0,0 +1,93 @@
+#include "fake_sd_card.h"
+
+#include <dirent.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "esp_vfs_fat.h"
+#include "sd_card_handler.h"
+#include "sdmmc_cmd.h"
+
+esp_err_t spi_bus_initialize(spi_host_device_t, const spi_bus_config_t*, int) {
+    return ESP_OK;
+}
+
+esp_err_t esp_vfs_fat_sdspi_mount(const char* base_path, const sdmmc_host_t*,
+                                  const sdspi_device_config_t*,
+                                  const esp_vfs_fat_sdmmc_mount_config_t*, sdmmc_card_t** card) {
+    *card = NULL;
+    if (mkdir(base_path, 0755) != 0 && access(base_path, W_OK) != 0) {
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+void sdmmc_card_print_info(FILE*, const sdmmc_card_t*) {}
+
+bool fake_sd_card_format() {
+    DIR* dir = opendir(MOUNT_POINT);
+    if (dir != NULL) {
+        char path[300];
+        struct dirent* entry;
+        while ((entry = readdir(dir)) != NULL) {
+            if (entry->d_name[0] == '.') {
+                continue;
+            }
+            snprintf(path, sizeof(path), MOUNT_POINT "/%s", entry->d_name);
+            unlink(path);
+        }
+        closedir(dir);
+    }
+    return mkdir(MOUNT_POINT, 0755) == 0 || access(MOUNT_POINT, W_OK) == 0;
+}
+
+namespace {
+
+std::vector<fake_sd_card_write_t> writes;
+uint32_t fsyncs = 0;
+
+bool on_card(int fd) {
+    char link[32];
+    char path[300];
+    snprintf(link, sizeof(link), "/proc/self/fd/%d", fd);
+    ssize_t len = readlink(link, path, sizeof(path) - 1);
+    if (len < 0) {
+        return false;
+    }
+    path[len] = '\0';
+    return strstr(path, "/" MOUNT_POINT "/") != NULL;
+}
+
+}  // namespace
+
+extern "C" size_t __real_fwrite(const void* data, size_t size, size_t count, FILE* stream);
+extern "C" int __real_fsync(int fd);
+
+extern "C" size_t __wrap_fwrite(const void* data, size_t size, size_t count, FILE* stream) {
+    if (on_card(fileno(stream))) {
+        writes.push_back({(uint32_t)ftell(stream), (uint32_t)(size * count)});
+    }
+    return __real_fwrite(data, size, count, stream);
+}
+
+extern "C" int __wrap_fsync(int fd) {
+    if (on_card(fd)) {
+        fsyncs++;
+    }
+    return __real_fsync(fd);
+}
+
+const std::vector<fake_sd_card_write_t>& fake_sd_card_writes() {
+    return writes;
+}
+
+uint32_t fake_sd_card_fsyncs() {
+    return fsyncs;
+}
+
+void fake_sd_card_trace_clear() {
+    writes.clear();
+    fsyncs = 0;
+}
@@ -0,0 +1,38 @@
+#ifndef FAKE_SD_CARD_H_
+#define FAKE_SD_CARD_H_
+
+#include <stdint.h>
+
+#include <vector>
+
+/**
+ * @brief Recria vazio o diretorio MOUNT_POINT, que faz o papel do cartao SD
+ * no host (relativo ao diretorio em que o teste roda).
+ *
+ * @return bool false se o diretorio nao pode ser criado
+ */
+bool fake_sd_card_format();
+
+/**
+ * @brief Uma escrita (fwrite) em um arquivo do cartao.
+ *
+ */
+typedef struct {
+    uint32_t offset;
+    uint32_t size;
+} fake_sd_card_write_t;
+
+/**
+ * @brief Escritas em arquivos do cartao desde o ultimo fake_sd_card_trace_clear(),
+ * em ordem. fwrite e fsync sao interceptados no link (--wrap).
+ */
+const std::vector<fake_sd_card_write_t>& fake_sd_card_writes();
+
+/**
+ * @brief fsyncs em arquivos do cartao desde o ultimo fake_sd_card_trace_clear().
+ */
+uint32_t fake_sd_card_fsyncs();
+
+void fake_sd_card_trace_clear();
+
+#endif
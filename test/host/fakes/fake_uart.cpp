@@ -0,0 +1,277 @@
+#include "fake_uart.h"
+
+#include <string.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+namespace {
+
+// bytes entregues ao tx_sink de uma vez (um FIFO de hardware tem 128)
+const size_t TX_SINK_CHUNK = 16;
+
+struct fake_port {
+    std::mutex mutex;
+    std::condition_variable rx_changed;
+    std::condition_variable tx_changed;
+    bool installed = false;
+    int baud_rate = 115200;
+
+    QueueHandle_t events = nullptr;
+    size_t events_posted = 0;
+    std::deque<uint8_t> rx;
+    size_t rx_capacity = 0;
+    // bytes ja consumidos do RX: as posicoes de padrao sao absolutas
+    uint64_t rx_consumed = 0;
+    bool pattern_enabled = false;
+    char pattern_chr = 0;
+    std::deque<uint64_t> patterns;
+    size_t pattern_capacity = 0;
+
+    std::deque<uint8_t> tx;
+    size_t tx_capacity = 0;
+    size_t tx_in_flight = 0;
+    size_t tx_total = 0;
+    fake_uart_tx_sink_t tx_sink;
+};
+
+// nunca destruido: a task de TX continua esperando ate o fim do processo
+fake_port* const ports = new fake_port[UART_NUM_MAX];
+
+void post_event(fake_port& port, uart_event_type_t type, size_t size) {
+    uart_event_t event = {.type = type, .size = size, .timeout_flag = false};
+    // fila cheia: o evento se perde, como no driver
+    if (port.events != nullptr && xQueueSend(port.events, &event, 0) == pdTRUE) {
+        port.events_posted++;
+    }
+}
+
+void tx_drain(fake_port* port) {
+    auto deadline = std::chrono::steady_clock::now();
+    uint8_t chunk[TX_SINK_CHUNK];
+    while (true) {
+        size_t len;
+        int baud_rate;
+        {
+            std::unique_lock<std::mutex> lock(port->mutex);
+            port->tx_changed.wait(lock, [port] { return !port->tx.empty(); });
+            len = port->tx.size() < sizeof(chunk) ? port->tx.size() : sizeof(chunk);
+            for (size_t i = 0; i < len; i++) {
+                chunk[i] = port->tx.front();
+                port->tx.pop_front();
+            }
+            port->tx_in_flight = len;
+            baud_rate = port->baud_rate;
+            port->tx_changed.notify_all();
+        }
+        // 10 bits por byte (start, 8 dados, stop)
+        auto now = std::chrono::steady_clock::now();
+        if (deadline < now) {
+            deadline = now;
+        }
+        deadline += std::chrono::nanoseconds((uint64_t)len * 10 * 1000000000ULL / baud_rate);
+        std::this_thread::sleep_until(deadline);
+
+        fake_uart_tx_sink_t sink;
+        {
+            std::lock_guard<std::mutex> lock(port->mutex);
+            sink = port->tx_sink;
+        }
+        if (sink) {
+            sink(chunk, len);
+        }
+        std::lock_guard<std::mutex> lock(port->mutex);
+        port->tx_in_flight = 0;
+        port->tx_total += len;
+        port->tx_changed.notify_all();
+    }
+}
+
+}  // namespace
+
+esp_err_t uart_driver_install(uart_port_t port_num, int rx_buffer_size, int tx_buffer_size,
+                              int queue_size, QueueHandle_t* queue, int intr_alloc_flags) {
+    fake_port& port = ports[port_num];
+    std::lock_guard<std::mutex> lock(port.mutex);
+    if (port.installed) {
+        return ESP_FAIL;
+    }
+    port.installed = true;
+    port.rx_capacity = rx_buffer_size;
+    port.tx_capacity = tx_buffer_size;
+    if (queue != nullptr && queue_size > 0) {
+        port.events = xQueueCreate(queue_size, sizeof(uart_event_t));
+        *queue = port.events;
+    }
+    std::thread(tx_drain, &port).detach();
+    return ESP_OK;
+}
+
+esp_err_t uart_driver_delete(uart_port_t port_num) {
+    return ESP_OK;
+}
+
+esp_err_t uart_param_config(uart_port_t port_num, const uart_config_t* config) {
+    fake_port& port = ports[port_num];
+    std::lock_guard<std::mutex> lock(port.mutex);
+    port.baud_rate = config->baud_rate;
+    return ESP_OK;
+}
+
+esp_err_t uart_set_pin(uart_port_t port_num, int tx, int rx, int rts, int cts) {
+    return ESP_OK;
+}
+
+esp_err_t uart_enable_pattern_det_baud_intr(uart_port_t port_num, char pattern_chr,
+                                            uint8_t chr_num, int chr_tout, int post_idle,
+                                            int pre_idle) {
+    fake_port& port = ports[port_num];
+    std::lock_guard<std::mutex> lock(port.mutex);
+    port.pattern_enabled = true;
+    port.pattern_chr = pattern_chr;
+    return ESP_OK;
+}
+
+esp_err_t uart_disable_pattern_det_intr(uart_port_t port_num) {
+    fake_port& port = ports[port_num];
+    std::lock_guard<std::mutex> lock(port.mutex);
+    port.pattern_enabled = false;
+    return ESP_OK;
+}
+
+esp_err_t uart_pattern_queue_reset(uart_port_t port_num, int queue_length) {
+    fake_port& port = ports[port_num];
+    std::lock_guard<std::mutex> lock(port.mutex);
+    port.patterns.clear();
+    port.pattern_capacity = queue_length;
+    return ESP_OK;
+}
+
+int uart_pattern_pop_pos(uart_port_t port_num) {
+    fake_port& port = ports[port_num];
+    std::lock_guard<std::mutex> lock(port.mutex);
+    while (!port.patterns.empty()) {
+        uint64_t position = port.patterns.front();
+        port.patterns.pop_front();
+        // posicao de um byte ja descartado por uart_flush_input
+        if (position >= port.rx_consumed) {
+            return (int)(position - port.rx_consumed);
+        }
+    }
+    return -1;
+}
+
+int uart_read_bytes(uart_port_t port_num, void* buf, uint32_t length, TickType_t wait) {
+    fake_port& port = ports[port_num];
+    std::unique_lock<std::mutex> lock(port.mutex);
+    auto ready = [&port, length] { return port.rx.size() >= length; };
+    if (wait == portMAX_DELAY) {
+        port.rx_changed.wait(lock, ready);
+    } else {
+        port.rx_changed.wait_for(lock, std::chrono::milliseconds(wait), ready);
+    }
+    size_t len = port.rx.size() < length ? port.rx.size() : length;
+    uint8_t* out = (uint8_t*)buf;
+    for (size_t i = 0; i < len; i++) {
+        out[i] = port.rx.front();
+        port.rx.pop_front();
+    }
+    port.rx_consumed += len;
+    return (int)len;
+}
+
+int uart_write_bytes(uart_port_t port_num, const void* src, size_t size) {
+    fake_port& port = ports[port_num];
+    const uint8_t* bytes = (const uint8_t*)src;
+    size_t written = 0;
+    std::unique_lock<std::mutex> lock(port.mutex);
+    while (written < size) {
+        port.tx_changed.wait(lock, [&port] { return port.tx.size() < port.tx_capacity; });
+        while (written < size && port.tx.size() < port.tx_capacity) {
+            port.tx.push_back(bytes[written++]);
+        }
+        port.tx_changed.notify_all();
+    }
+    return (int)written;
+}
+
+esp_err_t uart_wait_tx_done(uart_port_t port_num, TickType_t wait) {
+    fake_port& port = ports[port_num];
+    std::unique_lock<std::mutex> lock(port.mutex);
+    auto done = [&port] { return port.tx.empty() && port.tx_in_flight == 0; };
+    if (wait == portMAX_DELAY) {
+        port.tx_changed.wait(lock, done);
+        return ESP_OK;
+    }
+    return port.tx_changed.wait_for(lock, std::chrono::milliseconds(wait), done) ? ESP_OK
+                                                                               : ESP_ERR_TIMEOUT;
+}
+
+esp_err_t uart_get_buffered_data_len(uart_port_t port_num, size_t* size) {
+    fake_port& port = ports[port_num];
+    std::lock_guard<std::mutex> lock(port.mutex);
+    *size = port.rx.size();
+    return ESP_OK;
+}
+
+esp_err_t uart_flush_input(uart_port_t port_num) {
+    fake_port& port = ports[port_num];
+    std::lock_guard<std::mutex> lock(port.mutex);
+    port.rx_consumed += port.rx.size();
+    port.rx.clear();
+    return ESP_OK;
+}
+
+void fake_uart_rx_feed(uart_port_t port_num, const void* data, size_t len) {
+    fake_port& port = ports[port_num];
+    const uint8_t* bytes = (const uint8_t*)data;
+    std::lock_guard<std::mutex> lock(port.mutex);
+    size_t accepted = 0;
+    size_t patterns = 0;
+    bool overflow = false;
+    for (; accepted < len; accepted++) {
+        if (port.rx.size() >= port.rx_capacity) {
+            overflow = true;
+            break;
+        }
+        port.rx.push_back(bytes[accepted]);
+        if (port.pattern_enabled && bytes[accepted] == (uint8_t)port.pattern_chr) {
+            patterns++;
+            // fila de posicoes cheia: a posicao se perde, como no driver
+            if (port.patterns.size() < port.pattern_capacity) {
+                port.patterns.push_back(port.rx_consumed + port.rx.size() - 1);
+            }
+        }
+    }
+    port.rx_changed.notify_all();
+    if (accepted > 0) {
+        post_event(port, UART_DATA, accepted);
+    }
+    for (size_t i = 0; i < patterns; i++) {
+        post_event(port, UART_PATTERN_DET, 0);
+    }
+    if (overflow) {
+        post_event(port, UART_BUFFER_FULL, 0);
+    }
+}
+
+void fake_uart_set_tx_sink(uart_port_t port_num, fake_uart_tx_sink_t sink) {
+    fake_port& port = ports[port_num];
+    std::lock_guard<std::mutex> lock(port.mutex);
+    port.tx_sink = sink;
+}
+
+size_t fake_uart_events_posted(uart_port_t port_num) {
+    fake_port& port = ports[port_num];
+    std::lock_guard<std::mutex> lock(port.mutex);
+    return port.events_posted;
+}
+
+size_t fake_uart_tx_total(uart_port_t port_num) {
+    fake_port& port = ports[port_num];
+    std::lock_guard<std::mutex> lock(port.mutex);
+    return port.tx_total;
+}
@@ -0,0 +1,40 @@
+#ifndef FAKE_UART_H_
+#define FAKE_UART_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <functional>
+
+#include "driver/uart.h"
+
+/**
+ * Lado do sensor na UART falsa. Os bytes escritos pelo firmware saem no TX no
+ * ritmo do baud rate configurado (10 bits por byte) e sao entregues ao
+ * tx_sink quando terminam de sair; o sensor responde com fake_uart_rx_feed.
+ */
+
+typedef std::function<void(const uint8_t* data, size_t len)> fake_uart_tx_sink_t;
+
+/**
+ * @brief Entrega bytes ao RX do driver, como se tivessem chegado pela linha.
+ * Gera UART_DATA, um UART_PATTERN_DET por terminador (com a deteccao ligada) e
+ * UART_BUFFER_FULL quando o buffer de RX nao comporta os bytes.
+ */
+void fake_uart_rx_feed(uart_port_t port, const void* data, size_t len);
+
+void fake_uart_set_tx_sink(uart_port_t port, fake_uart_tx_sink_t sink);
+
+/**
+ * @brief Eventos postados na fila do driver. Cada um acorda a task leitora.
+ * O driver real gera UART_DATA por limiar do FIFO (120 bytes) ou por silencio
+ * na linha; aqui e um por chamada de fake_uart_rx_feed.
+ */
+size_t fake_uart_events_posted(uart_port_t port);
+
+/**
+ * @brief Bytes que ja sairam pelo TX desde a instalacao do driver.
+ */
+size_t fake_uart_tx_total(uart_port_t port);
+
+#endif
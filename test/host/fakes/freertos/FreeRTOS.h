@@ -0,0 +1,54 @@
+#ifndef FAKE_FREERTOS_H_
+#define FAKE_FREERTOS_H_
+
+/**
+ * FreeRTOS do host: tasks sao std::thread, filas e semaforos usam
+ * mutex/condition_variable e um tick vale 1 ms. Cobre so o que o firmware
+ * usa.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint8_t StackType_t;
+typedef struct {
+    uint8_t unused;
+} StaticTask_t;
+
+typedef struct fake_queue* QueueHandle_t;
+typedef struct fake_queue* SemaphoreHandle_t;
+typedef struct fake_task* TaskHandle_t;
+typedef void (*TaskFunction_t)(void*);
+
+#define pdFALSE 0
+#define pdTRUE 1
+#define pdPASS pdTRUE
+#define pdFAIL pdFALSE
+#define errQUEUE_FULL pdFALSE
+
+#define portMAX_DELAY ((TickType_t)0xffffffffUL)
+#define portTICK_PERIOD_MS ((TickType_t)1)
+#define portTICK_RATE_MS portTICK_PERIOD_MS
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms))
+#define configTICK_RATE_HZ 1000
+#define tskNO_AFFINITY 0x7fffffff
+
+typedef struct {
+    volatile int locked;
+} portMUX_TYPE;
+#define portMUX_INITIALIZER_UNLOCKED {0}
+
+void fake_port_enter_critical(portMUX_TYPE* mux);
+void fake_port_exit_critical(portMUX_TYPE* mux);
+#define portENTER_CRITICAL(mux) fake_port_enter_critical(mux)
+#define portEXIT_CRITICAL(mux) fake_port_exit_critical(mux)
+#define portENTER_CRITICAL_ISR(mux) fake_port_enter_critical(mux)
+#define portEXIT_CRITICAL_ISR(mux) fake_port_exit_critical(mux)
+#define portYIELD_FROM_ISR()
+
+#define configASSERT(x)
+
+#endif
@@ -0,0 +1,10 @@
+#ifndef FAKE_SDMMC_CMD_H_
+#define FAKE_SDMMC_CMD_H_
+
+#include <stdio.h>
+
+#include "driver/sdmmc_host.h"
+
+void sdmmc_card_print_info(FILE* stream, const sdmmc_card_t* card);
+
+#endif
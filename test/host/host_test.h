@@ -0,0 +1,42 @@
+#ifndef HOST_TEST_H_
+#define HOST_TEST_H_
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <chrono>
+
+/**
+ * Verificacoes dos testes de host: cada falha e impressa e o teste termina
+ * com HOST_TEST_RESULT() != 0.
+ */
+
+static int host_test_failures = 0;
+
+#define CHECK(cond)                                                                  \
+    do {                                                                             \
+        if (!(cond)) {                                                               \
+            fprintf(stderr, "%s:%d: falhou: %s\n", __FILE__, __LINE__, #cond);       \
+            host_test_failures++;                                                    \
+        }                                                                            \
+    } while (0)
+
+#define CHECK_EQ(a, b)                                                               \
+    do {                                                                             \
+        long long check_a_ = (long long)(a);                                         \
+        long long check_b_ = (long long)(b);                                         \
+        if (check_a_ != check_b_) {                                                  \
+            fprintf(stderr, "%s:%d: falhou: %s == %s (%lld != %lld)\n", __FILE__,    \
+                    __LINE__, #a, #b, check_a_, check_b_);                           \
+            host_test_failures++;                                                    \
+        }                                                                            \
+    } while (0)
+
+#define HOST_TEST_RESULT() (host_test_failures == 0 ? 0 : 1)
+
+inline double host_elapsed_us(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start)
+        .count();
+}
+
+#endif
@@ -0,0 +1,46 @@
+#ifndef LEGACY_HTML_DECODE_H_
+#define LEGACY_HTML_DECODE_H_
+
+#include <string.h>
+
+/**
+ * convert_html_text_to_ascii como era antes da passada unica: um strstr por
+ * codigo, deslocando o resto da string a cada ocorrencia. Referencia do teste
+ * diferencial e do benchmark. Mapeia %20 para ';', como o original.
+ */
+namespace Legacy {
+
+inline void convert_html_symbol(char* string, const char* code, char caracter) {
+    char* code_pos = strstr(string, code);
+    if (code_pos == NULL) {
+        return;
+    }
+    int pos = code_pos - string;
+    string[pos] = caracter;
+    for (size_t i = pos + 3; i < strlen(string) + 1; i++) {
+        string[i - 2] = string[i];
+    }
+    convert_html_symbol(string, code, caracter);
+}
+
+inline void convert_html_spaces(char* string) {
+    char* current_pos = strchr(string, '+');
+    while (current_pos) {
+        *current_pos = ' ';
+        current_pos = strchr(current_pos, '+');
+    }
+}
+
+inline void convert_html_text_to_ascii(char* string) {
+    convert_html_symbol(string, "%2C", ',');
+    convert_html_symbol(string, "%3B", ';');
+    convert_html_symbol(string, "%20", ';');
+    convert_html_symbol(string, "%7B", '{');
+    convert_html_symbol(string, "%22", '\"');
+    convert_html_symbol(string, "%3A", ':');
+    convert_html_symbol(string, "%7D", '}');
+    convert_html_spaces(string);
+}
+
+}  // namespace Legacy
+#endif
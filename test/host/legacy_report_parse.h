@@ -0,0 +1,27 @@
+#ifndef LEGACY_REPORT_PARSE_H_
+#define LEGACY_REPORT_PARSE_H_
+
+#include <stdio.h>
+
+#include "report_handler.h"
+
+/**
+ * parse_report_msg como era antes do hex_decode: sscanf no frame terminado em
+ * '\0'. Referencia do teste diferencial e do benchmark.
+ */
+namespace Legacy {
+
+inline esp_err_t parse_report_msg(const char* msg, Wetzel::report_msg_entry_t* report_msg) {
+    unsigned int pwm_value;
+
+    if (sscanf(msg, "%2hhx%2hhx%2hhx%2hhx%2hhx%2hhx,%u", &report_msg->mac[0],
+               &report_msg->mac[1], &report_msg->mac[2], &report_msg->mac[3],
+               &report_msg->mac[4], &report_msg->mac[5], &pwm_value) != 7) {
+        return ESP_FAIL;
+    }
+    report_msg->pwm_value = pwm_value;
+    return ESP_OK;
+}
+
+}  // namespace Legacy
+#endif
@@ -0,0 +1,78 @@
+#ifndef REPORT_DAYS_H_
+#define REPORT_DAYS_H_
+
+#include <stdio.h>
+
+#include <string>
+#include <vector>
+
+#include "report_handler.h"
+#include "report_reader.h"
+
+/**
+ * Arquivos diarios de relatorio no cartao do host (MOUNT_POINT), com o
+ * conteudo escolhido pelo teste: o ReportReader so os trata como bytes.
+ */
+
+/**
+ * @brief Nome do arquivo do dia relativo ao ponto de montagem ("/YYMMDD.rpt").
+ *
+ */
+inline std::string report_day_name(int32_t unix_day) {
+    uint16_t year;
+    uint8_t month, day;
+    char name[16];
+
+    Wetzel::ReportReader::dateFromUnixDay(unix_day, &year, &month, &day);
+    Wetzel::ReportHandler::createFileName(name, year, month, day, REPORT_FILE_EXTENSION);
+    return name;
+}
+
+inline std::string report_day_path(int32_t unix_day) {
+    return std::string(MOUNT_POINT) + report_day_name(unix_day);
+}
+
+inline bool report_day_write(int32_t unix_day, const std::vector<char>& data, bool append = false) {
+    FILE* f = fopen(report_day_path(unix_day).c_str(), append ? "ab" : "wb");
+    if (f == NULL) {
+        return false;
+    }
+    bool ok = fwrite(data.data(), 1, data.size(), f) == data.size();
+    return fclose(f) == 0 && ok;
+}
+
+/**
+ * @brief Todos os registros do arquivo do dia, lidos com o ReportReader ate o
+ * primeiro bloco invalido.
+ *
+ */
+inline std::vector<Wetzel::report_record_t> report_day_records(int32_t unix_day) {
+    std::vector<Wetzel::report_record_t> out;
+    Wetzel::report_record_t records[64];
+    uint16_t count = 0;
+    do {
+        if (Wetzel::ReportReader::readRecords(unix_day, out.size(), records, 64, &count) !=
+            ESP_OK) {
+            break;
+        }
+        out.insert(out.end(), records, records + count);
+    } while (count > 0);
+    return out;
+}
+
+inline bool report_record_equal(const Wetzel::report_record_t& a,
+                                const Wetzel::report_record_t& b) {
+    return a.id == b.id && a.qtd_luminarias == b.qtd_luminarias &&
+           a.modelo_luminarias == b.modelo_luminarias && a.pwm_value == b.pwm_value &&
+           a.unix_seconds == b.unix_seconds;
+}
+
+inline std::vector<char> report_random_bytes(size_t len) {
+    std::vector<char> data(len);
+    for (size_t i = 0; i < len; i++) {
+        data[i] = (char)(rand() & 0xFF);
+    }
+    return data;
+}
+
+#endif
@@ -0,0 +1,106 @@
+#ifndef SENSOR_CREDITS_H_
+#define SENSOR_CREDITS_H_
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "fake_uart.h"
+#include "uart_link.h"
+
+/**
+ * Sensor falso do controle de fluxo: devolve os creditos dos bytes recebidos
+ * depois de return_delay (processamento + o "cr,<bytes>;" voltando pela linha)
+ * e acompanha quantos bytes ficaram sem credito. Vive ate o fim do processo
+ * (a task de creditos nao termina).
+ */
+class SensorCredits {
+   private:
+    struct pending_t {
+        std::chrono::steady_clock::time_point due;
+        size_t len;
+    };
+
+    Wetzel::UartLink* _link;
+    std::chrono::microseconds _return_delay;
+    std::mutex _mutex;
+    std::condition_variable _changed;
+    std::deque<pending_t> _pending;
+    bool _returning = true;
+    std::vector<uint8_t> _data;
+    size_t _received = 0;
+    size_t _credited = 0;
+    size_t _max_outstanding = 0;
+
+    void _run() {
+        std::unique_lock<std::mutex> lock(_mutex);
+        while (true) {
+            _changed.wait(lock, [this] { return _returning && !_pending.empty(); });
+            pending_t next = _pending.front();
+            _pending.pop_front();
+            lock.unlock();
+            std::this_thread::sleep_until(next.due);
+            lock.lock();
+            _credited += next.len;
+            lock.unlock();
+            _link->addCredits(next.len);
+            lock.lock();
+        }
+    }
+
+   public:
+    SensorCredits(Wetzel::UartLink* link, uart_port_t port, std::chrono::microseconds delay)
+        : _link(link), _return_delay(delay) {
+        fake_uart_set_tx_sink(port, [this](const uint8_t* data, size_t len) {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _received += len;
+            _data.insert(_data.end(), data, data + len);
+            size_t outstanding = _received - _credited;
+            if (outstanding > _max_outstanding) {
+                _max_outstanding = outstanding;
+            }
+            _pending.push_back({std::chrono::steady_clock::now() + _return_delay, len});
+            _changed.notify_all();
+        });
+        std::thread(&SensorCredits::_run, this).detach();
+    }
+
+    // sem devolver creditos: simula um "cr," perdido ou sensor reiniciando
+    void setReturning(bool returning) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _returning = returning;
+        _changed.notify_all();
+    }
+
+    // creditos ainda nao devolvidos se perdem (nao contam como pendentes)
+    void dropPending() {
+        std::lock_guard<std::mutex> lock(_mutex);
+        for (const pending_t& pending : _pending) {
+            _credited += pending.len;
+        }
+        _pending.clear();
+    }
+
+    // bytes recebidos desde a chamada anterior
+    std::vector<uint8_t> takeData() {
+        std::lock_guard<std::mutex> lock(_mutex);
+        std::vector<uint8_t> data;
+        data.swap(_data);
+        return data;
+    }
+
+    size_t maxOutstanding() {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _max_outstanding;
+    }
+
+    void resetStats() {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _max_outstanding = 0;
+    }
+};
+
+#endif
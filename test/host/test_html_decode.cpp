@@ -0,0 +1,85 @@
+/**
+ * convert_html_text_to_ascii: casos fixos e comparacao com o decodificador
+ * antigo em strings aleatorias feitas dos sete codigos que ele tratava (menos
+ * %20, que ele trocava por ';'), de '+' e de caracteres comuns.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "host_test.h"
+#include "legacy_html_decode.h"
+#include "server_html_utils.h"
+
+using namespace Wetzel;
+
+#define PARAM_SIZE 1000
+#define RANDOM_STRINGS 2000
+
+static void check_decode(const char* input, const char* expected) {
+    char buffer[64];
+    strcpy(buffer, input);
+    size_t len = convert_html_text_to_ascii(buffer);
+    if (strcmp(buffer, expected) != 0) {
+        fprintf(stderr, "\"%s\" -> \"%s\", esperado \"%s\"\n", input, buffer, expected);
+    }
+    CHECK(strcmp(buffer, expected) == 0);
+    CHECK_EQ(len, strlen(expected));
+}
+
+static void test_fixed_cases() {
+    check_decode("", "");
+    check_decode("abc", "abc");
+    check_decode("a+b", "a b");
+    check_decode("%7B%22id%22%3A1%7D", "{\"id\":1}");
+    check_decode("%2c%3b", ",;");
+    check_decode("a%20b", "a b");
+    check_decode("%41%5a", "AZ");
+    // % invalido fica como esta
+    check_decode("%", "%");
+    check_decode("%2", "%2");
+    check_decode("%2x%%41", "%2x%A");
+    check_decode("100%", "100%");
+}
+
+static void test_matches_legacy() {
+    const char* tokens[] = {"%2C", "%3B", "%7B", "%22", "%3A", "%7D", "+", "a", "1", "Z", ","};
+    const size_t count = sizeof(tokens) / sizeof(tokens[0]);
+    char input[PARAM_SIZE + 1];
+    char expected[PARAM_SIZE + 1];
+    char actual[PARAM_SIZE + 1];
+    int mismatches = 0;
+
+    srand(1);
+    for (int n = 0; n < RANDOM_STRINGS; n++) {
+        size_t target = rand() % PARAM_SIZE;
+        size_t len = 0;
+        input[0] = '\0';
+        while (len < target) {
+            const char* token = tokens[rand() % count];
+            size_t token_len = strlen(token);
+            if (len + token_len > PARAM_SIZE) {
+                break;
+            }
+            memcpy(input + len, token, token_len + 1);
+            len += token_len;
+        }
+        strcpy(expected, input);
+        strcpy(actual, input);
+        Legacy::convert_html_text_to_ascii(expected);
+        size_t decoded = convert_html_text_to_ascii(actual);
+        if (strcmp(expected, actual) != 0 || decoded != strlen(expected)) {
+            if (mismatches++ < 3) {
+                fprintf(stderr, "diferente para \"%s\":\n  antigo \"%s\"\n  novo   \"%s\"\n",
+                        input, expected, actual);
+            }
+        }
+    }
+    CHECK_EQ(mismatches, 0);
+}
+
+int main() {
+    test_fixed_cases();
+    test_matches_legacy();
+    return HOST_TEST_RESULT();
+}
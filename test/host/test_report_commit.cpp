@@ -0,0 +1,137 @@
+/**
+ * Group commit do ReportFileWriter, contado nas escritas e fsyncs do cartao
+ * falso: so blocos inteiros de 512 bytes sao escritos, o bloco incompleto e
+ * regravado no mesmo lugar e o fsync so acontece no commit, no maximo a cada
+ * REPORT_WRITER_COMMIT_PERIOD_MS.
+ */
+
+#include "fake_freertos.h"
+#include "fake_sd_card.h"
+#include "host_test.h"
+#include "report_days.h"
+#include "report_file_writer.h"
+
+using namespace Wetzel;
+
+#define DAY 20100
+#define DEVICES 40
+
+static ReportFileWriter writer;
+static std::vector<report_record_t> written;
+
+static report_record_t next_record() {
+    uint32_t n = written.size();
+    report_record_t record = {
+        .id = (uint8_t)(n % DEVICES),
+        .qtd_luminarias = 4,
+        .modelo_luminarias = 2,
+        .pwm_value = (uint8_t)(n % 7 == 0 ? n : 50),
+        .unix_seconds = (uint32_t)(DAY * 86400UL + (n / DEVICES) * 60 + n % 3),
+    };
+    written.push_back(record);
+    return record;
+}
+
+static void check_whole_blocks() {
+    for (const fake_sd_card_write_t& w : fake_sd_card_writes()) {
+        CHECK_EQ(w.size, REPORT_FORMAT_BLOCK_SIZE);
+        CHECK_EQ(w.offset % REPORT_FORMAT_BLOCK_SIZE, 0);
+    }
+}
+
+// escritas de blocos de dados (fora o cabecalho, que tem o indice)
+static std::vector<uint32_t> data_writes() {
+    std::vector<uint32_t> offsets;
+    for (const fake_sd_card_write_t& w : fake_sd_card_writes()) {
+        if (w.offset != 0) {
+            offsets.push_back(w.offset);
+        }
+    }
+    return offsets;
+}
+
+static void advance_to_commit() {
+    fake_tick_advance(pdMS_TO_TICKS(REPORT_WRITER_COMMIT_PERIOD_MS));
+}
+
+int main() {
+    CHECK(fake_sd_card_format());
+    CHECK_EQ(CartaoSD::getInstance()->begin(23, 19, 18, 5), ESP_OK);
+    CHECK_EQ(ReportReader::getInstance()->begin(), ESP_OK);
+    CHECK_EQ(writer.begin(CartaoSD::getInstance()), ESP_OK);
+
+    // arquivo novo: cabecalho gravado e sincronizado
+    CHECK_EQ(writer.open(report_day_name(DAY).c_str(), DAY), ESP_OK);
+    check_whole_blocks();
+    CHECK_EQ(fake_sd_card_fsyncs(), 1);
+    fake_sd_card_trace_clear();
+
+    // registros ficam no bloco em RAM; commit ainda nao vencido nao escreve
+    for (int i = 0; i < 10; i++) {
+        CHECK_EQ(writer.append(next_record()), ESP_OK);
+    }
+    CHECK_EQ(writer.commitIfDue(), ESP_OK);
+    fake_tick_advance(pdMS_TO_TICKS(REPORT_WRITER_COMMIT_PERIOD_MS / 2));
+    CHECK_EQ(writer.commitIfDue(), ESP_OK);
+    CHECK(fake_sd_card_writes().empty());
+    CHECK_EQ(fake_sd_card_fsyncs(), 0);
+
+    // commit vencido: o bloco incompleto vai para o lugar dele, com um fsync
+    advance_to_commit();
+    CHECK_EQ(writer.commitIfDue(), ESP_OK);
+    check_whole_blocks();
+    CHECK(data_writes() == std::vector<uint32_t>{report_block_offset(0)});
+    CHECK_EQ(fake_sd_card_fsyncs(), 1);
+    fake_sd_card_trace_clear();
+
+    // sem nada novo o commit nao escreve nem sincroniza
+    advance_to_commit();
+    CHECK_EQ(writer.commitIfDue(), ESP_OK);
+    CHECK(fake_sd_card_writes().empty());
+    CHECK_EQ(fake_sd_card_fsyncs(), 0);
+
+    // mais registros no mesmo bloco: regravado no mesmo offset
+    for (int i = 0; i < 5; i++) {
+        CHECK_EQ(writer.append(next_record()), ESP_OK);
+    }
+    advance_to_commit();
+    CHECK_EQ(writer.commitIfDue(), ESP_OK);
+    CHECK(data_writes() == std::vector<uint32_t>{report_block_offset(0)});
+    CHECK_EQ(fake_sd_card_fsyncs(), 1);
+    fake_sd_card_trace_clear();
+
+    // blocos que enchem sao escritos na hora, em sequencia e sem fsync
+    while (data_writes().size() < 3) {
+        CHECK_EQ(writer.append(next_record()), ESP_OK);
+    }
+    check_whole_blocks();
+    std::vector<uint32_t> offsets = data_writes();
+    CHECK_EQ(offsets[0], report_block_offset(0));
+    CHECK_EQ(offsets[1], report_block_offset(1));
+    CHECK_EQ(offsets[2], report_block_offset(2));
+    CHECK_EQ(fake_sd_card_fsyncs(), 0);
+    fake_sd_card_trace_clear();
+
+    // o fsync segue a cadencia do commit, nao a dos blocos
+    CHECK_EQ(writer.append(next_record()), ESP_OK);
+    advance_to_commit();
+    CHECK_EQ(writer.commitIfDue(), ESP_OK);
+    CHECK_EQ(writer.commitIfDue(), ESP_OK);
+    check_whole_blocks();
+    CHECK(data_writes() == std::vector<uint32_t>{report_block_offset(3)});
+    CHECK_EQ(fake_sd_card_fsyncs(), 1);
+    fake_sd_card_trace_clear();
+
+    // close faz o commit final
+    CHECK_EQ(writer.append(next_record()), ESP_OK);
+    CHECK_EQ(writer.close(), ESP_OK);
+    CHECK(data_writes() == std::vector<uint32_t>{report_block_offset(3)});
+    CHECK_EQ(fake_sd_card_fsyncs(), 1);
+
+    std::vector<report_record_t> records = report_day_records(DAY);
+    CHECK_EQ(records.size(), written.size());
+    for (size_t i = 0; i < records.size() && i < written.size(); i++) {
+        CHECK(report_record_equal(records[i], written[i]));
+    }
+    return HOST_TEST_RESULT();
+}
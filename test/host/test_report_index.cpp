@@ -0,0 +1,140 @@
+/**
+ * Indice de horario do arquivo do dia: para qualquer janela [from, to], todo
+ * registro com horario dentro dela esta entre first_record e end_record do
+ * findWindow(). Os registros chegam como o ReportHandler grava: um flush por
+ * periodo, em ordem de id, com t_0 fora de ordem entre os ids, alguns t_0
+ * atrasados (dispositivo que ficou calado) e um indice que ficou atras dos
+ * dados depois de uma queda de energia com truncamento.
+ */
+
+#include "fake_sd_card.h"
+#include "host_test.h"
+#include "report_days.h"
+#include "report_file_writer.h"
+
+using namespace Wetzel;
+
+#define DAY 20300
+#define DEVICES 40
+// periodo de gravacao do ReportHandler
+#define PERIOD REPORT_CODEC_DEFAULT_STRIDE
+#define BUCKET_SECONDS (REPORT_INDEX_BUCKET_MINUTES * 60)
+
+static ReportFileWriter writer;
+
+/**
+ * @brief Um flush no horario now: t_0 e o ultimo report do ciclo anterior
+ * (entre um e dois periodos antes) ou, para um dispositivo que ficou calado,
+ * o piso de dois periodos que o ReportHandler aplica.
+ *
+ */
+static void flush(uint32_t now) {
+    for (uint8_t id = 0; id < DEVICES; id++) {
+        if (rand() % 10 == 0) {
+            continue;
+        }
+        uint32_t t_0 = rand() % 15 == 0 ? now - 2 * PERIOD : now - PERIOD - rand() % PERIOD;
+        report_record_t record = {
+            .id = id,
+            .qtd_luminarias = 2,
+            .modelo_luminarias = 1,
+            .pwm_value = (uint8_t)(rand() % 4 * 30),
+            .unix_seconds = t_0,
+        };
+        CHECK_EQ(writer.append(record), ESP_OK);
+    }
+}
+
+static uint32_t flush_until(uint32_t now, uint32_t end) {
+    for (; now < end; now += PERIOD) {
+        flush(now);
+    }
+    return now;
+}
+
+static std::vector<char> read_header() {
+    std::vector<char> data(REPORT_FORMAT_HEADER_SIZE);
+    FILE* f = fopen(report_day_path(DAY).c_str(), "rb");
+    CHECK(f != NULL);
+    CHECK_EQ(fread(data.data(), 1, data.size(), f), data.size());
+    fclose(f);
+    return data;
+}
+
+static void write_at(long offset, const char* data, size_t len) {
+    FILE* f = fopen(report_day_path(DAY).c_str(), "r+b");
+    CHECK(f != NULL);
+    fseek(f, offset, SEEK_SET);
+    CHECK_EQ(fwrite(data, 1, len, f), len);
+    fclose(f);
+}
+
+static void check_window(const std::vector<report_record_t>& records, uint32_t from, uint32_t to) {
+    uint32_t first = 0;
+    uint32_t end = 0;
+    CHECK_EQ(ReportReader::findWindow(DAY, from, to, &first, &end), ESP_OK);
+    if (end == REPORT_INDEX_EMPTY) {
+        end = records.size();
+    }
+    for (uint32_t i = 0; i < records.size(); i++) {
+        uint32_t t = records[i].unix_seconds;
+        if (t >= from && t <= to && (i < first || i >= end)) {
+            fprintf(stderr, "registro %u (%u) fora da janela [%u, %u]: [%u, %u)\n", i, t, from,
+                    to, first, end);
+            host_test_failures++;
+            return;
+        }
+    }
+}
+
+int main() {
+    CHECK(fake_sd_card_format());
+    CHECK_EQ(CartaoSD::getInstance()->begin(23, 19, 18, 5), ESP_OK);
+    CHECK_EQ(ReportReader::getInstance()->begin(), ESP_OK);
+    CHECK_EQ(writer.begin(CartaoSD::getInstance()), ESP_OK);
+    srand(23);
+
+    const uint32_t day_start = DAY * 86400UL;
+    const std::string name = report_day_name(DAY);
+
+    // o primeiro ciclo do dia traz horarios do dia anterior (bucket 0)
+    CHECK_EQ(writer.open(name.c_str(), DAY), ESP_OK);
+    uint32_t now = flush_until(day_start + PERIOD, day_start + 2 * 3600);
+    CHECK_EQ(writer.close(), ESP_OK);
+
+    // queda de energia: o cabecalho do ultimo commit ficou no cartao, os
+    // blocos do bucket seguinte tambem, e o ultimo deles pela metade
+    std::vector<char> header = read_header();
+    CHECK_EQ(writer.open(name.c_str(), DAY), ESP_OK);
+    now = flush_until(now, now + BUCKET_SECONDS / 2 + BUCKET_SECONDS / 3);
+    CHECK_EQ(writer.close(), ESP_OK);
+    size_t before = report_day_records(DAY).size();
+    CHECK(before > 0);
+    write_at(0, header.data(), header.size());
+    FILE* f = fopen(report_day_path(DAY).c_str(), "rb");
+    fseek(f, 0, SEEK_END);
+    long file_size = ftell(f);
+    fclose(f);
+    write_at(file_size - REPORT_FORMAT_BLOCK_SIZE + 9, "\xFF", 1);
+
+    // reaberto, o indice vem atrasado em relacao aos dados que sobraram
+    CHECK_EQ(writer.open(name.c_str(), DAY), ESP_OK);
+    now = flush_until(now, now + 3 * 3600);
+    CHECK_EQ(writer.close(), ESP_OK);
+
+    std::vector<report_record_t> records = report_day_records(DAY);
+    CHECK(records.size() > before);
+    for (uint32_t from = day_start; from < now; from += 5 * 60) {
+        for (uint32_t length : {0U, 59U, 5U * 60, 20U * 60, 2U * 3600}) {
+            check_window(records, from, from + length);
+        }
+    }
+    for (int i = 0; i < 500; i++) {
+        uint32_t from = day_start + rand() % (now - day_start);
+        check_window(records, from, from + rand() % 3600);
+    }
+    // janelas antes do dia e depois do ultimo registro
+    check_window(records, day_start - 3600, day_start + 60);
+    check_window(records, now - 60, now + 3600);
+    return HOST_TEST_RESULT();
+}
@@ -0,0 +1,105 @@
+/**
+ * hex_decode e ReportHandler::parse_report_msg: casos fixos, frames sem '\0'
+ * e comparacao com o sscanf antigo em frames aleatorios validos.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "hex_codec.h"
+#include "host_test.h"
+#include "legacy_report_parse.h"
+
+using namespace Wetzel;
+
+#define RANDOM_FRAMES 4096
+
+static esp_err_t parse(const char* text, report_msg_entry_t* entry) {
+    return ReportHandler::parse_report_msg(text, strlen(text), entry);
+}
+
+static void test_hex_decode() {
+    uint8_t out[4];
+    CHECK(hex_decode("00ff7A9b", out, 4));
+    CHECK_EQ(out[0], 0x00);
+    CHECK_EQ(out[1], 0xFF);
+    CHECK_EQ(out[2], 0x7A);
+    CHECK_EQ(out[3], 0x9B);
+    CHECK(hex_decode("", out, 0));
+    CHECK(!hex_decode("0g", out, 1));
+    CHECK(!hex_decode("g0", out, 1));
+    CHECK(!hex_decode("00 1", out, 2));
+    CHECK(!hex_decode("0x01", out, 2));
+    CHECK(!hex_decode("\xff" "0", out, 1));
+}
+
+static void test_fixed_frames() {
+    report_msg_entry_t entry;
+    const uint8_t mac[6] = {0xA0, 0xB1, 0xC2, 0xD3, 0xE4, 0xF5};
+
+    CHECK_EQ(parse("A0B1C2D3E4F5,0", &entry), ESP_OK);
+    CHECK(memcmp(entry.mac, mac, 6) == 0);
+    CHECK_EQ(entry.pwm_value, 0);
+    CHECK_EQ(parse("a0b1c2d3e4f5,255;", &entry), ESP_OK);
+    CHECK(memcmp(entry.mac, mac, 6) == 0);
+    CHECK_EQ(entry.pwm_value, 255);
+    CHECK_EQ(parse("A0B1C2D3E4F5,17,extra", &entry), ESP_OK);
+    CHECK_EQ(entry.pwm_value, 17);
+
+    // so os len bytes do frame contam
+    const char frame[] = "A0B1C2D3E4F5,127999";
+    CHECK_EQ(ReportHandler::parse_report_msg(frame, 16, &entry), ESP_OK);
+    CHECK_EQ(entry.pwm_value, 127);
+    CHECK_EQ(ReportHandler::parse_report_msg(frame, 15, &entry), ESP_OK);
+    CHECK_EQ(entry.pwm_value, 12);
+
+    const char* invalid[] = {
+        "",
+        "A0B1C2D3E4F5",
+        "A0B1C2D3E4F5,",
+        "A0B1C2D3E4F5;1",
+        "A0B1C2D3E4F,1",
+        "A0B1C2D3E4FG,1",
+        "A0B1C2D3E4F5,256",
+        "A0B1C2D3E4F5,1000",
+        "A0B1C2D3E4F5,12x",
+        "A0B1C2D3E4F5, 1",
+        "A0B1C2D3E4F5,+1",
+    };
+    for (const char* text : invalid) {
+        if (parse(text, &entry) == ESP_OK) {
+            fprintf(stderr, "aceitou \"%s\"\n", text);
+            host_test_failures++;
+        }
+    }
+}
+
+static void test_matches_legacy() {
+    char frame[32];
+    int mismatches = 0;
+
+    srand(17);
+    for (int n = 0; n < RANDOM_FRAMES; n++) {
+        // MAC com maiusculas e minusculas misturadas
+        int len = snprintf(frame, sizeof(frame), "%02X%02x%02X%02x%02X%02x,%u", rand() & 0xFF,
+                           rand() & 0xFF, rand() & 0xFF, rand() & 0xFF, rand() & 0xFF,
+                           rand() & 0xFF, (unsigned)(rand() % 256));
+        report_msg_entry_t expected;
+        report_msg_entry_t actual;
+        esp_err_t expected_err = Legacy::parse_report_msg(frame, &expected);
+        esp_err_t actual_err = ReportHandler::parse_report_msg(frame, len, &actual);
+        if (expected_err != actual_err || memcmp(&expected, &actual, sizeof(actual)) != 0) {
+            if (mismatches++ < 3) {
+                fprintf(stderr, "diferente para \"%s\"\n", frame);
+            }
+        }
+    }
+    CHECK_EQ(mismatches, 0);
+}
+
+int main() {
+    test_hex_decode();
+    test_fixed_frames();
+    test_matches_legacy();
+    return HOST_TEST_RESULT();
+}
@@ -0,0 +1,131 @@
+/**
+ * ReportReader como stream: varios dias (com dia sem arquivo e arquivo vazio)
+ * lidos em blocos alternando os dois buffers, Range com seek() em qualquer
+ * offset e arquivo do dia crescendo durante o download.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "fake_sd_card.h"
+#include "host_test.h"
+#include "report_days.h"
+
+using namespace Wetzel;
+
+#define FIRST_DAY 20000
+#define DAYS 5
+#define BUFFER_SIZE ASYNC_HTTP_PACKET_BUFFER_SIZE
+
+static char buffer_a[BUFFER_SIZE];
+static char buffer_b[BUFFER_SIZE];
+
+static std::vector<char> read_all(int32_t* blocks = NULL) {
+    std::vector<char> out;
+    const char* data;
+    int32_t len;
+    int32_t count = 0;
+    while ((len = ReportReader::read(&data)) > 0) {
+        CHECK(data == buffer_a || data == buffer_b);
+        CHECK(len <= BUFFER_SIZE);
+        out.insert(out.end(), data, data + len);
+        count++;
+    }
+    CHECK_EQ(len, 0);
+    if (blocks != NULL) {
+        *blocks = count;
+    }
+    return out;
+}
+
+static void test_stream(const std::vector<char>& expected) {
+    CHECK_EQ(ReportReader::open(FIRST_DAY, FIRST_DAY + DAYS - 1, buffer_a, buffer_b, BUFFER_SIZE),
+             ESP_OK);
+    CHECK_EQ(ReportReader::totalSize(), expected.size());
+    // um download por vez
+    CHECK_EQ(ReportReader::open(FIRST_DAY, FIRST_DAY, buffer_a, buffer_b, BUFFER_SIZE),
+             ESP_ERR_INVALID_STATE);
+
+    int32_t blocks = 0;
+    std::vector<char> stream = read_all(&blocks);
+    CHECK(stream == expected);
+    // blocos inteiros, menos o ultimo
+    CHECK_EQ(blocks, (expected.size() + 3584 - 1) / 3584);
+    ReportReader::close();
+}
+
+static void test_ranges(const std::vector<char>& expected) {
+    const uint32_t total = expected.size();
+    const uint32_t offsets[] = {0, 1, 511, 512, 5000, 7000, 7001, total - 1, total};
+
+    CHECK_EQ(ReportReader::open(FIRST_DAY, FIRST_DAY + DAYS - 1, buffer_a, buffer_b, BUFFER_SIZE),
+             ESP_OK);
+    for (uint32_t offset : offsets) {
+        uint32_t lengths[] = {total - offset, (total - offset) / 3, 0};
+        for (uint32_t length : lengths) {
+            CHECK_EQ(ReportReader::seek(offset, length), ESP_OK);
+            std::vector<char> range = read_all();
+            CHECK(range == std::vector<char>(expected.begin() + offset,
+                                             expected.begin() + offset + length));
+        }
+    }
+    CHECK_EQ(ReportReader::seek(total, 1), ESP_ERR_INVALID_ARG);
+    CHECK_EQ(ReportReader::seek(total + 1, 0), ESP_ERR_INVALID_ARG);
+
+    // seek depois de uma leitura parcial recomeca do ponto pedido
+    const char* data;
+    CHECK_EQ(ReportReader::seek(0, total), ESP_OK);
+    CHECK(ReportReader::read(&data) > 0);
+    ReportReader::close();
+    CHECK_EQ(ReportReader::open(FIRST_DAY, FIRST_DAY + DAYS - 1, buffer_a, buffer_b, BUFFER_SIZE),
+             ESP_OK);
+    CHECK_EQ(ReportReader::seek(100, 50), ESP_OK);
+    CHECK(read_all() == std::vector<char>(expected.begin() + 100, expected.begin() + 150));
+    ReportReader::close();
+}
+
+static void test_growing_day_file(const std::vector<char>& expected) {
+    CHECK_EQ(ReportReader::open(FIRST_DAY, FIRST_DAY + DAYS - 1, buffer_a, buffer_b, BUFFER_SIZE),
+             ESP_OK);
+    // gravacao do dia durante o download: o stream fica no tamanho do open()
+    CHECK(report_day_write(FIRST_DAY + DAYS - 1, report_random_bytes(1000), true));
+    CHECK(read_all() == expected);
+    ReportReader::close();
+}
+
+static void test_missing_days() {
+    CHECK_EQ(ReportReader::open(FIRST_DAY - 10, FIRST_DAY - 1, buffer_a, buffer_b, BUFFER_SIZE),
+             ESP_ERR_NOT_FOUND);
+    CHECK_EQ(ReportReader::open(FIRST_DAY + 2, FIRST_DAY + 1, buffer_a, buffer_b, BUFFER_SIZE),
+             ESP_ERR_INVALID_ARG);
+    CHECK_EQ(ReportReader::open(FIRST_DAY, FIRST_DAY + REPORT_DOWNLOAD_MAX_DAYS, buffer_a,
+                                buffer_b, BUFFER_SIZE),
+             ESP_ERR_INVALID_ARG);
+    // o lock foi devolvido nos erros
+    CHECK_EQ(ReportReader::open(FIRST_DAY, FIRST_DAY, buffer_a, buffer_b, BUFFER_SIZE), ESP_OK);
+    ReportReader::close();
+}
+
+int main() {
+    CHECK(fake_sd_card_format());
+    CHECK_EQ(CartaoSD::getInstance()->begin(23, 19, 18, 5), ESP_OK);
+    CHECK_EQ(ReportReader::getInstance()->begin(), ESP_OK);
+
+    // dia 1 sem arquivo, dia 3 com arquivo vazio
+    const size_t sizes[DAYS] = {7001, 0, 4096, 0, 2500};
+    std::vector<char> expected;
+    srand(15);
+    for (int i = 0; i < DAYS; i++) {
+        std::vector<char> data = report_random_bytes(sizes[i]);
+        if (i != 1) {
+            CHECK(report_day_write(FIRST_DAY + i, data));
+        }
+        expected.insert(expected.end(), data.begin(), data.end());
+    }
+
+    test_stream(expected);
+    test_ranges(expected);
+    test_missing_days();
+    test_growing_day_file(expected);
+    return HOST_TEST_RESULT();
+}
@@ -0,0 +1,203 @@
+/**
+ * Recuperacao do ReportFileWriter apos uma queda de energia, nas duas versoes
+ * do formato: bytes depois do ultimo bloco inteiro, ultimo bloco com CRC
+ * invalido, arquivo so com o cabecalho e cabecalho interrompido na criacao.
+ * Depois de reaberto, o arquivo tem os registros que sobreviveram seguidos
+ * dos novos.
+ */
+
+#include <sys/stat.h>
+
+#include "fake_sd_card.h"
+#include "host_test.h"
+#include "report_days.h"
+#include "report_file_writer.h"
+
+using namespace Wetzel;
+
+#define FIRST_DAY 20200
+#define DEVICES 30
+
+static ReportFileWriter writer;
+
+static report_record_t make_record(int32_t unix_day, uint32_t n) {
+    report_record_t record = {
+        .id = (uint8_t)(n % DEVICES),
+        .qtd_luminarias = 3,
+        .modelo_luminarias = 1,
+        .pwm_value = (uint8_t)(n % 5 == 0 ? n : 80),
+        .unix_seconds = (uint32_t)(unix_day * 86400UL + (n / DEVICES) * 60),
+    };
+    return record;
+}
+
+static long file_size(int32_t unix_day) {
+    struct stat st;
+    return stat(report_day_path(unix_day).c_str(), &st) == 0 ? st.st_size : -1;
+}
+
+static std::vector<char> file_bytes(int32_t unix_day) {
+    std::vector<char> data(file_size(unix_day));
+    FILE* f = fopen(report_day_path(unix_day).c_str(), "rb");
+    if (f != NULL) {
+        CHECK_EQ(fread(data.data(), 1, data.size(), f), data.size());
+        fclose(f);
+    }
+    return data;
+}
+
+static void corrupt_byte(int32_t unix_day, long offset) {
+    FILE* f = fopen(report_day_path(unix_day).c_str(), "r+b");
+    CHECK(f != NULL);
+    fseek(f, offset, SEEK_SET);
+    int c = fgetc(f);
+    fseek(f, offset, SEEK_SET);
+    fputc(c ^ 0x5A, f);
+    fclose(f);
+}
+
+/**
+ * @brief Acrescenta registros pelo writer, continuando a numeracao de expected.
+ *
+ */
+static void append_records(int32_t unix_day, std::vector<report_record_t>* expected,
+                           uint32_t count) {
+    CHECK_EQ(writer.open(report_day_name(unix_day).c_str(), unix_day), ESP_OK);
+    for (uint32_t i = 0; i < count; i++) {
+        report_record_t record = make_record(unix_day, expected->size());
+        CHECK_EQ(writer.append(record), ESP_OK);
+        expected->push_back(record);
+    }
+    CHECK_EQ(writer.close(), ESP_OK);
+}
+
+static void check_records(int32_t unix_day, const std::vector<report_record_t>& expected) {
+    std::vector<report_record_t> records = report_day_records(unix_day);
+    CHECK_EQ(records.size(), expected.size());
+    for (size_t i = 0; i < records.size() && i < expected.size(); i++) {
+        CHECK(report_record_equal(records[i], expected[i]));
+    }
+}
+
+/**
+ * @brief Arquivo v1 (sem indice) montado direto com o report_format.h, como o
+ * gravado por um firmware anterior a v2. O ultimo bloco fica incompleto.
+ *
+ */
+static std::vector<report_record_t> write_plain_day(int32_t unix_day, uint32_t count) {
+    std::vector<report_record_t> records;
+    std::vector<char> data(REPORT_FORMAT_HEADER_SIZE);
+    uint8_t block[REPORT_FORMAT_BLOCK_SIZE];
+
+    report_file_header_encode((uint8_t*)data.data(), REPORT_FORMAT_VERSION_PLAIN, unix_day, 0);
+    for (uint32_t first = 0; first < count; first += REPORT_FORMAT_RECORDS_PER_BLOCK) {
+        uint8_t n = 0;
+        memset(block, 0, sizeof(block));
+        for (; n < REPORT_FORMAT_RECORDS_PER_BLOCK && first + n < count; n++) {
+            records.push_back(make_record(unix_day, first + n));
+            report_record_encode(report_block_record(block, n), records.back());
+        }
+        report_block_seal(block, n);
+        data.insert(data.end(), block, block + sizeof(block));
+    }
+    CHECK(report_day_write(unix_day, data));
+    return records;
+}
+
+static void test_unaligned_tail(int32_t unix_day, bool plain) {
+    std::vector<report_record_t> expected;
+    if (plain) {
+        expected = write_plain_day(unix_day, 100);
+    } else {
+        append_records(unix_day, &expected, 300);
+    }
+    long size = file_size(unix_day);
+    CHECK_EQ((size - REPORT_FORMAT_HEADER_SIZE) % REPORT_FORMAT_BLOCK_SIZE, 0);
+
+    // bloco interrompido no meio da escrita
+    CHECK(report_day_write(unix_day, report_random_bytes(200), true));
+    CHECK_EQ(writer.open(report_day_name(unix_day).c_str(), unix_day), ESP_OK);
+    CHECK_EQ(file_size(unix_day), size);
+    CHECK_EQ(writer.close(), ESP_OK);
+
+    append_records(unix_day, &expected, 150);
+    check_records(unix_day, expected);
+}
+
+static void test_bad_last_block(int32_t unix_day, bool plain) {
+    std::vector<report_record_t> expected;
+    if (plain) {
+        expected = write_plain_day(unix_day, 3 * REPORT_FORMAT_RECORDS_PER_BLOCK + 10);
+    } else {
+        append_records(unix_day, &expected, 400);
+    }
+    long size = file_size(unix_day);
+    CHECK(size >= REPORT_FORMAT_HEADER_SIZE + 2 * REPORT_FORMAT_BLOCK_SIZE);
+
+    // ultimo bloco regravado pela metade: CRC invalido, os registros dele se
+    // perdem e os dos blocos anteriores ficam
+    corrupt_byte(unix_day, size - REPORT_FORMAT_BLOCK_SIZE + 9);
+    expected = report_day_records(unix_day);
+    CHECK(expected.size() > 0);
+    CHECK_EQ(writer.open(report_day_name(unix_day).c_str(), unix_day), ESP_OK);
+    CHECK_EQ(file_size(unix_day), size - REPORT_FORMAT_BLOCK_SIZE);
+    CHECK_EQ(writer.close(), ESP_OK);
+
+    append_records(unix_day, &expected, 200);
+    check_records(unix_day, expected);
+}
+
+static void test_header_only(int32_t unix_day) {
+    std::vector<report_record_t> expected;
+    append_records(unix_day, &expected, 0);
+    CHECK_EQ(file_size(unix_day), REPORT_FORMAT_HEADER_SIZE);
+
+    append_records(unix_day, &expected, 50);
+    CHECK_EQ(file_size(unix_day), REPORT_FORMAT_HEADER_SIZE + REPORT_FORMAT_BLOCK_SIZE);
+    check_records(unix_day, expected);
+}
+
+static void test_interrupted_header(int32_t unix_day) {
+    std::vector<report_record_t> expected;
+
+    // cabecalho interrompido na criacao: o arquivo e recriado
+    std::vector<char> partial(REPORT_FORMAT_HEADER_SIZE);
+    report_file_header_encode((uint8_t*)partial.data(), REPORT_FORMAT_VERSION, unix_day,
+                              REPORT_FORMAT_FLAG_TIME_INDEX);
+    partial.resize(100);
+    CHECK(report_day_write(unix_day, partial));
+    append_records(unix_day, &expected, 80);
+    check_records(unix_day, expected);
+
+    // maior que o cabecalho e sem cabecalho valido: nao e um arquivo deste
+    // formato, fica como esta
+    std::vector<char> foreign = report_random_bytes(REPORT_FORMAT_HEADER_SIZE + 300);
+    CHECK(report_day_write(unix_day + 1, foreign));
+    CHECK_EQ(writer.open(report_day_name(unix_day + 1).c_str(), unix_day + 1),
+             ESP_ERR_INVALID_VERSION);
+    CHECK(!writer.isOpen());
+    CHECK(file_bytes(unix_day + 1) == foreign);
+
+    // o mesmo com um cabecalho valido corrompido
+    std::vector<char> data = file_bytes(unix_day);
+    data[REPORT_FORMAT_HEADER_CRC_OFFSET] ^= 0x01;
+    CHECK(report_day_write(unix_day, data));
+    CHECK_EQ(writer.open(report_day_name(unix_day).c_str(), unix_day), ESP_ERR_INVALID_VERSION);
+    CHECK(file_bytes(unix_day) == data);
+}
+
+int main() {
+    CHECK(fake_sd_card_format());
+    CHECK_EQ(CartaoSD::getInstance()->begin(23, 19, 18, 5), ESP_OK);
+    CHECK_EQ(ReportReader::getInstance()->begin(), ESP_OK);
+    CHECK_EQ(writer.begin(CartaoSD::getInstance()), ESP_OK);
+    srand(22);
+
+    test_unaligned_tail(FIRST_DAY, false);
+    test_unaligned_tail(FIRST_DAY + 1, true);
+    test_bad_last_block(FIRST_DAY + 2, false);
+    test_bad_last_block(FIRST_DAY + 3, true);
+    test_header_only(FIRST_DAY + 4);
+    test_interrupted_header(FIRST_DAY + 5);
+    return HOST_TEST_RESULT();
+}
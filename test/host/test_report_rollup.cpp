@@ -0,0 +1,273 @@
+/**
+ * Rollups por hora, dia e mes ao longo de tres dias que atravessam o fim do
+ * mes, com a task de escrita chamando add()/hourDue()/closeHour() a cada
+ * minuto como o ReportHandler. No caminho: um reinicio no meio da hora depois
+ * de gravar a parte anterior (duas linhas do mesmo periodo), o equipamento
+ * desligado na virada do dia e do mes (fechados no begin()) e linhas rasgadas
+ * no fim dos arquivos, que nao podem esconder as anteriores nem duplicar o
+ * fechamento de um dia.
+ */
+
+#include <sys/stat.h>
+
+#include <map>
+#include <utility>
+
+#include "fake_sd_card.h"
+#include "host_test.h"
+#include "report_days.h"
+#include "report_rollup_writer.h"
+
+using namespace Wetzel;
+
+#define DEVICES 12
+#define MINUTE 60
+
+typedef std::pair<uint32_t, uint8_t> rollup_key_t;
+typedef std::map<rollup_key_t, report_rollup_row_t> rollup_sums_t;
+
+static ReportRollupWriter rollup;
+static uint32_t now;
+static uint32_t hour_start;
+// o que esta na hora em RAM e o que ja foi gravado, por periodo e id
+static rollup_sums_t pending;
+static rollup_sums_t hours;
+
+static void sum_into(rollup_sums_t* sums, uint32_t period, uint8_t id, uint16_t samples,
+                     uint32_t covered, uint32_t on, uint32_t pwm_seconds) {
+    report_rollup_row_t& row = (*sums)[rollup_key_t(period, id)];
+    row.period_start = period;
+    row.id = id;
+    row.samples += samples;
+    row.covered_seconds += covered;
+    row.on_seconds += on;
+    row.pwm_seconds += pwm_seconds;
+}
+
+static uint8_t pwm_of(uint8_t id, uint32_t t) {
+    uint32_t hour = t / 3600 % 24;
+    if (id % 4 == 0 || hour < 6 || hour >= 18) {
+        return (uint8_t)(20 + id * 5);
+    }
+    return 0;
+}
+
+static void close_hour() {
+    CHECK_EQ(rollup.closeHour(now), ESP_OK);
+    for (const auto& entry : pending) {
+        const report_rollup_row_t& row = entry.second;
+        sum_into(&hours, hour_start, row.id, row.samples, row.covered_seconds, row.on_seconds,
+                 row.pwm_seconds);
+    }
+    pending.clear();
+    hour_start = now - now % 3600;
+}
+
+/**
+ * @brief Um minuto da task de escrita: soma os registros do ciclo e fecha a
+ * hora se ela terminou.
+ *
+ */
+static void minute() {
+    now += MINUTE;
+    for (uint8_t id = 0; id < DEVICES; id++) {
+        if ((id + now / MINUTE) % 17 == 0) {
+            continue;
+        }
+        uint8_t pwm = pwm_of(id, now);
+        rollup.add(id, pwm, MINUTE);
+        sum_into(&pending, hour_start, id, 1, MINUTE, pwm > 0 ? MINUTE : 0, pwm * MINUTE);
+    }
+    if (rollup.hourDue(now)) {
+        close_hour();
+    }
+}
+
+static void run_until(uint32_t end) {
+    while (now < end) {
+        minute();
+    }
+}
+
+/**
+ * @brief Reinicio: o que estava na hora em RAM se perde.
+ *
+ */
+static void restart(uint32_t at) {
+    now = at;
+    hour_start = now - now % 3600;
+    pending.clear();
+    CHECK_EQ(rollup.begin(CartaoSD::getInstance(), now), ESP_OK);
+}
+
+static std::vector<report_rollup_row_t> read_rows(report_rollup_tier_t tier, int32_t unix_day) {
+    std::vector<report_rollup_row_t> out;
+    report_rollup_row_t rows[32];
+    uint16_t count = 0;
+    esp_err_t err;
+    while ((err = ReportReader::readRollups(tier, unix_day, out.size(), rows, 32, &count)) ==
+               ESP_OK &&
+           count > 0) {
+        out.insert(out.end(), rows, rows + count);
+        if (count < 32) {
+            break;
+        }
+    }
+    CHECK(err == ESP_OK || err == ESP_ERR_NOT_FOUND);
+    return out;
+}
+
+static rollup_sums_t sum_rows(const std::vector<report_rollup_row_t>& rows,
+                              report_rollup_tier_t tier) {
+    rollup_sums_t sums;
+    for (const report_rollup_row_t& row : rows) {
+        CHECK_EQ(row.tier, tier);
+        sum_into(&sums, row.period_start, row.id, row.samples, row.covered_seconds,
+                 row.on_seconds, row.pwm_seconds);
+    }
+    return sums;
+}
+
+/**
+ * @brief Soma as linhas de sums em periodos maiores (dia ou mes).
+ *
+ */
+static rollup_sums_t group(const rollup_sums_t& sums, uint32_t (*period_of)(uint32_t)) {
+    rollup_sums_t out;
+    for (const auto& entry : sums) {
+        const report_rollup_row_t& row = entry.second;
+        sum_into(&out, period_of(row.period_start), row.id, row.samples, row.covered_seconds,
+                 row.on_seconds, row.pwm_seconds);
+    }
+    return out;
+}
+
+static uint32_t day_of(uint32_t t) {
+    return t - t % 86400;
+}
+
+static uint32_t month_of(uint32_t t) {
+    uint16_t year;
+    uint8_t month, day;
+    ReportReader::dateFromUnixDay(t / 86400, &year, &month, &day);
+    return ReportReader::unixDayFromDate(year, month, 1) * 86400UL;
+}
+
+static bool same_sums(const rollup_sums_t& a, const rollup_sums_t& b) {
+    if (a.size() != b.size()) {
+        return false;
+    }
+    for (const auto& entry : a) {
+        auto other = b.find(entry.first);
+        if (other == b.end() || other->second.samples != entry.second.samples ||
+            other->second.covered_seconds != entry.second.covered_seconds ||
+            other->second.on_seconds != entry.second.on_seconds ||
+            other->second.pwm_seconds != entry.second.pwm_seconds) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static rollup_sums_t only_between(const rollup_sums_t& sums, uint32_t from, uint32_t to) {
+    rollup_sums_t out;
+    for (const auto& entry : sums) {
+        if (entry.first.first >= from && entry.first.first < to) {
+            out.insert(entry);
+        }
+    }
+    return out;
+}
+
+static std::string rollup_path(report_rollup_tier_t tier, int32_t unix_day) {
+    char name[20];
+    ReportHandler::createRollupFileName(name, tier, unix_day);
+    return std::string(MOUNT_POINT) + name;
+}
+
+static void append_bytes(const std::string& path, const std::vector<char>& data) {
+    FILE* f = fopen(path.c_str(), "ab");
+    CHECK(f != NULL);
+    CHECK_EQ(fwrite(data.data(), 1, data.size(), f), data.size());
+    fclose(f);
+}
+
+static long size_of(const std::string& path) {
+    struct stat st;
+    return stat(path.c_str(), &st) == 0 ? st.st_size : -1;
+}
+
+int main() {
+    CHECK(fake_sd_card_format());
+    CHECK_EQ(CartaoSD::getInstance()->begin(23, 19, 18, 5), ESP_OK);
+    CHECK_EQ(ReportReader::getInstance()->begin(), ESP_OK);
+    srand(25);
+
+    // 30/01, 31/01 e 01/02
+    const int32_t jan_30 = ReportReader::unixDayFromDate(2025, 1, 30);
+    const int32_t jan_31 = jan_30 + 1;
+    const int32_t feb_1 = jan_30 + 2;
+    const uint32_t jan_30_start = jan_30 * 86400UL;
+    const uint32_t jan_31_start = jan_31 * 86400UL;
+    const uint32_t feb_1_start = feb_1 * 86400UL;
+
+    restart(jan_30_start + 8 * 3600 + 7 * MINUTE);
+    run_until(jan_31_start + 14 * 3600 + 20 * MINUTE);
+
+    // reinicio no meio da hora: a parte anterior ja gravada e a seguinte
+    // ficam em duas linhas do mesmo periodo
+    close_hour();
+    restart(now + 5 * MINUTE);
+    const uint32_t split_hour = jan_31_start + 14 * 3600;
+    run_until(jan_31_start + 16 * 3600 + 30 * MINUTE);
+    uint16_t split_rows = 0;
+    for (const report_rollup_row_t& row : read_rows(REPORT_ROLLUP_HOUR, jan_31)) {
+        split_rows += row.period_start == split_hour && row.id == 1;
+    }
+    CHECK_EQ(split_rows, 2);
+    // o begin() do reinicio nao fechou o 30/01 de novo
+    CHECK_EQ(read_rows(REPORT_ROLLUP_DAY, jan_30).size(), DEVICES);
+
+    // linha rasgada no fim do arquivo de horas: sobrescrita pela proxima hora
+    const std::string hour_path = rollup_path(REPORT_ROLLUP_HOUR, jan_31);
+    append_bytes(hour_path, report_random_bytes(REPORT_ROLLUP_ROW_SIZE / 2));
+    run_until(jan_31_start + 23 * 3600 + 30 * MINUTE);
+    CHECK_EQ(size_of(hour_path) % REPORT_ROLLUP_ROW_SIZE, 0);
+
+    // desligado na virada do dia e do mes: a hora 23 se perde e o begin()
+    // fecha o 31/01 e janeiro
+    CHECK_EQ(read_rows(REPORT_ROLLUP_MONTH, jan_31).size(), 0);
+    restart(feb_1_start + 30 * MINUTE + 13);
+    rollup_sums_t jan_days = group(only_between(hours, jan_30_start, feb_1_start), day_of);
+    CHECK(same_sums(sum_rows(read_rows(REPORT_ROLLUP_DAY, jan_31), REPORT_ROLLUP_DAY), jan_days));
+    rollup_sums_t january = group(jan_days, month_of);
+    CHECK_EQ(january.size(), DEVICES);
+    CHECK(same_sums(sum_rows(read_rows(REPORT_ROLLUP_MONTH, jan_31), REPORT_ROLLUP_MONTH),
+                    january));
+
+    // linha rasgada (inteira e pela metade) no fim dos arquivos de dia e de
+    // mes: o proximo begin() acha o 31/01 e janeiro atras delas
+    const std::string day_path = rollup_path(REPORT_ROLLUP_DAY, jan_31);
+    const std::string month_path = rollup_path(REPORT_ROLLUP_MONTH, jan_31);
+    append_bytes(day_path, report_random_bytes(REPORT_ROLLUP_ROW_SIZE + 7));
+    append_bytes(month_path, report_random_bytes(REPORT_ROLLUP_ROW_SIZE));
+    long day_size = size_of(day_path);
+    long month_size = size_of(month_path);
+    restart(now + 20 * MINUTE);
+    CHECK_EQ(size_of(day_path), day_size);
+    CHECK_EQ(size_of(month_path), month_size);
+    CHECK(same_sums(sum_rows(read_rows(REPORT_ROLLUP_DAY, jan_31), REPORT_ROLLUP_DAY), jan_days));
+    CHECK(same_sums(sum_rows(read_rows(REPORT_ROLLUP_MONTH, jan_31), REPORT_ROLLUP_MONTH),
+                    january));
+
+    // o 01/02 segue nos arquivos de fevereiro
+    run_until(feb_1_start + 12 * 3600 + 10 * MINUTE);
+    CHECK(same_sums(sum_rows(read_rows(REPORT_ROLLUP_HOUR, feb_1), REPORT_ROLLUP_HOUR),
+                    only_between(hours, feb_1_start, feb_1_start + 86400)));
+    CHECK_EQ(read_rows(REPORT_ROLLUP_DAY, feb_1).size(), 0);
+    for (int32_t day : {jan_30, jan_31}) {
+        CHECK(same_sums(sum_rows(read_rows(REPORT_ROLLUP_HOUR, day), REPORT_ROLLUP_HOUR),
+                        only_between(hours, day * 86400UL, (day + 1) * 86400UL)));
+    }
+    return HOST_TEST_RESULT();
+}
@@ -0,0 +1,244 @@
+/**
+ * Arquivo do dia na v2 (report_block_codec.h) atravessando varios segmentos:
+ * o arquivo e reaberto varias vezes no meio de um bloco (ReportBlockEncoder::
+ * resume e estado do codec refeito com os blocos anteriores do segmento) e
+ * depois danificado com um bloco invalido no meio do segmento, com e sem o
+ * ultimo bloco tambem invalido. O ReportReader tem que devolver todos os
+ * registros que sobraram, a partir de qualquer registro.
+ */
+
+#include <sys/stat.h>
+
+#include "fake_sd_card.h"
+#include "host_test.h"
+#include "report_days.h"
+#include "report_file_writer.h"
+
+using namespace Wetzel;
+
+#define DAY 20400
+#define DEVICES 60
+#define READ_MAX 64
+
+static ReportFileWriter writer;
+static uint32_t now = DAY * 86400UL;
+static uint8_t pwm[DEVICES];
+
+// registros por numero no arquivo; lost marca os que nao podem mais ser lidos
+static std::vector<report_record_t> expected;
+static std::vector<bool> lost;
+
+/**
+ * @brief Um flush: a maior parte dos dispositivos repete passo e pwm (RUN),
+ * alguns variam o horario (SMALL/FULL) ou o pwm, alguns faltam e os ids
+ * a partir de 40 so aparecem no meio do arquivo (NEW no meio do segmento).
+ *
+ */
+static void flush(uint32_t count) {
+    for (uint8_t id = 0; id < DEVICES && count > 0; id++, count--) {
+        if ((id >= 40 && expected.size() < 4000) || rand() % 20 == 0) {
+            continue;
+        }
+        if (rand() % 10 == 0) {
+            pwm[id] = rand() % 101;
+        }
+        uint32_t jitter = rand() % 8 == 0 ? rand() % 40 : 0;
+        if (rand() % 200 == 0) {
+            jitter = 100000;
+        }
+        report_record_t record = {
+            .id = id,
+            .qtd_luminarias = (uint8_t)(1 + id % 4),
+            .modelo_luminarias = (uint8_t)(id % 3),
+            .pwm_value = pwm[id],
+            .unix_seconds = now + id + jitter,
+        };
+        CHECK_EQ(writer.append(record), ESP_OK);
+        expected.push_back(record);
+        lost.push_back(false);
+    }
+    now += 60;
+}
+
+static void append_session(uint32_t flushes, uint32_t last_flush_devices) {
+    CHECK_EQ(writer.open(report_day_name(DAY).c_str(), DAY), ESP_OK);
+    for (uint32_t i = 0; i < flushes; i++) {
+        flush(DEVICES);
+    }
+    flush(last_flush_devices);
+    CHECK_EQ(writer.close(), ESP_OK);
+}
+
+static uint32_t blocks() {
+    struct stat st;
+    if (stat(report_day_path(DAY).c_str(), &st) != 0) {
+        return 0;
+    }
+    return (st.st_size - REPORT_FORMAT_HEADER_SIZE) / REPORT_FORMAT_BLOCK_SIZE;
+}
+
+static void read_block(uint32_t block, uint8_t* data) {
+    FILE* f = fopen(report_day_path(DAY).c_str(), "rb");
+    CHECK(f != NULL);
+    fseek(f, report_block_offset(block), SEEK_SET);
+    CHECK_EQ(fread(data, 1, REPORT_FORMAT_BLOCK_SIZE, f), REPORT_FORMAT_BLOCK_SIZE);
+    fclose(f);
+}
+
+static uint32_t block_first_record(uint32_t block) {
+    uint8_t data[REPORT_FORMAT_BLOCK_SIZE];
+    read_block(block, data);
+    CHECK(report_v2_block_count(data) > 0);
+    return report_v2_block_first_record(data);
+}
+
+static void corrupt_block(uint32_t block) {
+    FILE* f = fopen(report_day_path(DAY).c_str(), "r+b");
+    CHECK(f != NULL);
+    fseek(f, report_block_offset(block) + REPORT_V2_BLOCK_HEADER_SIZE, SEEK_SET);
+    int c = fgetc(f);
+    fseek(f, report_block_offset(block) + REPORT_V2_BLOCK_HEADER_SIZE, SEEK_SET);
+    fputc(c ^ 0xFF, f);
+    fclose(f);
+}
+
+static void mark_lost(uint32_t from, uint32_t to) {
+    for (uint32_t k = from; k < to; k++) {
+        lost[k] = true;
+    }
+}
+
+/**
+ * @brief readRecords() a partir de cada registro (e de registros perdidos):
+ * devolve os registros que sobraram a partir dele, ate o fim ou ate o
+ * proximo trecho perdido.
+ *
+ */
+static void check_reads(uint32_t stride) {
+    report_record_t records[READ_MAX];
+    uint16_t count = 0;
+
+    for (uint32_t first = 0; first <= expected.size(); first += stride) {
+        CHECK_EQ(ReportReader::readRecords(DAY, first, records, READ_MAX, &count), ESP_OK);
+        uint32_t k = first;
+        while (k < expected.size() && lost[k]) {
+            k++;
+        }
+        uint16_t want = 0;
+        for (; want < READ_MAX && k + want < expected.size() && !lost[k + want]; want++) {
+        }
+        CHECK_EQ(count, want);
+        for (uint16_t i = 0; i < count && i < want; i++) {
+            if (!report_record_equal(records[i], expected[k + i])) {
+                fprintf(stderr, "readRecords(%u): registro %u diferente\n", first, k + i);
+                host_test_failures++;
+                break;
+            }
+        }
+    }
+}
+
+/**
+ * @brief Primeiro bloco do segmento do bloco: o anterior com a flag, que fora
+ * do alinhamento aparece depois de um bloco invalido.
+ *
+ */
+static uint32_t segment_of(uint32_t block) {
+    uint8_t data[REPORT_FORMAT_BLOCK_SIZE];
+    for (;; block--) {
+        read_block(block, data);
+        if (report_v2_block_count(data) > 0 && report_v2_block_segment_start(data)) {
+            return block;
+        }
+    }
+}
+
+/**
+ * @brief Os segmentos so comecam no alinhamento ou no bloco from.
+ *
+ */
+static void check_segment_flags(uint32_t from) {
+    uint8_t data[REPORT_FORMAT_BLOCK_SIZE];
+    for (uint32_t block = from; block < blocks(); block++) {
+        read_block(block, data);
+        CHECK(report_v2_block_count(data) > 0);
+        CHECK_EQ(report_v2_block_segment_start(data),
+                 block == from || block % REPORT_V2_SEGMENT_BLOCKS == 0);
+    }
+}
+
+/**
+ * @brief Danifica um bloco no meio do segmento do ultimo (e o ultimo, se
+ * last_too) e reabre o arquivo.
+ *
+ * @return uint32_t Bloco em que a escrita abriu um segmento
+ */
+static uint32_t damage_and_reopen(bool last_too) {
+    uint8_t data[REPORT_FORMAT_BLOCK_SIZE];
+
+    // sessoes curtas ate o ultimo bloco ter pelo menos 4 antes dele no segmento
+    while (blocks() - 1 - segment_of(blocks() - 1) < 4) {
+        append_session(3, rand() % DEVICES);
+    }
+    uint32_t last = blocks() - 1;
+    uint32_t bad = last - 2;
+    read_block(last, data);
+    uint32_t last_first = report_v2_block_first_record(data);
+    uint32_t end = last_first + report_v2_block_count(data);
+    CHECK_EQ(end, expected.size());
+    uint32_t bad_first = block_first_record(bad);
+
+    corrupt_block(bad);
+    if (last_too) {
+        // o ultimo e truncado e os registros dele renumerados pelos novos
+        corrupt_block(last);
+        mark_lost(bad_first, last_first);
+        expected.resize(last_first);
+        lost.resize(last_first);
+    } else {
+        // o ultimo fica como esta, mas o resto do segmento nao decodifica
+        mark_lost(bad_first, end);
+    }
+    append_session(20, 7);
+
+    uint32_t segment = last_too ? last : last + 1;
+    read_block(segment, data);
+    CHECK(report_v2_block_segment_start(data));
+    CHECK_EQ(report_v2_block_first_record(data), last_too ? last_first : end);
+    return segment;
+}
+
+int main() {
+    CHECK(fake_sd_card_format());
+    CHECK_EQ(CartaoSD::getInstance()->begin(23, 19, 18, 5), ESP_OK);
+    CHECK_EQ(ReportReader::getInstance()->begin(), ESP_OK);
+    CHECK_EQ(writer.begin(CartaoSD::getInstance()), ESP_OK);
+    srand(24);
+    memset(pwm, 50, sizeof(pwm));
+
+    // varias sessoes, cada uma terminando no meio de um flush e de um bloco
+    while (blocks() < 3 * REPORT_V2_SEGMENT_BLOCKS + REPORT_V2_SEGMENT_BLOCKS / 2) {
+        append_session(rand() % 40, rand() % DEVICES);
+    }
+    // o codec comprime: bem mais registros por bloco que na v1
+    CHECK(expected.size() > 2 * blocks() * REPORT_FORMAT_RECORDS_PER_BLOCK);
+    check_segment_flags(0);
+    CHECK_EQ(report_day_records(DAY).size(), expected.size());
+    check_reads(13);
+
+    // bloco invalido no meio do segmento, com o ultimo valido
+    uint32_t segment = damage_and_reopen(false);
+    check_reads(11);
+    // reabrir sem dano novo continua o segmento fora do alinhamento
+    append_session(10, 13);
+    append_session(10, 29);
+    check_segment_flags(segment);
+    check_reads(7);
+
+    // bloco invalido no meio do segmento e ultimo bloco invalido
+    segment = damage_and_reopen(true);
+    append_session(30, 11);
+    check_segment_flags(segment);
+    check_reads(5);
+    return HOST_TEST_RESULT();
+}
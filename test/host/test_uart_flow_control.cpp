@@ -0,0 +1,64 @@
+/**
+ * Controle de fluxo por creditos do UartLink: a janela do sensor nunca e
+ * excedida e um credito perdido nao trava o TX.
+ */
+
+#include <string.h>
+
+#include <chrono>
+#include <vector>
+
+#include "configuration.h"
+#include "freertos/task.h"
+#include "host_test.h"
+#include "sensor_credits.h"
+
+using namespace Wetzel;
+
+#define WINDOW 64
+
+static void test_window_is_respected(UartLink* link, SensorCredits* sensor) {
+    std::vector<char> payload(1000);
+    for (size_t i = 0; i < payload.size(); i++) {
+        payload[i] = 'a' + i % 26;
+    }
+    CHECK_EQ(link->write(payload.data(), payload.size()), payload.size());
+    CHECK_EQ(link->waitTxDone(pdMS_TO_TICKS(2000)), ESP_OK);
+    CHECK(sensor->maxOutstanding() <= WINDOW);
+    CHECK_EQ(link->creditTimeouts(), 0);
+    std::vector<uint8_t> received = sensor->takeData();
+    CHECK(received.size() == payload.size() &&
+          memcmp(received.data(), payload.data(), payload.size()) == 0);
+}
+
+static void test_lost_credits_reopen_window(UartLink* link, SensorCredits* sensor) {
+    // os creditos do teste anterior voltam 500 us depois do ultimo byte
+    vTaskDelay(pdMS_TO_TICKS(10));
+    sensor->setReturning(false);
+    char payload[3 * WINDOW];
+    memset(payload, 'z', sizeof(payload));
+    auto start = std::chrono::steady_clock::now();
+    CHECK_EQ(link->write(payload, sizeof(payload)), sizeof(payload));
+    double elapsed_ms = host_elapsed_us(start) / 1000;
+    // a primeira janela sai com os creditos iniciais, as outras duas esperam
+    // UART_LINK_CREDIT_TIMEOUT_MS cada
+    CHECK_EQ(link->creditTimeouts(), 2);
+    CHECK(elapsed_ms >= 2 * UART_LINK_CREDIT_TIMEOUT_MS * 0.9);
+    CHECK(elapsed_ms < 3 * UART_LINK_CREDIT_TIMEOUT_MS);
+    sensor->dropPending();
+    sensor->setReturning(true);
+    link->waitTxDone(pdMS_TO_TICKS(1000));
+    CHECK_EQ(sensor->takeData().size(), sizeof(payload));
+}
+
+int main() {
+    UartLink* link = UartLink::getInstance();
+    CHECK_EQ(link->begin(UART_NUM_2, UART_BAUD_RATE, 17, 16), ESP_OK);
+    SensorCredits* sensor = new SensorCredits(link, UART_NUM_2, std::chrono::microseconds(500));
+    link->enableFlowControl(WINDOW);
+    CHECK(link->flowControlEnabled());
+
+    test_window_is_respected(link, sensor);
+    test_lost_credits_reopen_window(link, sensor);
+    return HOST_TEST_RESULT();
+}
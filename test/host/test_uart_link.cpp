@@ -0,0 +1,156 @@
+/**
+ * UartLink sobre a UART falsa: frames ASCII acordados pela deteccao do ';',
+ * descarte de frames grandes e overflow, modo binario e escrita.
+ */
+
+#include <string.h>
+
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "configuration.h"
+#include "fake_uart.h"
+#include "host_test.h"
+#include "uart_link.h"
+
+using namespace Wetzel;
+
+static UartLink* link;
+static std::mutex tx_mutex;
+static std::vector<uint8_t> tx_bytes;
+
+static void feed(const char* text) {
+    fake_uart_rx_feed(UART_NUM_2, text, strlen(text));
+}
+
+static std::string read_text(int* len, TickType_t timeout = pdMS_TO_TICKS(200)) {
+    uint8_t type = 0xff;
+    uint8_t seq = 0xff;
+    char frame[ASYNC_SRV_MSG_LENGTH + 1];
+    *len = link->readFrame(&type, &seq, frame, sizeof(frame), timeout);
+    if (*len < 0) {
+        return "";
+    }
+    CHECK_EQ(type, LINK_FRAME_TYPE_TEXT);
+    CHECK_EQ(strlen(frame), *len);
+    return frame;
+}
+
+static std::vector<uint8_t> take_tx(size_t expected) {
+    link->waitTxDone(pdMS_TO_TICKS(1000));
+    std::lock_guard<std::mutex> lock(tx_mutex);
+    std::vector<uint8_t> bytes;
+    bytes.swap(tx_bytes);
+    CHECK_EQ(bytes.size(), expected);
+    return bytes;
+}
+
+static void test_ascii_frames() {
+    int len;
+    feed("9031,ok;008,abc;");
+    CHECK(read_text(&len) == "9031,ok");
+    CHECK(read_text(&len) == "008,abc");
+
+    // frame quebrado entre duas leituras do driver
+    feed("009,");
+    feed("OK,1;");
+    CHECK(read_text(&len) == "009,OK,1");
+
+    // sem frame completo: timeout
+    read_text(&len, pdMS_TO_TICKS(20));
+    CHECK_EQ(len, -1);
+    feed(";");
+    CHECK(read_text(&len) == "");
+    CHECK_EQ(len, 0);
+}
+
+static void test_oversized_frame_is_dropped() {
+    int len;
+    std::string big(ASYNC_SRV_MSG_LENGTH + 10, 'x');
+    big += ";depois;";
+    feed(big.c_str());
+    CHECK(read_text(&len) == "depois");
+}
+
+static void test_overflow_recovers() {
+    int len;
+    // sem terminador o RX enche: o driver avisa e o enlace descarta tudo
+    std::string flood(UART_RX_BUFFER + 100, 'y');
+    feed(flood.c_str());
+    read_text(&len, pdMS_TO_TICKS(50));
+    CHECK_EQ(len, -1);
+    feed("recuperado;");
+    CHECK(read_text(&len) == "recuperado");
+}
+
+static void test_ascii_write() {
+    const char* msg = "9052,1,;";
+    CHECK_EQ(link->write(msg, strlen(msg)), strlen(msg));
+    std::vector<uint8_t> bytes = take_tx(strlen(msg));
+    CHECK(memcmp(bytes.data(), msg, bytes.size()) == 0);
+}
+
+static void test_binary_frames() {
+    link->requestMode(UART_LINK_MODE_BINARY);
+    CHECK(link->modeChangePending());
+    link->applyPendingMode();
+    CHECK(link->mode() == UART_LINK_MODE_BINARY);
+
+    // ';' no payload nao termina o frame no modo binario
+    const char* text = "008,a;b;";
+    uint8_t frame[LINK_FRAME_MAX_SIZE];
+    size_t frame_len = link_frame_encode(frame, sizeof(frame), LINK_FRAME_TYPE_TEXT, 7,
+                                         (const uint8_t*)text, strlen(text));
+    uint8_t corrupt[LINK_FRAME_MAX_SIZE];
+    memcpy(corrupt, frame, frame_len);
+    corrupt[LINK_FRAME_HEADER_SIZE + 1] ^= 0x40;
+
+    uint32_t errors = link->frameErrors();
+    fake_uart_rx_feed(UART_NUM_2, corrupt, frame_len);
+    fake_uart_rx_feed(UART_NUM_2, frame, 5);
+    fake_uart_rx_feed(UART_NUM_2, frame + 5, frame_len - 5);
+
+    uint8_t type;
+    uint8_t seq;
+    char out[ASYNC_SRV_MSG_LENGTH + 1];
+    int len = link->readFrame(&type, &seq, out, sizeof(out), pdMS_TO_TICKS(200));
+    // o terminador final do TEXT e removido, o do meio fica
+    CHECK_EQ(len, strlen(text) - 1);
+    CHECK_EQ(type, LINK_FRAME_TYPE_TEXT);
+    CHECK_EQ(seq, 7);
+    CHECK(strcmp(out, "008,a;b") == 0);
+    CHECK_EQ(link->frameErrors(), errors + 1);
+
+    // escrita em modo binario sai dentro de um frame TEXT
+    const char* msg = "9031,;";
+    CHECK_EQ(link->write(msg, strlen(msg), 3), strlen(msg));
+    std::vector<uint8_t> bytes = take_tx(strlen(msg) + LINK_FRAME_OVERHEAD);
+    LinkFrameDecoder decoder;
+    int ready = 0;
+    for (uint8_t byte : bytes) {
+        if (decoder.push(byte) == LinkFrameDecoder::FRAME_READY) {
+            ready++;
+        }
+    }
+    CHECK_EQ(ready, 1);
+    CHECK_EQ(decoder.seq(), 3);
+    CHECK_EQ(decoder.length(), strlen(msg));
+    CHECK(memcmp(decoder.payload(), msg, strlen(msg)) == 0);
+}
+
+int main() {
+    link = UartLink::getInstance();
+    CHECK_EQ(link->begin(UART_NUM_2, UART_BAUD_RATE, 17, 16), ESP_OK);
+    fake_uart_set_tx_sink(UART_NUM_2, [](const uint8_t* data, size_t len) {
+        std::lock_guard<std::mutex> lock(tx_mutex);
+        tx_bytes.insert(tx_bytes.end(), data, data + len);
+    });
+
+    test_ascii_frames();
+    test_oversized_frame_is_dropped();
+    test_overflow_recovers();
+    test_ascii_write();
+    test_binary_frames();
+    return HOST_TEST_RESULT();
+}